@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "linalg.h"
+#include "covariance.h"
+#include "memtrack.h"
+#include "parallel.h"
+#include "trace.h"
+
+// Samples centered and added together (the k of one rank-k update)
+#define BLOCK_SAMPLES 256
+
+// Tiles of the scatter matrix are TILE x TILE entries
+#define TILE 64
+
+// Updates smaller than this many multiply-adds run on one thread
+#define PARALLEL_ENTRIES (1 << 16)
+
+struct covariance {
+    size_t d;
+    uint64_t count;
+    double *mean;
+    double *scatter;        // d x d, row by row; only the upper triangle
+                            //   is kept up to date
+    double *block;          // BLOCK_SAMPLES x d: centered samples
+    double *delta;          // d: the mean of the block, then its
+                            //   difference to mean
+};
+
+struct covariance *covariance_create(size_t dimension) {
+    assert(dimension > 0);
+    size_t d = dimension;
+    size_t bytes = (d * d + (BLOCK_SAMPLES + 2) * d) * sizeof(double);
+    struct covariance *acc = mem_alloc(sizeof(struct covariance));
+    double *entries = acc ? mem_alloc(bytes) : NULL;
+    if (!entries) {
+        mem_free(acc, sizeof(struct covariance));
+        return NULL;
+    }
+    memset(entries, 0, bytes);
+    double *scatter = entries + d;
+    double *block = scatter + d * d;
+    *acc = (struct covariance){d, 0, entries, scatter, block, block + BLOCK_SAMPLES * d};
+    return acc;
+}
+
+void destroy_covariance(struct covariance *acc) {
+    assert(acc);
+    size_t d = acc->d;
+    mem_free(acc->mean, (d * d + (BLOCK_SAMPLES + 2) * d) * sizeof(double));
+    mem_free(acc, sizeof(struct covariance));
+}
+
+size_t covariance_dimension(const struct covariance *acc) {
+    assert(acc);
+    return acc->d;
+}
+
+uint64_t covariance_count(const struct covariance *acc) {
+    assert(acc);
+    return acc->count;
+}
+
+struct rank_update {
+    struct covariance *acc;
+    size_t samples;
+    size_t tiles;           // tiles per row of the scatter matrix
+};
+
+// tile_pair(tiles, pair, ti, tj) sets ti <= tj to the tile row and column
+//   of the pair-th tile of the upper triangle
+static void tile_pair(size_t tiles, size_t pair, size_t *ti, size_t *tj) {
+    size_t i = 0;
+    while (pair >= tiles - i) {
+        pair -= tiles - i;
+        ++i;
+    }
+    *ti = i;
+    *tj = i + pair;
+}
+
+// update_tiles adds Y^T Y to the upper triangle of the tiles, where Y is
+//   the block of centered samples
+static void update_tiles(int begin, int end, void *ctx) {
+    const struct rank_update *up = ctx;
+    size_t d = up->acc->d;
+    const double *y = up->acc->block;
+    for (int pair = begin; pair < end; ++pair) {
+        size_t ti, tj;
+        tile_pair(up->tiles, pair, &ti, &tj);
+        size_t row_end = (ti + 1) * TILE < d ? (ti + 1) * TILE : d;
+        size_t col_end = (tj + 1) * TILE < d ? (tj + 1) * TILE : d;
+        for (size_t i = ti * TILE; i < row_end; ++i) {
+            size_t col_begin = ti == tj ? i : tj * TILE;
+            double *out = up->acc->scatter + i * d;
+            // four samples at a time, so each entry is loaded and
+            //   stored once per four multiply-adds
+            size_t s = 0;
+            for (; s + 4 <= up->samples; s += 4) {
+                const double *y0 = y + s * d;
+                const double *y1 = y0 + d;
+                const double *y2 = y1 + d;
+                const double *y3 = y2 + d;
+                double a0 = y0[i], a1 = y1[i], a2 = y2[i], a3 = y3[i];
+                for (size_t j = col_begin; j < col_end; ++j) {
+                    out[j] += a0 * y0[j] + a1 * y1[j] + a2 * y2[j] + a3 * y3[j];
+                }
+            }
+            for (; s < up->samples; ++s) {
+                double yi = y[s * d + i];
+                const double *ys = y + s * d;
+                for (size_t j = col_begin; j < col_end; ++j) {
+                    out[j] += yi * ys[j];
+                }
+            }
+        }
+    }
+}
+
+// add_block(acc, samples, count) adds count <= BLOCK_SAMPLES samples
+static void add_block(struct covariance *acc, const float *samples, size_t count) {
+    size_t d = acc->d;
+    double *y = acc->block;
+    double *delta = acc->delta;
+    for (size_t j = 0; j < d; ++j) {
+        double sum = 0;
+        for (size_t s = 0; s < count; ++s) {
+            sum += samples[s * d + j];
+        }
+        delta[j] = sum / count;
+    }
+    for (size_t s = 0; s < count; ++s) {
+        for (size_t j = 0; j < d; ++j) {
+            y[s * d + j] = samples[s * d + j] - delta[j];
+        }
+    }
+    size_t tiles = (d + TILE - 1) / TILE;
+    struct rank_update up = {acc, count, tiles};
+    size_t grain = PARALLEL_ENTRIES / (count * TILE * TILE) + 1;
+    parallel_for(tiles * (tiles + 1) / 2, grain, update_tiles, &up);
+
+    // combine with the earlier samples: with n = n_a + n_b and
+    //   delta = mean_b - mean_a, the scatter gains
+    //   delta delta^T n_a n_b / n and the mean moves by delta n_b / n
+    double before = acc->count;
+    acc->count += count;
+    double weight = before * count / acc->count;
+    for (size_t j = 0; j < d; ++j) {
+        delta[j] -= acc->mean[j];
+    }
+    for (size_t i = 0; before && i < d; ++i) {
+        double *out = acc->scatter + i * d;
+        double di = delta[i] * weight;
+        for (size_t j = i; j < d; ++j) {
+            out[j] += di * delta[j];
+        }
+    }
+    for (size_t j = 0; j < d; ++j) {
+        acc->mean[j] += delta[j] * count / acc->count;
+    }
+}
+
+void covariance_add(struct covariance *acc, const float *samples, size_t count) {
+    assert(acc);
+    assert(samples || !count);
+    TRACE_BEGIN("covariance_add", count, acc->d);
+    for (size_t s = 0; s < count; s += BLOCK_SAMPLES) {
+        size_t block = count - s < BLOCK_SAMPLES ? count - s : BLOCK_SAMPLES;
+        add_block(acc, samples + s * acc->d, block);
+    }
+    TRACE_END();
+}
+
+bool covariance_add_matrix(struct covariance *acc, const struct matrix *mat) {
+    assert(acc);
+    assert(mat);
+    size_t d = acc->d;
+    size_t rows = matrix_rows(mat);
+    if (matrix_columns(mat) != d) {
+        fprintf(stderr, "Error: samples must have %zu entries\n", d);
+        return false;
+    }
+    float *samples = mem_alloc(BLOCK_SAMPLES * d * sizeof(float));
+    if (!samples) {
+        return false;
+    }
+    for (size_t s = 0; s < rows; s += BLOCK_SAMPLES) {
+        size_t block = rows - s < BLOCK_SAMPLES ? rows - s : BLOCK_SAMPLES;
+        for (size_t i = 0; i < block; ++i) {
+            for (size_t j = 0; j < d; ++j) {
+                samples[i * d + j] = matrix_get(mat, s + i, j);
+            }
+        }
+        covariance_add(acc, samples, block);
+    }
+    mem_free(samples, BLOCK_SAMPLES * d * sizeof(float));
+    return true;
+}
+
+bool covariance_merge(struct covariance *acc, const struct covariance *other) {
+    assert(acc);
+    assert(other);
+    size_t d = acc->d;
+    if (other->d != d) {
+        fprintf(stderr, "Error: accumulators must have the same dimension\n");
+        return false;
+    }
+    if (!other->count) {
+        return true;
+    }
+    // as in add_block, with the samples of other as the block
+    double before = acc->count;
+    acc->count += other->count;
+    double weight = before * other->count / acc->count;
+    for (size_t j = 0; j < d; ++j) {
+        acc->delta[j] = other->mean[j] - acc->mean[j];
+    }
+    for (size_t i = 0; i < d; ++i) {
+        double *out = acc->scatter + i * d;
+        const double *in = other->scatter + i * d;
+        double di = acc->delta[i] * weight;
+        for (size_t j = i; j < d; ++j) {
+            out[j] += in[j] + di * acc->delta[j];
+        }
+    }
+    for (size_t j = 0; j < d; ++j) {
+        acc->mean[j] += acc->delta[j] * other->count / acc->count;
+    }
+    return true;
+}
+
+void covariance_mean(const struct covariance *acc, float *mean) {
+    assert(acc);
+    assert(mean);
+    for (size_t j = 0; j < acc->d; ++j) {
+        mean[j] = acc->mean[j];
+    }
+}
+
+struct matrix *covariance_matrix(const struct covariance *acc, enum covariance_kind kind) {
+    assert(acc);
+    size_t d = acc->d;
+    if (acc->count < (kind == COVARIANCE_SAMPLE ? 2 : 1)) {
+        fprintf(stderr, "Error: not enough samples\n");
+        return NULL;
+    }
+    float *entries = mem_alloc(d * d * sizeof(float));
+    if (!entries) {
+        return NULL;
+    }
+    double scale = kind == COVARIANCE_SAMPLE ? 1.0 / (acc->count - 1)
+                 : kind == COVARIANCE_POPULATION ? 1.0 / acc->count : 1;
+    for (size_t i = 0; i < d; ++i) {
+        for (size_t j = i; j < d; ++j) {
+            double value = acc->scatter[i * d + j] * scale;
+            if (kind == COVARIANCE_GRAM) {
+                value += (double)acc->count * acc->mean[i] * acc->mean[j];
+            }
+            entries[i * d + j] = value;
+            entries[j * d + i] = value;
+        }
+    }
+    struct matrix *mat = create_matrix(d, d, entries);
+    mem_free(entries, d * d * sizeof(float));
+    return mat;
+}
@@ -0,0 +1,90 @@
+// Gram and covariance matrices of a stream of samples.
+//   An accumulator takes the samples (rows of d entries) in batches of
+//   any size and keeps only their count, their mean and the scatter
+//   matrix sum (x - mean)(x - mean)^T, all in double, so its memory is
+//   O(d^2) however long the stream is. Each batch is centered on its
+//   own mean and combined with what came before by the pairwise update
+//   of Chan, Golub and LeVeque, which does not lose precision when the
+//   mean is large compared to the spread, as summing x x^T would.
+//   The scatter matrix is symmetric, so only its upper triangle is
+//   updated: a rank-k update over tiles that are spread across threads
+//   (see parallel.h).
+//   Accumulators for parts of a stream (say one per thread or per file)
+//   can be filled independently and merged afterwards; different
+//   accumulators may be used by different threads at the same time.
+// time: d is the dimension of the samples, k is # of samples in a batch
+// see linalg.h
+#include <stdint.h>
+
+struct covariance;
+
+enum covariance_kind {
+    COVARIANCE_GRAM,        // sum x x^T (the Gram matrix X^T X)
+    COVARIANCE_POPULATION,  // the scatter matrix divided by N
+    COVARIANCE_SAMPLE       // the scatter matrix divided by N - 1
+};
+
+// covariance_create(dimension) returns an accumulator of samples of
+//   dimension entries that has no samples yet
+// requires: dimension > 0
+// notes: outputs an error message and returns NULL if out of memory
+// effects: may allocate memory (client must call destroy_covariance)
+//          may produce output
+// time: O(d^2)
+struct covariance *covariance_create(size_t dimension);
+
+// destroy_covariance(acc) frees all memory for acc
+// requires: acc is a valid pointer
+// effects: acc is no longer valid
+// time: O(1)
+void destroy_covariance(struct covariance *acc);
+
+// covariance_dimension(acc) returns d, covariance_count(acc) the number
+//   N of samples added so far
+// requires: acc is a valid pointer
+// time: O(1)
+size_t covariance_dimension(const struct covariance *acc);
+uint64_t covariance_count(const struct covariance *acc);
+
+// covariance_add(acc, samples, count) adds the count samples in samples
+//   (count x d, row by row) to acc
+// requires: acc is a valid pointer
+//           samples is a valid pointer to count x d floats
+// effects: modifies acc
+// time: O(kd^2)
+void covariance_add(struct covariance *acc, const float *samples, size_t count);
+
+// covariance_add_matrix(acc, mat) adds the rows of mat to acc
+// requires: acc and mat are valid pointers
+// notes: outputs an error message and returns false if mat does not
+//   have d columns
+// effects: modifies acc
+//          may produce output
+// time: O(kd^2), k is # of rows of mat
+bool covariance_add_matrix(struct covariance *acc, const struct matrix *mat);
+
+// covariance_merge(acc, other) adds the samples of other to acc, as if
+//   they had been added to acc directly
+// requires: acc and other are valid pointers
+// notes: outputs an error message and returns false if other does not
+//   have dimension d
+// effects: modifies acc
+//          may produce output
+// time: O(d^2)
+bool covariance_merge(struct covariance *acc, const struct covariance *other);
+
+// covariance_mean(acc, mean) stores the mean of the samples (d floats)
+//   in mean
+// requires: acc and mean are valid pointers
+// time: O(d)
+void covariance_mean(const struct covariance *acc, float *mean);
+
+// covariance_matrix(acc, kind) returns the symmetric d x d matrix kind
+//   describes
+// requires: acc is a valid pointer
+// notes: outputs an error message and returns NULL if acc has too few
+//   samples (none, or one for COVARIANCE_SAMPLE)
+// effects: may allocate memory (client must call destroy_matrix)
+//          may produce output
+// time: O(d^2)
+struct matrix *covariance_matrix(const struct covariance *acc, enum covariance_kind kind);
@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <float.h>
+#include <math.h>
+#include "linalg.h"
+#include "dense.h"
+#include "memtrack.h"
+#include "trace.h"
+
+// Refinement steps before dense_solve_refined gives up
+#define REFINE_STEPS 30
+
+// DENSE_DEFINE(T, ABS, EPSILON) defines the functions DENSE_DECLARE(T)
+//   declares; ABS is the absolute value and EPSILON the machine epsilon
+//   of T. The elimination updates whole rows (a[j] -= l * a[k] for
+//   contiguous j), which the compiler vectorizes.
+#define DENSE_DEFINE(T, ABS, EPSILON) \
+    bool dense_lu_##T(size_t n, T *a, size_t *pivots) { \
+        assert(a); \
+        assert(pivots); \
+        T largest = 0; \
+        for (size_t i = 0; i < n * n; ++i) { \
+            largest = ABS(a[i]) > largest ? ABS(a[i]) : largest; \
+        } \
+        /* as pivot_tolerance, in the precision of T */ \
+        T tolerance = n * EPSILON * largest; \
+        for (size_t k = 0; k < n; ++k) { \
+            size_t best = k; \
+            for (size_t i = k + 1; i < n; ++i) { \
+                if (ABS(a[i * n + k]) > ABS(a[best * n + k])) { \
+                    best = i; \
+                } \
+            } \
+            if (!(ABS(a[best * n + k]) > tolerance)) { \
+                return false; \
+            } \
+            pivots[k] = best; \
+            if (best != k) { \
+                for (size_t j = 0; j < n; ++j) { \
+                    T temp = a[k * n + j]; \
+                    a[k * n + j] = a[best * n + j]; \
+                    a[best * n + j] = temp; \
+                } \
+            } \
+            const T *pivot_row = a + k * n; \
+            for (size_t i = k + 1; i < n; ++i) { \
+                T *row = a + i * n; \
+                T l = row[k] / pivot_row[k]; \
+                row[k] = l; \
+                for (size_t j = k + 1; j < n; ++j) { \
+                    row[j] -= l * pivot_row[j]; \
+                } \
+            } \
+        } \
+        return true; \
+    } \
+    void dense_lu_solve_##T(size_t n, const T *lu, const size_t *pivots, T *b) { \
+        assert(lu); \
+        assert(pivots); \
+        assert(b); \
+        for (size_t k = 0; k < n; ++k) { \
+            T temp = b[k]; \
+            b[k] = b[pivots[k]]; \
+            b[pivots[k]] = temp; \
+        } \
+        for (size_t i = 0; i < n; ++i) { \
+            T sum = b[i]; \
+            for (size_t j = 0; j < i; ++j) { \
+                sum -= lu[i * n + j] * b[j]; \
+            } \
+            b[i] = sum; \
+        } \
+        for (size_t i = n; i-- > 0;) { \
+            T sum = b[i]; \
+            for (size_t j = i + 1; j < n; ++j) { \
+                sum -= lu[i * n + j] * b[j]; \
+            } \
+            b[i] = sum / lu[i * n + i]; \
+        } \
+    } \
+    void dense_residual_##T(size_t n, const T *a, const T *x, const T *b, T *r) { \
+        assert(a); \
+        assert(x); \
+        assert(b); \
+        assert(r); \
+        for (size_t i = 0; i < n; ++i) { \
+            T sum = b[i]; \
+            for (size_t j = 0; j < n; ++j) { \
+                sum -= a[i * n + j] * x[j]; \
+            } \
+            r[i] = sum; \
+        } \
+    } \
+    size_t dense_ref_##T(size_t rows, size_t columns, T *a) { \
+        assert(a); \
+        T largest = 0; \
+        for (size_t i = 0; i < rows * columns; ++i) { \
+            largest = ABS(a[i]) > largest ? ABS(a[i]) : largest; \
+        } \
+        T tolerance = (rows > columns ? rows : columns) * EPSILON * largest; \
+        size_t k = 0; \
+        for (size_t j = 0; j < columns && k < rows; ++j) { \
+            size_t best = k; \
+            for (size_t i = k + 1; i < rows; ++i) { \
+                if (ABS(a[i * columns + j]) > ABS(a[best * columns + j])) { \
+                    best = i; \
+                } \
+            } \
+            if (!(ABS(a[best * columns + j]) > tolerance)) { \
+                /* what is left of the column is rounding error */ \
+                for (size_t i = k; i < rows; ++i) { \
+                    a[i * columns + j] = 0; \
+                } \
+                continue; \
+            } \
+            if (best != k) { \
+                for (size_t l = j; l < columns; ++l) { \
+                    T temp = a[k * columns + l]; \
+                    a[k * columns + l] = a[best * columns + l]; \
+                    a[best * columns + l] = temp; \
+                } \
+            } \
+            const T *pivot_row = a + k * columns; \
+            for (size_t i = k + 1; i < rows; ++i) { \
+                T *row = a + i * columns; \
+                T l = row[j] / pivot_row[j]; \
+                row[j] = 0; \
+                for (size_t c = j + 1; c < columns; ++c) { \
+                    row[c] -= l * pivot_row[c]; \
+                } \
+            } \
+            ++k; \
+        } \
+        return k; \
+    }
+
+DENSE_DEFINE(float, fabsf, FLT_EPSILON)
+DENSE_DEFINE(double, fabs, DBL_EPSILON)
+
+// largest(v, n) returns the largest absolute value in v
+static double largest(const double *v, size_t n) {
+    double max = 0;
+    for (size_t i = 0; i < n; ++i) {
+        max = fabs(v[i]) > max ? fabs(v[i]) : max;
+    }
+    return max;
+}
+
+int dense_solve_refined(const struct matrix *mat, const double *b, double *x) {
+    assert(mat);
+    assert(b);
+    assert(x);
+    size_t n = matrix_rows(mat);
+    if (matrix_columns(mat) != n) {
+        fprintf(stderr, "Error: matrix must be square\n");
+        return -1;
+    }
+    // one block: the doubles, the pivots, then the floats
+    size_t bytes = (n * n + n) * sizeof(double) + n * sizeof(size_t) + (n * n + n) * sizeof(float);
+    double *a = mem_alloc(bytes);
+    if (!a) {
+        return -1;
+    }
+    double *r = a + n * n;
+    size_t *pivots = (size_t *)(r + n);
+    float *lu = (float *)(pivots + n);
+    float *d = lu + n * n;
+    TRACE_BEGIN("dense_solve_refined", n, n);
+    matrix_entries(mat, LAYOUT_ROW_MAJOR, lu);
+    double norm = 0;        // the infinity norm of mat
+    for (size_t i = 0; i < n; ++i) {
+        double sum = 0;
+        for (size_t j = 0; j < n; ++j) {
+            a[i * n + j] = lu[i * n + j];
+            sum += fabs(a[i * n + j]);
+        }
+        norm = sum > norm ? sum : norm;
+    }
+    int steps = -1;
+    if (!dense_lu_float(n, lu, pivots)) {
+        fprintf(stderr, "Error: matrix is singular (to float precision)\n");
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            x[i] = 0;
+        }
+        // the backward error a double LU solve reaches (as LAPACK's
+        //   dsgesv tests it): ||b - A x|| <= sqrt(n) eps ||A|| ||x||
+        double scale = sqrt(n) * DBL_EPSILON * norm;
+        for (int step = 0; step <= REFINE_STEPS; ++step) {
+            dense_residual_double(n, a, x, b, r);
+            if (largest(r, n) <= scale * largest(x, n)) {
+                steps = step;
+                break;
+            }
+            for (size_t i = 0; i < n; ++i) {
+                d[i] = r[i];
+            }
+            dense_lu_solve_float(n, lu, pivots, d);
+            for (size_t i = 0; i < n; ++i) {
+                x[i] += d[i];
+            }
+        }
+        if (steps < 0) {
+            fprintf(stderr, "Error: iterative refinement did not converge in %d steps "
+                            "(matrix too ill-conditioned for float)\n", REFINE_STEPS);
+        }
+    }
+    TRACE_END();
+    mem_free(a, bytes);
+    return steps;
+}
@@ -0,0 +1,56 @@
+// Dense LU solves and row echelon forms in float and double, and
+//   mixed-precision solves.
+//   The kernels work on plain row-major arrays (a[i * n + j] is row i,
+//   column j) and are generated for both element types from one source
+//   by DENSE_DEFINE in dense.c, so dense_lu_float and dense_lu_double
+//   are the same algorithm. dense_solve_refined factors in float, which
+//   moves half the bytes of a double factorization, and then refines
+//   the solution with residuals computed in double.
+// time: n is the size of the system
+// see linalg.h
+
+// DENSE_DECLARE(T) declares, for the element type T:
+//   dense_lu_T(n, a, pivots) factors the n x n matrix a in place into
+//     P a = L U with partial pivoting (L has a unit diagonal and is
+//     stored below it, U on and above it); step k swapped rows k
+//     and pivots[k] >= k. It returns false (a is then not usable) if a
+//     pivot is within n * epsilon * max |a| of 0 (pivot_tolerance in
+//     the precision of T), that is if a is singular to that precision.
+//   dense_lu_solve_T(n, lu, pivots, b) overwrites b with the solution of
+//     a x = b, for lu and pivots from dense_lu_T
+//   dense_residual_T(n, a, x, b, r) stores b - a x in r
+//   dense_ref_T(rows, columns, a) reduces the rows x columns matrix a in
+//     place to the row echelon form ref (linalg.h) computes, with the
+//     tolerance of pivot_tolerance in the precision of T, and returns
+//     its rank (the nullity is columns - rank). ref, rank and nullity
+//     themselves work on float matrices only; this is their double
+//     version, for matrices whose rank float cannot resolve.
+// requires: a, lu, x, b and r are valid pointers to n x n or n entries
+//             (rows x columns for dense_ref_T)
+//           pivots is a valid pointer to n entries
+// time: O(n^3) for dense_lu_T, O(rows columns min(rows, columns)) for
+//       dense_ref_T, O(n^2) for the others
+#define DENSE_DECLARE(T) \
+    bool dense_lu_##T(size_t n, T *a, size_t *pivots); \
+    void dense_lu_solve_##T(size_t n, const T *lu, const size_t *pivots, T *b); \
+    void dense_residual_##T(size_t n, const T *a, const T *x, const T *b, T *r); \
+    size_t dense_ref_##T(size_t rows, size_t columns, T *a);
+
+DENSE_DECLARE(float)
+DENSE_DECLARE(double)
+
+// dense_solve_refined(mat, b, x) solves mat x = b, where b and x are
+//   arrays of n doubles, and returns the number of solves with the float
+//   factors it took (the first is a plain float solve, 0 if b = 0).
+//   mat is factored in float; each step computes r = b - mat x in double
+//   and corrects x by the float solve of mat d = r, until the residual
+//   is as small as a double solve would leave it.
+// requires: mat, b and x are valid pointers
+// notes: outputs an error message and returns -1 if mat is not square,
+//   is singular to float precision, if out of memory (see memtrack.h),
+//   or if the refinement does not converge (mat is too ill-conditioned
+//   for a float factorization, about cond(mat) > 1 / FLT_EPSILON); x
+//   then holds the last iterate
+// effects: may produce output
+// time: O(n^3 + kn^2), k is # of steps
+int dense_solve_refined(const struct matrix *mat, const double *b, double *x);
@@ -0,0 +1,468 @@
+#include <stdio.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include "linalg.h"
+#include "echelon.h"
+#include "memtrack.h"
+#include "trace.h"
+
+// A = Q R, where Q has used orthonormal columns and R = Q^T A is kept in
+//   row echelon form: row k has its pivot in column pivot_column[k], and
+//   the rows from pivots on are zero once an operation is done (used is
+//   then pivots, a change may add one more row while it is running).
+//   What is left of a column below the pivots before it is dropped, as
+//   ref drops it, when its magnitude is at most the tolerance; dropped
+//   bounds the magnitude of a column of A - Q R, so a decision within
+//   that bound of the tolerance is made again from the column of A.
+//   Changes are applied to R with Givens rotations on pairs of rows (and
+//   the matching columns of Q). Removing a pivot column or adding a
+//   rank-1 matrix leaves R upper Hessenberg below the first column that
+//   changed, so restoring the echelon form takes one rotation per pivot.
+//   A, R and Q are column-major with room for capacity columns (Q has
+//   steps), so appending a column does not move the others. All the
+//   buffers live in one block of block_bytes(rows, capacity) bytes,
+//   which starts at pivot_column.
+struct echelon {
+    size_t rows;
+    size_t columns;
+    size_t capacity;
+    float *matrix;          // A
+    float *ref;             // R
+    float *q;               // Q (steps columns)
+    float *dropped;         // for each column, a bound on what was dropped
+    float *work;            // rows + steps floats
+    float largest;          // largest magnitude of an entry of A
+    float tolerance;        // pivot_tolerance of A
+    size_t used;            // # of columns of Q
+    size_t pivots;
+    size_t *pivot_column;
+};
+
+// steps(rows, capacity) returns the number of columns of Q for capacity
+//   columns (a change adds a row before the sweep, which can add one
+//   more before it drops one)
+static size_t steps(size_t rows, size_t capacity) {
+    return capacity + 2 < rows ? capacity + 2 : rows;
+}
+
+// block_bytes(rows, capacity) returns the size of the block of an
+//   echelon with room for capacity columns
+static size_t block_bytes(size_t rows, size_t capacity) {
+    size_t q = steps(rows, capacity);
+    return q * sizeof(size_t) + (2 * rows * capacity + capacity + rows * q + rows + q) * sizeof(float);
+}
+
+// reserve(ech, columns) makes room for columns columns
+static bool reserve(struct echelon *ech, size_t columns) {
+    if (columns <= ech->capacity) {
+        return true;
+    }
+    size_t rows = ech->rows;
+    size_t capacity = ech->capacity * 2 > columns ? ech->capacity * 2 : columns;
+    size_t q = steps(rows, capacity);
+    size_t *block = mem_alloc(block_bytes(rows, capacity));
+    if (!block) {
+        return false;
+    }
+    size_t *pivot_column = block;
+    float *matrix = (float *)(pivot_column + q);
+    float *ref = matrix + rows * capacity;
+    float *dropped = ref + rows * capacity;
+    float *q_columns = dropped + capacity;
+    float *work = q_columns + rows * q;
+    if (ech->pivot_column) {
+        memcpy(pivot_column, ech->pivot_column, ech->pivots * sizeof(size_t));
+        memcpy(matrix, ech->matrix, rows * ech->columns * sizeof(float));
+        memcpy(ref, ech->ref, rows * ech->columns * sizeof(float));
+        memcpy(dropped, ech->dropped, ech->columns * sizeof(float));
+        memcpy(q_columns, ech->q, rows * ech->used * sizeof(float));
+        mem_free(ech->pivot_column, block_bytes(rows, ech->capacity));
+    }
+    ech->pivot_column = pivot_column;
+    ech->matrix = matrix;
+    ech->ref = ref;
+    ech->dropped = dropped;
+    ech->q = q_columns;
+    ech->work = work;
+    ech->capacity = capacity;
+    return true;
+}
+
+// pivots_before(ech, col) returns the number of pivots left of column col
+static size_t pivots_before(const struct echelon *ech, size_t col) {
+    size_t k = 0;
+    while (k < ech->pivots && ech->pivot_column[k] < col) {
+        ++k;
+    }
+    return k;
+}
+
+// apply(ech, a, b, cs, sn, first) rotates rows a and b of R in columns
+//   first.. by (cs, sn), and columns a and b of Q the same way, so Q R
+//   does not change
+static void apply(struct echelon *ech, size_t a, size_t b, float cs, float sn, size_t first) {
+    size_t rows = ech->rows;
+    for (size_t j = first; j < ech->columns; ++j) {
+        float *r = ech->ref + j * rows;
+        float ra = r[a];
+        r[a] = cs * ra + sn * r[b];
+        r[b] = cs * r[b] - sn * ra;
+    }
+    float *qa = ech->q + a * rows;
+    float *qb = ech->q + b * rows;
+    for (size_t i = 0; i < rows; ++i) {
+        float temp = qa[i];
+        qa[i] = cs * temp + sn * qb[i];
+        qb[i] = cs * qb[i] - sn * temp;
+    }
+}
+
+// givens(x, a, b, cs, sn) stores in cs and sn the rotation that zeroes
+//   x[b] into x[a], and applies it to x
+static void givens(float *x, size_t a, size_t b, float *cs, float *sn) {
+    float radius = hypotf(x[a], x[b]);
+    *cs = x[a] / radius;
+    *sn = x[b] / radius;
+    x[a] = radius;
+    x[b] = 0;
+}
+
+// rotate(ech, a, b, first) zeroes R[b][first] into R[a][first] with a
+//   rotation of rows a and b
+static void rotate(struct echelon *ech, size_t a, size_t b, size_t first) {
+    float cs, sn;
+    givens(ech->ref + first * ech->rows, a, b, &cs, &sn);
+    apply(ech, a, b, cs, sn, first + 1);
+}
+
+// norm(x, n) returns the 2-norm of the n floats of x
+static double norm(const float *x, size_t n) {
+    double sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        sum += (double)x[i] * x[i];
+    }
+    return sqrt(sum);
+}
+
+// project(ech, x, h) stores Q^T x in h and leaves x - Q Q^T x in x, with
+//   a second pass of (classical) Gram-Schmidt for the orthogonality
+//   lost in the first; returns ||x|| before the projection
+static double project(const struct echelon *ech, float *x, float *h) {
+    size_t rows = ech->rows;
+    double before = norm(x, rows);
+    for (size_t k = 0; k < ech->used; ++k) {
+        h[k] = 0;
+    }
+    for (int pass = 0; pass < 2; ++pass) {
+        for (size_t k = 0; k < ech->used; ++k) {
+            const float *q = ech->q + k * rows;
+            double dot = 0;
+            for (size_t i = 0; i < rows; ++i) {
+                dot += (double)q[i] * x[i];
+            }
+            for (size_t i = 0; i < rows; ++i) {
+                x[i] -= (float)dot * q[i];
+            }
+            h[k] += (float)dot;
+        }
+    }
+    return before;
+}
+
+// extend(ech, x, rho, before) appends x / rho to Q if there is room
+//   and x, of norm rho, is more than rounding error of a vector of norm
+//   before (as gram_schmidt decides it); returns true if it did
+// requires: x is orthogonal to Q, row used of R is zero
+static bool extend(struct echelon *ech, const float *x, double rho, double before) {
+    size_t rows = ech->rows;
+    if (rho <= 16 * FLT_EPSILON * before || ech->used == steps(rows, ech->capacity)) {
+        return false;
+    }
+    float *q = ech->q + ech->used * rows;
+    for (size_t i = 0; i < rows; ++i) {
+        q[i] = x[i] / rho;
+    }
+    ++ech->used;
+    return true;
+}
+
+// place(ech, col) sets column col of R to Q^T times column col of A,
+//   adding a column to Q for what Q does not reach, and clears the bound
+//   on what was dropped from it; returns true if Q got a column
+static bool place(struct echelon *ech, size_t col) {
+    size_t rows = ech->rows;
+    float *x = ech->work;
+    float *h = ech->work + rows;
+    float *column = ech->ref + col * rows;
+    memcpy(x, ech->matrix + col * rows, rows * sizeof(float));
+    double before = project(ech, x, h);
+    for (size_t i = 0; i < rows; ++i) {
+        column[i] = i < ech->used ? h[i] : 0;
+    }
+    double rho = norm(x, rows);
+    bool added = extend(ech, x, rho, before);
+    if (added) {
+        column[ech->used - 1] = rho;
+    }
+    ech->dropped[col] = added ? 0 : rho;
+    return added;
+}
+
+// sweep(ech, first) restores the echelon form of the columns first..,
+//   given that the earlier columns are in it and the rows of R below
+//   their pivots are zero in them
+static void sweep(struct echelon *ech, size_t first) {
+    size_t rows = ech->rows;
+    size_t t = pivots_before(ech, first);
+    for (size_t j = first; j < ech->columns; ++j) {
+        float *column = ech->ref + j * rows;
+        double magnitude = t < ech->used ? norm(column + t, ech->used - t) : 0;
+        bool added = false;
+        if (t < rows && fabs(magnitude - ech->tolerance) <= ech->dropped[j]) {
+            // too close to call with what was dropped from the column
+            added = place(ech, j);
+            magnitude = t < ech->used ? norm(column + t, ech->used - t) : 0;
+        }
+        if (t < rows && magnitude > ech->tolerance) {
+            // bottom up, so the pivots below get one nonzero under them
+            for (size_t i = ech->used - 1; i > t; --i) {
+                if (column[i]) {
+                    rotate(ech, i - 1, i, j);
+                }
+            }
+            ech->pivot_column[t++] = j;
+        } else {
+            for (size_t i = t; i < ech->used; ++i) {
+                column[i] = 0;
+            }
+            ech->dropped[j] += magnitude;
+            if (added) {
+                // its row is zero again
+                --ech->used;
+            }
+        }
+    }
+    ech->pivots = t;
+    ech->used = t;
+}
+
+// largest_magnitude(ech) returns the largest magnitude of an entry of A
+static float largest_magnitude(const struct echelon *ech) {
+    float largest = 0;
+    for (size_t i = 0; i < ech->columns * ech->rows; ++i) {
+        largest = fabsf(ech->matrix[i]) > largest ? fabsf(ech->matrix[i]) : largest;
+    }
+    return largest;
+}
+
+// update(ech, first, largest) switches to the tolerance of A, whose
+//   largest entry has magnitude largest, and restores the echelon form
+//   from column first, or from the first column before it whose pivot
+//   decision the new tolerance may change
+// requires: the columns before first are in echelon form
+static void update(struct echelon *ech, size_t first, float largest) {
+    float tolerance = pivot_tolerance(ech->rows, ech->columns, largest);
+    if (tolerance != ech->tolerance) {
+        for (size_t j = 0, k = 0; j < first; ++j) {
+            bool pivot = k < ech->pivots && ech->pivot_column[k] == j;
+            float magnitude = pivot ? fabsf(ech->ref[j * ech->rows + k++]) : 0;
+            if (pivot ? magnitude - ech->dropped[j] <= tolerance
+                      : magnitude + ech->dropped[j] > tolerance) {
+                first = j;
+                break;
+            }
+        }
+    }
+    ech->largest = largest;
+    ech->tolerance = tolerance;
+    sweep(ech, first);
+}
+
+struct echelon *echelon_create(size_t rows) {
+    assert(rows > 0);
+    struct echelon *ech = mem_alloc(sizeof(struct echelon));
+    if (!ech) {
+        return NULL;
+    }
+    *ech = (struct echelon){rows, 0, 0, NULL, NULL, NULL, NULL, NULL, 0, 0, 0, 0, NULL};
+    return ech;
+}
+
+struct echelon *echelon_from_matrix(const struct matrix *mat) {
+    assert(mat);
+    size_t rows = matrix_rows(mat);
+    size_t columns = matrix_columns(mat);
+    TRACE_BEGIN("echelon_from_matrix", rows, columns);
+    struct echelon *ech = echelon_create(rows);
+    if (ech && !reserve(ech, columns)) {
+        destroy_echelon(ech);
+        ech = NULL;
+    }
+    if (ech) {
+        matrix_entries(mat, LAYOUT_COLUMN_MAJOR, ech->matrix);
+        ech->columns = columns;
+        ech->largest = largest_magnitude(ech);
+        ech->tolerance = pivot_tolerance(rows, columns, ech->largest);
+        for (size_t j = 0; j < columns; ++j) {
+            ech->columns = j + 1;
+            place(ech, j);
+            sweep(ech, j);
+        }
+    }
+    TRACE_END();
+    return ech;
+}
+
+void destroy_echelon(struct echelon *ech) {
+    assert(ech);
+    mem_free(ech->pivot_column, block_bytes(ech->rows, ech->capacity));
+    mem_free(ech, sizeof(struct echelon));
+}
+
+size_t echelon_rows(const struct echelon *ech) {
+    assert(ech);
+    return ech->rows;
+}
+
+size_t echelon_columns(const struct echelon *ech) {
+    assert(ech);
+    return ech->columns;
+}
+
+bool echelon_append_column(struct echelon *ech, const float *column) {
+    assert(ech);
+    assert(column);
+    if (!reserve(ech, ech->columns + 1)) {
+        return false;
+    }
+    size_t col = ech->columns++;
+    memcpy(ech->matrix + col * ech->rows, column, ech->rows * sizeof(float));
+    float largest = ech->largest;
+    for (size_t i = 0; i < ech->rows; ++i) {
+        largest = fabsf(column[i]) > largest ? fabsf(column[i]) : largest;
+    }
+    place(ech, col);
+    update(ech, col, largest);
+    return true;
+}
+
+bool echelon_remove_column(struct echelon *ech, size_t col) {
+    assert(ech);
+    if (col >= ech->columns) {
+        fprintf(stderr, "Error: invalid column index\n");
+        return false;
+    }
+    TRACE_BEGIN("echelon_remove_column", ech->rows, ech->columns);
+    size_t rows = ech->rows;
+    size_t after = ech->columns - col - 1;
+    memmove(ech->matrix + col * rows, ech->matrix + (col + 1) * rows, after * rows * sizeof(float));
+    memmove(ech->ref + col * rows, ech->ref + (col + 1) * rows, after * rows * sizeof(float));
+    memmove(ech->dropped + col, ech->dropped + col + 1, after * sizeof(float));
+    --ech->columns;
+    // sweep recounts the pivots from col
+    update(ech, col, largest_magnitude(ech));
+    TRACE_END();
+    return true;
+}
+
+bool echelon_set_column(struct echelon *ech, size_t col, const float *column) {
+    assert(ech);
+    assert(column);
+    if (col >= ech->columns) {
+        fprintf(stderr, "Error: invalid column index\n");
+        return false;
+    }
+    TRACE_BEGIN("echelon_set_column", ech->rows, ech->columns);
+    memcpy(ech->matrix + col * ech->rows, column, ech->rows * sizeof(float));
+    place(ech, col);
+    update(ech, col, largest_magnitude(ech));
+    TRACE_END();
+    return true;
+}
+
+void echelon_rank_update(struct echelon *ech, const float *u, const float *v) {
+    assert(ech);
+    assert(u);
+    assert(v);
+    size_t rows = ech->rows;
+    size_t columns = ech->columns;
+    size_t first = 0;
+    while (first < columns && !v[first]) {
+        ++first;
+    }
+    if (first == columns) {
+        return;
+    }
+    TRACE_BEGIN("echelon_rank_update", rows, columns);
+    for (size_t j = first; j < columns; ++j) {
+        float *column = ech->matrix + j * rows;
+        for (size_t i = 0; i < rows; ++i) {
+            column[i] += u[i] * v[j];
+        }
+    }
+    // u = Q w (+ the new column of Q), so R + w v^T is Q^T A
+    float *x = ech->work;
+    float *w = ech->work + rows;
+    memcpy(x, u, rows * sizeof(float));
+    double before = project(ech, x, w);
+    double rho = norm(x, rows);
+    bool added = extend(ech, x, rho, before);
+    if (added) {
+        w[ech->used - 1] = rho;
+    }
+    for (size_t j = first; j < columns; ++j) {
+        // the rounding error of R is relative to the column before the
+        //   update, which can cancel to far below it
+        double scale = norm(ech->ref + j * rows, ech->used) + fabsf(v[j]) * before;
+        ech->dropped[j] += v[j] ? 4 * FLT_EPSILON * scale + (added ? 0 : fabsf(v[j]) * rho) : 0;
+    }
+    // rotate w into row k0 from the bottom up; the rows it rotates are
+    //   zero left of first, and R becomes upper Hessenberg below row k0
+    size_t k0 = pivots_before(ech, first);
+    for (size_t i = ech->used; i-- > k0 + 1;) {
+        if (w[i]) {
+            float cs, sn;
+            givens(w, i - 1, i, &cs, &sn);
+            apply(ech, i - 1, i, cs, sn, first);
+        }
+    }
+    for (size_t k = 0; k <= k0 && k < ech->used; ++k) {
+        for (size_t j = first; j < columns; ++j) {
+            ech->ref[j * rows + k] += w[k] * v[j];
+        }
+    }
+    update(ech, first, largest_magnitude(ech));
+    TRACE_END();
+}
+
+size_t echelon_rank(const struct echelon *ech) {
+    assert(ech);
+    return ech->pivots;
+}
+
+size_t echelon_nullity(const struct echelon *ech) {
+    assert(ech);
+    return ech->columns - ech->pivots;
+}
+
+struct matrix *echelon_ref(const struct echelon *ech) {
+    assert(ech);
+    if (!ech->columns) {
+        fprintf(stderr, "Error: the matrix has no columns\n");
+        return NULL;
+    }
+    return create_matrix_layout(ech->rows, ech->columns, ech->ref, LAYOUT_COLUMN_MAJOR);
+}
+
+struct matrix *echelon_to_matrix(const struct echelon *ech) {
+    assert(ech);
+    if (!ech->columns) {
+        fprintf(stderr, "Error: the matrix has no columns\n");
+        return NULL;
+    }
+    return create_matrix_layout(ech->rows, ech->columns, ech->matrix, LAYOUT_COLUMN_MAJOR);
+}
@@ -0,0 +1,103 @@
+// Row echelon forms kept up to date while the columns of a matrix change.
+//   An echelon holds a matrix A and a factorization A = Q R, where Q has
+//   orthonormal columns and R = Q^T A is a row echelon form of A. As ref
+//   does, a column gets a pivot if what is left of it below the earlier
+//   pivots has a magnitude above the tolerance (see pivot_tolerance), so
+//   the pivot columns, rank and nullity are those of ref, rank and
+//   nullity of the matrix, except for a column within rounding error of
+//   the tolerance. The entries of R are not those of ref(A): the rows are
+//   combined by rotations instead of eliminations, which is what lets a
+//   change be absorbed without a new factorization of all of A.
+//   Removing a column or adding a rank-1 matrix leaves R one rotation per
+//   row away from echelon form, and setting a column adds one column to
+//   rotate away, so each is O(nm) whatever column it touches. A column
+//   whose pivot decision could go either way with what was dropped from
+//   it (up to the tolerance each time) is projected again from A, at
+//   O(nr) more.
+// time: n is # of rows, m is # of columns (as in linalg.h)
+//       r is # of pivots (<= min(n, m))
+// see linalg.h
+
+struct echelon;
+
+// echelon_create(rows) returns an echelon of a matrix with rows rows
+//   and no columns yet
+// requires: rows > 0
+// notes: outputs an error message and returns NULL if out of memory
+// effects: may allocate memory (client must call destroy_echelon)
+//          may produce output
+// time: O(n)
+struct echelon *echelon_create(size_t rows);
+
+// echelon_from_matrix(mat) returns an echelon of mat
+// requires: mat is a valid pointer
+// notes: outputs an error message and returns NULL if out of memory
+// effects: may allocate memory (client must call destroy_echelon)
+//          may produce output
+// time: O(nm min(n, m))
+struct echelon *echelon_from_matrix(const struct matrix *mat);
+
+// destroy_echelon(ech) frees all memory for ech
+// requires: ech is a valid pointer
+// effects: ech is no longer valid
+// time: O(1)
+void destroy_echelon(struct echelon *ech);
+
+// echelon_rows(ech) returns n, echelon_columns(ech) returns m
+// requires: ech is a valid pointer
+// time: O(1)
+size_t echelon_rows(const struct echelon *ech);
+size_t echelon_columns(const struct echelon *ech);
+
+// echelon_append_column(ech, column) appends column (an array of n
+//   floats) to the right of the matrix
+// requires: ech and column are valid pointers
+// notes: outputs an error message and returns false (leaving ech
+//   unchanged) if out of memory
+// effects: modifies ech
+//          may allocate memory
+//          may produce output
+// time: O(nr + m), amortized (plus O(nm) if the tolerance moves past a
+//       pivot decision)
+bool echelon_append_column(struct echelon *ech, const float *column);
+
+// echelon_remove_column(ech, col) removes column col from the matrix
+// requires: ech is a valid pointer
+// notes: outputs an error message and returns false if col >= m
+// effects: modifies ech
+//          may produce output
+// time: O(nm)
+bool echelon_remove_column(struct echelon *ech, size_t col);
+
+// echelon_set_column(ech, col, column) replaces column col of the matrix
+//   with column (an array of n floats)
+// requires: ech and column are valid pointers
+// notes: outputs an error message and returns false if col >= m
+// effects: modifies ech
+//          may produce output
+// time: O(nm)
+bool echelon_set_column(struct echelon *ech, size_t col, const float *column);
+
+// echelon_rank_update(ech, u, v) adds the rank-1 matrix u v^T to the
+//   matrix (u is an array of n floats, v of m floats)
+// requires: ech, u and v are valid pointers
+// effects: modifies ech
+// time: O(nm)
+void echelon_rank_update(struct echelon *ech, const float *u, const float *v);
+
+// echelon_rank(ech) returns rank(A), echelon_nullity(ech) nullity(A)
+// requires: ech is a valid pointer
+// time: O(1)
+size_t echelon_rank(const struct echelon *ech);
+size_t echelon_nullity(const struct echelon *ech);
+
+// echelon_ref(ech) returns R, a row echelon form of A with the pivot
+//   columns of ref(A) (column-major), and echelon_to_matrix(ech) returns A
+//   (column-major)
+// requires: ech is a valid pointer
+// notes: outputs an error message and returns NULL if m = 0
+// effects: may allocate memory (client must call destroy_matrix)
+//          may produce output
+// time: O(nm)
+struct matrix *echelon_ref(const struct echelon *ech);
+struct matrix *echelon_to_matrix(const struct echelon *ech);
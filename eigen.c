@@ -0,0 +1,451 @@
+#include <stdio.h>
+#include <assert.h>
+#include <float.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "linalg.h"
+#include "krylov.h"
+#include "parallel.h"
+#include "eigen.h"
+#include "memtrack.h"
+
+// tridiagonalize(v, n, d, e) reduces the symmetric n x n matrix v (row
+//   major, lower triangle used) to tridiagonal form with Householder
+//   reflections: on return d is the diagonal, e[1..n-1] the subdiagonal
+//   and v the accumulated orthogonal transformation.
+// time: O(n^3)
+static void tridiagonalize(double *v, int n, double *d, double *e) {
+    for (int j = 0; j < n; ++j) {
+        d[j] = v[(n - 1) * n + j];
+    }
+    for (int i = n - 1; i > 0; --i) {
+        double scale = 0;
+        double h = 0;
+        for (int k = 0; k < i; ++k) {
+            scale += fabs(d[k]);
+        }
+        if (scale == 0) {
+            e[i] = d[i - 1];
+            for (int j = 0; j < i; ++j) {
+                d[j] = v[(i - 1) * n + j];
+                v[i * n + j] = 0;
+                v[j * n + i] = 0;
+            }
+        } else {
+            for (int k = 0; k < i; ++k) {
+                d[k] /= scale;
+                h += d[k] * d[k];
+            }
+            double f = d[i - 1];
+            double g = f > 0 ? -sqrt(h) : sqrt(h);
+            e[i] = scale * g;
+            h -= f * g;
+            d[i - 1] = f - g;
+            for (int j = 0; j < i; ++j) {
+                e[j] = 0;
+            }
+            for (int j = 0; j < i; ++j) {
+                f = d[j];
+                v[j * n + i] = f;
+                g = e[j] + v[j * n + j] * f;
+                for (int k = j + 1; k < i; ++k) {
+                    g += v[k * n + j] * d[k];
+                    e[k] += v[k * n + j] * f;
+                }
+                e[j] = g;
+            }
+            f = 0;
+            for (int j = 0; j < i; ++j) {
+                e[j] /= h;
+                f += e[j] * d[j];
+            }
+            double hh = f / (h + h);
+            for (int j = 0; j < i; ++j) {
+                e[j] -= hh * d[j];
+            }
+            for (int j = 0; j < i; ++j) {
+                f = d[j];
+                g = e[j];
+                for (int k = j; k < i; ++k) {
+                    v[k * n + j] -= f * e[k] + g * d[k];
+                }
+                d[j] = v[(i - 1) * n + j];
+                v[i * n + j] = 0;
+            }
+        }
+        d[i] = h;
+    }
+    for (int i = 0; i < n - 1; ++i) {
+        v[(n - 1) * n + i] = v[i * n + i];
+        v[i * n + i] = 1;
+        double h = d[i + 1];
+        if (h != 0) {
+            for (int k = 0; k <= i; ++k) {
+                d[k] = v[k * n + i + 1] / h;
+            }
+            for (int j = 0; j <= i; ++j) {
+                double g = 0;
+                for (int k = 0; k <= i; ++k) {
+                    g += v[k * n + i + 1] * v[k * n + j];
+                }
+                for (int k = 0; k <= i; ++k) {
+                    v[k * n + j] -= g * d[k];
+                }
+            }
+        }
+        for (int k = 0; k <= i; ++k) {
+            v[k * n + i + 1] = 0;
+        }
+    }
+    for (int j = 0; j < n; ++j) {
+        d[j] = v[(n - 1) * n + j];
+        v[(n - 1) * n + j] = 0;
+    }
+    v[(n - 1) * n + n - 1] = 1;
+    e[0] = 0;
+}
+
+// diagonalize(v, n, d, e) diagonalizes the tridiagonal matrix from
+//   tridiagonalize with implicit QL iterations: on return d holds the
+//   eigenvalues and column i of v the eigenvector of d[i]. Returns false
+//   if an eigenvalue needs more than 30 iterations.
+// time: O(n^3)
+static bool diagonalize(double *v, int n, double *d, double *e) {
+    for (int i = 1; i < n; ++i) {
+        e[i - 1] = e[i];
+    }
+    e[n - 1] = 0;
+    double f = 0;
+    double tst1 = 0;
+    for (int l = 0; l < n; ++l) {
+        tst1 = fmax(tst1, fabs(d[l]) + fabs(e[l]));
+        int m = l;
+        while (m < n - 1 && fabs(e[m]) > DBL_EPSILON * tst1) {
+            ++m;
+        }
+        int iter = 0;
+        while (m > l && fabs(e[l]) > DBL_EPSILON * tst1) {
+            if (++iter > 30) {
+                return false;
+            }
+            double g = d[l];
+            double p = (d[l + 1] - g) / (2 * e[l]);
+            double r = p < 0 ? -hypot(p, 1) : hypot(p, 1);
+            d[l] = e[l] / (p + r);
+            d[l + 1] = e[l] * (p + r);
+            double dl1 = d[l + 1];
+            double h = g - d[l];
+            for (int i = l + 2; i < n; ++i) {
+                d[i] -= h;
+            }
+            f += h;
+            p = d[m];
+            double c = 1;
+            double c2 = 1;
+            double c3 = 1;
+            double el1 = e[l + 1];
+            double s = 0;
+            double s2 = 0;
+            for (int i = m - 1; i >= l; --i) {
+                c3 = c2;
+                c2 = c;
+                s2 = s;
+                g = c * e[i];
+                h = c * p;
+                r = hypot(p, e[i]);
+                e[i + 1] = s * r;
+                s = e[i] / r;
+                c = p / r;
+                p = c * d[i] - s * g;
+                d[i + 1] = h + s * (c * g + s * d[i]);
+                for (int k = 0; k < n; ++k) {
+                    h = v[k * n + i + 1];
+                    v[k * n + i + 1] = s * v[k * n + i] + c * h;
+                    v[k * n + i] = c * v[k * n + i] - s * h;
+                }
+            }
+            p = -s * s2 * c3 * el1 * e[l] / dl1;
+            e[l] = s * p;
+            d[l] = c * p;
+        }
+        d[l] += f;
+        e[l] = 0;
+    }
+    return true;
+}
+
+// symmetric_eigen(v, n, d, e) replaces the symmetric matrix v with its
+//   eigenvectors (column i for d[i]) and sorts the eigenvalues in d in
+//   descending order. e is scratch space of n doubles.
+// time: O(n^3)
+static bool symmetric_eigen(double *v, int n, double *d, double *e) {
+    tridiagonalize(v, n, d, e);
+    if (!diagonalize(v, n, d, e)) {
+        return false;
+    }
+    for (int i = 0; i < n - 1; ++i) {
+        int max = i;
+        for (int j = i + 1; j < n; ++j) {
+            if (d[j] > d[max]) {
+                max = j;
+            }
+        }
+        if (max != i) {
+            double t = d[i];
+            d[i] = d[max];
+            d[max] = t;
+            for (int k = 0; k < n; ++k) {
+                t = v[k * n + i];
+                v[k * n + i] = v[k * n + max];
+                v[k * n + max] = t;
+            }
+        }
+    }
+    return true;
+}
+
+bool eigen_symmetric(const struct matrix *mat, float *values, float *vectors) {
+    assert(mat);
+    assert(values);
+    assert(matrix_rows(mat) == matrix_columns(mat));
+    int n = matrix_rows(mat);
+    size_t bytes = ((size_t)n * n + 2 * n) * sizeof(double);
+    double *v = mem_alloc(bytes);
+    if (!v) {
+        return false;
+    }
+    double *d = v + n * n;
+    double *e = d + n;
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j <= i; ++j) {
+            v[i * n + j] = matrix_get(mat, i, j);
+            v[j * n + i] = v[i * n + j];
+        }
+    }
+    bool ok = symmetric_eigen(v, n, d, e);
+    if (!ok) {
+        fprintf(stderr, "Error: eigenvalue iteration did not converge\n");
+    } else {
+        for (int i = 0; i < n; ++i) {
+            values[i] = d[i];
+            for (int k = 0; vectors && k < n; ++k) {
+                vectors[i * n + k] = v[k * n + i];
+            }
+        }
+    }
+    mem_free(v, bytes);
+    return ok;
+}
+
+static double dot(int n, const float *x, const float *y) {
+    double sum = 0;
+    for (int i = 0; i < n; ++i) {
+        sum += (double)x[i] * y[i];
+    }
+    return sum;
+}
+
+// random_vector(n, x, seed) fills x with pseudo-random entries in
+//   [-1, 1); the same seed gives the same vector
+static void random_vector(int n, float *x, unsigned *seed) {
+    for (int i = 0; i < n; ++i) {
+        *seed = *seed * 1103515245u + 12345u;
+        x[i] = (float)((*seed >> 8) & 0xffff) / 32768 - 1;
+    }
+}
+
+// orthogonalize(n, q, count, w, c) makes w orthogonal to the unit
+//   vectors q[0], ..., q[count - 1] (stored n apart). The components
+//   c[i] = q[i] . w are always measured, but only subtracted when one of
+//   them is above sqrt(eps) * ||w||, and at most twice.
+// time: O(n count)
+static void orthogonalize(int n, const float *q, int count, float *w, double *c) {
+    for (int pass = 0; pass < 2; ++pass) {
+        double wnorm = sqrt(dot(n, w, w));
+        double max = 0;
+        for (int i = 0; i < count; ++i) {
+            c[i] = dot(n, q + i * n, w);
+            max = fmax(max, fabs(c[i]));
+        }
+        if (max <= sqrt(FLT_EPSILON) * wnorm) {
+            return;
+        }
+        for (int i = 0; i < count; ++i) {
+            for (int r = 0; r < n; ++r) {
+                w[r] -= c[i] * q[i * n + r];
+            }
+        }
+    }
+}
+
+// Rows a rotation works on at a time
+#define ROTATE_ROWS 4096
+
+// A rotation of the basis: row r of out (vector i at out + i * stride)
+//   becomes sum_p q[p * n + r] * s[p * b + i] for i < count.
+struct rotation {
+    int n;
+    int b;
+    int count;
+    const double *s;
+    float *q;        // b vectors, rotated in place when out == q
+    float *out;
+    double *scratch; // 2 b doubles for each range of ROTATE_ROWS rows
+};
+
+static void rotate_rows(int begin, int end, void *ctx) {
+    struct rotation *rot = ctx;
+    double *row = rot->scratch + (size_t)(begin / ROTATE_ROWS) * 2 * rot->b;
+    double *next = row + rot->b;
+    for (int r = begin; r < end; ++r) {
+        for (int p = 0; p < rot->b; ++p) {
+            row[p] = rot->q[p * rot->n + r];
+        }
+        for (int i = 0; i < rot->count; ++i) {
+            next[i] = 0;
+            for (int p = 0; p < rot->b; ++p) {
+                next[i] += row[p] * rot->s[p * rot->b + i];
+            }
+        }
+        for (int i = 0; i < rot->count; ++i) {
+            rot->out[i * rot->n + r] = next[i];
+        }
+    }
+}
+
+struct lanczos_result eigen_lanczos(const struct linop *op, int k,
+                                    const struct lanczos_options *opts,
+                                    float *values, float *vectors) {
+    assert(op);
+    assert(values);
+    assert(vectors);
+    assert(k > 0 && k <= op->n);
+    int n = op->n;
+    int b = opts && opts->basis ? opts->basis : (2 * k + 10 > 20 ? 2 * k + 10 : 20);
+    b = b < k + 1 ? k + 1 : b;
+    b = b > n ? n : b;
+    int max_iter = opts && opts->max_iter ? opts->max_iter : 100 * b;
+    double tol = opts && opts->tol ? opts->tol : 1e-5;
+    struct lanczos_result result = {0, 0, 0, false};
+
+    // t is the projected matrix, s its eigenvectors, q holds the basis
+    //   q[0..b-1] plus the next Lanczos vector q[b]
+    size_t ranges = n / ROTATE_ROWS + 1;
+    size_t bytes = (2 * b * b + 3 * b + 1 + ranges * 2 * b) * sizeof(double) +
+                   ((size_t)(b + 1) * n + n) * sizeof(float);
+    char *work = mem_alloc(bytes);
+    if (!work) {
+        result.failed = true;
+        return result;
+    }
+    double *t = (double *)work;
+    double *s = t + b * b;
+    double *theta = s + b * b;
+    double *e = theta + b;
+    double *c = e + b;
+    double *scratch = c + b + 1;
+    float *q = (float *)(scratch + ranges * 2 * b);
+    float *w = q + (b + 1) * n;
+
+    unsigned seed = 12345;
+    random_vector(n, q, &seed);
+    double qnorm = sqrt(dot(n, q, q));
+    for (int r = 0; r < n; ++r) {
+        q[r] /= qnorm;
+    }
+    memset(t, 0, b * b * sizeof(double));
+    int l = 0;
+    double beta = 0;
+    while (1) {
+        for (int j = l; j < b; ++j) {
+            float *qj = q + j * n;
+            op->apply(qj, w, op->ctx);
+            ++result.matvecs;
+            double alpha = dot(n, qj, w);
+            t[j * b + j] = alpha;
+            for (int r = 0; r < n; ++r) {
+                w[r] -= alpha * qj[r];
+            }
+            // the couplings above the diagonal: beta to q[j - 1], or
+            //   the kept Ritz vectors right after a restart
+            for (int i = 0; i < j; ++i) {
+                if (t[i * b + j] != 0) {
+                    for (int r = 0; r < n; ++r) {
+                        w[r] -= t[i * b + j] * q[i * n + r];
+                    }
+                }
+            }
+            orthogonalize(n, q, j + 1, w, c);
+            beta = sqrt(dot(n, w, w));
+            float *next = q + (j + 1) * n;
+            if (beta > DBL_EPSILON * fabs(alpha) && beta > DBL_MIN) {
+                for (int r = 0; r < n; ++r) {
+                    next[r] = w[r] / beta;
+                }
+            } else {
+                // the basis spans an invariant subspace: continue with a
+                //   fresh direction that is not coupled to it
+                beta = 0;
+                if (j + 1 < n) {
+                    random_vector(n, next, &seed);
+                    orthogonalize(n, q, j + 1, next, c);
+                    orthogonalize(n, q, j + 1, next, c);
+                    qnorm = sqrt(dot(n, next, next));
+                    for (int r = 0; r < n; ++r) {
+                        next[r] /= qnorm;
+                    }
+                } else {
+                    memset(next, 0, n * sizeof(float));
+                }
+            }
+            if (j + 1 < b) {
+                t[j * b + j + 1] = beta;
+                t[(j + 1) * b + j] = beta;
+            }
+        }
+
+        memcpy(s, t, b * b * sizeof(double));
+        if (!symmetric_eigen(s, b, theta, e)) {
+            // s and theta are not usable, so there is nothing to return
+            fprintf(stderr, "Error: the projected eigenproblem did not converge\n");
+            result.converged = 0;
+            result.failed = true;
+            mem_free(work, bytes);
+            return result;
+        }
+        double scale = fmax(fabs(theta[0]), fabs(theta[b - 1]));
+        result.converged = 0;
+        while (result.converged < k &&
+               fabs(beta * s[(b - 1) * b + result.converged]) <= tol * scale) {
+            ++result.converged;
+        }
+        if (result.converged == k || result.matvecs >= max_iter) {
+            break;
+        }
+
+        // thick restart: keep the best l Ritz vectors and continue the
+        //   Lanczos process from the last Lanczos vector
+        l = k + (b - k) / 2;
+        l = l > b - 1 ? b - 1 : l;
+        struct rotation rot = {n, b, l, s, q, q, scratch};
+        parallel_for(n, ROTATE_ROWS, rotate_rows, &rot);
+        memcpy(q + l * n, q + b * n, n * sizeof(float));
+        memset(t, 0, b * b * sizeof(double));
+        for (int i = 0; i < l; ++i) {
+            t[i * b + i] = theta[i];
+            t[i * b + l] = beta * s[(b - 1) * b + i];
+            t[l * b + i] = t[i * b + l];
+        }
+        ++result.restarts;
+    }
+
+    struct rotation rot = {n, b, k, s, q, vectors, scratch};
+    parallel_for(n, ROTATE_ROWS, rotate_rows, &rot);
+    for (int i = 0; i < k; ++i) {
+        values[i] = theta[i];
+    }
+    mem_free(work, bytes);
+    return result;
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+// Eigenvalues and eigenvectors of symmetric matrices.
+// time: n is the size of the matrix
+//       k is the number of eigenpairs asked for
+//       b is the Lanczos basis size (O(k))
+//       T(A) is the time of one product with A
+// see linalg.h and krylov.h
+
+struct lanczos_options {
+    int basis;      // Lanczos basis size b; 0 picks max(2k + 10, 20)
+    int max_iter;   // limit on products with A; 0 picks 100 * b
+    float tol;      // a Ritz pair (t, y) is converged once
+                    //   ||A y - t y|| <= tol * |largest Ritz value|;
+                    //   0 picks 1e-5
+};
+
+struct lanczos_result {
+    int matvecs;    // number of products with A
+    int restarts;
+    int converged;  // number of the k eigenpairs that converged
+    bool failed;    // out of memory, or the projected eigenproblem did
+                    //   not converge: values and vectors were not set
+};
+
+// eigen_symmetric(mat, values, vectors) computes all eigenvalues of the
+//   symmetric matrix mat, in descending order, and stores them in values.
+//   If vectors is not NULL, the unit eigenvector of values[i] is stored in
+//   vectors[i * n], ..., vectors[i * n + n - 1]. The matrix is reduced to
+//   tridiagonal form with Householder reflections, then the tridiagonal
+//   matrix is diagonalized with implicit QL iterations (in double).
+// requires: mat and values are valid pointers
+//           mat is square and symmetric (only the lower triangle is read)
+//           values has room for n floats, vectors for n^2 floats
+// notes: outputs an error message and returns false if out of memory
+//   (see memtrack.h) or the QL iteration does not converge
+// effects: may produce output
+//          allocates and frees memory
+// time: O(n^3)
+bool eigen_symmetric(const struct matrix *mat, float *values, float *vectors);
+
+// eigen_lanczos(op, k, opts, values, vectors) computes the k
+//   algebraically largest eigenvalues of the symmetric operator op, in
+//   descending order, using only products with op (thick-restart
+//   Lanczos). values and vectors are stored as in eigen_symmetric.
+//   Each new Lanczos vector is checked against the basis and only
+//   reorthogonalized when it has lost orthogonality, and the iteration
+//   stops as soon as all k pairs have converged. Memory is O(n b), so it
+//   grows with k and not with the number of iterations.
+// requires: op, values and vectors are valid pointers
+//           0 < k <= op->n
+//           opts is a valid pointer or NULL (all defaults)
+//           values has room for k floats, vectors for n * k floats
+// notes: outputs an error message and sets failed in the result (with
+//   converged = 0) if out of memory or the QL iteration on the projected
+//   matrix does not converge
+// effects: allocates and frees memory
+//          may produce output
+// time: O(b^3 + n b^2 + b T(A)) per restart
+struct lanczos_result eigen_lanczos(const struct linop *op, int k,
+                                    const struct lanczos_options *opts,
+                                    float *values, float *vectors);
\ No newline at end of file
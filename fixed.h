@@ -0,0 +1,203 @@
+// Fixed-size 2x2, 3x3 and 4x4 matrices and 2, 3 and 4 vectors.
+//   These are plain values (no allocation, no error output) whose
+//   kernels are generated by the macros below and fully unrolled, so
+//   they are much cheaper than the general struct matrix functions for
+//   the small shapes used in graphics and robotics.
+//   Entries are stored row by row: m[i * N + j] is row i, column j.
+// see linalg.h
+#include <stdbool.h>
+
+// The FIXED_I, FIXED_J and FIXED_K macros expand X once per index.
+//   They are separate families so they can be nested.
+#define FIXED_I2(X, N) X(N, 0) X(N, 1)
+#define FIXED_I3(X, N) X(N, 0) X(N, 1) X(N, 2)
+#define FIXED_I4(X, N) X(N, 0) X(N, 1) X(N, 2) X(N, 3)
+#define FIXED_J2(X, N, i) X(N, i, 0) X(N, i, 1)
+#define FIXED_J3(X, N, i) X(N, i, 0) X(N, i, 1) X(N, i, 2)
+#define FIXED_J4(X, N, i) X(N, i, 0) X(N, i, 1) X(N, i, 2) X(N, i, 3)
+#define FIXED_K2(X, N, i, j) X(N, i, j, 0) X(N, i, j, 1)
+#define FIXED_K3(X, N, i, j) X(N, i, j, 0) X(N, i, j, 1) X(N, i, j, 2)
+#define FIXED_K4(X, N, i, j) X(N, i, j, 0) X(N, i, j, 1) X(N, i, j, 2) X(N, i, j, 3)
+
+#define FIXED_MUL_TERM(N, i, j, k) + a.m[(i) * N + (k)] * b.m[(k) * N + (j)]
+#define FIXED_MUL_ENTRY(N, i, j) c.m[(i) * N + (j)] = 0 FIXED_K##N(FIXED_MUL_TERM, N, i, j);
+#define FIXED_MUL_ROW(N, i) FIXED_J##N(FIXED_MUL_ENTRY, N, i)
+#define FIXED_MV_TERM(N, i, k) + a.m[(i) * N + (k)] * x.v[k]
+#define FIXED_MV_ENTRY(N, i) y.v[i] = 0 FIXED_J##N(FIXED_MV_TERM, N, i);
+#define FIXED_T_ENTRY(N, i, j) t.m[(j) * N + (i)] = a.m[(i) * N + (j)];
+#define FIXED_T_ROW(N, i) FIXED_J##N(FIXED_T_ENTRY, N, i)
+#define FIXED_ID_ENTRY(N, i, j) e.m[(i) * N + (j)] = (i) == (j);
+#define FIXED_ID_ROW(N, i) FIXED_J##N(FIXED_ID_ENTRY, N, i)
+#define FIXED_DOT_TERM(N, i) + a.v[i] * b.v[i]
+
+// FIXED_DEFINE(N) defines struct matN, struct vecN and:
+//   matN_identity() returns the N x N identity matrix
+//   matN_multiply(a, b) returns a * b
+//   matN_transform(a, x) returns the vector a * x
+//   matN_transpose(a) returns the transpose of a
+//   vecN_dot(a, b) returns the dot product of a and b
+// time: O(1)
+#define FIXED_DEFINE(N) \
+    struct mat##N { float m[N * N]; }; \
+    struct vec##N { float v[N]; }; \
+    static inline struct mat##N mat##N##_identity(void) { \
+        struct mat##N e; \
+        FIXED_I##N(FIXED_ID_ROW, N) \
+        return e; \
+    } \
+    static inline struct mat##N mat##N##_multiply(struct mat##N a, struct mat##N b) { \
+        struct mat##N c; \
+        FIXED_I##N(FIXED_MUL_ROW, N) \
+        return c; \
+    } \
+    static inline struct vec##N mat##N##_transform(struct mat##N a, struct vec##N x) { \
+        struct vec##N y; \
+        FIXED_I##N(FIXED_MV_ENTRY, N) \
+        return y; \
+    } \
+    static inline struct mat##N mat##N##_transpose(struct mat##N a) { \
+        struct mat##N t; \
+        FIXED_I##N(FIXED_T_ROW, N) \
+        return t; \
+    } \
+    static inline float vec##N##_dot(struct vec##N a, struct vec##N b) { \
+        return 0 FIXED_I##N(FIXED_DOT_TERM, N); \
+    }
+
+FIXED_DEFINE(2)
+FIXED_DEFINE(3)
+FIXED_DEFINE(4)
+
+// matN_determinant(a) returns the determinant of a
+// time: O(1)
+static inline float mat2_determinant(struct mat2 a) {
+    return a.m[0] * a.m[3] - a.m[1] * a.m[2];
+}
+
+static inline float mat3_determinant(struct mat3 a) {
+    return a.m[0] * (a.m[4] * a.m[8] - a.m[5] * a.m[7])
+         - a.m[1] * (a.m[3] * a.m[8] - a.m[5] * a.m[6])
+         + a.m[2] * (a.m[3] * a.m[7] - a.m[4] * a.m[6]);
+}
+
+// The 4x4 determinant and inverse are expanded along 2x2 minors of the
+//   top two rows (s0..s5) and the bottom two rows (c0..c5).
+#define FIXED_MINORS4(a) \
+    float s0 = a.m[0] * a.m[5] - a.m[4] * a.m[1]; \
+    float s1 = a.m[0] * a.m[6] - a.m[4] * a.m[2]; \
+    float s2 = a.m[0] * a.m[7] - a.m[4] * a.m[3]; \
+    float s3 = a.m[1] * a.m[6] - a.m[5] * a.m[2]; \
+    float s4 = a.m[1] * a.m[7] - a.m[5] * a.m[3]; \
+    float s5 = a.m[2] * a.m[7] - a.m[6] * a.m[3]; \
+    float c5 = a.m[10] * a.m[15] - a.m[14] * a.m[11]; \
+    float c4 = a.m[9] * a.m[15] - a.m[13] * a.m[11]; \
+    float c3 = a.m[9] * a.m[14] - a.m[13] * a.m[10]; \
+    float c2 = a.m[8] * a.m[15] - a.m[12] * a.m[11]; \
+    float c1 = a.m[8] * a.m[14] - a.m[12] * a.m[10]; \
+    float c0 = a.m[8] * a.m[13] - a.m[12] * a.m[9]; \
+    float det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+
+static inline float mat4_determinant(struct mat4 a) {
+    FIXED_MINORS4(a)
+    return det;
+}
+
+// matN_inverse(a, inv) stores the inverse of a in *inv and returns true,
+//   or returns false (leaving *inv unchanged) if a is singular.
+// requires: inv is a valid pointer
+// time: O(1)
+static inline bool mat2_inverse(struct mat2 a, struct mat2 *inv) {
+    float det = mat2_determinant(a);
+    if (det == 0) {
+        return false;
+    }
+    float r = 1 / det;
+    struct mat2 b = {{a.m[3] * r, -a.m[1] * r, -a.m[2] * r, a.m[0] * r}};
+    *inv = b;
+    return true;
+}
+
+static inline bool mat3_inverse(struct mat3 a, struct mat3 *inv) {
+    float det = mat3_determinant(a);
+    if (det == 0) {
+        return false;
+    }
+    float r = 1 / det;
+    struct mat3 b = {{
+        (a.m[4] * a.m[8] - a.m[5] * a.m[7]) * r,
+        (a.m[2] * a.m[7] - a.m[1] * a.m[8]) * r,
+        (a.m[1] * a.m[5] - a.m[2] * a.m[4]) * r,
+        (a.m[5] * a.m[6] - a.m[3] * a.m[8]) * r,
+        (a.m[0] * a.m[8] - a.m[2] * a.m[6]) * r,
+        (a.m[2] * a.m[3] - a.m[0] * a.m[5]) * r,
+        (a.m[3] * a.m[7] - a.m[4] * a.m[6]) * r,
+        (a.m[1] * a.m[6] - a.m[0] * a.m[7]) * r,
+        (a.m[0] * a.m[4] - a.m[1] * a.m[3]) * r
+    }};
+    *inv = b;
+    return true;
+}
+
+static inline bool mat4_inverse(struct mat4 a, struct mat4 *inv) {
+    FIXED_MINORS4(a)
+    if (det == 0) {
+        return false;
+    }
+    float r = 1 / det;
+    struct mat4 b = {{
+        ( a.m[5] * c5 - a.m[6] * c4 + a.m[7] * c3) * r,
+        (-a.m[1] * c5 + a.m[2] * c4 - a.m[3] * c3) * r,
+        ( a.m[13] * s5 - a.m[14] * s4 + a.m[15] * s3) * r,
+        (-a.m[9] * s5 + a.m[10] * s4 - a.m[11] * s3) * r,
+        (-a.m[4] * c5 + a.m[6] * c2 - a.m[7] * c1) * r,
+        ( a.m[0] * c5 - a.m[2] * c2 + a.m[3] * c1) * r,
+        (-a.m[12] * s5 + a.m[14] * s2 - a.m[15] * s1) * r,
+        ( a.m[8] * s5 - a.m[10] * s2 + a.m[11] * s1) * r,
+        ( a.m[4] * c4 - a.m[5] * c2 + a.m[7] * c0) * r,
+        (-a.m[0] * c4 + a.m[1] * c2 - a.m[3] * c0) * r,
+        ( a.m[12] * s4 - a.m[13] * s2 + a.m[15] * s0) * r,
+        (-a.m[8] * s4 + a.m[9] * s2 - a.m[11] * s0) * r,
+        (-a.m[4] * c3 + a.m[5] * c1 - a.m[6] * c0) * r,
+        ( a.m[0] * c3 - a.m[1] * c1 + a.m[2] * c0) * r,
+        (-a.m[12] * s3 + a.m[13] * s1 - a.m[14] * s0) * r,
+        ( a.m[8] * s3 - a.m[9] * s1 + a.m[10] * s0) * r
+    }};
+    *inv = b;
+    return true;
+}
+
+// vec3_cross(a, b) returns the cross product of a and b
+// time: O(1)
+static inline struct vec3 vec3_cross(struct vec3 a, struct vec3 b) {
+    struct vec3 c = {{
+        a.v[1] * b.v[2] - a.v[2] * b.v[1],
+        a.v[2] * b.v[0] - a.v[0] * b.v[2],
+        a.v[0] * b.v[1] - a.v[1] * b.v[0]
+    }};
+    return c;
+}
+
+struct matrix;
+
+// matrix_to_matN(mat, out) copies mat into *out and returns true, or
+//   returns false if mat is not N x N.
+// matrix_to_vecN(mat, out) does the same for N x 1 matrices.
+// requires: mat and out are valid pointers
+// time: O(1)
+bool matrix_to_mat2(const struct matrix *mat, struct mat2 *out);
+bool matrix_to_mat3(const struct matrix *mat, struct mat3 *out);
+bool matrix_to_mat4(const struct matrix *mat, struct mat4 *out);
+bool matrix_to_vec2(const struct matrix *mat, struct vec2 *out);
+bool matrix_to_vec3(const struct matrix *mat, struct vec3 *out);
+bool matrix_to_vec4(const struct matrix *mat, struct vec4 *out);
+
+// matN_to_matrix(a) and vecN_to_matrix(x) return a struct matrix copy
+//   of a (resp. x).
+// effects: allocates memory (client must call destroy matrix)
+// time: O(1)
+struct matrix *mat2_to_matrix(struct mat2 a);
+struct matrix *mat3_to_matrix(struct mat3 a);
+struct matrix *mat4_to_matrix(struct mat4 a);
+struct matrix *vec2_to_matrix(struct vec2 x);
+struct matrix *vec3_to_matrix(struct vec3 x);
+struct matrix *vec4_to_matrix(struct vec4 x);
\ No newline at end of file
@@ -0,0 +1,456 @@
+#include <stdio.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HALF_X86
+#endif
+#include "linalg.h"
+#include "memtrack.h"
+#include "parallel.h"
+#include "half.h"
+#include "trace.h"
+
+// Rows of a product computed by one parallel_for range
+#define RANGE_ROWS 16
+
+// Entries converted to float at a time, into a buffer on the stack
+#define PIECE_ENTRIES 512
+
+// Partial sums of a dot product, which are independent, so they can be
+//   added in vector registers instead of one after the other
+#define DOT_LANES 16
+
+struct half_matrix {
+    size_t rows;
+    size_t columns;
+    enum half_format format;
+    uint16_t *entries;      // row by row
+};
+
+// fp16_from_float(value) rounds value to the nearest fp16 by adding to
+//   its bits: the carry out of the dropped bits rounds up, and through
+//   the exponent to infinity. Results that are subnormal in fp16 are
+//   rounded by a float addition that lines the value up with them.
+static uint16_t fp16_from_float(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = bits & 0x80000000u;
+    bits ^= sign;
+    uint16_t result;
+    if (bits >= (127u + 16) << 23) {
+        // too large (or infinite, or NaN)
+        result = bits > 0x7f800000u ? 0x7e00 : 0x7c00;
+    } else if (bits < (127u - 14) << 23) {
+        uint32_t magic_bits = (127u - 15 + 23 - 10 + 1) << 23;
+        float magic;
+        float f;
+        memcpy(&magic, &magic_bits, sizeof(magic));
+        memcpy(&f, &bits, sizeof(f));
+        f += magic;
+        memcpy(&bits, &f, sizeof(bits));
+        result = bits - magic_bits;
+    } else {
+        uint32_t odd = (bits >> 13) & 1;
+        bits += ((uint32_t)(15 - 127) << 23) + 0xfff + odd;
+        result = bits >> 13;
+    }
+    return result | (sign >> 16);
+}
+
+static float fp16_to_float(uint16_t value) {
+    uint32_t bits = (uint32_t)(value & 0x7fff) << 13;
+    uint32_t exponent = bits & (0x7c00u << 13);
+    bits += (uint32_t)(127 - 15) << 23;
+    if (exponent == 0x7c00u << 13) {
+        // infinity or NaN
+        bits += (uint32_t)(128 - 16) << 23;
+    } else if (!exponent) {
+        // zero or subnormal: renormalized by a float subtraction
+        uint32_t magic_bits = (127u - 14) << 23;
+        float magic;
+        float f;
+        bits += 1 << 23;
+        memcpy(&magic, &magic_bits, sizeof(magic));
+        memcpy(&f, &bits, sizeof(f));
+        f -= magic;
+        memcpy(&bits, &f, sizeof(bits));
+    }
+    bits |= (uint32_t)(value & 0x8000) << 16;
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+static uint16_t bf16_from_float(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    if ((bits & 0x7fffffffu) > 0x7f800000u) {
+        // NaN: keep it quiet rather than round it to infinity
+        return (bits >> 16) | 0x40;
+    }
+    bits += 0x7fff + ((bits >> 16) & 1);
+    return bits >> 16;
+}
+
+static float bf16_to_float(uint16_t value) {
+    uint32_t bits = (uint32_t)value << 16;
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+#ifdef HALF_X86
+// The instruction sets the processor has (bits of isa_flags())
+#define ISA_F16C 1
+#define ISA_AVX2 2
+#define ISA_AVX512 4
+
+static int isa_flags(void) {
+    static int flags = -1;  // accessed atomically
+    int value = __atomic_load_n(&flags, __ATOMIC_RELAXED);
+    if (value < 0) {
+        value = (__builtin_cpu_supports("f16c") ? ISA_F16C : 0) |
+                (__builtin_cpu_supports("avx2") ? ISA_AVX2 : 0) |
+                (__builtin_cpu_supports("avx512f") ? ISA_AVX512 : 0);
+        __atomic_store_n(&flags, value, __ATOMIC_RELAXED);
+    }
+    return value;
+}
+
+// The vector conversions below handle whole vectors of entries and
+//   return how many they converted; the scalar code does the rest.
+
+__attribute__((target("avx512f")))
+static size_t encode_avx512(const float *in, uint16_t *out, size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m512 x = _mm512_loadu_ps(in + i);
+        _mm256_storeu_si256((__m256i *)(out + i),
+                            _mm512_cvtps_ph(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    }
+    return i;
+}
+
+__attribute__((target("avx512f")))
+static size_t decode_avx512(const uint16_t *in, float *out, size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(in + i));
+        _mm512_storeu_ps(out + i, _mm512_cvtph_ps(x));
+    }
+    return i;
+}
+
+// bfloat16 is widened by a shift, so it needs no conversion instructions
+__attribute__((target("avx512f")))
+static size_t decode_bf16_avx512(const uint16_t *in, float *out, size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m512i x = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i *)(in + i)));
+        _mm512_storeu_si512(out + i, _mm512_slli_epi32(x, 16));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t decode_bf16_avx2(const uint16_t *in, float *out, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i x = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(in + i)));
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_slli_epi32(x, 16));
+    }
+    return i;
+}
+
+__attribute__((target("avx,f16c")))
+static size_t encode_f16c(const float *in, uint16_t *out, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 x = _mm256_loadu_ps(in + i);
+        _mm_storeu_si128((__m128i *)(out + i), _mm256_cvtps_ph(x, _MM_FROUND_TO_NEAREST_INT));
+    }
+    return i;
+}
+
+__attribute__((target("avx,f16c")))
+static size_t decode_f16c(const uint16_t *in, float *out, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+        _mm256_storeu_ps(out + i, _mm256_cvtph_ps(x));
+    }
+    return i;
+}
+#endif
+
+void half_encode(enum half_format format, const float *in, uint16_t *out, size_t count) {
+    assert(in);
+    assert(out);
+    size_t i = 0;
+    if (format == HALF_BF16) {
+        for (; i < count; ++i) {
+            out[i] = bf16_from_float(in[i]);
+        }
+        return;
+    }
+#ifdef HALF_X86
+    int isa = isa_flags();
+    if (isa & ISA_AVX512) {
+        i = encode_avx512(in, out, count);
+    } else if (isa & ISA_F16C) {
+        i = encode_f16c(in, out, count);
+    }
+#endif
+    for (; i < count; ++i) {
+        out[i] = fp16_from_float(in[i]);
+    }
+}
+
+void half_decode(enum half_format format, const uint16_t *in, float *out, size_t count) {
+    assert(in);
+    assert(out);
+    size_t i = 0;
+#ifdef HALF_X86
+    int isa = isa_flags();
+    if (format == HALF_BF16) {
+        if (isa & ISA_AVX512) {
+            i = decode_bf16_avx512(in, out, count);
+        } else if (isa & ISA_AVX2) {
+            i = decode_bf16_avx2(in, out, count);
+        }
+    } else if (isa & ISA_AVX512) {
+        i = decode_avx512(in, out, count);
+    } else if (isa & ISA_F16C) {
+        i = decode_f16c(in, out, count);
+    }
+#endif
+    for (; i < count; ++i) {
+        out[i] = format == HALF_BF16 ? bf16_to_float(in[i]) : fp16_to_float(in[i]);
+    }
+}
+
+struct half_matrix *half_from_matrix(const struct matrix *mat, enum half_format format) {
+    assert(mat);
+    size_t rows = matrix_rows(mat);
+    size_t columns = matrix_columns(mat);
+    TRACE_BEGIN("half_from_matrix", rows, columns);
+    struct half_matrix *h = mem_alloc(sizeof(struct half_matrix));
+    uint16_t *entries = h ? mem_alloc(rows * columns * sizeof(uint16_t)) : NULL;
+    if (!entries) {
+        mem_free(h, sizeof(struct half_matrix));
+        TRACE_END();
+        return NULL;
+    }
+    // row by row, so no float copy of mat is made
+    bool row_major = matrix_layout(mat) == LAYOUT_ROW_MAJOR;
+    float piece[PIECE_ENTRIES];
+    for (size_t i = 0; i < rows; ++i) {
+        uint16_t *row = entries + i * columns;
+        if (row_major) {
+            half_encode(format, matrix_row_data(mat, i), row, columns);
+            continue;
+        }
+        for (size_t start = 0; start < columns; start += PIECE_ENTRIES) {
+            size_t count = columns - start < PIECE_ENTRIES ? columns - start : PIECE_ENTRIES;
+            for (size_t j = 0; j < count; ++j) {
+                piece[j] = matrix_column_data(mat, start + j)[i];
+            }
+            half_encode(format, piece, row + start, count);
+        }
+    }
+    *h = (struct half_matrix){rows, columns, format, entries};
+    TRACE_END();
+    return h;
+}
+
+struct matrix *half_to_matrix(const struct half_matrix *h) {
+    assert(h);
+    float *floats = mem_alloc(h->rows * h->columns * sizeof(float));
+    if (!floats) {
+        return NULL;
+    }
+    half_decode(h->format, h->entries, floats, h->rows * h->columns);
+    struct matrix *mat = create_matrix(h->rows, h->columns, floats);
+    mem_free(floats, h->rows * h->columns * sizeof(float));
+    return mat;
+}
+
+void destroy_half(struct half_matrix *h) {
+    assert(h);
+    mem_free(h->entries, h->rows * h->columns * sizeof(uint16_t));
+    mem_free(h, sizeof(struct half_matrix));
+}
+
+size_t half_rows(const struct half_matrix *h) {
+    assert(h);
+    return h->rows;
+}
+
+size_t half_columns(const struct half_matrix *h) {
+    assert(h);
+    return h->columns;
+}
+
+enum half_format half_format(const struct half_matrix *h) {
+    assert(h);
+    return h->format;
+}
+
+struct half_product {
+    const struct half_matrix *h;
+    const float *x;             // of a vector product
+    const struct matrix *mat;   // of a matrix product
+    float *out;                 // row-major
+};
+
+// add_products(sums, a, b, count) adds the products of the count
+//   entries of a and b to the DOT_LANES partial sums in sums
+static void add_products(float *sums, const float *a, const float *b, size_t count) {
+    size_t j = 0;
+    for (; j + DOT_LANES <= count; j += DOT_LANES) {
+        for (int lane = 0; lane < DOT_LANES; ++lane) {
+            sums[lane] += a[j + lane] * b[j + lane];
+        }
+    }
+    for (; j < count; ++j) {
+        sums[j % DOT_LANES] += a[j] * b[j];
+    }
+}
+
+static float total(const float *sums) {
+    float sum = 0;
+    for (int lane = 0; lane < DOT_LANES; ++lane) {
+        sum += sums[lane];
+    }
+    return sum;
+}
+
+// vector_rows computes the entries of h * x for the rows in the ranges
+//   of RANGE_ROWS rows [begin, end)
+static void vector_rows(int begin, int end, void *ctx) {
+    struct half_product *product = ctx;
+    const struct half_matrix *h = product->h;
+    size_t last = (size_t)end * RANGE_ROWS < h->rows ? (size_t)end * RANGE_ROWS : h->rows;
+    float a[PIECE_ENTRIES];
+    for (size_t i = (size_t)begin * RANGE_ROWS; i < last; ++i) {
+        const uint16_t *row = h->entries + i * h->columns;
+        float sums[DOT_LANES] = {0};
+        for (size_t start = 0; start < h->columns; start += PIECE_ENTRIES) {
+            size_t count = h->columns - start < PIECE_ENTRIES ? h->columns - start : PIECE_ENTRIES;
+            half_decode(h->format, row + start, a, count);
+            add_products(sums, a, product->x + start, count);
+        }
+        product->out[i] = total(sums);
+    }
+}
+
+// multiply_rows computes the rows in the ranges of RANGE_ROWS rows
+//   [begin, end) of h * mat, reading mat in place: a row-major mat as
+//   sums of its rows, like the float kernel of matrix_multiplication,
+//   and a column-major one as dot products with its columns
+static void multiply_rows(int begin, int end, void *ctx) {
+    struct half_product *product = ctx;
+    const struct half_matrix *h = product->h;
+    const struct matrix *mat = product->mat;
+    size_t columns = matrix_columns(mat);
+    bool row_major = matrix_layout(mat) == LAYOUT_ROW_MAJOR;
+    size_t last = (size_t)end * RANGE_ROWS < h->rows ? (size_t)end * RANGE_ROWS : h->rows;
+    float a[PIECE_ENTRIES];
+    for (size_t i = (size_t)begin * RANGE_ROWS; i < last; ++i) {
+        float *out = product->out + i * columns;
+        for (size_t j = 0; j < columns; ++j) {
+            out[j] = 0;
+        }
+        for (size_t start = 0; start < h->columns; start += PIECE_ENTRIES) {
+            size_t count = h->columns - start < PIECE_ENTRIES ? h->columns - start : PIECE_ENTRIES;
+            half_decode(h->format, h->entries + i * h->columns + start, a, count);
+            for (size_t k = 0; row_major && k < count; ++k) {
+                const float *b = matrix_row_data(mat, start + k);
+                for (size_t j = 0; j < columns; ++j) {
+                    out[j] += a[k] * b[j];
+                }
+            }
+            for (size_t j = 0; !row_major && j < columns; ++j) {
+                float sums[DOT_LANES] = {0};
+                add_products(sums, a, matrix_column_data(mat, j) + start, count);
+                out[j] += total(sums);
+            }
+        }
+    }
+}
+
+// The entries of a product, which become those of the result matrix
+struct product_entries {
+    size_t bytes;
+    float entries[];
+};
+
+static void release_entries(void *ctx) {
+    struct product_entries *p = ctx;
+    mem_free(p, p->bytes);
+}
+
+void half_vector_product(const struct half_matrix *h, const float *x, float *y) {
+    assert(h);
+    assert(x);
+    assert(y);
+    TRACE_BEGIN("half_vector_product", h->rows, h->columns);
+    struct half_product product = {h, x, NULL, y};
+    parallel_for((h->rows + RANGE_ROWS - 1) / RANGE_ROWS, 1, vector_rows, &product);
+    TRACE_END();
+}
+
+struct matrix *half_multiply(const struct half_matrix *h, const struct matrix *mat) {
+    assert(h);
+    assert(mat);
+    if (h->columns != matrix_rows(mat)) {
+        fprintf(stderr, "Error: Matrix dimensions are not compatible\n");
+        return NULL;
+    }
+    size_t columns = matrix_columns(mat);
+    TRACE_BEGIN("half_multiply", h->rows, columns);
+    size_t bytes = sizeof(struct product_entries) + h->rows * columns * sizeof(float);
+    struct product_entries *p = mem_alloc(bytes);
+    struct matrix *result = NULL;
+    if (p) {
+        p->bytes = bytes;
+        struct half_product product = {h, NULL, mat, p->entries};
+        parallel_for((h->rows + RANGE_ROWS - 1) / RANGE_ROWS, 1, multiply_rows, &product);
+        // the matrix takes over the entries instead of copying them
+        result = create_matrix_borrowed(h->rows, columns, p->entries, LAYOUT_ROW_MAJOR,
+                                        release_entries, p);
+        if (!result) {
+            release_entries(p);
+        }
+    }
+    TRACE_END();
+    return result;
+}
+
+float half_dot_product(const struct half_matrix *h1, const struct half_matrix *h2) {
+    assert(h1);
+    assert(h2);
+    if (h1->columns != 1 || h2->columns != 1) {
+        fprintf(stderr, "Error: All matrices must be vectors (1 column)\n");
+        return NAN;
+    }
+    if (h1->rows != h2->rows) {
+        fprintf(stderr, "Error: Matrices are not same size\n");
+        return NAN;
+    }
+    float a[PIECE_ENTRIES];
+    float b[PIECE_ENTRIES];
+    float sums[DOT_LANES] = {0};
+    for (size_t start = 0; start < h1->rows; start += PIECE_ENTRIES) {
+        size_t count = h1->rows - start < PIECE_ENTRIES ? h1->rows - start : PIECE_ENTRIES;
+        half_decode(h1->format, h1->entries + start, a, count);
+        half_decode(h2->format, h2->entries + start, b, count);
+        add_products(sums, a, b, count);
+    }
+    return total(sums);
+}
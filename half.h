@@ -0,0 +1,83 @@
+// Matrices stored in 16-bit floating point and computed with in float.
+//   Half the bytes of a float matrix have to be read, which is what
+//   bounds products with large matrices; every sum is still accumulated
+//   in float. Entries are converted with F16C or AVX-512 instructions
+//   when the processor has them (checked at run time) and in portable C
+//   otherwise, with the same results.
+// time: n is # of rows, m is # of columns (as in linalg.h)
+//       p is # of columns of a dense operand
+// see linalg.h
+#include <stddef.h>
+#include <stdint.h>
+
+enum half_format {
+    HALF_FP16,      // IEEE binary16: 11 bits of precision, |x| <= 65504
+    HALF_BF16       // bfloat16 (the high half of a float): 8 bits of
+                    //   precision, the range of a float
+};
+
+// A row-major matrix of 16-bit entries
+struct half_matrix;
+
+// half_encode(format, in, out, count) rounds the count floats in to
+//   format (to nearest, ties to even) and stores them in out;
+//   half_decode(format, in, out, count) converts them back exactly
+// requires: in and out are valid pointers to count entries
+// notes: fp16 turns floats beyond its range into infinities
+// time: O(count)
+void half_encode(enum half_format format, const float *in, uint16_t *out, size_t count);
+void half_decode(enum half_format format, const uint16_t *in, float *out, size_t count);
+
+// half_from_matrix(mat, format) returns mat rounded to format, encoded
+//   row by row from the entries of mat (no float copy is made)
+// requires: mat is a valid pointer
+// notes: outputs an error message and returns NULL if out of memory
+// effects: may allocate memory (client must call destroy_half)
+//          may produce output
+// time: O(nm)
+struct half_matrix *half_from_matrix(const struct matrix *mat, enum half_format format);
+
+// half_to_matrix(h) returns h as a (row-major) float matrix
+// requires: h is a valid pointer
+// effects: may allocate memory (client must call destroy_matrix)
+// time: O(nm)
+struct matrix *half_to_matrix(const struct half_matrix *h);
+
+// destroy_half(h) frees all memory for h
+// requires: h is a valid pointer
+// effects: h is no longer valid
+// time: O(1)
+void destroy_half(struct half_matrix *h);
+
+// half_rows(h) returns n, half_columns(h) m, half_format(h) the format
+// requires: h is a valid pointer
+// time: O(1)
+size_t half_rows(const struct half_matrix *h);
+size_t half_columns(const struct half_matrix *h);
+enum half_format half_format(const struct half_matrix *h);
+
+// half_vector_product(h, x, y) stores h * x in y, where x is an array
+//   of m floats and y one of n floats
+// requires: h, x and y are valid pointers
+// time: O(nm)
+void half_vector_product(const struct half_matrix *h, const float *x, float *y);
+
+// half_multiply(h, mat) returns h * mat (row-major, in float). mat is
+//   read in place in either layout, and the result matrix is built on
+//   the buffer the product is computed in.
+// requires: h and mat are valid pointers
+// notes: outputs an error message and returns NULL if the columns of h
+//   do not match the rows of mat
+// effects: may allocate memory (client must call destroy_matrix)
+//          may produce output
+// time: O(nmp)
+struct matrix *half_multiply(const struct half_matrix *h, const struct matrix *mat);
+
+// half_dot_product(h1, h2) returns the dot product of the vectors h1
+//   and h2 (which may have different formats)
+// requires: h1 and h2 are valid pointers
+// notes: outputs an error message and returns NAN if h1 or h2 is not a
+//   vector (1 column) or they are not the same size
+// effects: may produce output
+// time: O(n)
+float half_dot_product(const struct half_matrix *h1, const struct half_matrix *h2);
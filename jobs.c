@@ -0,0 +1,261 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "jobs.h"
+
+struct job {
+    int id;
+    char name[32];
+    enum job_status status;
+    bool cancelled;
+    job_fn run;
+    job_fn complete;
+    job_fn release;
+    void *arg;
+};
+
+struct job_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t work;      // signalled when a job is queued or on shutdown
+    pthread_cond_t finished;  // signalled when a job leaves the running state
+    bool shutdown;
+    struct job **jobs;        // jobs[id - 1]
+    int len;
+    int maxlen;
+    int next;                 // no job before this index is queued
+    int threads;
+    pthread_t *workers;
+};
+
+static const char *status_names[] = {"queued", "running", "done", "cancelled"};
+
+// next_queued(pool) returns the oldest queued job or NULL
+// requires: pool->lock is held
+static struct job *next_queued(struct job_pool *pool) {
+    while (pool->next < pool->len && pool->jobs[pool->next]->status != JOB_QUEUED) {
+        ++pool->next;
+    }
+    return pool->next < pool->len ? pool->jobs[pool->next] : NULL;
+}
+
+static void *worker(void *data) {
+    struct job_pool *pool = data;
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        struct job *job = next_queued(pool);
+        if (!job) {
+            if (pool->shutdown) {
+                break;
+            }
+            pthread_cond_wait(&pool->work, &pool->lock);
+            continue;
+        }
+        job->status = JOB_RUNNING;
+        pthread_mutex_unlock(&pool->lock);
+        job->run(job->arg);
+        pthread_mutex_lock(&pool->lock);
+        if (job->cancelled) {
+            job->status = JOB_CANCELLED;
+            pthread_mutex_unlock(&pool->lock);
+            job->release(job->arg);
+            job->arg = NULL;
+            pthread_mutex_lock(&pool->lock);
+        } else {
+            // complete runs under the pool lock so that a concurrent
+            //   cancel cannot observe a half-published result
+            if (job->complete) {
+                job->complete(job->arg);
+            }
+            job->status = JOB_DONE;
+        }
+        pthread_cond_broadcast(&pool->finished);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// stop_workers(pool, started) stops and joins the first started workers
+static void stop_workers(struct job_pool *pool, int started) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < started; ++i) {
+        pthread_join(pool->workers[i], NULL);
+    }
+}
+
+// free_pool(pool) frees pool and what it owns, but not its jobs
+static void free_pool(struct job_pool *pool) {
+    pthread_cond_destroy(&pool->finished);
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool->jobs);
+    free(pool);
+}
+
+struct job_pool *jobpool_create(int threads) {
+    assert(threads > 0);
+    struct job_pool *pool = malloc(sizeof(struct job_pool));
+    if (!pool) {
+        fprintf(stderr, "Error: out of memory\n");
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->finished, NULL);
+    pool->shutdown = false;
+    pool->len = 0;
+    pool->maxlen = 8;
+    pool->jobs = malloc(pool->maxlen * sizeof(struct job *));
+    pool->next = 0;
+    pool->threads = threads;
+    pool->workers = malloc(threads * sizeof(pthread_t));
+    if (!pool->jobs || !pool->workers) {
+        fprintf(stderr, "Error: out of memory\n");
+        free_pool(pool);
+        return NULL;
+    }
+    for (int i = 0; i < threads; ++i) {
+        int error = pthread_create(&pool->workers[i], NULL, worker, pool);
+        if (error) {
+            fprintf(stderr, "Error: cannot start a worker thread: %s\n", strerror(error));
+            stop_workers(pool, i);
+            free_pool(pool);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+void jobpool_destroy(struct job_pool *pool) {
+    assert(pool);
+    pthread_mutex_lock(&pool->lock);
+    for (int i = 0; i < pool->len; ++i) {
+        if (pool->jobs[i]->status == JOB_QUEUED) {
+            pool->jobs[i]->status = JOB_CANCELLED;
+            pool->jobs[i]->release(pool->jobs[i]->arg);
+            pool->jobs[i]->arg = NULL;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    stop_workers(pool, pool->threads);
+    for (int i = 0; i < pool->len; ++i) {
+        if (pool->jobs[i]->arg) {
+            pool->jobs[i]->release(pool->jobs[i]->arg);
+        }
+        free(pool->jobs[i]);
+    }
+    free_pool(pool);
+}
+
+int jobpool_submit(struct job_pool *pool, const char *name, job_fn run,
+                   job_fn complete, job_fn release, void *arg) {
+    assert(pool);
+    assert(name);
+    assert(run);
+    assert(release);
+    struct job *job = malloc(sizeof(struct job));
+    if (!job) {
+        fprintf(stderr, "Error: out of memory\n");
+        return -1;
+    }
+    strncpy(job->name, name, sizeof(job->name) - 1);
+    job->name[sizeof(job->name) - 1] = '\0';
+    job->status = JOB_QUEUED;
+    job->cancelled = false;
+    job->run = run;
+    job->complete = complete;
+    job->release = release;
+    job->arg = arg;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->len == pool->maxlen) {
+        struct job **jobs = realloc(pool->jobs, 2 * pool->maxlen * sizeof(struct job *));
+        if (!jobs) {
+            pthread_mutex_unlock(&pool->lock);
+            fprintf(stderr, "Error: out of memory\n");
+            free(job);
+            return -1;
+        }
+        pool->jobs = jobs;
+        pool->maxlen *= 2;
+    }
+    pool->jobs[pool->len] = job;
+    ++pool->len;
+    job->id = pool->len;
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    return job->id;
+}
+
+// find_job(pool, id) returns the job with the given id or NULL
+// requires: pool->lock is held
+static struct job *find_job(struct job_pool *pool, int id) {
+    if (id < 1 || id > pool->len) {
+        fprintf(stderr, "Error: There is no job with that id\n");
+        return NULL;
+    }
+    return pool->jobs[id - 1];
+}
+
+int jobpool_wait(struct job_pool *pool, int id, void **arg) {
+    assert(pool);
+    assert(arg);
+    pthread_mutex_lock(&pool->lock);
+    struct job *job = find_job(pool, id);
+    if (!job) {
+        pthread_mutex_unlock(&pool->lock);
+        *arg = NULL;
+        return -1;
+    }
+    while (job->status == JOB_QUEUED || job->status == JOB_RUNNING) {
+        pthread_cond_wait(&pool->finished, &pool->lock);
+    }
+    int status = job->status;
+    *arg = status == JOB_DONE ? job->arg : NULL;
+    pthread_mutex_unlock(&pool->lock);
+    return status;
+}
+
+int jobpool_cancel(struct job_pool *pool, int id) {
+    assert(pool);
+    pthread_mutex_lock(&pool->lock);
+    struct job *job = find_job(pool, id);
+    if (!job) {
+        pthread_mutex_unlock(&pool->lock);
+        return -1;
+    }
+    int status = job->status;
+    if (status == JOB_QUEUED) {
+        job->status = JOB_CANCELLED;
+        job->release(job->arg);
+        job->arg = NULL;
+        pthread_cond_broadcast(&pool->finished);
+    } else if (status == JOB_RUNNING) {
+        job->cancelled = true;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return status;
+}
+
+void jobpool_print(struct job_pool *pool) {
+    assert(pool);
+    pthread_mutex_lock(&pool->lock);
+    if (pool->len == 0) {
+        printf("[No jobs]\n");
+    }
+    for (int i = 0; i < pool->len; ++i) {
+        struct job *job = pool->jobs[i];
+        const char *status = status_names[job->status];
+        if (job->status == JOB_RUNNING && job->cancelled) {
+            status = "cancelling";
+        }
+        printf("%d) %-10s\t%s\n", job->id, status, job->name);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
\ No newline at end of file
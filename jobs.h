@@ -0,0 +1,79 @@
+// time: j is the number of jobs submitted to the pool
+// see linalg.h
+
+// A job pool runs submitted jobs on a fixed set of worker threads.
+//   Every job gets an id (starting at 1) that can be used to wait on
+//   or cancel it.
+struct job_pool;
+
+enum job_status {
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_DONE,
+    JOB_CANCELLED
+};
+
+// A job is described by three callbacks that all receive the same arg:
+//   run(arg) does the work on a worker thread
+//   complete(arg) is called on the worker thread after run if the job
+//     was not cancelled in the meantime (e.g. to publish the result)
+//   release(arg) frees arg; it is called when the job is cancelled
+//     before it finishes, or when the pool is destroyed
+typedef void (*job_fn)(void *arg);
+
+// jobpool_create(threads) returns a pool with threads worker threads.
+// requires: threads > 0
+// notes: outputs an error message and returns NULL if out of memory or
+//   a thread cannot be started
+// effects: may allocate memory (client must call jobpool_destroy)
+//          may start threads
+//          may produce output
+// time: O(threads)
+struct job_pool *jobpool_create(int threads);
+
+// jobpool_destroy(pool) cancels all queued jobs, waits for the running
+//   jobs to finish, releases every job and frees pool.
+// requires: pool is a valid pointer
+// effects: pool is no longer valid
+// time: O(j) plus the time to finish the running jobs
+void jobpool_destroy(struct job_pool *pool);
+
+// jobpool_submit(pool, name, run, complete, release, arg) queues a job
+//   and returns its id immediately.
+// requires: pool, name, run and release are valid pointers
+//           complete may be NULL
+// notes: outputs an error message and returns -1 if out of memory;
+//   the job is then not queued and arg is not released
+// effects: may allocate memory
+//          may produce output
+// time: O(1) amortized
+int jobpool_submit(struct job_pool *pool, const char *name, job_fn run,
+                   job_fn complete, job_fn release, void *arg);
+
+// jobpool_wait(pool, id, arg) blocks until the job with the given id
+//   has finished or was cancelled and returns its final status.
+//   If the job is JOB_DONE, *arg is set to the arg it was submitted with
+//   (it stays valid until the pool is destroyed), otherwise to NULL.
+// requires: pool and arg are valid pointers
+// notes: outputs an error message and returns -1 if there is no job
+//   with that id
+// effects: may produce output
+// time: O(1) plus the time to finish the job
+int jobpool_wait(struct job_pool *pool, int id, void **arg);
+
+// jobpool_cancel(pool, id) cancels the job with the given id.
+//   A queued job is released immediately and never runs. A running job
+//   keeps running, but its result is discarded (complete is not called).
+//   Returns the status of the job before it was cancelled.
+// requires: pool is a valid pointer
+// notes: outputs an error message and returns -1 if there is no job
+//   with that id
+// effects: may produce output
+// time: O(1)
+int jobpool_cancel(struct job_pool *pool, int id);
+
+// jobpool_print(pool) prints the id, status and name of every job
+// requires: pool is a valid pointer
+// effects: produces output
+// time: O(j)
+void jobpool_print(struct job_pool *pool);
\ No newline at end of file
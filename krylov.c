@@ -0,0 +1,474 @@
+#include <stdio.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "linalg.h"
+#include "krylov.h"
+#include "memtrack.h"
+
+static void matrix_apply(const float *x, float *y, void *ctx) {
+    matrix_vector_product(ctx, x, y);
+}
+
+struct linop linop_matrix(const struct matrix *mat) {
+    assert(mat);
+    assert(matrix_rows(mat) == matrix_columns(mat));
+    struct linop op = {matrix_rows(mat), matrix_apply, (void *)mat};
+    return op;
+}
+
+// A preconditioner and its data live in one block of bytes bytes that
+//   starts with a struct precond_head: the Jacobi one is followed by its
+//   n floats, the ILU(0) one by its factors in compressed sparse row
+//   form.
+struct precond_head {
+    struct krylov_precond precond;
+    size_t bytes;
+};
+
+struct precond_data {
+    struct precond_head head;
+    int n;
+    float *values;
+};
+
+static void jacobi_apply(const float *r, float *z, void *ctx) {
+    struct precond_data *data = ctx;
+    for (int i = 0; i < data->n; ++i) {
+        z[i] = r[i] * data->values[i];
+    }
+}
+
+struct krylov_precond *precond_jacobi(const struct matrix *mat) {
+    assert(mat);
+    assert(matrix_rows(mat) == matrix_columns(mat));
+    int n = matrix_rows(mat);
+    size_t bytes = sizeof(struct precond_data) + n * sizeof(float);
+    struct precond_data *data = mem_alloc(bytes);
+    if (!data) {
+        return NULL;
+    }
+    data->head = (struct precond_head){{jacobi_apply, data}, bytes};
+    data->n = n;
+    data->values = (float *)(data + 1);
+    for (int i = 0; i < n; ++i) {
+        float diag = matrix_get(mat, i, i);
+        if (!diag) {
+            fprintf(stderr, "Error: Jacobi preconditioner needs a nonzero diagonal\n");
+            mem_free(data, bytes);
+            return NULL;
+        }
+        data->values[i] = 1 / diag;
+    }
+    return &data->head.precond;
+}
+
+// The ILU(0) factors, stored like A in compressed sparse row form:
+//   row i has the entries start[i]..start[i + 1] - 1 of column and
+//   values, in increasing column order; diag[i] is the position of its
+//   diagonal entry. L (unit lower, not stored) and U share the pattern.
+struct ilu0 {
+    struct precond_head head;
+    int n;
+    float *values;
+    int *column;
+    int *start;
+    int *diag;
+};
+
+// ilu0_apply solves L U z = r in O(nnz)
+static void ilu0_apply(const float *r, float *z, void *ctx) {
+    const struct ilu0 *f = ctx;
+    for (int i = 0; i < f->n; ++i) {
+        float sum = r[i];
+        for (int p = f->start[i]; p < f->diag[i]; ++p) {
+            sum -= f->values[p] * z[f->column[p]];
+        }
+        z[i] = sum;
+    }
+    for (int i = f->n - 1; i >= 0; --i) {
+        float sum = z[i];
+        for (int p = f->diag[i] + 1; p < f->start[i + 1]; ++p) {
+            sum -= f->values[p] * z[f->column[p]];
+        }
+        z[i] = sum / f->values[f->diag[i]];
+    }
+}
+
+// ilu0_pattern(mat, n) returns the factors of mat with its nonzero
+//   pattern and entries, or NULL if out of memory or a diagonal entry
+//   is zero (so it is not in the pattern)
+static struct ilu0 *ilu0_pattern(const struct matrix *mat, int n) {
+    size_t nonzeros = 0;
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            nonzeros += matrix_get(mat, i, j) != 0;
+        }
+    }
+    size_t bytes = sizeof(struct ilu0) + nonzeros * (sizeof(float) + sizeof(int)) +
+                   (2 * (size_t)n + 1) * sizeof(int);
+    struct ilu0 *f = mem_alloc(bytes);
+    if (!f) {
+        return NULL;
+    }
+    f->head = (struct precond_head){{ilu0_apply, f}, bytes};
+    f->n = n;
+    f->values = (float *)(f + 1);
+    f->column = (int *)(f->values + nonzeros);
+    f->start = f->column + nonzeros;
+    f->diag = f->start + n + 1;
+    int p = 0;
+    for (int i = 0; i < n; ++i) {
+        f->start[i] = p;
+        f->diag[i] = -1;
+        for (int j = 0; j < n; ++j) {
+            float entry = matrix_get(mat, i, j);
+            if (entry) {
+                f->diag[i] = j == i ? p : f->diag[i];
+                f->values[p] = entry;
+                f->column[p++] = j;
+            }
+        }
+        if (f->diag[i] < 0) {
+            fprintf(stderr, "Error: ILU(0) preconditioner hit a zero pivot\n");
+            mem_free(f, bytes);
+            return NULL;
+        }
+    }
+    f->start[n] = p;
+    return f;
+}
+
+struct krylov_precond *precond_ilu0(const struct matrix *mat) {
+    assert(mat);
+    assert(matrix_rows(mat) == matrix_columns(mat));
+    int n = matrix_rows(mat);
+    struct ilu0 *f = ilu0_pattern(mat, n);
+    // position[j] is where column j is in the current row, or -1
+    int *position = f ? mem_alloc(n * sizeof(int)) : NULL;
+    if (!position) {
+        if (f) {
+            mem_free(f, f->head.bytes);
+        }
+        return NULL;
+    }
+    for (int j = 0; j < n; ++j) {
+        position[j] = -1;
+    }
+    // row i is reduced by the rows k < i in its pattern; updates only
+    //   land on entries in the pattern (no fill-in), whatever their value
+    //   is at the time, so the pattern is the structure of mat
+    bool singular = false;
+    for (int i = 0; i < n && !singular; ++i) {
+        for (int p = f->start[i]; p < f->start[i + 1]; ++p) {
+            position[f->column[p]] = p;
+        }
+        for (int p = f->start[i]; p < f->diag[i]; ++p) {
+            int k = f->column[p];
+            float l = f->values[p] /= f->values[f->diag[k]];
+            for (int q = f->diag[k] + 1; q < f->start[k + 1]; ++q) {
+                int at = position[f->column[q]];
+                if (at >= 0) {
+                    f->values[at] -= l * f->values[q];
+                }
+            }
+        }
+        for (int p = f->start[i]; p < f->start[i + 1]; ++p) {
+            position[f->column[p]] = -1;
+        }
+        singular = !f->values[f->diag[i]];
+    }
+    mem_free(position, n * sizeof(int));
+    if (singular) {
+        fprintf(stderr, "Error: ILU(0) preconditioner hit a zero pivot\n");
+        mem_free(f, f->head.bytes);
+        return NULL;
+    }
+    return &f->head.precond;
+}
+
+void precond_destroy(struct krylov_precond *precond) {
+    assert(precond);
+    // precond is the first member of the head of its block
+    struct precond_head *head = (struct precond_head *)precond;
+    mem_free(head, head->bytes);
+}
+
+// dot(n, x, y) returns x . y, accumulated in double
+static float dot(int n, const float *x, const float *y) {
+    double sum = 0;
+    for (int i = 0; i < n; ++i) {
+        sum += (double)x[i] * y[i];
+    }
+    return sum;
+}
+
+static float norm(int n, const float *x) {
+    return sqrt(dot(n, x, x));
+}
+
+// axpy(n, a, x, y) stores y + a x in y
+static void axpy(int n, float a, const float *x, float *y) {
+    for (int i = 0; i < n; ++i) {
+        y[i] += a * x[i];
+    }
+}
+
+// precondition(opts, n, r, z) stores M^-1 r in z (z = r without M)
+static void precondition(const struct krylov_options *opts, int n, const float *r, float *z) {
+    if (opts->precond) {
+        opts->precond->apply(r, z, opts->precond->ctx);
+    } else {
+        memcpy(z, r, n * sizeof(float));
+    }
+}
+
+// residual(op, b, x, r) stores b - A x in r
+static void residual(const struct linop *op, const float *b, const float *x, float *r) {
+    op->apply(x, r, op->ctx);
+    for (int i = 0; i < op->n; ++i) {
+        r[i] = b[i] - r[i];
+    }
+}
+
+// record(opts, result, res) stores the relative residual of the current
+//   iteration and returns true if it is below the tolerance
+static bool record(const struct krylov_options *opts, struct krylov_result *result, float res) {
+    result->residual = res;
+    if (opts->history) {
+        opts->history[result->iterations] = res;
+    }
+    result->converged = res <= opts->tol;
+    return result->converged;
+}
+
+static void check_args(const struct linop *op, const float *b, float *x,
+                       const struct krylov_options *opts) {
+    assert(op);
+    assert(b);
+    assert(x);
+    assert(opts);
+    assert(opts->tol > 0);
+    assert(opts->max_iter >= 0);
+}
+
+struct krylov_result krylov_cg(const struct linop *op, const float *b, float *x,
+                               const struct krylov_options *opts) {
+    check_args(op, b, x, opts);
+    int n = op->n;
+    struct krylov_result result = {0, 0, false};
+    float bnorm = norm(n, b);
+    if (bnorm == 0) {
+        bnorm = 1;
+    }
+    float *work = mem_alloc(4 * n * sizeof(float));
+    if (!work) {
+        result.residual = NAN;
+        return result;
+    }
+    float *r = work;
+    float *z = r + n;
+    float *p = z + n;
+    float *ap = p + n;
+    residual(op, b, x, r);
+    if (!record(opts, &result, norm(n, r) / bnorm)) {
+        precondition(opts, n, r, z);
+        memcpy(p, z, n * sizeof(float));
+        float rz = dot(n, r, z);
+        while (result.iterations < opts->max_iter) {
+            op->apply(p, ap, op->ctx);
+            float pap = dot(n, p, ap);
+            if (pap == 0) {
+                break;
+            }
+            float alpha = rz / pap;
+            axpy(n, alpha, p, x);
+            axpy(n, -alpha, ap, r);
+            ++result.iterations;
+            if (record(opts, &result, norm(n, r) / bnorm)) {
+                break;
+            }
+            precondition(opts, n, r, z);
+            float rz_next = dot(n, r, z);
+            float beta = rz_next / rz;
+            rz = rz_next;
+            for (int i = 0; i < n; ++i) {
+                p[i] = z[i] + beta * p[i];
+            }
+        }
+    }
+    mem_free(work, 4 * n * sizeof(float));
+    return result;
+}
+
+struct krylov_result krylov_gmres(const struct linop *op, const float *b, float *x,
+                                  const struct krylov_options *opts) {
+    check_args(op, b, x, opts);
+    assert(opts->restart > 0);
+    int n = op->n;
+    int m = opts->restart;
+    struct krylov_result result = {0, 0, false};
+    float bnorm = norm(n, b);
+    if (bnorm == 0) {
+        bnorm = 1;
+    }
+    // basis (m + 1 vectors), two scratch vectors, the Hessenberg matrix
+    //   (column j at h + j * (m + 1)), Givens rotations, rhs and solution
+    int total = (m + 1) * n + 2 * n + (m + 1) * m + 2 * m + (m + 1) + m;
+    float *work = mem_alloc(total * sizeof(float));
+    if (!work) {
+        result.residual = NAN;
+        return result;
+    }
+    float *v = work;
+    float *w = v + (m + 1) * n;
+    float *z = w + n;
+    float *h = z + n;
+    float *cs = h + (m + 1) * m;
+    float *sn = cs + m;
+    float *g = sn + m;
+    float *y = g + m + 1;
+    residual(op, b, x, v);
+    float beta = norm(n, v);
+    if (!record(opts, &result, beta / bnorm)) {
+        while (result.iterations < opts->max_iter) {
+            for (int i = 0; i < n; ++i) {
+                v[i] /= beta;
+            }
+            memset(g, 0, (m + 1) * sizeof(float));
+            g[0] = beta;
+            int j = 0;
+            bool done = false;
+            while (j < m && !done && result.iterations < opts->max_iter) {
+                float *col = h + j * (m + 1);
+                precondition(opts, n, v + j * n, z);
+                op->apply(z, w, op->ctx);
+                for (int i = 0; i <= j; ++i) {
+                    col[i] = dot(n, w, v + i * n);
+                    axpy(n, -col[i], v + i * n, w);
+                }
+                float next = norm(n, w);
+                col[j + 1] = next;
+                if (next != 0) {
+                    for (int i = 0; i < n; ++i) {
+                        v[(j + 1) * n + i] = w[i] / next;
+                    }
+                }
+                for (int i = 0; i < j; ++i) {
+                    float t = cs[i] * col[i] + sn[i] * col[i + 1];
+                    col[i + 1] = -sn[i] * col[i] + cs[i] * col[i + 1];
+                    col[i] = t;
+                }
+                float r = hypot(col[j], col[j + 1]);
+                cs[j] = r == 0 ? 1 : col[j] / r;
+                sn[j] = r == 0 ? 0 : col[j + 1] / r;
+                col[j] = r;
+                col[j + 1] = 0;
+                g[j + 1] = -sn[j] * g[j];
+                g[j] = cs[j] * g[j];
+                ++j;
+                ++result.iterations;
+                // next == 0 means the Krylov space is invariant, so the
+                //   solution in it is exact
+                done = record(opts, &result, fabs(g[j]) / bnorm) || next == 0;
+            }
+            for (int i = j - 1; i >= 0; --i) {
+                float sum = g[i];
+                for (int k = i + 1; k < j; ++k) {
+                    sum -= h[k * (m + 1) + i] * y[k];
+                }
+                y[i] = h[i * (m + 1) + i] ? sum / h[i * (m + 1) + i] : 0;
+            }
+            memset(w, 0, n * sizeof(float));
+            for (int i = 0; i < j; ++i) {
+                axpy(n, y[i], v + i * n, w);
+            }
+            precondition(opts, n, w, z);
+            axpy(n, 1, z, x);
+            if (done) {
+                break;
+            }
+            // the true residual also guards against drift in g
+            residual(op, b, x, v);
+            beta = norm(n, v);
+            if (record(opts, &result, beta / bnorm) || beta == 0) {
+                break;
+            }
+        }
+    }
+    mem_free(work, total * sizeof(float));
+    return result;
+}
+
+struct krylov_result krylov_bicgstab(const struct linop *op, const float *b, float *x,
+                                     const struct krylov_options *opts) {
+    check_args(op, b, x, opts);
+    int n = op->n;
+    struct krylov_result result = {0, 0, false};
+    float bnorm = norm(n, b);
+    if (bnorm == 0) {
+        bnorm = 1;
+    }
+    float *work = mem_alloc(7 * n * sizeof(float));
+    if (!work) {
+        result.residual = NAN;
+        return result;
+    }
+    float *r = work;
+    float *rhat = r + n;
+    float *p = rhat + n;
+    float *v = p + n;
+    float *s = v + n;
+    float *t = s + n;
+    float *z = t + n;
+    residual(op, b, x, r);
+    if (!record(opts, &result, norm(n, r) / bnorm)) {
+        memcpy(rhat, r, n * sizeof(float));
+        memset(p, 0, n * sizeof(float));
+        memset(v, 0, n * sizeof(float));
+        float rho = 1;
+        float alpha = 1;
+        float omega = 1;
+        while (result.iterations < opts->max_iter) {
+            float rho_next = dot(n, rhat, r);
+            if (rho_next == 0 || omega == 0) {
+                break;
+            }
+            float beta = (rho_next / rho) * (alpha / omega);
+            rho = rho_next;
+            for (int i = 0; i < n; ++i) {
+                p[i] = r[i] + beta * (p[i] - omega * v[i]);
+            }
+            precondition(opts, n, p, z);
+            op->apply(z, v, op->ctx);
+            float rv = dot(n, rhat, v);
+            if (rv == 0) {
+                break;
+            }
+            alpha = rho / rv;
+            axpy(n, alpha, z, x);
+            for (int i = 0; i < n; ++i) {
+                s[i] = r[i] - alpha * v[i];
+            }
+            ++result.iterations;
+            if (record(opts, &result, norm(n, s) / bnorm)) {
+                break;
+            }
+            precondition(opts, n, s, z);
+            op->apply(z, t, op->ctx);
+            float tt = dot(n, t, t);
+            omega = tt == 0 ? 0 : dot(n, t, s) / tt;
+            axpy(n, omega, z, x);
+            for (int i = 0; i < n; ++i) {
+                r[i] = s[i] - omega * t[i];
+            }
+            if (record(opts, &result, norm(n, r) / bnorm)) {
+                break;
+            }
+        }
+    }
+    mem_free(work, 7 * n * sizeof(float));
+    return result;
+}
\ No newline at end of file
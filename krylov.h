@@ -0,0 +1,107 @@
+// Iterative (Krylov subspace) solvers for A x = b.
+// time: n is the size of the system
+//       k is the number of iterations
+//       T(A) is the time of one product with A
+// see linalg.h
+
+// A linear operator on vectors of length n: apply(x, y, ctx) stores
+//   A x in y. The solvers only ever use A through apply, so A does not
+//   have to be stored as a struct matrix.
+struct linop {
+    int n;
+    void (*apply)(const float *x, float *y, void *ctx);
+    void *ctx;
+};
+
+// A preconditioner M ~ A: apply(r, z, ctx) stores M^-1 r in z.
+struct krylov_precond {
+    void (*apply)(const float *r, float *z, void *ctx);
+    void *ctx;
+};
+
+struct krylov_options {
+    float tol;           // stop once ||b - A x|| <= tol * ||b||
+    int max_iter;        // stop after this many iterations
+    int restart;         // GMRES only: Krylov basis size before a restart
+    const struct krylov_precond *precond;  // NULL for none
+    float *history;      // NULL, or room for max_iter + 1 relative
+                         //   residuals (history[i] is after iteration i)
+};
+
+struct krylov_result {
+    int iterations;
+    float residual;      // final ||b - A x|| / ||b||
+    bool converged;
+};
+
+// linop_matrix(mat) returns the operator x -> mat * x
+// requires: mat is a valid pointer to a square matrix that outlives
+//   the returned operator
+// time: O(1)
+struct linop linop_matrix(const struct matrix *mat);
+
+// precond_jacobi(mat) returns the Jacobi (diagonal) preconditioner of mat
+// requires: mat is a valid pointer to a square matrix
+// notes: outputs an error message and returns NULL if out of memory
+//   (see memtrack.h) or a diagonal entry of mat is zero
+// effects: may allocate memory (client must call precond_destroy)
+//          may produce output
+// time: O(n)
+struct krylov_precond *precond_jacobi(const struct matrix *mat);
+
+// precond_ilu0(mat) returns the ILU(0) preconditioner of mat: an
+//   incomplete LU factorization that keeps exactly the nonzero pattern
+//   of mat (no fill-in). The factors are stored in compressed sparse
+//   row form with that pattern, so they take O(nnz) memory, where nnz
+//   is # of nonzero entries of mat.
+// requires: mat is a valid pointer to a square matrix
+// notes: outputs an error message and returns NULL if out of memory
+//   (see memtrack.h), a diagonal entry of mat is zero or a zero pivot comes up during the
+//   factorization
+// effects: may allocate memory (client must call precond_destroy)
+//          may produce output
+// time: O(n^2) to read mat plus O(nnz * r) to factor, where r is the
+//       most nonzero entries in a row; O(nnz) to apply
+struct krylov_precond *precond_ilu0(const struct matrix *mat);
+
+// precond_destroy(precond) frees a preconditioner returned by
+//   precond_jacobi or precond_ilu0
+// requires: precond is a valid pointer
+// effects: precond is no longer valid
+// time: O(1)
+void precond_destroy(struct krylov_precond *precond);
+
+// The solvers below improve the initial guess in x (all zeros is a
+//   fine default) until the relative residual drops below opts->tol or
+//   opts->max_iter iterations are done, and report how it went. Each
+//   solver allocates all of its workspace in one block up front.
+// requires: op, b, x and opts are valid pointers
+//           b and x have op->n entries
+//           opts->tol > 0, opts->max_iter >= 0
+// notes: if the workspace cannot be allocated (see memtrack.h), an
+//   error message is output, x is left as it is and the result has no
+//   iterations and a NAN residual
+// effects: modifies x
+//          allocates and frees memory
+//          may produce output
+
+// krylov_cg(op, b, x, opts) runs the (preconditioned) conjugate
+//   gradient method.
+// requires: A and M are symmetric positive definite
+// time: O(k (n + T(A)))
+struct krylov_result krylov_cg(const struct linop *op, const float *b, float *x,
+                               const struct krylov_options *opts);
+
+// krylov_gmres(op, b, x, opts) runs restarted GMRES with right
+//   preconditioning; every opts->restart iterations the Krylov basis is
+//   thrown away and rebuilt from the current residual.
+// requires: opts->restart > 0
+// time: O(k (n * restart + T(A)))
+struct krylov_result krylov_gmres(const struct linop *op, const float *b, float *x,
+                                  const struct krylov_options *opts);
+
+// krylov_bicgstab(op, b, x, opts) runs BiCGSTAB with right
+//   preconditioning; it works for nonsymmetric A.
+// time: O(k (n + T(A)))
+struct krylov_result krylov_bicgstab(const struct linop *op, const float *b, float *x,
+                                     const struct krylov_options *opts);
\ No newline at end of file
@@ -1,49 +1,744 @@
+#define _DEFAULT_SOURCE
 #include <stdio.h>
 #include <assert.h>
+#include <float.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <sys/mman.h>
 #include "linalg.h"
+#include "fixed.h"
+#include "parallel.h"
+#include "trace.h"
+#include "memtrack.h"
 
-struct matrix {
-    int rows;
-    int columns;
+// A reference-counted buffer of entries, shared by the chunks of all
+//   matrices that point into it (see struct matrix)
+struct block {
+    size_t refs;        // # of chunks that point into the block (updated atomically)
+    size_t count;       // # of floats in entries
+    float *entries;
+    void (*release)(void *ctx);     // NULL, or how to give back borrowed
+    void *ctx;                      //   entries (see create_matrix_borrowed)
+};
+
+// A run of consecutive rows of a matrix, stored row by row
+struct chunk {
+    struct block *block;    // NULL if the entries are part of the matrix allocation
     float *entries;
 };
 
-struct matrix *create_matrix(int rows, int columns, float *data) {
+// The rows of a matrix are split into chunks of chunk_rows rows (the
+//   last one may be shorter). A freshly computed matrix has all of its
+//   chunks in one block, in order, and entries points to them. A row
+//   operation on a matrix with several chunks copies only the chunks of
+//   the rows it changes and shares all others with its input
+//   (copy-on-write: a block is never written once it is shared), so its
+//   result has entries = NULL. Functions that need all entries in one
+//   piece read such a matrix through flat_view.
+//   Column-major matrices and small matrices always have a single chunk.
+struct matrix {
+    size_t rows;
+    size_t columns;
+    enum matrix_layout layout;
+    float *entries;         // all entries in layout order, or NULL
+    size_t chunk_rows;
+    size_t chunk_count;
+    struct chunk *chunks;   // allocated together with the matrix
+};
+
+// Matrices with at most SMALL_ENTRIES entries are allocated together
+//   with their entries in a single block.
+#define SMALL_ENTRIES 16
+
+// Row-major matrices are split into chunks of about CHUNK_ENTRIES
+//   entries (at least one row)
+#define CHUNK_ENTRIES (1 << 14)
+
+// Entry buffers of at least HUGE_PAGE bytes are aligned to huge pages
+//   and backed by transparent huge pages where the system supports them.
+#define HUGE_PAGE (2 << 20)
+
+// Loops over fewer entries than this run on the calling thread
+#define PARALLEL_ENTRIES (1 << 16)
+
+// Element-wise loops are split into blocks of one huge page, so each
+//   page is first touched (and placed on a NUMA node) by a single thread.
+#define BLOCK_ENTRIES (HUGE_PAGE / sizeof(float))
+
+// entries_bytes(count) returns the size of the buffer alloc_entries
+//   allocates for count floats
+static size_t entries_bytes(size_t count) {
+    size_t bytes = count * sizeof(float);
+    if (bytes < HUGE_PAGE) {
+        return bytes;
+    }
+    return (bytes + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+}
+
+// alloc_entries(count) returns an uninitialized buffer of count floats,
+//   or NULL if the memory is not available (see memtrack.h)
+// effects: may allocate memory (client must call mem_free with
+//          entries_bytes(count))
+// time: O(1)
+static float *alloc_entries(size_t count) {
+    size_t bytes = entries_bytes(count);
+    if (bytes < HUGE_PAGE) {
+        return mem_alloc(bytes);
+    }
+    void *entries = mem_alloc_aligned(HUGE_PAGE, bytes);
+#ifdef MADV_HUGEPAGE
+    if (entries) {
+        madvise(entries, bytes, MADV_HUGEPAGE);
+    }
+#endif
+    return entries;
+}
+
+// alloc_block(count) returns a block of count uninitialized floats with
+//   no references, or NULL if the memory is not available
+// effects: may allocate memory (client must call release_block)
+//          may produce output
+// time: O(1)
+static struct block *alloc_block(size_t count) {
+    size_t bytes = entries_bytes(count);
+    struct block *block = NULL;
+    if (bytes < HUGE_PAGE) {
+        block = mem_alloc(sizeof(struct block) + bytes);
+        if (block) {
+            block->entries = (float *)(block + 1);
+        }
+    } else {
+        block = mem_alloc(sizeof(struct block));
+        float *entries = block ? alloc_entries(count) : NULL;
+        if (entries) {
+            block->entries = entries;
+        } else {
+            mem_free(block, sizeof(struct block));
+            block = NULL;
+        }
+    }
+    if (block) {
+        block->refs = 0;
+        block->count = count;
+        block->release = NULL;
+    }
+    return block;
+}
+
+// release_block(block) drops one reference to block and frees it once
+//   no chunk points into it
+static void release_block(struct block *block) {
+    if (__atomic_sub_fetch(&block->refs, 1, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+    if (block->release) {
+        block->release(block->ctx);
+        mem_free(block, sizeof(struct block));
+        return;
+    }
+    if (block->entries == (float *)(block + 1)) {
+        mem_free(block, sizeof(struct block) + block->count * sizeof(float));
+        return;
+    }
+    mem_free(block->entries, entries_bytes(block->count));
+    mem_free(block, sizeof(struct block));
+}
+
+// matrix_bytes(rows, columns, chunk_count) returns the size of the
+//   allocation of a matrix (with its entries if it is small)
+static size_t matrix_bytes(size_t rows, size_t columns, size_t chunk_count) {
+    size_t bytes = sizeof(struct matrix) + chunk_count * sizeof(struct chunk);
+    if (rows * columns <= SMALL_ENTRIES) {
+        bytes += rows * columns * sizeof(float);
+    }
+    return bytes;
+}
+
+// new_matrix(rows, columns, layout) returns a matrix whose chunks are
+//   not set yet (except for small matrices, whose entries are allocated
+//   with them), or NULL if the memory is not available
+// effects: may allocate memory
+//          may produce output
+// time: O(1)
+static struct matrix *new_matrix(size_t rows, size_t columns, enum matrix_layout layout) {
+    size_t chunk_rows = CHUNK_ENTRIES / columns;
+    if (layout == LAYOUT_COLUMN_MAJOR || rows * columns <= SMALL_ENTRIES || chunk_rows >= rows) {
+        chunk_rows = rows;
+    } else if (chunk_rows == 0) {
+        chunk_rows = 1;
+    }
+    size_t chunk_count = (rows + chunk_rows - 1) / chunk_rows;
+    struct matrix *mat = mem_alloc(matrix_bytes(rows, columns, chunk_count));
+    if (!mat) {
+        return NULL;
+    }
+    mat->rows = rows;
+    mat->columns = columns;
+    mat->layout = layout;
+    mat->entries = NULL;
+    mat->chunk_rows = chunk_rows;
+    mat->chunk_count = chunk_count;
+    mat->chunks = (struct chunk *)(mat + 1);
+    if (rows * columns <= SMALL_ENTRIES) {
+        mat->entries = (float *)(mat->chunks + 1);
+        mat->chunks[0].block = NULL;
+        mat->chunks[0].entries = mat->entries;
+    }
+    return mat;
+}
+
+// alloc_matrix(rows, columns, layout) returns a matrix with uninitialized
+//   entries stored in the given layout (in a single block), or NULL if
+//   the memory is not available
+// effects: may allocate memory (client must call destroy matrix)
+//          may produce output
+// time: O(n) for a row-major matrix with n > CHUNK_ENTRIES / m, else O(1)
+static struct matrix *alloc_matrix(size_t rows, size_t columns, enum matrix_layout layout) {
+    TRACE_BEGIN("alloc_matrix", rows, columns);
+    struct matrix *mat = new_matrix(rows, columns, layout);
+    if (mat && !mat->entries) {
+        struct block *block = alloc_block(rows * columns);
+        if (block) {
+            block->refs = mat->chunk_count;
+            mat->entries = block->entries;
+            for (size_t c = 0; c < mat->chunk_count; ++c) {
+                mat->chunks[c].block = block;
+                mat->chunks[c].entries = block->entries + c * mat->chunk_rows * columns;
+            }
+        } else {
+            mem_free(mat, matrix_bytes(rows, columns, mat->chunk_count));
+            mat = NULL;
+        }
+    }
+    TRACE_END();
+    return mat;
+}
+
+// row_stride(mat) is the distance in entries between (i, j) and (i + 1, j)
+static size_t row_stride(const struct matrix *mat) {
+    return mat->layout == LAYOUT_ROW_MAJOR ? mat->columns : 1;
+}
+
+// column_stride(mat) is the distance in entries between (i, j) and (i, j + 1)
+static size_t column_stride(const struct matrix *mat) {
+    return mat->layout == LAYOUT_ROW_MAJOR ? 1 : mat->rows;
+}
+
+// row_entries(mat, row) returns the address of the first entry of row
+//   in the row-major matrix mat
+static float *row_entries(const struct matrix *mat, size_t row) {
+    return mat->chunks[row / mat->chunk_rows].entries + row % mat->chunk_rows * mat->columns;
+}
+
+// entry(mat, row, col) returns the address of entry (row, col) of mat
+static float *entry(const struct matrix *mat, size_t row, size_t col) {
+    if (!mat->entries) {
+        // only row-major matrices have several chunks
+        return row_entries(mat, row) + col;
+    }
+    return mat->entries + row * row_stride(mat) + col * column_stride(mat);
+}
+
+struct range {
+    size_t count;
+    size_t block;
+    void (*body)(size_t begin, size_t end, void *ctx);
+    void *ctx;
+};
+
+static void range_blocks(int begin, int end, void *ctx) {
+    struct range *range = ctx;
+    size_t last = (size_t)end * range->block;
+    range->body((size_t)begin * range->block, last < range->count ? last : range->count,
+                range->ctx);
+}
+
+// parallel_range(count, block, body, ctx) runs body over [0, count) in
+//   blocks of block indexes spread across threads (see parallel_for),
+//   or on the calling thread if there is only one block
+static void parallel_range(size_t count, size_t block,
+                           void (*body)(size_t begin, size_t end, void *ctx), void *ctx) {
+    if (count <= block) {
+        body(0, count, ctx);
+        return;
+    }
+    struct range range = {count, block, body, ctx};
+    parallel_for((count + block - 1) / block, 1, range_blocks, &range);
+}
+
+struct copy {
+    float *dest;
+    const float *src;
+};
+
+static void copy_entries(size_t begin, size_t end, void *ctx) {
+    struct copy *copy = ctx;
+    memcpy(copy->dest + begin, copy->src + begin, (end - begin) * sizeof(float));
+}
+
+struct matrix *create_matrix(size_t rows, size_t columns, const float *data) {
+    return create_matrix_layout(rows, columns, data, LAYOUT_ROW_MAJOR);
+}
+
+struct matrix *create_matrix_layout(size_t rows, size_t columns, const float *data,
+                                    enum matrix_layout layout) {
     assert(rows > 0);
     assert(columns > 0);
     assert(data);
-    struct matrix *mat = malloc(sizeof(struct matrix));
-    mat->rows = rows;
-    mat->columns = columns;
-    mat->entries = malloc(rows * columns * sizeof(float));
-    for (int i = 0; i < rows * columns; ++i) {
-        mat->entries[i] = data[i];
+    assert(layout == LAYOUT_ROW_MAJOR || layout == LAYOUT_COLUMN_MAJOR);
+    TRACE_BEGIN("create_matrix", rows, columns);
+    struct matrix *mat = alloc_matrix(rows, columns, layout);
+    if (mat) {
+        struct copy copy = {mat->entries, data};
+        parallel_range(rows * columns, BLOCK_ENTRIES, copy_entries, &copy);
+    }
+    TRACE_END();
+    return mat;
+}
+
+struct matrix *create_matrix_borrowed(size_t rows, size_t columns, const float *data,
+                                      enum matrix_layout layout, void (*release)(void *ctx),
+                                      void *ctx) {
+    assert(rows > 0);
+    assert(columns > 0);
+    assert(data);
+    assert(layout == LAYOUT_ROW_MAJOR || layout == LAYOUT_COLUMN_MAJOR);
+    assert(release);
+    struct matrix *mat = new_matrix(rows, columns, layout);
+    if (!mat) {
+        return NULL;
+    }
+    if (mat->entries) {
+        memcpy(mat->entries, data, rows * columns * sizeof(float));
+        release(ctx);
+        return mat;
+    }
+    struct block *block = mem_alloc(sizeof(struct block));
+    if (!block) {
+        mem_free(mat, matrix_bytes(rows, columns, mat->chunk_count));
+        return NULL;
+    }
+    // the chunks never write into a block they point to, so the cast
+    //   only lets them share the type of allocated blocks
+    *block = (struct block){mat->chunk_count, rows * columns, (float *)data, release, ctx};
+    mat->entries = block->entries;
+    for (size_t c = 0; c < mat->chunk_count; ++c) {
+        mat->chunks[c].block = block;
+        mat->chunks[c].entries = block->entries + c * mat->chunk_rows * columns;
     }
     return mat;
 }
 
 void destroy_matrix(struct matrix *mat) {
     assert(mat);
-    free(mat->entries);
-    free(mat);
+    for (size_t c = 0; c < mat->chunk_count; ++c) {
+        if (mat->chunks[c].block) {
+            release_block(mat->chunks[c].block);
+        }
+    }
+    mem_free(mat, matrix_bytes(mat->rows, mat->columns, mat->chunk_count));
+}
+
+// flat_copy(mat) returns a copy of mat in a single block of its own
+// effects: may allocate memory (client must call destroy_matrix)
+//          may produce output
+// time: O(nm)
+static struct matrix *flat_copy(const struct matrix *mat) {
+    struct matrix *copy = alloc_matrix(mat->rows, mat->columns, mat->layout);
+    if (copy) {
+        matrix_entries(mat, mat->layout, copy->entries);
+    }
+    return copy;
+}
+
+// derive(mat, row1, row2) returns a matrix with the entries of mat in
+//   which rows row1 and row2 may be written: the chunks holding them are
+//   copied and all other chunks are shared with mat. A matrix with a
+//   single chunk is copied whole, and nothing is copied if row1 and
+//   row2 are SIZE_MAX.
+// effects: may allocate memory (client must call destroy_matrix)
+//          may produce output
+// time: O(n / chunk_rows + m chunk_rows), or O(nm) for a single chunk
+static struct matrix *derive(const struct matrix *mat, size_t row1, size_t row2) {
+    if (mat->chunk_count == 1 && (row1 != SIZE_MAX || !mat->chunks[0].block)) {
+        return flat_copy(mat);
+    }
+    struct matrix *out = new_matrix(mat->rows, mat->columns, mat->layout);
+    if (!out) {
+        return NULL;
+    }
+    size_t chunk1 = row1 == SIZE_MAX ? SIZE_MAX : row1 / mat->chunk_rows;
+    size_t chunk2 = row2 == SIZE_MAX ? SIZE_MAX : row2 / mat->chunk_rows;
+    struct block *copies[2] = {NULL, NULL};
+    size_t chunks[2] = {chunk1, chunk2 == chunk1 ? SIZE_MAX : chunk2};
+    for (int i = 0; i < 2; ++i) {
+        if (chunks[i] == SIZE_MAX) {
+            continue;
+        }
+        size_t first = chunks[i] * mat->chunk_rows;
+        size_t rows = mat->rows - first < mat->chunk_rows ? mat->rows - first : mat->chunk_rows;
+        copies[i] = alloc_block(rows * mat->columns);
+        if (!copies[i]) {
+            if (copies[0]) {
+                release_block(copies[0]);
+            }
+            mem_free(out, matrix_bytes(out->rows, out->columns, out->chunk_count));
+            return NULL;
+        }
+        copies[i]->refs = 1;
+        memcpy(copies[i]->entries, mat->chunks[chunks[i]].entries, rows * mat->columns * sizeof(float));
+    }
+    for (size_t c = 0; c < mat->chunk_count; ++c) {
+        if (c == chunks[0] || c == chunks[1]) {
+            struct block *copy = copies[c == chunks[0] ? 0 : 1];
+            out->chunks[c].block = copy;
+            out->chunks[c].entries = copy->entries;
+        } else {
+            __atomic_add_fetch(&mat->chunks[c].block->refs, 1, __ATOMIC_RELAXED);
+            out->chunks[c] = mat->chunks[c];
+        }
+    }
+    if (row1 == SIZE_MAX && row2 == SIZE_MAX) {
+        out->entries = mat->entries;
+    }
+    return out;
+}
+
+// flat_view(mat, view) returns mat if its entries are in one piece, and
+//   otherwise view filled with mat and a contiguous copy of its entries
+//   (NULL if the memory is not available); see release_view
+// effects: may allocate memory
+//          may produce output
+// time: O(nm) if mat has shared chunks, else O(1)
+static const struct matrix *flat_view(const struct matrix *mat, struct matrix *view) {
+    if (mat->entries) {
+        return mat;
+    }
+    *view = *mat;
+    view->entries = alloc_entries(mat->rows * mat->columns);
+    if (!view->entries) {
+        return NULL;
+    }
+    matrix_entries(mat, mat->layout, view->entries);
+    return view;
+}
+
+// release_view(mat, view) frees the entries flat_view(mat, view) copied
+static void release_view(const struct matrix *mat, const struct matrix *view) {
+    if (view && view != mat) {
+        mem_free(view->entries, entries_bytes(mat->rows * mat->columns));
+    }
+}
+
+// The fixed-size types have at most SMALL_ENTRIES entries, so matrices of
+//   their size always have their entries in one piece
+#define FIXED_CONVERSIONS(N) \
+    bool matrix_to_mat##N(const struct matrix *mat, struct mat##N *out) { \
+        assert(mat); \
+        assert(out); \
+        if (mat->rows != N || mat->columns != N) { \
+            return false; \
+        } \
+        if (mat->layout == LAYOUT_ROW_MAJOR) { \
+            memcpy(out->m, mat->entries, sizeof(out->m)); \
+        } else { \
+            struct mat##N t; \
+            memcpy(t.m, mat->entries, sizeof(t.m)); \
+            *out = mat##N##_transpose(t); \
+        } \
+        return true; \
+    } \
+    bool matrix_to_vec##N(const struct matrix *mat, struct vec##N *out) { \
+        assert(mat); \
+        assert(out); \
+        if (mat->rows != N || mat->columns != 1) { \
+            return false; \
+        } \
+        memcpy(out->v, mat->entries, sizeof(out->v)); \
+        return true; \
+    } \
+    struct matrix *mat##N##_to_matrix(struct mat##N a) { \
+        struct matrix *mat = alloc_matrix(N, N, LAYOUT_ROW_MAJOR); \
+        if (mat) { \
+            memcpy(mat->entries, a.m, sizeof(a.m)); \
+        } \
+        return mat; \
+    } \
+    struct matrix *vec##N##_to_matrix(struct vec##N x) { \
+        struct matrix *mat = alloc_matrix(N, 1, LAYOUT_ROW_MAJOR); \
+        if (mat) { \
+            memcpy(mat->entries, x.v, sizeof(x.v)); \
+        } \
+        return mat; \
+    }
+
+FIXED_CONVERSIONS(2)
+FIXED_CONVERSIONS(3)
+FIXED_CONVERSIONS(4)
+
+struct matrix *copy_matrix(const struct matrix *mat) {
+    assert(mat);
+    TRACE_BEGIN("copy_matrix", mat->rows, mat->columns);
+    // the copy shares the (never written) blocks of mat
+    struct matrix *copy = derive(mat, SIZE_MAX, SIZE_MAX);
+    TRACE_END();
+    return copy;
+}
+
+// out = add + sign * mat, with out and add in the opposite layout of mat
+//   (out = mat in the opposite layout if add is NULL)
+struct relayout {
+    const struct matrix *mat;
+    const float *add;
+    float sign;
+    float *out;
+};
+
+// transpose_blocks computes the entries of block lines [begin, end) of
+//   mat (its rows if row-major, else its columns) in the opposite
+//   layout, TRANSPOSE_BLOCK x TRANSPOSE_BLOCK at a time so reads and
+//   writes both stay within a few pages
+#define TRANSPOSE_BLOCK 64
+
+static void transpose_blocks(size_t begin, size_t end, void *ctx) {
+    struct relayout *tr = ctx;
+    // view the entries as a lines x length row-major array
+    size_t lines = tr->mat->layout == LAYOUT_ROW_MAJOR ? tr->mat->rows : tr->mat->columns;
+    size_t length = tr->mat->layout == LAYOUT_ROW_MAJOR ? tr->mat->columns : tr->mat->rows;
+    for (size_t bi = begin * TRANSPOSE_BLOCK; bi < end * TRANSPOSE_BLOCK && bi < lines;
+         bi += TRANSPOSE_BLOCK) {
+        for (size_t bj = 0; bj < length; bj += TRANSPOSE_BLOCK) {
+            for (size_t i = bi; i < bi + TRANSPOSE_BLOCK && i < lines; ++i) {
+                if (!tr->add) {
+                    for (size_t j = bj; j < bj + TRANSPOSE_BLOCK && j < length; ++j) {
+                        tr->out[j * lines + i] = tr->mat->entries[i * length + j];
+                    }
+                    continue;
+                }
+                for (size_t j = bj; j < bj + TRANSPOSE_BLOCK && j < length; ++j) {
+                    tr->out[j * lines + i] = tr->add[j * lines + i] + tr->sign * tr->mat->entries[i * length + j];
+                }
+            }
+        }
+    }
+}
+
+// transpose_into(mat, add, sign, out) runs transpose_blocks over all of mat
+static void transpose_into(const struct matrix *mat, const float *add, float sign, float *out) {
+    struct relayout tr = {mat, add, sign, out};
+    size_t lines = mat->layout == LAYOUT_ROW_MAJOR ? mat->rows : mat->columns;
+    size_t length = mat->rows * mat->columns / lines;
+    size_t blocks = (lines + TRANSPOSE_BLOCK - 1) / TRANSPOSE_BLOCK;
+    parallel_range(blocks, PARALLEL_ENTRIES / (TRANSPOSE_BLOCK * length) + 1, transpose_blocks, &tr);
+}
+
+struct matrix *matrix_to_layout(const struct matrix *mat, enum matrix_layout layout) {
+    assert(mat);
+    assert(layout == LAYOUT_ROW_MAJOR || layout == LAYOUT_COLUMN_MAJOR);
+    if (mat->layout == layout) {
+        return copy_matrix(mat);
+    }
+    TRACE_BEGIN("matrix_to_layout", mat->rows, mat->columns);
+    struct matrix view;
+    const struct matrix *flat = flat_view(mat, &view);
+    struct matrix *out = flat ? alloc_matrix(mat->rows, mat->columns, layout) : NULL;
+    if (out) {
+        transpose_into(flat, NULL, 1, out->entries);
+    }
+    release_view(mat, flat);
+    TRACE_END();
+    return out;
+}
+
+struct gather {
+    const struct matrix *mat;
+    float *out;
+};
+
+// gather_chunks copies chunks [begin, end) of a row-major matrix to
+//   their place in a row-major array
+static void gather_chunks(size_t begin, size_t end, void *ctx) {
+    struct gather *gather = ctx;
+    const struct matrix *mat = gather->mat;
+    for (size_t c = begin; c < end; ++c) {
+        size_t first = c * mat->chunk_rows;
+        size_t rows = mat->rows - first < mat->chunk_rows ? mat->rows - first : mat->chunk_rows;
+        memcpy(gather->out + first * mat->columns, mat->chunks[c].entries,
+               rows * mat->columns * sizeof(float));
+    }
+}
+
+void matrix_entries(const struct matrix *mat, enum matrix_layout layout, float *out) {
+    assert(mat);
+    assert(out);
+    TRACE_BEGIN("matrix_entries", mat->rows, mat->columns);
+    if (mat->entries && mat->layout == layout) {
+        struct copy copy = {out, mat->entries};
+        parallel_range(mat->rows * mat->columns, BLOCK_ENTRIES, copy_entries, &copy);
+    } else if (mat->entries) {
+        transpose_into(mat, NULL, 1, out);
+    } else if (layout == LAYOUT_ROW_MAJOR) {
+        // only row-major matrices have several chunks
+        struct gather gather = {mat, out};
+        parallel_range(mat->chunk_count, BLOCK_ENTRIES / CHUNK_ENTRIES, gather_chunks, &gather);
+    } else {
+        for (size_t bi = 0; bi < mat->rows; bi += TRANSPOSE_BLOCK) {
+            for (size_t bj = 0; bj < mat->columns; bj += TRANSPOSE_BLOCK) {
+                for (size_t i = bi; i < bi + TRANSPOSE_BLOCK && i < mat->rows; ++i) {
+                    const float *row = row_entries(mat, i);
+                    for (size_t j = bj; j < bj + TRANSPOSE_BLOCK && j < mat->columns; ++j) {
+                        out[j * mat->rows + i] = row[j];
+                    }
+                }
+            }
+        }
+    }
+    TRACE_END();
+}
+
+struct matrix *transpose(const struct matrix *mat) {
+    assert(mat);
+    // the entries of mat, read in the other layout, are its transpose
+    enum matrix_layout layout = LAYOUT_ROW_MAJOR;
+    if (mat->layout == LAYOUT_ROW_MAJOR) {
+        layout = LAYOUT_COLUMN_MAJOR;
+    }
+    TRACE_BEGIN("transpose", mat->rows, mat->columns);
+    struct matrix *out = alloc_matrix(mat->columns, mat->rows, layout);
+    if (out) {
+        matrix_entries(mat, mat->layout, out->entries);
+    }
+    TRACE_END();
+    return out;
+}
+
+enum matrix_layout matrix_layout(const struct matrix *mat) {
+    assert(mat);
+    return mat->layout;
+}
+
+size_t matrix_rows(const struct matrix *mat) {
+    assert(mat);
+    return mat->rows;
+}
+
+size_t matrix_columns(const struct matrix *mat) {
+    assert(mat);
+    return mat->columns;
+}
+
+float matrix_get(const struct matrix *mat, size_t row, size_t col) {
+    assert(mat);
+    assert(row < mat->rows);
+    assert(col < mat->columns);
+    return *entry(mat, row, col);
+}
+
+const float *matrix_row_data(const struct matrix *mat, size_t row) {
+    assert(mat);
+    assert(mat->layout == LAYOUT_ROW_MAJOR);
+    assert(row < mat->rows);
+    return entry(mat, row, 0);
+}
+
+const float *matrix_column_data(const struct matrix *mat, size_t col) {
+    assert(mat);
+    assert(mat->layout == LAYOUT_COLUMN_MAJOR);
+    assert(col < mat->columns);
+    return entry(mat, 0, col);
+}
+
+struct matvec {
+    const struct matrix *mat;
+    const float *x;
+    float *y;
+};
+
+// matvec_rows computes y[begin..end) as dot products with the rows of
+//   a row-major matrix, or as a sum of column slices of a column-major one
+static void matvec_rows(size_t begin, size_t end, void *ctx) {
+    struct matvec *mv = ctx;
+    const struct matrix *mat = mv->mat;
+    if (mat->layout == LAYOUT_ROW_MAJOR) {
+        for (size_t i = begin; i < end; ++i) {
+            const float *row = row_entries(mat, i);
+            float sum = 0;
+            for (size_t j = 0; j < mat->columns; ++j) {
+                sum += row[j] * mv->x[j];
+            }
+            mv->y[i] = sum;
+        }
+        return;
+    }
+    for (size_t i = begin; i < end; ++i) {
+        mv->y[i] = 0;
+    }
+    for (size_t j = 0; j < mat->columns; ++j) {
+        const float *col = mat->entries + j * mat->rows;
+        float scale = mv->x[j];
+        for (size_t i = begin; i < end; ++i) {
+            mv->y[i] += col[i] * scale;
+        }
+    }
+}
+
+void matrix_vector_product(const struct matrix *mat, const float *x, float *y) {
+    assert(mat);
+    assert(x);
+    assert(y);
+    TRACE_BEGIN("matrix_vector_product", mat->rows, mat->columns);
+    struct matvec mv = {mat, x, y};
+    parallel_range(mat->rows, PARALLEL_ENTRIES / mat->columns + 1, matvec_rows, &mv);
+    TRACE_END();
 }
 
 void print_matrix(const struct matrix *mat) {
     assert(mat);
-    printf("Matrix (%d x %d):\n\n", mat->rows, mat->columns);
-    for (int i = 0; i < mat->rows; ++i) {
-        for (int j = 0; j < mat->columns; ++j) {
-            printf("%g\t", mat->entries[i * mat->columns + j]);
+    if (mat->layout == LAYOUT_COLUMN_MAJOR) {
+        printf("Matrix (%zu x %zu, column-major):\n\n", mat->rows, mat->columns);
+    } else {
+        printf("Matrix (%zu x %zu):\n\n", mat->rows, mat->columns);
+    }
+    for (size_t i = 0; i < mat->rows; ++i) {
+        for (size_t j = 0; j < mat->columns; ++j) {
+            printf("%g\t", *entry(mat, i, j));
         }
         printf("\n\n\n\n");
     }
 }
 
+// out = a + scalar * b, or out = scalar * a if b is NULL
+struct elementwise {
+    float *out;
+    const float *a;
+    const float *b;
+    float scalar;
+};
+
+static void add_range(size_t begin, size_t end, void *ctx) {
+    struct elementwise *op = ctx;
+    if (op->scalar == 1) {
+        for (size_t i = begin; i < end; ++i) {
+            op->out[i] = op->a[i] + op->b[i];
+        }
+    } else {
+        for (size_t i = begin; i < end; ++i) {
+            op->out[i] = op->a[i] - op->b[i];
+        }
+    }
+}
+
+static void scale_range(size_t begin, size_t end, void *ctx) {
+    struct elementwise *op = ctx;
+    for (size_t i = begin; i < end; ++i) {
+        op->out[i] = op->scalar * op->a[i];
+    }
+}
+
 struct matrix *addsub_matrix(struct matrix *mat1, struct matrix *mat2, int addsub) {
     assert(mat1);
     assert(mat2);
@@ -52,31 +747,39 @@ struct matrix *addsub_matrix(struct matrix *mat1, struct matrix *mat2, int addsu
         fprintf(stderr, "Error: Matrices are not the same size\n");
         return NULL;
     }
-    int num_entries = mat1->columns * mat1->rows;
-    float *sum_entries = malloc(num_entries * sizeof(float));
-    if (addsub == 0) {
-        for (int i = 0; i < num_entries; ++i) {
-            sum_entries[i] = mat1->entries[i] + mat2->entries[i];
-        }
-    } else {
-        for (int i = 0; i < num_entries; ++i) {
-            sum_entries[i] = mat1->entries[i] - mat2->entries[i];
-        }
+    TRACE_BEGIN("addsub_matrix", mat1->rows, mat1->columns);
+    struct matrix view1;
+    struct matrix view2;
+    const struct matrix *flat1 = flat_view(mat1, &view1);
+    const struct matrix *flat2 = flat1 ? flat_view(mat2, &view2) : NULL;
+    struct matrix *matrix_sum = flat2 ? alloc_matrix(mat1->rows, mat1->columns, mat1->layout) : NULL;
+    if (matrix_sum && mat1->layout != mat2->layout) {
+        transpose_into(flat2, flat1->entries, addsub ? -1 : 1, matrix_sum->entries);
+    } else if (matrix_sum) {
+        struct elementwise sum = {matrix_sum->entries, flat1->entries, flat2->entries, addsub ? -1 : 1};
+        parallel_range(mat1->rows * mat1->columns, BLOCK_ENTRIES, add_range, &sum);
     }
-    struct matrix *matrix_sum = create_matrix(mat1->rows, mat1->columns, sum_entries);
-    free(sum_entries);
+    release_view(mat1, flat1);
+    release_view(mat2, flat2);
+    TRACE_END();
     return matrix_sum;
 }
 
 struct matrix *scalar_multiply(float scalar, struct matrix *mat) {
     assert(mat);
-    int num_entries = mat->rows * mat->columns;
-    float *scaled_entries = malloc(num_entries * sizeof(float));
-    for (int i = 0; i < num_entries; ++i) {
-        scaled_entries[i] = scalar * mat->entries[i];
+    TRACE_BEGIN("scalar_multiply", mat->rows, mat->columns);
+    struct matrix *scaled_matrix = alloc_matrix(mat->rows, mat->columns, mat->layout);
+    if (scaled_matrix) {
+        // shared chunks are gathered into the result and scaled in place
+        const float *entries = mat->entries;
+        if (!entries) {
+            matrix_entries(mat, mat->layout, scaled_matrix->entries);
+            entries = scaled_matrix->entries;
+        }
+        struct elementwise scaled = {scaled_matrix->entries, entries, NULL, scalar};
+        parallel_range(mat->rows * mat->columns, BLOCK_ENTRIES, scale_range, &scaled);
     }
-    struct matrix *scaled_matrix = create_matrix(mat->rows, mat->columns, scaled_entries);
-    free(scaled_entries);
+    TRACE_END();
     return scaled_matrix;
 }
 
@@ -92,8 +795,8 @@ float dot_product(struct matrix *mat1, struct matrix *mat2) {
         return NAN;
     }
     float dot_product = 0;
-    for (int i = 0; i < mat1->rows; ++i) {
-        dot_product += mat1->entries[i] * mat2->entries[i];
+    for (size_t i = 0; i < mat1->rows; ++i) {
+        dot_product += *entry(mat1, i, 0) * *entry(mat2, i, 0);
     }
     return dot_product;
 }
@@ -189,190 +892,666 @@ struct matrix *cross_product(struct matrix *mat1, struct matrix *mat2) {
         fprintf(stderr, "Error: All vectors must belong to R^3 (3 rows)\n");
         return NULL;
     }
-    float *entries = malloc(3 * sizeof(float));
-    entries[0] = (mat1->entries[1] * mat2->entries[2]) - (mat1->entries[2] * mat2->entries[1]);
-    entries[1] = (mat1->entries[2] * mat2->entries[0]) - (mat1->entries[0] * mat2->entries[2]);
-    entries[2] = (mat1->entries[0] * mat2->entries[1]) - (mat1->entries[1] * mat2->entries[0]);
-    struct matrix *crossproduct = create_matrix(3, 1, entries);
-    free(entries);
-    return crossproduct;
+    struct vec3 a;
+    struct vec3 b;
+    matrix_to_vec3(mat1, &a);
+    matrix_to_vec3(mat2, &b);
+    return vec3_to_matrix(vec3_cross(a, b));
 }
 
-struct matrix *row_swap(int row1, int row2, struct matrix *mat) {
+// swap_rows(mat, row1, row2) swaps two rows of mat in place
+// requires: the chunks of row1 and row2 are not shared
+static void swap_rows(struct matrix *mat, size_t row1, size_t row2) {
+    for (size_t j = 0; j < mat->columns; ++j) {
+        float *entry1 = entry(mat, row1, j);
+        float *entry2 = entry(mat, row2, j);
+        float swap = *entry1;
+        *entry1 = *entry2;
+        *entry2 = swap;
+    }
+}
+
+struct matrix *row_swap(size_t row1, size_t row2, struct matrix *mat) {
     assert(mat);
-    if (row1 < 0 || row1 >= mat->rows || row2 < 0 || row2 >= mat->rows) {
+    if (row1 >= mat->rows || row2 >= mat->rows) {
         fprintf(stderr, "Error: invalid row index\n");
         return NULL;
     }
-    float *swap_entries = malloc(mat->columns * mat->rows * sizeof(float));
-    int new_row = -1;
-    for (int i = 0; i < mat->rows; ++i) {
-        if (i == row1) {
-            new_row = row2;
-        } else if (i == row2) {
-            new_row = row1;
-        } else {
-            new_row = i;
-        }
-        for (int j = 0; j < mat->columns; ++j) {
-            swap_entries[i * mat->columns + j] = mat->entries[new_row * mat->columns + j];
-        }
+    TRACE_BEGIN("row_swap", mat->rows, mat->columns);
+    struct matrix *swap_matrix = derive(mat, row1, row2);
+    if (swap_matrix) {
+        swap_rows(swap_matrix, row1, row2);
     }
-    struct matrix *swap_matrix = create_matrix(mat->rows, mat->columns, swap_entries);
-    free(swap_entries);
+    TRACE_END();
     return swap_matrix;
 }
 
-struct matrix *row_scale(int row, float scalar, struct matrix *mat) {
+struct matrix *row_scale(size_t row, float scalar, struct matrix *mat) {
     assert(mat);
-    if (row < 0 || row >= mat->rows) {
+    if (row >= mat->rows) {
         fprintf(stderr, "Error: invalid row index\n");
         return NULL;
     } 
-    float *scale_entries = malloc(mat->columns * mat->rows * sizeof(float));
-    for (int i = 0; i < mat->rows; ++i) {
-        for (int j = 0; j < mat->columns; ++j) {
-            if (i == row) {
-                scale_entries[i * mat->columns + j] = scalar * mat->entries[i * mat->columns + j];
-            } else {
-                scale_entries[i * mat->columns + j] = mat->entries[i * mat->columns + j];
-            }
-        }
+    TRACE_BEGIN("row_scale", mat->rows, mat->columns);
+    struct matrix *scale_matrix = derive(mat, row, row);
+    for (size_t j = 0; scale_matrix && j < mat->columns; ++j) {
+        *entry(scale_matrix, row, j) *= scalar;
     }
-    struct matrix *scale_matrix = create_matrix(mat->rows, mat->columns, scale_entries);
-    free(scale_entries);
+    TRACE_END();
     return scale_matrix;
 }
 
-struct matrix *row_add(int row1, float scalar, int row2, struct matrix *mat) {
+struct matrix *row_add(size_t row1, float scalar, size_t row2, struct matrix *mat) {
     assert(mat);
-    if (row1 < 0 || row1 >= mat->rows || row2 < 0 || row2 >= mat->rows) {
+    if (row1 >= mat->rows || row2 >= mat->rows) {
         fprintf(stderr, "Error: invalid row index\n");
         return NULL;
     }
-    float *new_entries = malloc(mat->rows * mat->columns * sizeof(float));
-    for (int i = 0; i < mat->rows; ++i) {
-        for (int j = 0; j < mat->columns; ++j) {
-            if (i == row2) {
-                new_entries[i * mat->columns + j] = mat->entries[row1 * mat->columns + j] * scalar + mat->entries[i * mat->columns + j];
-            } else {
-                new_entries[i * mat->columns + j] = mat->entries[i * mat->columns + j];
-            }
-        }
+    TRACE_BEGIN("row_add", mat->rows, mat->columns);
+    struct matrix *new_mat = derive(mat, row2, row2);
+    for (size_t j = 0; new_mat && j < mat->columns; ++j) {
+        *entry(new_mat, row2, j) = *entry(mat, row1, j) * scalar + *entry(mat, row2, j);
     }
-    struct matrix *new_mat = create_matrix(mat->rows, mat->columns, new_entries);
-    free(new_entries);
+    TRACE_END();
     return new_mat;
 }
 
-int argmax_col(struct matrix *mat, int col, int starting_row) {
+size_t argmax_col(struct matrix *mat, size_t col, size_t starting_row) {
     assert(mat);
-    assert(col >= 0 && col < mat->columns);
-    assert(starting_row >= 0 && starting_row < mat->rows);
-    int max_index = starting_row * mat->columns + col;
-    float max_value = mat->entries[starting_row * mat->columns + col];
-    for (int i = starting_row + 1; i < mat->rows; ++i) {
-        if (mat->entries[i * mat->columns + col] > max_value) {
-            max_value = mat->entries[i * mat->columns + col];
-            max_index = i * mat->columns + col; 
+    assert(col < mat->columns);
+    assert(starting_row < mat->rows);
+    if (!mat->entries) {
+        size_t max_row = starting_row;
+        float max_value = fabsf(*entry(mat, starting_row, col));
+        for (size_t i = starting_row + 1; i < mat->rows; ++i) {
+            if (fabsf(*entry(mat, i, col)) > max_value) {
+                max_value = fabsf(*entry(mat, i, col));
+                max_row = i;
+            }
+        }
+        return max_row * row_stride(mat) + col * column_stride(mat);
+    }
+    // contiguous for column-major matrices
+    size_t stride = row_stride(mat);
+    size_t max_index = entry(mat, starting_row, col) - mat->entries;
+    float max_value = fabsf(mat->entries[max_index]);
+    for (size_t i = starting_row + 1, index = max_index + stride; i < mat->rows; ++i, index += stride) {
+        if (fabsf(mat->entries[index]) > max_value) {
+            max_value = fabsf(mat->entries[index]);
+            max_index = index; 
         }
     }
     return max_index;
 }
 
+float pivot_tolerance(size_t rows, size_t columns, float largest) {
+    return (rows > columns ? rows : columns) * FLT_EPSILON * largest;
+}
+
+// largest_magnitude(mat) returns the largest absolute value of an entry
+//   of mat, which is in one piece
+static float largest_magnitude(const struct matrix *mat) {
+    float largest = 0;
+    for (size_t i = 0; i < mat->rows * mat->columns; ++i) {
+        largest = fabsf(mat->entries[i]) > largest ? fabsf(mat->entries[i]) : largest;
+    }
+    return largest;
+}
+
+// eliminate_below(mat, row, col) subtracts multiples of row from the rows
+//   below it so their entries in col become 0, in the order that walks
+//   the storage of mat contiguously
+static void eliminate_below(struct matrix *mat, size_t row, size_t col) {
+    float pivot = *entry(mat, row, col);
+    if (mat->layout == LAYOUT_ROW_MAJOR) {
+        for (size_t k = row + 1; k < mat->rows; ++k) {
+            float ratio = mat->entries[k * mat->columns + col] / pivot;
+            mat->entries[k * mat->columns + col] = 0;
+            for (size_t l = col + 1; l < mat->columns; ++l) {
+                mat->entries[k * mat->columns + l] = mat->entries[k * mat->columns + l] - mat->entries[row * mat->columns + l] * ratio;
+            }
+        }
+        return;
+    }
+    // the ratios are kept in column col until every column is updated
+    float *ratios = mat->entries + col * mat->rows;
+    for (size_t k = row + 1; k < mat->rows; ++k) {
+        ratios[k] /= pivot;
+    }
+    for (size_t l = col + 1; l < mat->columns; ++l) {
+        float *column = mat->entries + l * mat->rows;
+        for (size_t k = row + 1; k < mat->rows; ++k) {
+            column[k] = column[k] - column[row] * ratios[k];
+        }
+    }
+    for (size_t k = row + 1; k < mat->rows; ++k) {
+        ratios[k] = 0;
+    }
+}
+
 struct matrix *ref(struct matrix *mat) {
     assert(mat);
-    struct matrix *REF = create_matrix(mat->rows, mat->columns, mat->entries);
-    struct matrix *REF_NEXT = NULL;
-    for (int i = 0, j = 0; i < REF->rows && j < REF->columns;) {
-        int row = i; 
-        int col = j;
-        int max_index = argmax_col(REF, col, row);
-        if (!REF->entries[max_index]) {
+    TRACE_BEGIN("ref", mat->rows, mat->columns);
+    // REF is private and in one piece, so it is updated in place
+    struct matrix *REF = flat_copy(mat);
+    float tolerance = REF ? pivot_tolerance(REF->rows, REF->columns, largest_magnitude(REF)) : 0;
+    for (size_t i = 0, j = 0; REF && i < REF->rows && j < REF->columns;) {
+        size_t row = i; 
+        size_t col = j;
+        size_t max_index = argmax_col(REF, col, row);
+        if (fabsf(REF->entries[max_index]) <= tolerance) {
+            // what is left of the column is rounding error
+            for (size_t k = row; k < REF->rows; ++k) {
+                *entry(REF, k, col) = 0;
+            }
             ++j;
         } else {
-            REF_NEXT = row_swap(row, (max_index - col) / REF->columns, REF);
-            destroy_matrix(REF);
-            REF = REF_NEXT;
-            for (int k = row + 1; k < REF->rows; ++k) {
-                float ratio = REF->entries[k * REF->columns + col] / REF->entries[row * REF->columns + col];
-                REF->entries[k * REF->columns + col] = 0;
-                for (int l = col + 1; l < REF->columns; ++l) {
-                    REF->entries[k * REF->columns + l] = REF->entries[k * REF->columns + l] - REF->entries[row * REF->columns + l] * ratio;
-                }
-            }
+            size_t max_row = (max_index - col * column_stride(REF)) / row_stride(REF);
+            swap_rows(REF, row, max_row);
+            eliminate_below(REF, row, col);
             ++i;
             ++j;
         }
     }
+    TRACE_END();
     return REF;
 }
 
 struct matrix *rref(struct matrix *mat) {
     assert(mat);
+    TRACE_BEGIN("rref", mat->rows, mat->columns);
     struct matrix *RREF = ref(mat);
     struct matrix *RREF_NEXT = NULL;
-    for (int row = RREF->rows - 1; row >= 0; --row) {
-        for (int col = 0; col < RREF->columns; ++col) {
-            float entry = RREF->entries[row * RREF->columns + col];
-            if (entry) {
-                if (entry != 1) {
-                    RREF_NEXT = row_scale(row, 1 / entry, RREF);
+    for (size_t row = RREF ? RREF->rows : 0; RREF && row-- > 0;) {
+        for (size_t col = 0; col < RREF->columns; ++col) {
+            float value = *entry(RREF, row, col);
+            if (value) {
+                if (value != 1) {
+                    RREF_NEXT = row_scale(row, 1 / value, RREF);
                     destroy_matrix(RREF);
                     RREF = RREF_NEXT;
                 }
-                for (int i = 0; i < row; ++i) {
-                    float ratio = -1 * RREF->entries[i * RREF->columns + col];
+                for (size_t i = 0; RREF && i < row; ++i) {
+                    float ratio = -1 * *entry(RREF, i, col);
                     RREF_NEXT = row_add(row, ratio, i, RREF);
                     destroy_matrix(RREF);
                     RREF = RREF_NEXT;
-                    RREF->entries[i * RREF->columns + col] = 0;
+                    if (RREF) {
+                        *entry(RREF, i, col) = 0;
+                    }
                 }
                 break;
             }
         }
     }
+    TRACE_END();
     return RREF;
 }
 
-int rank(struct matrix *mat) {
+size_t rank(struct matrix *mat) {
     assert(mat);
+    TRACE_BEGIN("rank", mat->rows, mat->columns);
     struct matrix *REF = ref(mat);
-    int rank = 0;
-    for (int row = REF->rows - 1; row >=0; --row) {
-        for (int col = 0; col < REF->columns; ++col) {
-            if (REF->entries[row * REF->columns + col]) {
+    if (!REF) {
+        TRACE_END();
+        return SIZE_MAX;
+    }
+    size_t rank = 0;
+    for (size_t row = REF->rows; row-- > 0;) {
+        for (size_t col = 0; col < REF->columns; ++col) {
+            if (*entry(REF, row, col)) {
                 ++rank;
                 break;
             }
         }
     }
     destroy_matrix(REF);
+    TRACE_END();
     return rank;
 }
 
-int nullity(struct matrix *mat) {
+size_t nullity(struct matrix *mat) {
     assert(mat);
-    return mat->columns - rank(mat);
+    size_t r = rank(mat);
+    return r == SIZE_MAX ? SIZE_MAX : mat->columns - r;
+}
+
+// FIXED_MULTIPLY(N, mat1, mat2) returns mat1 * mat2 from the fixed-size
+//   kernels if mat1 is N x N and mat2 is N x N or N x 1 (both row-major)
+#define FIXED_MULTIPLY(N, mat1, mat2) \
+    if (mat1->rows == N && mat1->columns == N && mat1->layout == LAYOUT_ROW_MAJOR) { \
+        struct mat##N a; \
+        memcpy(a.m, mat1->entries, sizeof(a.m)); \
+        if (mat2->columns == N && mat2->layout == LAYOUT_ROW_MAJOR) { \
+            struct mat##N b; \
+            memcpy(b.m, mat2->entries, sizeof(b.m)); \
+            return mat##N##_to_matrix(mat##N##_multiply(a, b)); \
+        } \
+        if (mat2->columns == 1) { \
+            struct vec##N x; \
+            memcpy(x.v, mat2->entries, sizeof(x.v)); \
+            return vec##N##_to_matrix(mat##N##_transform(a, x)); \
+        } \
+    }
+
+struct product {
+    const struct matrix *mat1;
+    const struct matrix *mat2;
+    struct matrix *out;
+};
+
+// The product kernels below each read both operands along their storage
+//   order; each entry of the result is summed over k in increasing order.
+
+// multiply_rows computes rows [begin, end) of a row-major product of
+//   row-major matrices as sums of rows of mat2
+static void multiply_rows(size_t begin, size_t end, void *ctx) {
+    struct product *product = ctx;
+    size_t inner = product->mat1->columns;
+    size_t columns = product->mat2->columns;
+    for (size_t i = begin; i < end; ++i) {
+        const float *a = product->mat1->entries + i * inner;
+        float *out = product->out->entries + i * columns;
+        for (size_t j = 0; j < columns; ++j) {
+            out[j] = 0;
+        }
+        for (size_t k = 0; k < inner; ++k) {
+            const float *b = product->mat2->entries + k * columns;
+            for (size_t j = 0; j < columns; ++j) {
+                out[j] += a[k] * b[j];
+            }
+        }
+    }
+}
+
+// multiply_outer(product, rows, columns) computes the block rows x
+//   columns ([begin, end) ranges) of a row-major product of a column-major
+//   mat1 and a row-major mat2 as a sum of outer products of the columns
+//   of mat1 and the rows of mat2, reading both along their storage order
+static void multiply_outer(struct product *product, size_t row_begin, size_t row_end,
+                           size_t column_begin, size_t column_end) {
+    size_t rows = product->mat1->rows;
+    size_t inner = product->mat1->columns;
+    size_t columns = product->mat2->columns;
+    float *out = product->out->entries;
+    for (size_t i = row_begin; i < row_end; ++i) {
+        for (size_t j = column_begin; j < column_end; ++j) {
+            out[i * columns + j] = 0;
+        }
+    }
+    for (size_t k = 0; k < inner; ++k) {
+        const float *a = product->mat1->entries + k * rows;
+        const float *b = product->mat2->entries + k * columns;
+        for (size_t i = row_begin; i < row_end; ++i) {
+            float scale = a[i];
+            float *row = out + i * columns;
+            for (size_t j = column_begin; j < column_end; ++j) {
+                row[j] += scale * b[j];
+            }
+        }
+    }
+}
+
+static void multiply_outer_rows(size_t begin, size_t end, void *ctx) {
+    struct product *product = ctx;
+    multiply_outer(product, begin, end, 0, product->mat2->columns);
+}
+
+static void multiply_outer_columns(size_t begin, size_t end, void *ctx) {
+    struct product *product = ctx;
+    multiply_outer(product, 0, product->mat1->rows, begin, end);
+}
+
+// Outer product blocks split by columns are at least this wide, so the
+//   rows of mat2 are still read in long runs
+#define OUTER_COLUMNS 256
+
+// multiply_columns computes columns [begin, end) of a column-major product
+//   of column-major matrices as sums of columns of mat1
+static void multiply_columns(size_t begin, size_t end, void *ctx) {
+    struct product *product = ctx;
+    size_t rows = product->mat1->rows;
+    size_t inner = product->mat1->columns;
+    for (size_t j = begin; j < end; ++j) {
+        const float *b = product->mat2->entries + j * inner;
+        float *out = product->out->entries + j * rows;
+        for (size_t i = 0; i < rows; ++i) {
+            out[i] = 0;
+        }
+        for (size_t k = 0; k < inner; ++k) {
+            const float *a = product->mat1->entries + k * rows;
+            for (size_t i = 0; i < rows; ++i) {
+                out[i] += a[i] * b[k];
+            }
+        }
+    }
+}
+
+// multiply_dots computes rows [begin, end) of a row-major product of a
+//   row-major mat1 and a column-major mat2 as dot products
+static void multiply_dots(size_t begin, size_t end, void *ctx) {
+    struct product *product = ctx;
+    size_t inner = product->mat1->columns;
+    size_t columns = product->mat2->columns;
+    for (size_t i = begin; i < end; ++i) {
+        const float *a = product->mat1->entries + i * inner;
+        for (size_t j = 0; j < columns; ++j) {
+            const float *b = product->mat2->entries + j * inner;
+            float sum = 0;
+            for (size_t k = 0; k < inner; ++k) {
+                sum += a[k] * b[k];
+            }
+            product->out->entries[i * columns + j] = sum;
+        }
+    }
+}
+
+// multiply_flat(product) stores mat1 * mat2 in out, which has the layout
+//   matrix_multiplication gives the product; all three are in one piece
+//   and out does not overlap the operands
+static void multiply_flat(struct product *product) {
+    const struct matrix *mat1 = product->mat1;
+    const struct matrix *mat2 = product->mat2;
+    if (mat1->layout == LAYOUT_ROW_MAJOR && mat2->layout == LAYOUT_ROW_MAJOR) {
+        size_t work = mat1->columns * mat2->columns;
+        parallel_range(mat1->rows, PARALLEL_ENTRIES / work + 1, multiply_rows, product);
+    } else if (mat2->layout == LAYOUT_ROW_MAJOR) {
+        // split the longer side of the result between threads
+        if (mat1->rows >= mat2->columns) {
+            size_t work = mat1->columns * mat2->columns;
+            parallel_range(mat1->rows, PARALLEL_ENTRIES / work + 1, multiply_outer_rows, product);
+        } else {
+            size_t grain = PARALLEL_ENTRIES / (mat1->rows * mat1->columns) + 1;
+            parallel_range(mat2->columns, grain < OUTER_COLUMNS ? OUTER_COLUMNS : grain,
+                           multiply_outer_columns, product);
+        }
+    } else if (mat1->layout == LAYOUT_COLUMN_MAJOR) {
+        size_t work = mat1->rows * mat1->columns;
+        parallel_range(mat2->columns, PARALLEL_ENTRIES / work + 1, multiply_columns, product);
+    } else {
+        size_t work = mat1->columns * mat2->columns;
+        parallel_range(mat1->rows, PARALLEL_ENTRIES / work + 1, multiply_dots, product);
+    }
 }
 
 struct matrix *matrix_multiplication(struct matrix *mat1, struct matrix *mat2) {
     assert(mat1);
+    assert(mat2);
     if (mat1->columns != mat2->rows) {
         fprintf(stderr, "Error: first matrix columns must equal second matrix rows \n");
         return NULL;
     }
-    float *new_entries = malloc(mat1->rows * mat2->columns * sizeof(float));
-    for (int i = 0; i < mat1->rows; ++i) {
-        for (int j = 0; j < mat2->columns; ++j) {
-            float entry = 0;
-            for (int k = 0; k < mat2->rows; ++k) {
-                entry += mat1->entries[i * mat1->columns + k] * mat2->entries[k * mat2->columns + j];
+    FIXED_MULTIPLY(2, mat1, mat2)
+    FIXED_MULTIPLY(3, mat1, mat2)
+    FIXED_MULTIPLY(4, mat1, mat2)
+    TRACE_BEGIN("matrix_multiplication", mat1->rows, mat2->columns);
+    enum matrix_layout layout = LAYOUT_ROW_MAJOR;
+    if (mat1->layout == LAYOUT_COLUMN_MAJOR && mat2->layout == LAYOUT_COLUMN_MAJOR) {
+        layout = LAYOUT_COLUMN_MAJOR;
+    }
+    struct matrix view1;
+    struct matrix view2;
+    const struct matrix *flat1 = flat_view(mat1, &view1);
+    const struct matrix *flat2 = flat1 ? flat_view(mat2, &view2) : NULL;
+    struct product product = {flat1, flat2, NULL};
+    if (flat2) {
+        product.out = alloc_matrix(mat1->rows, mat2->columns, layout);
+    }
+    if (!product.out) {
+        release_view(mat1, flat1);
+        release_view(mat2, flat2);
+        TRACE_END();
+        return NULL;
+    }
+    multiply_flat(&product);
+    release_view(mat1, flat1);
+    release_view(mat2, flat2);
+    TRACE_END();
+    return product.out;
+}
+
+// Taylor polynomial matrix_exponential evaluates, and the 1-norm it
+//   scales the matrix down to first: the terms left out add up to less
+//   than 0.5^9 / 9! (about 5e-9), below float precision
+#define EXP_DEGREE 8
+#define EXP_NORM 0.5
+
+// alloc_squares(n, layout, buffers, count) stores count n x n matrices
+//   (in one piece, uninitialized) in buffers and returns true, or
+//   returns false (and allocates nothing) if the memory is not available
+// effects: may allocate memory (client must call destroy_matrix)
+//          may produce output
+static bool alloc_squares(size_t n, enum matrix_layout layout, struct matrix **buffers,
+                          size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        buffers[i] = alloc_matrix(n, n, layout);
+        if (!buffers[i]) {
+            while (i-- > 0) {
+                destroy_matrix(buffers[i]);
             }
-            new_entries[i * mat2->columns + j] = entry;
+            return false;
         }
     }
-    struct matrix *new_mat = create_matrix(mat1->rows, mat2->columns, new_entries);
-    free(new_entries);
-    return new_mat;
+    return true;
+}
+
+// square_product(a, b, out) stores a * b in out; a, b and out are
+//   square, in one piece and in the same layout, and out is neither a
+//   nor b
+static void square_product(const struct matrix *a, const struct matrix *b, struct matrix *out) {
+    struct product product = {a, b, out};
+    multiply_flat(&product);
+}
+
+// add_block(out, powers, c, count) adds c[0] I + c[1] A + ... +
+//   c[count - 1] A^(count - 1) to the n x n entries out, where powers[i]
+//   is A^i (i > 0)
+static void add_block(float *out, const struct matrix *const *powers, const float *c,
+                      size_t count) {
+    size_t n = powers[1]->rows;
+    for (size_t i = 0; i < n; ++i) {
+        out[i * n + i] += c[0];
+    }
+    for (size_t p = 1; p < count; ++p) {
+        const float *power = powers[p]->entries;
+        for (size_t e = 0; e < n * n; ++e) {
+            out[e] += c[p] * power[e];
+        }
+    }
+}
+
+// ps_products(degree, s) returns the number of products evaluate needs
+//   for a polynomial of degree > 0 with the powers A^1 .. A^s
+static size_t ps_products(size_t degree, size_t s) {
+    return s - 1 + degree / s - (degree % s == 0);
+}
+
+// evaluate(a, c, degree, spare) returns c[0] I + c[1] a + ... +
+//   c[degree] a^degree for the square matrix a (in one piece), or NULL
+//   if the memory is not available. If spare is not NULL, it is set to a
+//   second matrix of the same shape for the caller to reuse.
+//   The Paterson-Stockmeyer scheme computes a^2 .. a^s and then runs
+//   Horner's rule in a^s over blocks of s coefficients, which takes
+//   about 2 sqrt(degree) products instead of degree - 1; s is picked to
+//   need the fewest.
+// effects: may allocate memory (client must call destroy_matrix)
+//          may produce output
+// time: O(sqrt(degree) n^3 + degree n^2)
+static struct matrix *evaluate(const struct matrix *a, const float *c, size_t degree,
+                               struct matrix **spare) {
+    size_t n = a->rows;
+    size_t s = 1;
+    for (size_t t = 2; t <= degree; ++t) {
+        if (ps_products(degree, t) < ps_products(degree, s)) {
+            s = t;
+        }
+    }
+    // powers[2..s], then the result and the spare buffer
+    size_t bytes = 2 * (s + 1) * sizeof(struct matrix *);
+    struct matrix **buffers = mem_alloc(bytes);
+    if (!buffers || !alloc_squares(n, a->layout, buffers, s + 1)) {
+        mem_free(buffers, bytes);
+        return NULL;
+    }
+    const struct matrix **powers = (const struct matrix **)(buffers + s + 1);
+    powers[1] = a;
+    for (size_t p = 2; p <= s; ++p) {
+        square_product(powers[p - 1], a, buffers[p - 2]);
+        powers[p] = buffers[p - 2];
+    }
+    struct matrix *result = buffers[s - 1];
+    struct matrix *other = buffers[s];
+    size_t blocks = degree / s;
+    if (degree && degree % s == 0) {
+        // the last block is c[degree] alone, so it only scales a^s
+        for (size_t e = 0; e < n * n; ++e) {
+            result->entries[e] = c[degree] * powers[s]->entries[e];
+        }
+        add_block(result->entries, powers, c + (blocks - 1) * s, s);
+    } else {
+        memset(result->entries, 0, n * n * sizeof(float));
+        add_block(result->entries, powers, c + blocks * s, degree - blocks * s + 1);
+        ++blocks;
+    }
+    for (size_t j = blocks - 1; j-- > 0;) {
+        square_product(result, powers[s], other);
+        add_block(other->entries, powers, c + j * s, s);
+        struct matrix *swap = result;
+        result = other;
+        other = swap;
+    }
+    for (size_t p = 0; p + 1 < s; ++p) {
+        destroy_matrix(buffers[p]);
+    }
+    if (spare) {
+        *spare = other;
+    } else {
+        destroy_matrix(other);
+    }
+    mem_free(buffers, bytes);
+    return result;
+}
+
+struct matrix *matrix_power(const struct matrix *mat, unsigned k) {
+    assert(mat);
+    size_t n = mat->rows;
+    if (mat->columns != n) {
+        fprintf(stderr, "Error: Matrix must be square\n");
+        return NULL;
+    }
+    TRACE_BEGIN("matrix_power", n, n);
+    struct matrix view;
+    const struct matrix *a = flat_view(mat, &view);
+    struct matrix *buffers[2];
+    if (!a || !alloc_squares(n, mat->layout, buffers, 2)) {
+        release_view(mat, a);
+        TRACE_END();
+        return NULL;
+    }
+    struct matrix *result = buffers[0];
+    struct matrix *other = buffers[1];
+    if (k == 0) {
+        memset(result->entries, 0, n * n * sizeof(float));
+        for (size_t i = 0; i < n; ++i) {
+            result->entries[i * n + i] = 1;
+        }
+    } else {
+        // the bits of k from the highest down: square, and multiply by a
+        //   for each 1 bit after the first
+        memcpy(result->entries, a->entries, n * n * sizeof(float));
+        int bit = 0;
+        while (k >> bit > 1) {
+            ++bit;
+        }
+        while (bit-- > 0) {
+            square_product(result, result, other);
+            struct matrix *swap = result;
+            result = other;
+            other = swap;
+            if (k >> bit & 1) {
+                square_product(result, a, other);
+                swap = result;
+                result = other;
+                other = swap;
+            }
+        }
+    }
+    destroy_matrix(other);
+    release_view(mat, a);
+    TRACE_END();
+    return result;
+}
+
+struct matrix *matrix_polynomial(const struct matrix *mat, const float *coefficients,
+                                 size_t degree) {
+    assert(mat);
+    assert(coefficients);
+    size_t n = mat->rows;
+    if (mat->columns != n) {
+        fprintf(stderr, "Error: Matrix must be square\n");
+        return NULL;
+    }
+    TRACE_BEGIN("matrix_polynomial", n, n);
+    struct matrix view;
+    const struct matrix *a = flat_view(mat, &view);
+    struct matrix *result = a ? evaluate(a, coefficients, degree, NULL) : NULL;
+    release_view(mat, a);
+    TRACE_END();
+    return result;
+}
+
+struct matrix *matrix_exponential(const struct matrix *mat) {
+    assert(mat);
+    size_t n = mat->rows;
+    if (mat->columns != n) {
+        fprintf(stderr, "Error: Matrix must be square\n");
+        return NULL;
+    }
+    // the 1-norm (largest column sum), in either layout
+    double norm = 0;
+    for (size_t j = 0; j < n; ++j) {
+        double sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            sum += fabsf(*entry(mat, i, j));
+        }
+        norm = sum > norm ? sum : norm;
+    }
+    if (!isfinite(norm)) {
+        fprintf(stderr, "Error: Matrix entries must be finite\n");
+        return NULL;
+    }
+    int squarings = 0;
+    while (norm > EXP_NORM) {
+        norm /= 2;
+        ++squarings;
+    }
+    TRACE_BEGIN("matrix_exponential", n, n);
+    float c[EXP_DEGREE + 1];
+    c[0] = 1;
+    for (int k = 1; k <= EXP_DEGREE; ++k) {
+        c[k] = c[k - 1] / k;
+    }
+    struct matrix *scaled = alloc_matrix(n, n, mat->layout);
+    struct matrix *spare = NULL;
+    struct matrix *result = NULL;
+    if (scaled) {
+        matrix_entries(mat, mat->layout, scaled->entries);
+        for (size_t e = 0; e < n * n; ++e) {
+            scaled->entries[e] = ldexpf(scaled->entries[e], -squarings);
+        }
+        result = evaluate(scaled, c, EXP_DEGREE, &spare);
+        destroy_matrix(scaled);
+    }
+    // e^A = (e^(A / 2^squarings))^(2^squarings)
+    for (int i = 0; result && i < squarings; ++i) {
+        square_product(result, result, spare);
+        struct matrix *swap = result;
+        result = spare;
+        spare = swap;
+    }
+    if (spare) {
+        destroy_matrix(spare);
+    }
+    TRACE_END();
+    return result;
 }
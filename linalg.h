@@ -1,18 +1,69 @@
 // times: n is # of rows
 //        m is # of columns
+// Sizes and indexes are size_t, so matrices may have more than 2^31
+//   entries. Large matrices are backed by huge pages where available
+//   and their element-wise operations run on several threads (see
+//   parallel.h).
+// Matrices are allocated through the tracking allocator (see
+//   memtrack.h). A function that returns a matrix outputs an error
+//   message and returns NULL if the memory for it (or for an
+//   intermediate result) is not available or would exceed the memory
+//   budget; mem_last_error tells which.
+// Matrices share storage: the rows of a large row-major matrix are
+//   kept in chunks of about 64 KB, and copy_matrix and the elementary
+//   row operations share every chunk they do not change with their
+//   input (copy-on-write). A derived matrix then costs O(m) memory
+//   beyond its input instead of O(nm).
 
 // A vector is considered to be an n x 1 matrix
 struct matrix;
 
+// The order entries are stored in. Every operation works on matrices of
+//   either layout without converting them; results keep the layout of
+//   their (first) operand unless noted otherwise.
+enum matrix_layout {
+    LAYOUT_ROW_MAJOR,       // row by row (the default)
+    LAYOUT_COLUMN_MAJOR     // column by column (as in Fortran)
+};
+
 // create_matrix(rows, columns, data) returns a matrix/vector with
 //   the rows, columns, and data provided to the function.
+//   data is read row by row.
 // requires: 
 //   the number of elements in data is equal to rows * columns. (not asserted)
 //   rows and columns are greater than 0
 //   data is a valid pointer
 // effects: allocates memory (client must call destroy matrix)
 // time: O(nm)
-struct matrix *create_matrix(int rows, int columns, float *data);
+struct matrix *create_matrix(size_t rows, size_t columns, const float *data);
+
+// create_matrix_layout(rows, columns, data, layout) is create_matrix for
+//   data stored (and kept) in the given layout
+// requires: as create_matrix
+// effects: allocates memory (client must call destroy matrix)
+// time: O(nm)
+struct matrix *create_matrix_layout(size_t rows, size_t columns, const float *data,
+                                    enum matrix_layout layout);
+
+// create_matrix_borrowed(rows, columns, data, layout, release, ctx)
+//   returns a matrix whose entries are data itself (stored in layout),
+//   not a copy. Matrices never write entries they may share, so data
+//   can be read-only memory. Once neither the matrix nor a matrix that
+//   shares its storage (see copy_matrix) uses data, release(ctx) is
+//   called (at most once, possibly from another thread).
+//   A matrix of at most 16 entries copies data and calls release(ctx)
+//   right away.
+// requires: as create_matrix_layout
+//           release is a valid pointer
+//           data does not change until release(ctx) is called
+// notes: outputs an error message and returns NULL if out of memory
+//   (without calling release)
+// effects: may allocate memory (client must call destroy matrix)
+//          may produce output
+// time: O(n) for a row-major matrix with n > 16384 / m, else O(1)
+struct matrix *create_matrix_borrowed(size_t rows, size_t columns, const float *data,
+                                      enum matrix_layout layout, void (*release)(void *ctx),
+                                      void *ctx);
 
 // destroy_matrix(mat) frees all memory for mat.
 // requires: mat is a valid pointer
@@ -21,6 +72,72 @@ struct matrix *create_matrix(int rows, int columns, float *data);
 // time: O(1)
 void destroy_matrix(struct matrix *mat);
 
+// copy_matrix(mat) returns a copy of mat (sharing its storage, except
+//   for matrices of at most 16 entries)
+// requires: mat is a valid pointer
+// effects: allocates memory (client must call destroy matrix)
+// time: O(n) (O(nm) for matrices of at most 16 entries)
+struct matrix *copy_matrix(const struct matrix *mat);
+
+// matrix_to_layout(mat, layout) returns a copy of mat stored in layout
+// requires: mat is a valid pointer
+// effects: allocates memory (client must call destroy matrix)
+// time: O(nm)
+struct matrix *matrix_to_layout(const struct matrix *mat, enum matrix_layout layout);
+
+// matrix_entries(mat, layout, out) stores the entries of mat in out, in
+//   the given layout
+// requires: mat and out are valid pointers, out has room for nm floats
+// time: O(nm)
+void matrix_entries(const struct matrix *mat, enum matrix_layout layout, float *out);
+
+// transpose(mat) returns the transpose of mat. It is stored in the other
+//   layout, so this is a plain copy of the entries.
+// requires: mat is a valid pointer
+// effects: allocates memory (client must call destroy matrix)
+// time: O(nm)
+struct matrix *transpose(const struct matrix *mat);
+
+// matrix_layout(mat) returns the layout mat is stored in
+// requires: mat is a valid pointer
+// time: O(1)
+enum matrix_layout matrix_layout(const struct matrix *mat);
+
+// matrix_rows(mat) returns the number of rows of mat
+// requires: mat is a valid pointer
+// time: O(1)
+size_t matrix_rows(const struct matrix *mat);
+
+// matrix_columns(mat) returns the number of columns of mat
+// requires: mat is a valid pointer
+// time: O(1)
+size_t matrix_columns(const struct matrix *mat);
+
+// matrix_get(mat, row, col) returns the entry of mat at row, col
+// requires: mat is a valid pointer
+//           row and col are valid indexes
+// time: O(1)
+float matrix_get(const struct matrix *mat, size_t row, size_t col);
+
+// matrix_row_data(mat, row) returns the address of the m entries of row
+//   of the row-major matrix mat, and matrix_column_data(mat, col) the
+//   address of the n entries of column col of the column-major matrix
+//   mat, so they can be read in place instead of copied out
+// requires: mat is a valid pointer stored in that layout
+//           row and col are valid indexes
+// notes: the entries must not be written (they may be shared)
+// time: O(1)
+const float *matrix_row_data(const struct matrix *mat, size_t row);
+const float *matrix_column_data(const struct matrix *mat, size_t col);
+
+// matrix_vector_product(mat, x, y) stores mat * x in y, where x is an
+//   array of m floats and y an array of n floats. Large products are
+//   split across threads (see parallel.h).
+// requires: mat, x and y are valid pointers
+//           x and y do not overlap
+// time: O(nm)
+void matrix_vector_product(const struct matrix *mat, const float *x, float *y);
+
 // print_matrix(mat) prints the matrix mat
 // requires: mat is a valid pointer
 // effects: produces output
@@ -117,8 +234,9 @@ struct matrix *cross_product(struct matrix *mat1, struct matrix *mat2);
 //   *row index starts at 0
 // effects: may allocate memory
 //          may produce output
-// time: O(nm)
-struct matrix *row_swap(int row1, int row2, struct matrix *mat);
+// time: O(n + m) for row-major matrices with more than one chunk,
+//       otherwise O(nm)
+struct matrix *row_swap(size_t row1, size_t row2, struct matrix *mat);
 
 // row_scale(row, scalar, mat) returns a matrix with the specified 
 //   row of mat scaled by scalar
@@ -127,8 +245,8 @@ struct matrix *row_swap(int row1, int row2, struct matrix *mat);
 //   row is an invalid index
 // effects: may allocate memory
 //          may produce output
-// time: O(nm)
-struct matrix *row_scale(int row, float scalar, struct matrix *mat);
+// time: as row_swap
+struct matrix *row_scale(size_t row, float scalar, struct matrix *mat);
 
 // row_add(row1, scalar, row2, mat) adds all elements of row1 scaled by scalar
 //   to row2 of mat. (row1 is NOT scaled or changed in the returned 
@@ -138,18 +256,29 @@ struct matrix *row_scale(int row, float scalar, struct matrix *mat);
 //   are invalid row indexes
 // effects: may allocate memory
 //          may produce output
-// time: O(nm)
-struct matrix *row_add(int row1, float scalar, int row2, struct matrix *mat);
+// time: as row_swap
+struct matrix *row_add(size_t row1, float scalar, size_t row2, struct matrix *mat);
 
 // argmax_col(mat, col, starting_row) returns the index of the 
 //   maximum value between the absolute values of all entries of mat
 //   in column col starting from row starting_row.
+//   The index is into the entries of mat, so it depends on its layout.
 // requires: mat is a valid pointer
 //           col and starting row are both valid indexes.
 // time: O(n)
-int argmax_col(struct matrix *mat, int col, int starting_row);
+size_t argmax_col(struct matrix *mat, size_t col, size_t starting_row);
+
+// pivot_tolerance(rows, columns, largest) returns the magnitude up to
+//   which ref treats a pivot of a rows x columns matrix whose largest
+//   entry (in absolute value) is largest as 0: max(n, m) * FLT_EPSILON
+//   * largest, about the rounding error elimination accumulates
+// time: O(1)
+float pivot_tolerance(size_t rows, size_t columns, float largest);
 
 // ref(mat) returns the REF of mat.
+//   Pivots are chosen by argmax_col (partial pivoting); a column whose
+//   candidates are all within pivot_tolerance of 0 has no pivot and
+//   they are set to 0, so rounding errors do not count as pivots.
 // requires: mat is a valid pointer
 // effects: allocates memory
 // time: O(nm * min(m, n)) ???
@@ -161,14 +290,65 @@ struct matrix *ref(struct matrix *mat);
 // time: O(mn^2)
 struct matrix *rref(struct matrix *mat);
 
-// rank(mat) returns the rank (# pivots) of mat
+// rank(mat) returns the rank (# pivots) of mat, the numerical rank
+//   with the tolerance of ref
 // requires: mat is a valid pointer
+// notes: returns SIZE_MAX if the memory for ref(mat) is not available
+//   for a matrix that grows a column at a time, an echelon (echelon.h)
+//   gives the same rank after each column without redoing ref
+// effects: may produce output
 // time: O(mn^2)
-int rank(struct matrix *mat);
+size_t rank(struct matrix *mat);
 
 // nullity(mat) returns the nullity of mat
 // requires: mat is a valid pointer
+// notes: returns SIZE_MAX if the memory for ref(mat) is not available
+// effects: may produce output
 // time: O(mn^2)
-int nullity(struct matrix *mat);
+size_t nullity(struct matrix *mat);
 
-struct matrix *matrix_multiplication(struct matrix *mat1, struct matrix *mat2);
\ No newline at end of file
+// matrix_multiplication(mat1, mat2) returns mat1 * mat2. The result is
+//   column-major if both operands are, and row-major otherwise.
+// requires: mat1 and mat2 are valid pointers
+// notes: outputs an error message and returns NULL if the columns of
+//   mat1 do not match the rows of mat2
+// effects: may allocate memory
+//          may produce output
+// time: O(nmk) for an n x k by k x m product
+struct matrix *matrix_multiplication(struct matrix *mat1, struct matrix *mat2);
+
+// matrix_power(mat, k) returns mat^k (the identity for k = 0) by
+//   repeated squaring: at most 2 log2(k) products, which alternate
+//   between two result matrices allocated once
+// requires: mat is a valid pointer
+// notes: outputs an error message and returns NULL if mat is not square
+// effects: may allocate memory (client must call destroy matrix)
+//          may produce output
+// time: O(n^3 log k)
+struct matrix *matrix_power(const struct matrix *mat, unsigned k);
+
+// matrix_polynomial(mat, coefficients, degree) returns coefficients[0] I
+//   + coefficients[1] mat + ... + coefficients[degree] mat^degree,
+//   evaluated with the Paterson-Stockmeyer scheme: about
+//   2 sqrt(degree) products instead of degree - 1, in buffers allocated
+//   once up front
+// requires: mat is a valid pointer
+//           coefficients is a valid pointer to degree + 1 floats
+// notes: outputs an error message and returns NULL if mat is not square
+// effects: may allocate memory (client must call destroy matrix)
+//          may produce output
+// time: O(sqrt(degree) n^3 + degree n^2)
+struct matrix *matrix_polynomial(const struct matrix *mat, const float *coefficients,
+                                 size_t degree);
+
+// matrix_exponential(mat) returns e^mat by scaling and squaring: mat is
+//   divided by 2^s so its 1-norm is at most 1/2, the Taylor polynomial
+//   of degree 8 (accurate to float precision there) is evaluated with
+//   matrix_polynomial's scheme and the result is squared s times
+// requires: mat is a valid pointer
+// notes: outputs an error message and returns NULL if mat is not
+//   square or has an entry that is not finite
+// effects: may allocate memory (client must call destroy matrix)
+//          may produce output
+// time: O(n^3 (4 + s)), s = max(0, log2(2 ||mat||_1))
+struct matrix *matrix_exponential(const struct matrix *mat);
\ No newline at end of file
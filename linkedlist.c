@@ -1,55 +1,101 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <assert.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "linalg.h"
+#include "linkedlist.h"
+#include "memtrack.h"
 
 struct llnode {
     struct matrix *mat;
+    uint64_t id;
     struct llnode *next;
 };
 
+// lock guards front, next_id, version and every node; the matrices
+//   themselves are not protected (see linkedlist.h)
 struct llist {
     struct llnode *front;
+    uint64_t next_id;
+    uint64_t version;       // # of matrices ever added or removed
+    pthread_rwlock_t lock;
 };
 
 struct llist *list_create(void) {
-    struct llist *lst = malloc(sizeof(struct llist));
+    struct llist *lst = mem_alloc(sizeof(struct llist));
+    if (!lst) {
+        return NULL;
+    }
     lst->front = NULL;
+    lst->next_id = 1;
+    lst->version = 0;
+    pthread_rwlock_init(&lst->lock, NULL);
     return lst;
 }
 
-void add_front(struct matrix *mat, struct llist *lst) {
+uint64_t list_add(struct matrix *mat, struct llist *lst, bool back) {
     assert(lst);
     assert(mat);
-    struct llnode *newnode = malloc(sizeof(struct llnode));
+    struct llnode *newnode = mem_alloc(sizeof(struct llnode));
+    if (!newnode) {
+        return 0;
+    }
     newnode->mat = mat;
-    newnode->next = lst->front;
-    lst->front = newnode;
+    newnode->next = NULL;
+    pthread_rwlock_wrlock(&lst->lock);
+    newnode->id = lst->next_id++;
+    ++lst->version;
+    struct llnode **link = &lst->front;
+    if (back) {
+        while (*link) {
+            link = &(*link)->next;
+        }
+    } else {
+        newnode->next = lst->front;
+    }
+    *link = newnode;
+    uint64_t id = newnode->id;
+    pthread_rwlock_unlock(&lst->lock);
+    return id;
+}
+
+bool add_front(struct matrix *mat, struct llist *lst) {
+    return list_add(mat, lst, false) != 0;
+}
+
+bool add_back(struct matrix *mat, struct llist *lst) {
+    return list_add(mat, lst, true) != 0;
 }
 
 void list_destroy(struct llist *lst, int d) {
     assert(lst);
     assert(d == 0 || d == 1);
+    pthread_rwlock_wrlock(&lst->lock);
     struct llnode *curnode = lst->front;
     struct llnode *nextnode = NULL;
     while (curnode) {
         nextnode = curnode->next;
         destroy_matrix(curnode->mat);
-        free(curnode);
+        mem_free(curnode, sizeof(struct llnode));
         curnode = nextnode;
+        ++lst->version;
     }
+    lst->front = NULL;
+    pthread_rwlock_unlock(&lst->lock);
     if (d) {
-        free(lst);
-    } else {
-        lst->front = NULL;
+        pthread_rwlock_destroy(&lst->lock);
+        mem_free(lst, sizeof(struct llist));
     }
 }
 
-int list_length(const struct llist *lst) {
-    assert(lst);
+// count_nodes(lst) returns the length of lst
+// requires: lst->lock is held
+static int count_nodes(const struct llist *lst) {
     int len = 0;
     struct llnode *node = lst->front;
     while (node) {
@@ -59,13 +105,23 @@ int list_length(const struct llist *lst) {
     return len;
 }
 
+int list_length(struct llist *lst) {
+    assert(lst);
+    pthread_rwlock_rdlock(&lst->lock);
+    int len = count_nodes(lst);
+    pthread_rwlock_unlock(&lst->lock);
+    return len;
+}
+
 struct matrix *matrix_at(int index, struct llist *lst) {
     assert(lst);
     if (index < 0) {
         fprintf(stderr, "Error: This is an invalid index\n");
         return NULL;
     }
-    if (index >= list_length(lst)) {
+    pthread_rwlock_rdlock(&lst->lock);
+    if (index >= count_nodes(lst)) {
+        pthread_rwlock_unlock(&lst->lock);
         fprintf(stderr, "Error: There is no matrix at that index\n");
         return NULL;
     }
@@ -73,7 +129,72 @@ struct matrix *matrix_at(int index, struct llist *lst) {
     for (int i = 0; i < index; ++i) {
         curnode = curnode->next;
     }
-    return curnode->mat;
+    struct matrix *mat = curnode->mat;
+    pthread_rwlock_unlock(&lst->lock);
+    return mat;
+}
+
+int index_of_id(uint64_t id, struct llist *lst) {
+    assert(lst);
+    pthread_rwlock_rdlock(&lst->lock);
+    int index = 0;
+    struct llnode *curnode = lst->front;
+    while (curnode && curnode->id != id) {
+        ++index;
+        curnode = curnode->next;
+    }
+    pthread_rwlock_unlock(&lst->lock);
+    return curnode ? index : -1;
+}
+
+uint64_t id_at(int index, struct llist *lst) {
+    assert(lst);
+    pthread_rwlock_rdlock(&lst->lock);
+    struct llnode *curnode = index < 0 ? NULL : lst->front;
+    for (int i = 0; curnode && i < index; ++i) {
+        curnode = curnode->next;
+    }
+    uint64_t id = curnode ? curnode->id : 0;
+    pthread_rwlock_unlock(&lst->lock);
+    return id;
+}
+
+struct matrix *matrix_with_id(uint64_t id, struct llist *lst) {
+    assert(lst);
+    pthread_rwlock_rdlock(&lst->lock);
+    struct llnode *curnode = lst->front;
+    while (curnode && curnode->id != id) {
+        curnode = curnode->next;
+    }
+    struct matrix *mat = curnode ? curnode->mat : NULL;
+    pthread_rwlock_unlock(&lst->lock);
+    return mat;
+}
+
+uint64_t list_version(struct llist *lst) {
+    assert(lst);
+    pthread_rwlock_rdlock(&lst->lock);
+    uint64_t version = lst->version;
+    pthread_rwlock_unlock(&lst->lock);
+    return version;
+}
+
+struct matrix **list_snapshot(struct llist *lst, int *len) {
+    assert(lst);
+    assert(len);
+    pthread_rwlock_rdlock(&lst->lock);
+    *len = count_nodes(lst);
+    struct matrix **mats = NULL;
+    if (*len) {
+        mats = mem_alloc(*len * sizeof(struct matrix *));
+        struct llnode *curnode = lst->front;
+        for (int i = 0; mats && curnode; ++i) {
+            mats[i] = curnode->mat;
+            curnode = curnode->next;
+        }
+    }
+    pthread_rwlock_unlock(&lst->lock);
+    return mats;
 }
 
 void remove_item(int index, struct llist *lst) {
@@ -82,7 +203,9 @@ void remove_item(int index, struct llist *lst) {
         fprintf(stderr, "Error: This is an invalid index\n");
         return;
     }
-    if (index >= list_length(lst)) {
+    pthread_rwlock_wrlock(&lst->lock);
+    if (index >= count_nodes(lst)) {
+        pthread_rwlock_unlock(&lst->lock);
         fprintf(stderr, "Error: There is no matrix at that index\n");
         return;
     }
@@ -93,21 +216,43 @@ void remove_item(int index, struct llist *lst) {
         curnode = curnode->next;
     }
     destroy_matrix(curnode->mat);
+    ++lst->version;
     if (prevnode == NULL) {
         lst->front = curnode->next;
     } else {
         prevnode->next = curnode->next;
     }
-    free(curnode);
+    pthread_rwlock_unlock(&lst->lock);
+    mem_free(curnode, sizeof(struct llnode));
+}
+
+bool remove_id(uint64_t id, struct llist *lst) {
+    assert(lst);
+    pthread_rwlock_wrlock(&lst->lock);
+    struct llnode **link = &lst->front;
+    while (*link && (*link)->id != id) {
+        link = &(*link)->next;
+    }
+    struct llnode *curnode = *link;
+    if (!curnode) {
+        pthread_rwlock_unlock(&lst->lock);
+        return false;
+    }
+    destroy_matrix(curnode->mat);
+    ++lst->version;
+    *link = curnode->next;
+    pthread_rwlock_unlock(&lst->lock);
+    mem_free(curnode, sizeof(struct llnode));
+    return true;
 }
 
 void print_llist(struct llist *lst) {
     assert(lst);
+    pthread_rwlock_rdlock(&lst->lock);
     struct llnode *curnode = lst->front;
     int i = 0;
     if (!lst->front) {
         printf("[Empty]\n");
-        return;
     }
     while (curnode) {
         printf("%d) ", i);
@@ -115,4 +260,5 @@ void print_llist(struct llist *lst) {
         ++i;
         curnode = curnode->next;
     }
+    pthread_rwlock_unlock(&lst->lock);
 }
\ No newline at end of file
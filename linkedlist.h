@@ -1,19 +1,45 @@
 // time: k is length of list
 // see linalg.h
+#include <stdbool.h>
+#include <stdint.h>
+
+// All functions below may be called concurrently from several threads;
+//   the list structure is guarded by a reader-writer lock. The matrices
+//   in the list are not: a matrix returned by matrix_at stays valid until
+//   it is removed with remove_item or list_destroy, so only the thread
+//   that removes matrices may hold on to them without copying.
 struct llnode;
 
 struct llist;
 
 // list_create() returns an empty linked list
-// effects: allocates memory
+// notes: returns NULL if the memory is not available (see memtrack.h)
+// effects: may allocate memory
+//          may produce output
 // time: O(1)
 struct llist *list_create(void);
 
-// add_front(mat, lst) adds a matrix to the front of a linked list
+// list_add(mat, lst, back) adds a matrix to the front of a linked list
+//   (to the back if back is true) and returns the id of its node, or
+//   returns 0 (leaving mat to the caller) if the memory for the node is
+//   not available (see memtrack.h). Ids start at 1 and are never
+//   reused within lst, so unlike an index an id keeps naming the same
+//   matrix while others are added and removed.
 // requires: lst and mat are valid pointers
-// effects: allocates memory (call remove_item or list_destroy)
-// time: O(1)
-void add_front(const struct matrix *mat, struct llist *lst);
+// effects: may allocate memory (call remove_item or list_destroy)
+//          may produce output
+// time: O(1) at the front, O(k) at the back
+uint64_t list_add(struct matrix *mat, struct llist *lst, bool back);
+
+// add_front(mat, lst) and add_back(mat, lst) are list_add(mat, lst,
+//   false) and list_add(mat, lst, true), returning whether it succeeded.
+//   Adding at the back leaves the index of every matrix in lst as it is.
+// requires: lst and mat are valid pointers
+// effects: may allocate memory (call remove_item or list_destroy)
+//          may produce output
+// time: O(1) for add_front, O(k) for add_back
+bool add_front(struct matrix *mat, struct llist *lst);
+bool add_back(struct matrix *mat, struct llist *lst);
 
 // list_destroy(lst) frees all memory for lst if d = 1 and frees
 //   memory for all nodes in lst if d = 0
@@ -26,7 +52,7 @@ void list_destroy(struct llist *lst, int d);
 // list_length(lst) returns the length of lst
 // requires: lst is a valid pointer
 // time: O(k)
-int list_length(const struct llist *lst);
+int list_length(struct llist *lst);
 
 // matrix_at(index, lst) returns the matrix at index in lst
 // requires: lst is a valid pointer
@@ -38,6 +64,46 @@ int list_length(const struct llist *lst);
 // time: O(k)
 struct matrix *matrix_at(int index, struct llist *lst);
 
+// index_of_id(id, lst) returns the index of the matrix with the given id
+//   in lst, or -1 if it is not (or no longer) in lst
+// requires: lst is a valid pointer
+// time: O(k)
+int index_of_id(uint64_t id, struct llist *lst);
+
+// id_at(index, lst) returns the id of the matrix at index in lst, or 0
+//   if there is none
+// requires: lst is a valid pointer
+// time: O(k)
+uint64_t id_at(int index, struct llist *lst);
+
+// matrix_with_id(id, lst) returns the matrix with the given id in lst,
+//   or NULL if it is not (or no longer) in lst
+// requires: lst is a valid pointer
+// time: O(k)
+struct matrix *matrix_with_id(uint64_t id, struct llist *lst);
+
+// list_version(lst) returns a number that changes whenever a matrix is
+//   added to or removed from lst. The matrices themselves never change,
+//   so anything computed from the matrices of lst is still up to date
+//   while the version is the same.
+// requires: lst is a valid pointer
+// time: O(1)
+uint64_t list_version(struct llist *lst);
+
+// list_snapshot(lst, len) returns an array with the matrices of lst
+//   in index order and stores its length in *len. The list is walked
+//   once under its lock, so the array is consistent even while other
+//   threads add matrices.
+// requires: lst and len are valid pointers
+// notes: returns NULL if lst is empty, or outputs an error message and
+//   returns NULL (with *len > 0) if out of memory (see memtrack.h)
+// effects: may allocate memory (client must call mem_free on the array
+//            with *len * sizeof(struct matrix *), not destroy the
+//            matrices)
+//          may produce output
+// time: O(k)
+struct matrix **list_snapshot(struct llist *lst, int *len);
+
 // remove_item(index, lst) removes the node at index from lst
 // requires: lst is a valid pointer
 // notes: 
@@ -49,6 +115,13 @@ struct matrix *matrix_at(int index, struct llist *lst);
 // time: O(k)
 void remove_item(int index, struct llist *lst);
 
+// remove_id(id, lst) removes the matrix with the given id from lst and
+//   returns true, or returns false if it is not (or no longer) in lst
+// requires: lst is a valid pointer
+// effects: may free memory
+// time: O(k)
+bool remove_id(uint64_t id, struct llist *lst);
+
 // print_llist(lst) prints all matrices in lst
 // requires: lst is a valid pointer
 // effects: produces output
@@ -2,11 +2,128 @@
 #include <assert.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include "linalg.h"
 #include "linkedlist.h"
+#include "jobs.h"
+#include "parallel.h"
+#include "mapall.h"
+#include "krylov.h"
+#include "eigen.h"
+#include "svd.h"
+#include "trace.h"
+#include "memtrack.h"
+#include "server.h"
+#include "similarity.h"
+#include "half.h"
+#include "dense.h"
+#include "qr.h"
+#include "covariance.h"
+#include "shm.h"
+
+// Heavy commands can run as background jobs (see the async command).
+//   A job works on private copies of its input matrices, so the stored
+//   matrices can be removed while it runs; the copies are freed as soon
+//   as it is done. Its matrix result is added to the back of the
+//   workspace when it finishes, so the indexes the user is typing do not
+//   shift, and wait prints where it went.
+enum job_kind {
+    JOB_REF,
+    JOB_RREF,
+    JOB_RANK,
+    JOB_NULLITY,
+    JOB_MATPROD
+};
+
+struct async_job {
+    enum job_kind kind;
+    struct llist *list;
+    struct matrix *mat1;
+    struct matrix *mat2;
+    struct matrix *result;
+    uint64_t saved;         // the list id of result once it is saved, or 0
+    size_t value;
+};
+
+void run_job(void *arg) {
+    struct async_job *job = arg;
+    if (job->kind == JOB_REF) {
+        job->result = ref(job->mat1);
+    } else if (job->kind == JOB_RREF) {
+        job->result = rref(job->mat1);
+    } else if (job->kind == JOB_RANK) {
+        job->value = rank(job->mat1);
+    } else if (job->kind == JOB_NULLITY) {
+        job->value = nullity(job->mat1);
+    } else {
+        job->result = matrix_multiplication(job->mat1, job->mat2);
+    }
+    // the copies share blocks with the inputs (see copy_matrix), which
+    //   would otherwise stay alive until the pool is destroyed
+    destroy_matrix(job->mat1);
+    job->mat1 = NULL;
+    if (job->mat2) {
+        destroy_matrix(job->mat2);
+        job->mat2 = NULL;
+    }
+}
+
+void complete_job(void *arg) {
+    struct async_job *job = arg;
+    if (job->result) {
+        job->saved = list_add(job->result, job->list, true);
+    }
+}
+
+void release_job(void *arg) {
+    struct async_job *job = arg;
+    if (job->mat1) {
+        destroy_matrix(job->mat1);
+    }
+    if (job->mat2) {
+        destroy_matrix(job->mat2);
+    }
+    if (job->result && !job->saved) {
+        destroy_matrix(job->result);
+    }
+    free(job);
+}
+
+void submit_job(struct job_pool *pool, struct llist *list, enum job_kind kind,
+                const char *name, struct matrix *mat1, struct matrix *mat2) {
+    struct async_job *job = malloc(sizeof(struct async_job));
+    if (!job) {
+        fprintf(stderr, "Error: out of memory\n");
+        return;
+    }
+    job->kind = kind;
+    job->list = list;
+    job->mat1 = copy_matrix(mat1);
+    job->mat2 = mat2 ? copy_matrix(mat2) : NULL;
+    if (!job->mat1 || (mat2 && !job->mat2)) {
+        if (job->mat1) {
+            destroy_matrix(job->mat1);
+        }
+        if (job->mat2) {
+            destroy_matrix(job->mat2);
+        }
+        free(job);
+        return;
+    }
+    job->result = NULL;
+    job->saved = 0;
+    job->value = 0;
+    int id = jobpool_submit(pool, name, run_job, complete_job, release_job, job);
+    if (id < 0) {
+        fprintf(stderr, "Error: the job was not submitted\n");
+        release_job(job);
+        return;
+    }
+    printf("Submitted job %d (use wait %d to get the result)\n", id, id);
+}
 
 void handle_create(struct llist *list) {
     int rows = 0;
@@ -19,13 +136,21 @@ void handle_create(struct llist *list) {
         fprintf(stderr, "Error: row or column number less or equal to zero\n");
         return;
     }
-    float *input_array = malloc(rows * columns * sizeof(float));
-    printf("Please enter the %d elements of your matrix from left to right, top to bottom:\n", rows * columns);
-    for (int i = 0; i < rows * columns; ++i) {
+    size_t count = (size_t)rows * columns;
+    float *input_array = malloc(count * sizeof(float));
+    if (!input_array) {
+        fprintf(stderr, "Error: out of memory\n");
+        return;
+    }
+    printf("Please enter the %zu elements of your matrix from left to right, top to bottom:\n", count);
+    for (size_t i = 0; i < count; ++i) {
         scanf("%f", &input_array[i]);
     }
-    add_front(create_matrix(rows, columns, input_array), list);
+    struct matrix *mat = create_matrix(rows, columns, input_array);
     free(input_array);
+    if (mat && !add_front(mat, list)) {
+        destroy_matrix(mat);
+    }
 }
 
 void handle_remove(struct llist *list) {
@@ -47,11 +172,13 @@ void handle_print(struct llist *list) {
 
 void save_matrix(struct llist *list, struct matrix *mat) {
     char yes_no = 0;
-    while (1) {
+    while (mat) {
         printf("Do you want to save this matrix? (y or n): ");
         scanf(" %c", &yes_no);
         if (yes_no == 'y') {
-            add_front(mat, list);
+            if (!add_front(mat, list)) {
+                destroy_matrix(mat);
+            }
             return;
         } else if (yes_no == 'n') {
             destroy_matrix(mat);
@@ -62,6 +189,28 @@ void save_matrix(struct llist *list, struct matrix *mat) {
     }
 }
 
+void handle_layout(struct llist *list) {
+    int index = 0;
+    printf("Enter the index of your matrix: ");
+    scanf("%d", &index);
+    struct matrix *mat = matrix_at(index, list);
+    if (!mat) {
+        return;
+    }
+    enum matrix_layout layout = LAYOUT_ROW_MAJOR;
+    if (matrix_layout(mat) == LAYOUT_ROW_MAJOR) {
+        layout = LAYOUT_COLUMN_MAJOR;
+    }
+    struct matrix *converted = matrix_to_layout(mat, layout);
+    if (!converted) {
+        return;
+    }
+    printf("The matrix is now stored %s:\n",
+           layout == LAYOUT_ROW_MAJOR ? "row by row" : "column by column");
+    print_matrix(converted);
+    save_matrix(list, converted);
+}
+
 void handle_addsub(struct llist *list, int addsub) {
     int index = 0;
     printf("Enter the index of the first matrix: ");
@@ -101,6 +250,9 @@ void handle_scalarmultiply(struct llist *list) {
     printf("Enter the value of the scalar: ");
     scanf("%f", &scalar);
     struct matrix *scaled_matrix = scalar_multiply(scalar, mat);
+    if (!scaled_matrix) {
+        return;
+    }
     printf("Your scaled matrix is:\n");
     print_matrix(scaled_matrix);
     save_matrix(list, scaled_matrix);
@@ -181,6 +333,118 @@ void handle_angle(struct llist *list) {
     printf("The angle between these two vectors is %g radians or %g degrees\n", anglerad, angledeg);
 }
 
+// The similarity index of the workspace vectors of one dimension, kept
+//   between similar commands while the workspace does not change
+struct similar_cache {
+    bool built;
+    uint64_t version;               // list_version it was built at
+    size_t dimension;
+    bool reduced;
+    struct similarity_index *idx;   // NULL if there are no such vectors
+    int *indexes;                   // workspace index of each vector
+};
+
+// similar_cache_clear(cache) frees the index in cache, if any
+static void similar_cache_clear(struct similar_cache *cache) {
+    if (cache->idx) {
+        similarity_index_destroy(cache->idx);
+    }
+    free(cache->indexes);
+    *cache = (struct similar_cache){0};
+}
+
+// similar_index(list, cache, dimension, reduced) makes cache hold the
+//   index of the vectors with dimension rows in list, and builds it again
+//   only if list changed or the index does not have what is asked for;
+//   returns false if out of memory (cache is then empty)
+static bool similar_index(struct llist *list, struct similar_cache *cache, size_t dimension,
+                          bool reduced) {
+    uint64_t version = list_version(list);
+    if (cache->built && cache->version == version && cache->dimension == dimension &&
+        (cache->reduced || !reduced)) {
+        return true;
+    }
+    similar_cache_clear(cache);
+    int len = 0;
+    struct matrix **mats = list_snapshot(list, &len);
+    if (!mats && len) {
+        return false;
+    }
+    int *indexes = len ? malloc(len * sizeof(int)) : NULL;
+    if (len && !indexes) {
+        fprintf(stderr, "Error: out of memory\n");
+        mem_free(mats, len * sizeof(struct matrix *));
+        return false;
+    }
+    int count = 0;
+    for (int i = 0; i < len; ++i) {
+        if (matrix_columns(mats[i]) == 1 && matrix_rows(mats[i]) == dimension) {
+            mats[count] = mats[i];
+            indexes[count++] = i;
+        }
+    }
+    struct similarity_index *idx = count ? similarity_index_create(mats, count, reduced) : NULL;
+    mem_free(mats, len * sizeof(struct matrix *));
+    if (count && !idx) {
+        free(indexes);
+        return false;
+    }
+    *cache = (struct similar_cache){true, version, dimension, reduced, idx, indexes};
+    return true;
+}
+
+void handle_similar(struct llist *list, struct similar_cache *cache) {
+    int index = 0;
+    int k = 0;
+    char yes_no = 0;
+    printf("Enter the index of the query vector: ");
+    scanf("%d", &index);
+    struct matrix *query = matrix_at(index, list);
+    if (!query) {
+        return;
+    }
+    if (matrix_columns(query) != 1) {
+        fprintf(stderr, "Error: Matrix must be a vector (1 column)\n");
+        return;
+    }
+    printf("Enter the number of vectors to find: ");
+    scanf("%d", &k);
+    if (k <= 0) {
+        fprintf(stderr, "Error: invalid number of vectors\n");
+        return;
+    }
+    printf("Score in reduced precision first? (y/n): ");
+    scanf(" %c", &yes_no);
+    if (!similar_index(list, cache, matrix_rows(query), yes_no == 'y')) {
+        return;
+    }
+    // the query is in the index too, so one more hit is asked for
+    size_t size = cache->idx ? similarity_index_size(cache->idx) : 0;
+    if (size <= 1) {
+        printf("There are no other vectors of the same size\n");
+        return;
+    }
+    size_t wanted = (size_t)k < size ? (size_t)k + 1 : size;
+    struct similarity_hit *hits = malloc(wanted * sizeof(struct similarity_hit));
+    float *entries = malloc(matrix_rows(query) * sizeof(float));
+    if (!hits || !entries) {
+        fprintf(stderr, "Error: out of memory\n");
+    } else {
+        matrix_entries(query, LAYOUT_ROW_MAJOR, entries);
+        size_t found = similarity_top_k(cache->idx, entries, wanted, yes_no == 'y', hits);
+        for (size_t i = 0, shown = 0; i < found && shown < (size_t)k; ++i) {
+            int at = cache->indexes[hits[i].index];
+            if (at != index) {
+                printf("Index %d: angle %g radians (cosine %g)\n", at, hits[i].angle,
+                       hits[i].cosine);
+                ++shown;
+            }
+        }
+    }
+    free(entries);
+    free(hits);
+}
+
 void handle_proj(struct llist *list) {
     int index = 0;
     printf("Enter the index of the matrix you'd like to project: ");
@@ -322,7 +586,7 @@ void handle_rowadd(struct llist *list) {
     save_matrix(list, rowadd);
 }
 
-void handle_ref(struct llist *list) {
+void handle_ref(struct llist *list, struct job_pool *pool) {
     int index = 0;
     printf("Enter the index of your matrix: ");
     scanf("%d", &index);
@@ -330,13 +594,20 @@ void handle_ref(struct llist *list) {
     if (!mat) {
         return;
     }
+    if (pool) {
+        submit_job(pool, list, JOB_REF, "ref", mat, NULL);
+        return;
+    }
     struct matrix *REF = ref(mat);
+    if (!REF) {
+        return;
+    }
     printf("The resulting matrix is:\n");
     print_matrix(REF);
     save_matrix(list, REF);
 }
 
-void handle_rref(struct llist *list) {
+void handle_rref(struct llist *list, struct job_pool *pool) {
     int index = 0;
     printf("Enter the index of your matrix: ");
     scanf("%d", &index);
@@ -344,13 +615,20 @@ void handle_rref(struct llist *list) {
     if (!mat) {
         return;
     }
+    if (pool) {
+        submit_job(pool, list, JOB_RREF, "rref", mat, NULL);
+        return;
+    }
     struct matrix *RREF = rref(mat);
+    if (!RREF) {
+        return;
+    }
     printf("The resulting matrix is:\n");
     print_matrix(RREF);
     save_matrix(list, RREF);
 }
 
-void handle_rank(struct llist *list) {
+void handle_rank(struct llist *list, struct job_pool *pool) {
     int index = 0;
     printf("Enter the index of your matrix: ");
     scanf("%d", &index);
@@ -358,10 +636,17 @@ void handle_rank(struct llist *list) {
     if (!mat) {
         return;
     }
-    printf("The rank of this matrix is %d\n", rank(mat));
+    if (pool) {
+        submit_job(pool, list, JOB_RANK, "rank", mat, NULL);
+        return;
+    }
+    size_t r = rank(mat);
+    if (r != SIZE_MAX) {
+        printf("The rank of this matrix is %zu\n", r);
+    }
 }
 
-void handle_nullity(struct llist *list) {
+void handle_nullity(struct llist *list, struct job_pool *pool) {
     int index = 0;
     printf("Enter the index of your matrix: ");
     scanf("%d", &index);
@@ -369,10 +654,17 @@ void handle_nullity(struct llist *list) {
     if (!mat) {
         return;
     }
-    printf("The nullity of this matrix is %d\n", nullity(mat));
+    if (pool) {
+        submit_job(pool, list, JOB_NULLITY, "nullity", mat, NULL);
+        return;
+    }
+    size_t n = nullity(mat);
+    if (n != SIZE_MAX) {
+        printf("The nullity of this matrix is %zu\n", n);
+    }
 }
 
-void handle_matprod(struct llist *list) {
+void handle_matprod(struct llist *list, struct job_pool *pool) {
     int index = 0;
     printf("Enter the index of the first matrix: ");
     scanf("%d", &index);
@@ -386,6 +678,10 @@ void handle_matprod(struct llist *list) {
     if (!mat2) {
         return;
     }
+    if (pool) {
+        submit_job(pool, list, JOB_MATPROD, "matprod", mat1, mat2);
+        return;
+    }
     struct matrix *new_vec = matrix_multiplication(mat1, mat2);
     if (!new_vec) {
         return;
@@ -395,32 +691,766 @@ void handle_matprod(struct llist *list) {
     save_matrix(list, new_vec);
 }
 
+void handle_power(struct llist *list) {
+    int index = 0;
+    int k = 0;
+    printf("Enter the index of your (square) matrix: ");
+    scanf("%d", &index);
+    struct matrix *mat = matrix_at(index, list);
+    if (!mat) {
+        return;
+    }
+    printf("Enter the exponent: ");
+    scanf("%d", &k);
+    if (k < 0) {
+        fprintf(stderr, "Error: invalid exponent\n");
+        return;
+    }
+    struct matrix *power = matrix_power(mat, k);
+    if (!power) {
+        return;
+    }
+    print_matrix(power);
+    save_matrix(list, power);
+}
+
+void handle_polynomial(struct llist *list) {
+    int index = 0;
+    int degree = 0;
+    printf("Enter the index of your (square) matrix: ");
+    scanf("%d", &index);
+    struct matrix *mat = matrix_at(index, list);
+    if (!mat) {
+        return;
+    }
+    printf("Enter the degree of the polynomial: ");
+    scanf("%d", &degree);
+    if (degree < 0) {
+        fprintf(stderr, "Error: invalid degree\n");
+        return;
+    }
+    float *coefficients = malloc((degree + 1) * sizeof(float));
+    if (!coefficients) {
+        fprintf(stderr, "Error: out of memory\n");
+        return;
+    }
+    printf("Please enter the %d coefficients, constant term first:\n", degree + 1);
+    for (int i = 0; i <= degree; ++i) {
+        scanf("%f", &coefficients[i]);
+    }
+    struct matrix *value = matrix_polynomial(mat, coefficients, degree);
+    free(coefficients);
+    if (!value) {
+        return;
+    }
+    print_matrix(value);
+    save_matrix(list, value);
+}
+
+void handle_exp(struct llist *list) {
+    int index = 0;
+    printf("Enter the index of your (square) matrix: ");
+    scanf("%d", &index);
+    struct matrix *mat = matrix_at(index, list);
+    if (!mat) {
+        return;
+    }
+    struct matrix *exponential = matrix_exponential(mat);
+    if (!exponential) {
+        return;
+    }
+    print_matrix(exponential);
+    save_matrix(list, exponential);
+}
+
+void handle_mapall(struct llist *list) {
+    char name[20];
+    enum map_op op;
+    float scalar = 0;
+    struct matrix *operand = NULL;
+    printf("Enter the operation to apply to every matrix: ");
+    scanf("%19s", name);
+    if (!map_op_parse(name, &op)) {
+        fprintf(stderr, "Error: mapall supports unitvector, length, scalarmultiply, "
+                        "matprod, ref, rref, rank and nullity\n");
+        return;
+    }
+    if (op == MAP_SCALARMULTIPLY) {
+        printf("Enter the value of the scalar: ");
+        scanf("%f", &scalar);
+    } else if (op == MAP_MATPROD) {
+        int index = 0;
+        printf("Enter the index of the matrix to multiply every matrix by: ");
+        scanf("%d", &index);
+        operand = matrix_at(index, list);
+        if (!operand) {
+            return;
+        }
+    }
+    int len = 0;
+    struct map_result *results = map_list(op, scalar, operand, list, &len);
+    if (!results) {
+        if (!len) {
+            printf("[Empty]\n");
+        }
+        return;
+    }
+    int produced = 0;
+    for (int i = 0; i < len; ++i) {
+        if (!map_op_has_matrix(op)) {
+            printf("%d) %g\n", i, results[i].value);
+        } else if (results[i].mat) {
+            printf("%d) ", i);
+            print_matrix(results[i].mat);
+            ++produced;
+        } else {
+            printf("%d) [No result]\n", i);
+        }
+    }
+    char yes_no = 0;
+    while (produced) {
+        printf("Do you want to save these %d matrices? (y or n): ", produced);
+        scanf(" %c", &yes_no);
+        if (yes_no == 'y' || yes_no == 'n') {
+            break;
+        }
+        fprintf(stderr, "Error: invalid input\n");
+    }
+    // saved back to front so the results keep the order of their inputs
+    for (int i = len - 1; i >= 0; --i) {
+        if (!results[i].mat) {
+            continue;
+        }
+        if (yes_no != 'y' || !add_front(results[i].mat, list)) {
+            destroy_matrix(results[i].mat);
+        }
+    }
+    mem_free(results, len * sizeof(struct map_result));
+}
+
+void handle_jobs(struct job_pool *pool) {
+    jobpool_print(pool);
+}
+
+void handle_wait(struct job_pool *pool) {
+    int id = 0;
+    printf("Enter the id of the job: ");
+    scanf("%d", &id);
+    void *arg = NULL;
+    int status = jobpool_wait(pool, id, &arg);
+    if (status == JOB_CANCELLED) {
+        printf("Job %d was cancelled\n", id);
+    } else if (status == JOB_DONE) {
+        struct async_job *job = arg;
+        if ((job->kind == JOB_RANK || job->kind == JOB_NULLITY) && job->value == SIZE_MAX) {
+            printf("Job %d ran out of memory\n", id);
+        } else if (job->kind == JOB_RANK) {
+            printf("The rank of this matrix is %zu\n", job->value);
+        } else if (job->kind == JOB_NULLITY) {
+            printf("The nullity of this matrix is %zu\n", job->value);
+        } else if (job->saved) {
+            int index = index_of_id(job->saved, job->list);
+            if (index >= 0) {
+                printf("Job %d finished and its matrix was saved at index %d\n", id, index);
+            } else {
+                printf("Job %d finished; its matrix was saved but has since been removed\n", id);
+            }
+        } else {
+            printf("Job %d finished without a result\n", id);
+        }
+    }
+}
+
+void handle_cancel(struct job_pool *pool) {
+    int id = 0;
+    printf("Enter the id of the job: ");
+    scanf("%d", &id);
+    int status = jobpool_cancel(pool, id);
+    if (status == JOB_QUEUED || status == JOB_RUNNING) {
+        printf("Job %d was cancelled\n", id);
+    } else if (status >= 0) {
+        printf("Job %d has already finished\n", id);
+    }
+}
+
+// solve_refined(list, mat, vec) solves mat x = vec by a float LU with
+//   iterative refinement in double (see dense.h), and prints x and the
+//   residual in double: the workspace only keeps x rounded to float,
+//   which loses the accuracy the refinement gained
+void solve_refined(struct llist *list, const struct matrix *mat, const struct matrix *vec) {
+    int n = matrix_rows(mat);
+    double *b = malloc(n * sizeof(double));
+    double *x = malloc(n * sizeof(double));
+    float *rounded = malloc(n * sizeof(float));
+    if (!b || !x || !rounded) {
+        fprintf(stderr, "Error: out of memory\n");
+        free(b);
+        free(x);
+        free(rounded);
+        return;
+    }
+    for (int i = 0; i < n; ++i) {
+        b[i] = matrix_get(vec, i, 0);
+    }
+    int steps = dense_solve_refined(mat, b, x);
+    struct matrix *solution = NULL;
+    if (steps >= 0) {
+        printf("Converged after %d solves with the float factors\n", steps);
+        printf("The solution x is (in double):\n");
+        double residual = 0;
+        double norm = 0;
+        for (int i = 0; i < n; ++i) {
+            double sum = b[i];
+            for (int j = 0; j < n; ++j) {
+                sum -= (double)matrix_get(mat, i, j) * x[j];
+            }
+            residual += sum * sum;
+            norm += b[i] * b[i];
+            printf("%.17g\n", x[i]);
+            rounded[i] = x[i];
+        }
+        printf("||b - Ax|| = %.3g (relative to ||b||: %.3g)\n", sqrt(residual),
+               norm ? sqrt(residual / norm) : 0);
+        solution = create_matrix(n, 1, rounded);
+    }
+    free(b);
+    free(x);
+    free(rounded);
+    if (!solution) {
+        return;
+    }
+    printf("x rounded to float, as the workspace keeps it:\n");
+    print_matrix(solution);
+    save_matrix(list, solution);
+}
+
+void handle_solve(struct llist *list) {
+    int index = 0;
+    char method[20];
+    char precond_name[20];
+    printf("Enter the index of the (square) matrix A: ");
+    scanf("%d", &index);
+    struct matrix *mat = matrix_at(index, list);
+    if (!mat) {
+        return;
+    }
+    printf("Enter the index of the vector b: ");
+    scanf("%d", &index);
+    struct matrix *vec = matrix_at(index, list);
+    if (!vec) {
+        return;
+    }
+    int n = matrix_rows(mat);
+    if (matrix_columns(mat) != n || matrix_rows(vec) != n || matrix_columns(vec) != 1) {
+        fprintf(stderr, "Error: A must be square and b a vector with as many rows as A\n");
+        return;
+    }
+    printf("Enter the method (lu, cg, gmres or bicgstab): ");
+    scanf("%19s", method);
+    if (!strcmp(method, "lu")) {
+        solve_refined(list, mat, vec);
+        return;
+    }
+    if (strcmp(method, "cg") && strcmp(method, "gmres") && strcmp(method, "bicgstab")) {
+        fprintf(stderr, "Error: invalid method\n");
+        return;
+    }
+    printf("Enter the preconditioner (none, jacobi or ilu0): ");
+    scanf("%19s", precond_name);
+    struct krylov_precond *precond = NULL;
+    if (!strcmp(precond_name, "jacobi")) {
+        precond = precond_jacobi(mat);
+    } else if (!strcmp(precond_name, "ilu0")) {
+        precond = precond_ilu0(mat);
+    } else if (strcmp(precond_name, "none")) {
+        fprintf(stderr, "Error: invalid preconditioner\n");
+        return;
+    }
+    if (!precond && strcmp(precond_name, "none")) {
+        return;
+    }
+    struct krylov_options opts = {1e-6, 10 * n, 30, precond, NULL};
+    struct linop op = linop_matrix(mat);
+    float *b = malloc(n * sizeof(float));
+    float *x = malloc(n * sizeof(float));
+    if (!b || !x) {
+        fprintf(stderr, "Error: out of memory\n");
+        free(b);
+        free(x);
+        if (precond) {
+            precond_destroy(precond);
+        }
+        return;
+    }
+    for (int i = 0; i < n; ++i) {
+        b[i] = matrix_get(vec, i, 0);
+        x[i] = 0;
+    }
+    struct krylov_result result;
+    if (!strcmp(method, "cg")) {
+        result = krylov_cg(&op, b, x, &opts);
+    } else if (!strcmp(method, "gmres")) {
+        result = krylov_gmres(&op, b, x, &opts);
+    } else {
+        result = krylov_bicgstab(&op, b, x, &opts);
+    }
+    if (precond) {
+        precond_destroy(precond);
+    }
+    if (isnan(result.residual)) {
+        // the solver could not allocate its workspace
+        free(b);
+        free(x);
+        return;
+    }
+    printf("%s after %d iterations (relative residual %g)\n",
+           result.converged ? "Converged" : "Did not converge", result.iterations, result.residual);
+    struct matrix *solution = create_matrix(n, 1, x);
+    free(b);
+    free(x);
+    if (!solution) {
+        return;
+    }
+    printf("The solution x is:\n");
+    print_matrix(solution);
+    save_matrix(list, solution);
+}
+
+// Matrices up to this size use the dense eigensolver in handle_eigen
+#define DENSE_EIGEN_MAX 500
+
+void handle_eigen(struct llist *list) {
+    int index = 0;
+    int k = 0;
+    printf("Enter the index of your (symmetric) matrix: ");
+    scanf("%d", &index);
+    struct matrix *mat = matrix_at(index, list);
+    if (!mat) {
+        return;
+    }
+    int n = matrix_rows(mat);
+    if (matrix_columns(mat) != n) {
+        fprintf(stderr, "Error: Matrix must be square\n");
+        return;
+    }
+    printf("Enter the number of (largest) eigenvalues to compute: ");
+    scanf("%d", &k);
+    if (k <= 0 || k > n) {
+        fprintf(stderr, "Error: invalid number of eigenvalues\n");
+        return;
+    }
+    float *values = malloc(n * sizeof(float));
+    float *vectors = malloc((size_t)n * (n <= DENSE_EIGEN_MAX ? n : k) * sizeof(float));
+    if (!values || !vectors) {
+        fprintf(stderr, "Error: out of memory\n");
+        free(values);
+        free(vectors);
+        return;
+    }
+    if (n <= DENSE_EIGEN_MAX) {
+        if (!eigen_symmetric(mat, values, vectors)) {
+            free(values);
+            free(vectors);
+            return;
+        }
+    } else {
+        struct linop op = linop_matrix(mat);
+        struct lanczos_result result = eigen_lanczos(&op, k, NULL, values, vectors);
+        if (result.failed) {
+            free(values);
+            free(vectors);
+            return;
+        }
+        printf("Lanczos: %d of %d eigenpairs converged after %d products\n",
+               result.converged, k, result.matvecs);
+    }
+    printf("The largest eigenvalues are:\n");
+    for (int i = 0; i < k; ++i) {
+        printf("%g\n", values[i]);
+    }
+    // the eigenvectors are stored one after another, i.e. column-major
+    struct matrix *eigenvectors = create_matrix_layout(n, k, vectors, LAYOUT_COLUMN_MAJOR);
+    free(values);
+    free(vectors);
+    if (!eigenvectors) {
+        return;
+    }
+    printf("The matching eigenvectors (as columns) are:\n");
+    print_matrix(eigenvectors);
+    save_matrix(list, eigenvectors);
+}
+
+void handle_svd(struct llist *list) {
+    int index = 0;
+    int k = 0;
+    printf("Enter the index of your matrix: ");
+    scanf("%d", &index);
+    struct matrix *mat = matrix_at(index, list);
+    if (!mat) {
+        return;
+    }
+    printf("Enter the rank of the approximation: ");
+    scanf("%d", &k);
+    if (k <= 0 || (size_t)k > matrix_rows(mat) || (size_t)k > matrix_columns(mat)) {
+        fprintf(stderr, "Error: invalid rank\n");
+        return;
+    }
+    struct low_rank *lr = randomized_svd(mat, k, NULL);
+    if (!lr) {
+        return;
+    }
+    printf("The largest singular values are:\n");
+    for (int i = 0; i < k; ++i) {
+        printf("%g\n", lr->values[i]);
+    }
+    printf("Estimated error (2-norm) of the approximation: %g\n", lr->error);
+    printf("The left singular vectors (as columns) are:\n");
+    print_matrix(lr->u);
+    save_matrix(list, copy_matrix(lr->u));
+    printf("The right singular vectors (as columns) are:\n");
+    print_matrix(lr->v);
+    save_matrix(list, copy_matrix(lr->v));
+    destroy_low_rank(lr);
+}
+
+// print_error(label, exact, approx) prints how far approx (of the same
+//   size) is from exact: the largest entry of the difference and its
+//   Frobenius norm relative to that of exact
+static void print_error(const char *label, const struct matrix *exact,
+                        const struct matrix *approx) {
+    size_t count = matrix_rows(exact) * matrix_columns(exact);
+    float *x = malloc(count * sizeof(float));
+    float *y = malloc(count * sizeof(float));
+    if (!x || !y) {
+        fprintf(stderr, "Error: out of memory\n");
+    } else {
+        matrix_entries(exact, LAYOUT_ROW_MAJOR, x);
+        matrix_entries(approx, LAYOUT_ROW_MAJOR, y);
+        double largest = 0;
+        double squares = 0;
+        double diff_squares = 0;
+        for (size_t i = 0; i < count; ++i) {
+            double diff = fabs((double)x[i] - y[i]);
+            largest = diff > largest ? diff : largest;
+            squares += (double)x[i] * x[i];
+            diff_squares += diff * diff;
+        }
+        printf("%s: largest error %g, relative error %g\n", label, largest,
+               squares ? sqrt(diff_squares / squares) : sqrt(diff_squares));
+    }
+    free(x);
+    free(y);
+}
+
+void handle_qr(struct llist *list) {
+    int index = 0;
+    printf("Enter the index of your matrix: ");
+    scanf("%d", &index);
+    struct matrix *mat = matrix_at(index, list);
+    if (!mat) {
+        return;
+    }
+    struct qr *qr = qr_householder(mat);
+    if (!qr) {
+        return;
+    }
+    printf("Q (orthonormal columns) is:\n");
+    print_matrix(qr->q);
+    save_matrix(list, copy_matrix(qr->q));
+    printf("R (upper triangular) is:\n");
+    print_matrix(qr->r);
+    save_matrix(list, copy_matrix(qr->r));
+    destroy_qr(qr);
+}
+
+void handle_orthonormalize(struct llist *list) {
+    int count = 0;
+    char method[20];
+    printf("Enter the number of vectors: ");
+    scanf("%d", &count);
+    if (count <= 0) {
+        fprintf(stderr, "Error: invalid number of vectors\n");
+        return;
+    }
+    struct matrix **vectors = malloc(count * sizeof(struct matrix *));
+    struct matrix **basis = malloc(count * sizeof(struct matrix *));
+    if (!vectors || !basis) {
+        fprintf(stderr, "Error: out of memory\n");
+        free(vectors);
+        free(basis);
+        return;
+    }
+    for (int i = 0; i < count; ++i) {
+        int index = 0;
+        printf("Enter the index of vector %d: ", i + 1);
+        scanf("%d", &index);
+        vectors[i] = matrix_at(index, list);
+        if (!vectors[i]) {
+            free(vectors);
+            free(basis);
+            return;
+        }
+    }
+    printf("Enter the method (classical or modified): ");
+    scanf("%19s", method);
+    if (strcmp(method, "classical") && strcmp(method, "modified")) {
+        fprintf(stderr, "Error: invalid method\n");
+        free(vectors);
+        free(basis);
+        return;
+    }
+    int rank = gram_schmidt(vectors, count, strcmp(method, "classical") ? GS_MODIFIED : GS_CLASSICAL,
+                            basis);
+    if (rank >= 0) {
+        printf("The vectors span %d dimensions; an orthonormal basis is:\n", rank);
+    }
+    for (int i = 0; i < rank; ++i) {
+        print_matrix(basis[i]);
+        save_matrix(list, basis[i]);
+    }
+    free(vectors);
+    free(basis);
+}
+
+void handle_covariance(struct llist *list) {
+    int index = 0;
+    char kind[20];
+    printf("Enter the index of your matrix (one sample per row): ");
+    scanf("%d", &index);
+    struct matrix *mat = matrix_at(index, list);
+    if (!mat) {
+        return;
+    }
+    printf("Enter the kind (sample, population or gram): ");
+    scanf("%19s", kind);
+    if (strcmp(kind, "sample") && strcmp(kind, "population") && strcmp(kind, "gram")) {
+        fprintf(stderr, "Error: invalid kind\n");
+        return;
+    }
+    struct covariance *acc = covariance_create(matrix_columns(mat));
+    if (!acc) {
+        return;
+    }
+    struct matrix *result = NULL;
+    if (covariance_add_matrix(acc, mat)) {
+        result = covariance_matrix(acc, !strcmp(kind, "sample") ? COVARIANCE_SAMPLE
+                                        : !strcmp(kind, "population") ? COVARIANCE_POPULATION
+                                        : COVARIANCE_GRAM);
+    }
+    destroy_covariance(acc);
+    if (!result) {
+        return;
+    }
+    print_matrix(result);
+    save_matrix(list, result);
+}
+
+void handle_export(struct llist *list) {
+    int index = 0;
+    char name[256];
+    printf("Enter the index of your matrix: ");
+    scanf("%d", &index);
+    struct matrix *mat = matrix_at(index, list);
+    if (!mat) {
+        return;
+    }
+    printf("Enter the shared memory name: ");
+    scanf("%255s", name);
+    uint64_t version = shm_export(name, mat);
+    if (version) {
+        printf("Exported as /%s, version %llu\n", name, (unsigned long long)version);
+    }
+}
+
+void handle_unexport(void) {
+    char name[256];
+    printf("Enter the shared memory name: ");
+    scanf("%255s", name);
+    if (shm_remove(name)) {
+        printf("Removed /%s; processes that attached it keep their mapping\n", name);
+    }
+}
+
+void handle_attach(struct llist *list) {
+    char name[256];
+    uint64_t version = 0;
+    printf("Enter the shared memory name: ");
+    scanf("%255s", name);
+    struct matrix *mat = shm_attach(name, &version);
+    if (!mat) {
+        return;
+    }
+    printf("Version %llu of /%s is:\n", (unsigned long long)version, name);
+    print_matrix(mat);
+    save_matrix(list, mat);
+}
+
+void handle_half(struct llist *list) {
+    int index = 0;
+    char format[20];
+    printf("Enter the index of your matrix: ");
+    scanf("%d", &index);
+    struct matrix *mat = matrix_at(index, list);
+    if (!mat) {
+        return;
+    }
+    printf("Enter fp16 or bf16: ");
+    scanf("%19s", format);
+    if (strcmp(format, "fp16") && strcmp(format, "bf16")) {
+        fprintf(stderr, "Error: invalid format\n");
+        return;
+    }
+    struct half_matrix *h = half_from_matrix(mat, strcmp(format, "fp16") ? HALF_BF16 : HALF_FP16);
+    if (!h) {
+        return;
+    }
+    size_t count = matrix_rows(mat) * matrix_columns(mat);
+    printf("Storage: %.2f MB as float, %.2f MB as %s\n", count * sizeof(float) / 1048576.0,
+           count * sizeof(uint16_t) / 1048576.0, format);
+    struct matrix *rounded = half_to_matrix(h);
+    if (rounded) {
+        print_error("Rounding", mat, rounded);
+        destroy_matrix(rounded);
+    }
+    printf("Enter the index of a matrix to multiply it by (-1 for none): ");
+    scanf("%d", &index);
+    struct matrix *other = index < 0 ? NULL : matrix_at(index, list);
+    struct matrix *exact = other ? matrix_multiplication(mat, other) : NULL;
+    struct matrix *product = exact ? half_multiply(h, other) : NULL;
+    if (product) {
+        print_error("Product", exact, product);
+        destroy_matrix(product);
+    }
+    if (exact) {
+        destroy_matrix(exact);
+    }
+    destroy_half(h);
+}
+
+void handle_trace(void) {
+    char action[20];
+    printf("Enter start, stop, clear or save: ");
+    scanf("%19s", action);
+    if (!strcmp(action, "start")) {
+        trace_start();
+        printf("Tracing is on\n");
+    } else if (!strcmp(action, "stop")) {
+        trace_stop();
+        printf("Tracing is off\n");
+    } else if (!strcmp(action, "clear")) {
+        trace_clear();
+    } else if (!strcmp(action, "save")) {
+        char path[256];
+        printf("Enter the file name: ");
+        scanf("%255s", path);
+        if (trace_write(path)) {
+            printf("Trace saved to %s (open it in ui.perfetto.dev or chrome://tracing)\n", path);
+        }
+    } else {
+        fprintf(stderr, "Error: invalid action\n");
+    }
+}
+
+// print_bytes(label, bytes) prints a labelled amount of memory in MB
+static void print_bytes(const char *label, size_t bytes) {
+    printf("%s: %.2f MB\n", label, bytes / 1048576.0);
+}
+
+void handle_mem(size_t command_peak) {
+    struct mem_stats stats;
+    mem_get_stats(&stats);
+    print_bytes("Memory in use", stats.current);
+    print_bytes("Peak of the last command", command_peak);
+    if (stats.budget) {
+        print_bytes("Budget", stats.budget);
+    } else {
+        printf("Budget: none\n");
+    }
+    printf("Failed allocations: %zu\n", stats.failures);
+    long long megabytes = -1;
+    printf("Enter a new budget in MB (0 for none, -1 to keep it): ");
+    scanf("%lld", &megabytes);
+    if (megabytes >= 0) {
+        mem_set_budget((size_t)megabytes << 20);
+    }
+}
+
 void handle_help(void) {
     printf("Setup comands:\n");
     printf("- create\n- remove\n- removeall\n- print\n- printall\n- end\n");
+    printf("- layout (switches a matrix between row-major and column-major storage)\n");
+    printf("job commands:\n");
+    printf("- async (runs ref, rref, rank, nullity and matprod in the background)\n");
+    printf("- jobs\n- wait\n- cancel\n");
     printf("operation commands:\n");
     printf("- add\t\t\t- subtract\n- scalarmultiply\t- dotproduct\n- length\t\t");
     printf("- unitvector\n- anglebetween\t\t- proj\n- perp\t\t\t- crossproduct\n- rowswap\t\t");
     printf("- rowscale\n- rowadd\t\t- ref\n- rref\t\t\t- rank\n- nullity\t\t- matprod\n");
+    printf("- power\t\t\t- polynomial (Paterson-Stockmeyer)\n- exp (matrix exponential)\n");
+    printf("- mapall (applies an operation to every matrix)\n");
+    printf("- similar (the vectors with the smallest angles to a vector)\n");
+    printf("- solve (solver for Ax = b: refined LU or iterative)\n");
+    printf("- eigen (largest eigenvalues of a symmetric matrix)\n");
+    printf("- svd (randomized low-rank approximation)\n");
+    printf("- qr (Householder QR factorization)\n");
+    printf("- orthonormalize (Gram-Schmidt on a set of vectors)\n");
+    printf("- covariance (covariance or Gram matrix of the rows)\n");
+    printf("- export (share a matrix with other processes)\n");
+    printf("- attach (map a shared matrix without copying it)\n");
+    printf("- unexport (stop sharing a matrix)\n");
+    printf("- half (precision lost storing a matrix in fp16 or bf16)\n");
+    printf("- mem (memory usage and budget; also LINALG_MEMORY=megabytes)\n");
+    printf("- trace (records library calls for chrome://tracing; also LINALG_TRACE=file)\n");
+    printf("Run with --serve PATH to share the workspace with clients over a socket\n");
 }
 
-int main(void) {
+// Requests the server mode answers at a time
+#define SERVER_THREADS 8
+
+int main(int argc, char **argv) {
+    trace_from_environment();
     struct llist *list = list_create();
+    if (argc == 3 && !strcmp(argv[1], "--serve")) {
+        if (!list || !server_run(argv[2], list, SERVER_THREADS)) {
+            if (list) {
+                list_destroy(list, 1);
+            }
+            return 1;
+        }
+        list_destroy(list, 1);
+        return 0;
+    }
+    struct job_pool *pool = jobpool_create(parallel_threads());
+    if (!pool) {
+        if (list) {
+            list_destroy(list, 1);
+        }
+        return 1;
+    }
+    bool async = false;
+    struct similar_cache similar = {0};
+    size_t command_peak = 0;
     char command[20];
     while (1) {
         printf("Enter command: ");
         if (scanf("%s", command) < 0) {
             printf("\n");
+            similar_cache_clear(&similar);
+            jobpool_destroy(pool);
             list_destroy(list, 1);
             return 0;
         }
         if (!(strcmp(command, "create"))) {
             handle_create(list);
+        } else if (!(strcmp(command, "layout"))) {
+            handle_layout(list);
         } else if (!(strcmp(command, "remove"))) {
             handle_remove(list);
         } else if (!(strcmp(command, "print"))) {
             handle_print(list);
         } else if (!(strcmp(command, "end"))) {
+            similar_cache_clear(&similar);
+            jobpool_destroy(pool);
             list_destroy(list, 1);
             return 0;
         } else if (!(strcmp(command, "add"))) {
@@ -437,6 +1467,22 @@ int main(void) {
             handle_length(list);
         } else if (!(strcmp(command, "anglebetween"))) {
             handle_angle(list);
+        } else if (!(strcmp(command, "similar"))) {
+            handle_similar(list, &similar);
+        } else if (!(strcmp(command, "qr"))) {
+            handle_qr(list);
+        } else if (!(strcmp(command, "orthonormalize"))) {
+            handle_orthonormalize(list);
+        } else if (!(strcmp(command, "covariance"))) {
+            handle_covariance(list);
+        } else if (!(strcmp(command, "export"))) {
+            handle_export(list);
+        } else if (!(strcmp(command, "attach"))) {
+            handle_attach(list);
+        } else if (!(strcmp(command, "unexport"))) {
+            handle_unexport();
+        } else if (!(strcmp(command, "half"))) {
+            handle_half(list);
         } else if (!(strcmp(command, "proj"))) {
             handle_proj(list);
         } else if (!(strcmp(command, "perp"))) {
@@ -450,23 +1496,54 @@ int main(void) {
         } else if (!(strcmp(command, "rowadd"))) {
             handle_rowadd(list);
         } else if (!(strcmp(command, "ref"))) {
-            handle_ref(list);
+            handle_ref(list, async ? pool : NULL);
         } else if (!(strcmp(command, "rref"))) {
-            handle_rref(list);
+            handle_rref(list, async ? pool : NULL);
         } else if (!(strcmp(command, "rank"))) {
-            handle_rank(list);
+            handle_rank(list, async ? pool : NULL);
         } else if (!(strcmp(command, "nullity"))) {
-            handle_nullity(list);
+            handle_nullity(list, async ? pool : NULL);
         } else if (!(strcmp(command, "matprod"))) {
-            handle_matprod(list);
+            handle_matprod(list, async ? pool : NULL);
+        } else if (!(strcmp(command, "power"))) {
+            handle_power(list);
+        } else if (!(strcmp(command, "polynomial"))) {
+            handle_polynomial(list);
+        } else if (!(strcmp(command, "exp"))) {
+            handle_exp(list);
         } else if (!(strcmp(command, "printall"))) {
             print_llist(list);
         } else if (!(strcmp(command, "removeall"))) {
             list_destroy(list, 0);
+        } else if (!(strcmp(command, "eigen"))) {
+            handle_eigen(list);
+        } else if (!(strcmp(command, "svd"))) {
+            handle_svd(list);
+        } else if (!(strcmp(command, "solve"))) {
+            handle_solve(list);
+        } else if (!(strcmp(command, "mapall"))) {
+            handle_mapall(list);
+        } else if (!(strcmp(command, "async"))) {
+            async = !async;
+            printf("Async mode is %s\n", async ? "on" : "off");
+        } else if (!(strcmp(command, "jobs"))) {
+            handle_jobs(pool);
+        } else if (!(strcmp(command, "wait"))) {
+            handle_wait(pool);
+        } else if (!(strcmp(command, "cancel"))) {
+            handle_cancel(pool);
+        } else if (!(strcmp(command, "mem"))) {
+            handle_mem(command_peak);
+        } else if (!(strcmp(command, "trace"))) {
+            handle_trace();
         } else if (!(strcmp(command, "help"))) {
             handle_help();
         } else {
             printf("Invalid command\n");
         }
+        // the peak was last reset after the previous command
+        if (strcmp(command, "mem")) {
+            command_peak = mem_reset_peak();
+        }
     }
 }
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "linalg.h"
+#include "linkedlist.h"
+#include "memtrack.h"
+#include "parallel.h"
+#include "mapall.h"
+
+static const char *op_names[] = {
+    "unitvector", "length", "scalarmultiply", "matprod",
+    "ref", "rref", "rank", "nullity"
+};
+
+bool map_op_parse(const char *name, enum map_op *op) {
+    assert(name);
+    assert(op);
+    for (int i = 0; i < sizeof(op_names) / sizeof(op_names[0]); ++i) {
+        if (!strcmp(name, op_names[i])) {
+            *op = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool map_op_has_matrix(enum map_op op) {
+    return op != MAP_LENGTH && op != MAP_RANK && op != MAP_NULLITY;
+}
+
+struct map_task {
+    enum map_op op;
+    float scalar;
+    struct matrix *operand;
+    struct matrix **mats;
+    struct map_result *results;
+};
+
+static void map_range(int begin, int end, void *ctx) {
+    struct map_task *task = ctx;
+    for (int i = begin; i < end; ++i) {
+        struct matrix *mat = task->mats[i];
+        struct map_result *result = &task->results[i];
+        result->mat = NULL;
+        result->value = NAN;
+        if (task->op == MAP_UNITVECTOR) {
+            result->mat = unit_vector(mat);
+        } else if (task->op == MAP_LENGTH) {
+            result->value = length(mat);
+        } else if (task->op == MAP_SCALARMULTIPLY) {
+            result->mat = scalar_multiply(task->scalar, mat);
+        } else if (task->op == MAP_MATPROD) {
+            result->mat = matrix_multiplication(mat, task->operand);
+        } else if (task->op == MAP_REF) {
+            result->mat = ref(mat);
+        } else if (task->op == MAP_RREF) {
+            result->mat = rref(mat);
+        } else {
+            // rank and nullity are SIZE_MAX when out of memory
+            size_t count = task->op == MAP_RANK ? rank(mat) : nullity(mat);
+            result->value = count == SIZE_MAX ? NAN : count;
+        }
+    }
+}
+
+void map_matrices(enum map_op op, float scalar, struct matrix *operand,
+                  struct matrix **mats, int len, struct map_result *results) {
+    assert(len == 0 || mats);
+    assert(len == 0 || results);
+    assert(op != MAP_MATPROD || operand);
+    struct map_task task = {op, scalar, operand, mats, results};
+    parallel_for(len, 1, map_range, &task);
+}
+
+struct map_result *map_list(enum map_op op, float scalar, struct matrix *operand,
+                            struct llist *lst, int *len) {
+    assert(lst);
+    assert(len);
+    struct matrix **mats = list_snapshot(lst, len);
+    if (!mats) {
+        return NULL;
+    }
+    struct map_result *results = mem_alloc(*len * sizeof(struct map_result));
+    if (results) {
+        map_matrices(op, scalar, operand, mats, *len, results);
+    }
+    mem_free(mats, *len * sizeof(struct matrix *));
+    return results;
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+// time: k is the number of matrices mapped over
+// see linalg.h and parallel.h
+
+// The operations that can be applied to every matrix of a set.
+//   The operations with a matrix result fill in the mat field of
+//   struct map_result, the others fill in the value field.
+enum map_op {
+    MAP_UNITVECTOR,      // unit_vector(mat)
+    MAP_LENGTH,          // length(mat)
+    MAP_SCALARMULTIPLY,  // scalar_multiply(scalar, mat)
+    MAP_MATPROD,         // matrix_multiplication(mat, operand)
+    MAP_REF,             // ref(mat)
+    MAP_RREF,            // rref(mat)
+    MAP_RANK,            // rank(mat)
+    MAP_NULLITY          // nullity(mat)
+};
+
+struct map_result {
+    struct matrix *mat;
+    float value;
+};
+
+// map_op_parse(name, op) stores the operation with the given REPL
+//   command name (e.g. "rank" or "scalarmultiply") in *op and returns
+//   true, or returns false if there is no such operation.
+// requires: name and op are valid pointers
+// time: O(1)
+bool map_op_parse(const char *name, enum map_op *op);
+
+// map_op_has_matrix(op) returns true if op produces a matrix
+// time: O(1)
+bool map_op_has_matrix(enum map_op op);
+
+// map_matrices(op, scalar, operand, mats, len, results) applies op to
+//   mats[0], ..., mats[len - 1] in parallel and stores the result for
+//   mats[i] in results[i]. Matrices are handed out to the threads one at
+//   a time, so a few expensive matrices do not hold up the rest.
+//   If op fails for a matrix, results[i].mat is NULL (resp.
+//   results[i].value is NAN) and an error message is output.
+// requires: mats and results are valid pointers to arrays of length len
+//           operand is a valid pointer if op is MAP_MATPROD
+//           scalar is only used by MAP_SCALARMULTIPLY
+// effects: may allocate memory (client must destroy the result matrices)
+//          may produce output
+// time: O(k) plus the time of the k operations divided among the threads
+void map_matrices(enum map_op op, float scalar, struct matrix *operand,
+                  struct matrix **mats, int len, struct map_result *results);
+
+// map_list(op, scalar, operand, lst, len) applies op to every matrix of
+//   lst as in map_matrices and returns the results in index order; the
+//   number of results is stored in *len.
+// requires: lst and len are valid pointers
+//           operand is a valid pointer if op is MAP_MATPROD
+// notes: returns NULL if lst is empty, or outputs an error message and
+//   returns NULL (with *len > 0) if out of memory (see memtrack.h)
+// effects: may allocate memory (client must call mem_free on the array
+//            with *len * sizeof(struct map_result) and destroy the
+//            result matrices)
+//          may produce output
+// time: O(k) plus the time of the k operations divided among the threads
+struct map_result *map_list(enum map_op op, float scalar, struct matrix *operand,
+                            struct llist *lst, int *len);
\ No newline at end of file
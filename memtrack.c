@@ -0,0 +1,119 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "memtrack.h"
+
+// The counters are updated atomically; current never exceeds a nonzero
+//   budget because bytes are only added with a compare-and-swap that
+//   checks it.
+static size_t current = 0;
+static size_t peak = 0;
+static size_t budget = 0;
+static size_t failures = 0;
+static pthread_once_t budget_once = PTHREAD_ONCE_INIT;
+static __thread enum mem_error last_error = MEM_OK;
+
+static void budget_from_environment(void) {
+    const char *env = getenv("LINALG_MEMORY");
+    long long megabytes = env ? atoll(env) : 0;
+    if (megabytes > 0) {
+        __atomic_store_n(&budget, (size_t)megabytes << 20, __ATOMIC_RELAXED);
+    }
+}
+
+static void fail(enum mem_error error, size_t bytes) {
+    last_error = error;
+    __atomic_add_fetch(&failures, 1, __ATOMIC_RELAXED);
+    if (error == MEM_OVER_BUDGET) {
+        fprintf(stderr, "Error: allocating %zu bytes would exceed the memory budget of %zu bytes\n",
+                bytes, __atomic_load_n(&budget, __ATOMIC_RELAXED));
+    } else {
+        fprintf(stderr, "Error: out of memory (allocating %zu bytes)\n", bytes);
+    }
+}
+
+// reserve(bytes) counts bytes as in use if that stays within the budget
+static bool reserve(size_t bytes) {
+    pthread_once(&budget_once, budget_from_environment);
+    size_t limit = __atomic_load_n(&budget, __ATOMIC_RELAXED);
+    size_t used = __atomic_load_n(&current, __ATOMIC_RELAXED);
+    do {
+        if (limit && (bytes > limit || used > limit - bytes)) {
+            fail(MEM_OVER_BUDGET, bytes);
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&current, &used, used + bytes, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    used += bytes;
+    size_t highest = __atomic_load_n(&peak, __ATOMIC_RELAXED);
+    while (used > highest && !__atomic_compare_exchange_n(&peak, &highest, used, true,
+                                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+    return true;
+}
+
+void *mem_alloc(size_t bytes) {
+    assert(bytes > 0);
+    if (!reserve(bytes)) {
+        return NULL;
+    }
+    void *ptr = malloc(bytes);
+    if (!ptr) {
+        __atomic_sub_fetch(&current, bytes, __ATOMIC_RELAXED);
+        fail(MEM_EXHAUSTED, bytes);
+    }
+    return ptr;
+}
+
+void *mem_alloc_aligned(size_t alignment, size_t bytes) {
+    assert(bytes > 0);
+    if (!reserve(bytes)) {
+        return NULL;
+    }
+    void *ptr = NULL;
+    if (posix_memalign(&ptr, alignment, bytes)) {
+        __atomic_sub_fetch(&current, bytes, __ATOMIC_RELAXED);
+        fail(MEM_EXHAUSTED, bytes);
+        return NULL;
+    }
+    return ptr;
+}
+
+void mem_free(void *ptr, size_t bytes) {
+    if (!ptr) {
+        return;
+    }
+    free(ptr);
+    __atomic_sub_fetch(&current, bytes, __ATOMIC_RELAXED);
+}
+
+enum mem_error mem_last_error(void) {
+    return last_error;
+}
+
+void mem_clear_error(void) {
+    last_error = MEM_OK;
+}
+
+void mem_get_stats(struct mem_stats *stats) {
+    assert(stats);
+    pthread_once(&budget_once, budget_from_environment);
+    stats->current = __atomic_load_n(&current, __ATOMIC_RELAXED);
+    stats->peak = __atomic_load_n(&peak, __ATOMIC_RELAXED);
+    stats->budget = __atomic_load_n(&budget, __ATOMIC_RELAXED);
+    stats->failures = __atomic_load_n(&failures, __ATOMIC_RELAXED);
+}
+
+void mem_set_budget(size_t bytes) {
+    // a later first allocation must not replace this with LINALG_MEMORY
+    pthread_once(&budget_once, budget_from_environment);
+    __atomic_store_n(&budget, bytes, __ATOMIC_RELAXED);
+}
+
+size_t mem_reset_peak(void) {
+    return __atomic_exchange_n(&peak, __atomic_load_n(&current, __ATOMIC_RELAXED),
+                               __ATOMIC_RELAXED);
+}
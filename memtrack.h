@@ -0,0 +1,66 @@
+// Tracking allocator for the memory the library holds.
+//   Matrices, list nodes, factorizations and the workspaces of the
+//   algorithms are allocated through it, so it knows how many bytes are
+//   in use right now and the peak since the last mem_reset_peak. An optional budget caps the bytes in use: an
+//   allocation that would exceed it fails like one the system refuses,
+//   so an oversized operation returns NULL instead of taking the
+//   process down. The budget can be set with mem_set_budget or in
+//   megabytes with the LINALG_MEMORY environment variable.
+#include <stddef.h>
+
+enum mem_error {
+    MEM_OK,             // no allocation has failed
+    MEM_OVER_BUDGET,    // an allocation would have exceeded the budget
+    MEM_EXHAUSTED       // the system could not provide the memory
+};
+
+struct mem_stats {
+    size_t current;     // bytes in use
+    size_t peak;        // most bytes in use since the last mem_reset_peak
+    size_t budget;      // limit on bytes in use, 0 if there is none
+    size_t failures;    // # of allocations that failed
+};
+
+// mem_alloc(bytes) returns an uninitialized buffer of bytes bytes, and
+//   mem_alloc_aligned(alignment, bytes) one aligned to alignment
+// requires: bytes > 0
+//           alignment is a power of 2 and a multiple of sizeof(void *)
+// notes: outputs an error message, records the reason for
+//   mem_last_error and returns NULL if the allocation fails
+// effects: may allocate memory (client must call mem_free with the
+//          same bytes)
+//          may produce output
+// time: O(1)
+void *mem_alloc(size_t bytes);
+void *mem_alloc_aligned(size_t alignment, size_t bytes);
+
+// mem_free(ptr, bytes) frees a buffer of bytes bytes from mem_alloc or
+//   mem_alloc_aligned; it does nothing if ptr is NULL
+// effects: ptr is no longer valid
+// time: O(1)
+void mem_free(void *ptr, size_t bytes);
+
+// mem_last_error() returns why the last failed allocation of the calling
+//   thread failed, or MEM_OK if none has failed since mem_clear_error
+// time: O(1)
+enum mem_error mem_last_error(void);
+
+// mem_clear_error() resets mem_last_error of the calling thread to MEM_OK
+// time: O(1)
+void mem_clear_error(void);
+
+// mem_get_stats(stats) stores the current usage in stats
+// requires: stats is a valid pointer
+// time: O(1)
+void mem_get_stats(struct mem_stats *stats);
+
+// mem_set_budget(bytes) limits the bytes in use to bytes (0 removes the
+//   limit). Memory that is already in use is not affected.
+// time: O(1)
+void mem_set_budget(size_t bytes);
+
+// mem_reset_peak() sets the peak to the bytes currently in use and
+//   returns the previous peak, so the peak of an operation is the value
+//   returned by a reset after it
+// time: O(1)
+size_t mem_reset_peak(void);
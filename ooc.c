@@ -0,0 +1,944 @@
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+#include <stdio.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include "linalg.h"
+#include "memtrack.h"
+#include "parallel.h"
+#include "ooc.h"
+
+// File layout: a HEADER_SIZE byte header (magic, rows, columns, tile as
+//   64-bit integers), then the tiles row by row, each tile row by row.
+#define HEADER_SIZE 64
+#define MAGIC 0x31434f4f414c /* "LAOOC1" as little-endian bytes */
+#define QUEUE_LENGTH 64
+
+struct ooc_matrix {
+    int fd;
+    unsigned id;             // unique, identifies tiles in the pool
+    long long rows;
+    long long columns;
+    int tile;
+    long long tile_rows;
+    long long tile_columns;
+};
+
+enum slot_state {
+    SLOT_FREE,
+    SLOT_LOADING,            // owned by the thread doing its I/O
+    SLOT_READY
+};
+
+struct slot {
+    enum slot_state state;
+    struct ooc_matrix *mat;  // the tile in the slot
+    unsigned owner;
+    long long index;
+    struct ooc_matrix *old_mat;  // the dirty tile being written back
+    unsigned old_owner;          //   while the slot is loading (0: none)
+    long long old_index;
+    int pins;
+    bool dirty;
+    unsigned long long used;
+    float *data;
+};
+
+struct request {
+    struct ooc_matrix *mat;
+    long long index;
+};
+
+struct ooc_pool {
+    size_t budget;
+    int tile;
+    int num_slots;
+    struct slot *slots;
+    float *buffer;
+    unsigned long long clock;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;  // a slot changed state or was unpinned
+    pthread_cond_t queued;   // a prefetch was requested, or shutdown
+    struct request queue[QUEUE_LENGTH];
+    int head;
+    int count;
+    int inflight;            // prefetches being loaded
+    bool shutdown;
+    pthread_t thread;
+    long long bytes_read;
+    long long bytes_written;
+};
+
+static unsigned next_id = 1;
+
+// transfer(fd, data, bytes, offset, write) reads or writes all bytes
+static bool transfer(int fd, void *data, size_t bytes, off_t offset, bool write) {
+    char *pos = data;
+    while (bytes > 0) {
+        ssize_t done = write ? pwrite(fd, pos, bytes, offset) : pread(fd, pos, bytes, offset);
+        if (done < 0 && errno == EINTR) {
+            continue;
+        }
+        if (done <= 0) {
+            return false;
+        }
+        pos += done;
+        bytes -= done;
+        offset += done;
+    }
+    return true;
+}
+
+static size_t tile_bytes(int tile) {
+    return (size_t)tile * tile * sizeof(float);
+}
+
+static off_t tile_offset(const struct ooc_matrix *mat, long long index) {
+    return HEADER_SIZE + (off_t)index * tile_bytes(mat->tile);
+}
+
+static bool tile_io(struct ooc_matrix *mat, long long index, float *data, bool write) {
+    if (!transfer(mat->fd, data, tile_bytes(mat->tile), tile_offset(mat, index), write)) {
+        fprintf(stderr, "Error: out-of-core tile %s failed\n", write ? "write" : "read");
+        return false;
+    }
+    return true;
+}
+
+// find_slot(pool, id, index) returns the slot holding (or loading) tile
+//   index of the matrix with the given id, or NULL
+// requires: pool->lock is held
+static struct slot *find_slot(struct ooc_pool *pool, unsigned id, long long index) {
+    for (int i = 0; i < pool->num_slots; ++i) {
+        struct slot *slot = &pool->slots[i];
+        if (slot->state != SLOT_FREE && slot->owner == id && slot->index == index) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+// writing_back(pool, id, index) returns true if the tile is being
+//   written back from a slot that is loading another tile
+// requires: pool->lock is held
+static bool writing_back(struct ooc_pool *pool, unsigned id, long long index) {
+    for (int i = 0; i < pool->num_slots; ++i) {
+        struct slot *slot = &pool->slots[i];
+        if (slot->state == SLOT_LOADING && slot->old_owner == id && slot->old_index == index) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// claim_slot(pool, mat, index) takes the least recently used unpinned
+//   slot for tile index of mat, pins it and marks it loading; returns
+//   NULL if every slot is pinned or loading
+// requires: pool->lock is held
+static struct slot *claim_slot(struct ooc_pool *pool, struct ooc_matrix *mat, long long index) {
+    struct slot *best = NULL;
+    for (int i = 0; i < pool->num_slots; ++i) {
+        struct slot *slot = &pool->slots[i];
+        if (slot->pins == 0 && slot->state != SLOT_LOADING &&
+            (!best || slot->state == SLOT_FREE || (best->state != SLOT_FREE && slot->used < best->used))) {
+            best = slot;
+            if (slot->state == SLOT_FREE) {
+                break;
+            }
+        }
+    }
+    if (!best) {
+        return NULL;
+    }
+    best->old_owner = 0;
+    if (best->state == SLOT_READY && best->dirty) {
+        best->old_mat = best->mat;
+        best->old_owner = best->owner;
+        best->old_index = best->index;
+    }
+    best->state = SLOT_LOADING;
+    best->mat = mat;
+    best->owner = mat->id;
+    best->index = index;
+    best->pins = 1;
+    best->dirty = false;
+    best->used = ++pool->clock;
+    return best;
+}
+
+// fill_slot(pool, slot, read) writes back the tile slot replaces (if it
+//   was dirty) and then reads its new tile (or zeroes it if !read)
+// requires: slot was claimed by the calling thread, pool->lock is not held
+static bool fill_slot(struct ooc_pool *pool, struct slot *slot, bool read) {
+    bool ok = true;
+    size_t bytes = tile_bytes(pool->tile);
+    if (slot->old_owner) {
+        ok = tile_io(slot->old_mat, slot->old_index, slot->data, true);
+    }
+    if (read) {
+        ok = ok && tile_io(slot->mat, slot->index, slot->data, false);
+    } else {
+        memset(slot->data, 0, bytes);
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->bytes_written += slot->old_owner ? bytes : 0;
+    pool->bytes_read += read ? bytes : 0;
+    slot->old_owner = 0;
+    slot->state = ok ? SLOT_READY : SLOT_FREE;
+    pthread_cond_broadcast(&pool->changed);
+    pthread_mutex_unlock(&pool->lock);
+    return ok;
+}
+
+static void *prefetcher(void *data) {
+    struct ooc_pool *pool = data;
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (pool->count == 0 && !pool->shutdown) {
+            pthread_cond_wait(&pool->queued, &pool->lock);
+        }
+        if (pool->shutdown) {
+            break;
+        }
+        struct request req = pool->queue[pool->head];
+        pool->head = (pool->head + 1) % QUEUE_LENGTH;
+        --pool->count;
+        if (find_slot(pool, req.mat->id, req.index) || writing_back(pool, req.mat->id, req.index)) {
+            pthread_cond_broadcast(&pool->changed);
+            continue;
+        }
+        struct slot *slot = claim_slot(pool, req.mat, req.index);
+        if (!slot) {
+            // no room: the operation will load the tile itself
+            pthread_cond_broadcast(&pool->changed);
+            continue;
+        }
+        ++pool->inflight;
+        pthread_mutex_unlock(&pool->lock);
+        fill_slot(pool, slot, true);
+        pthread_mutex_lock(&pool->lock);
+        --slot->pins;
+        --pool->inflight;
+        pthread_cond_broadcast(&pool->changed);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+struct ooc_pool *ooc_pool_create(size_t budget) {
+    struct ooc_pool *pool = mem_alloc(sizeof(struct ooc_pool));
+    if (!pool) {
+        return NULL;
+    }
+    pool->budget = budget;
+    pool->tile = 0;
+    pool->num_slots = 0;
+    pool->slots = NULL;
+    pool->buffer = NULL;
+    pool->clock = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->changed, NULL);
+    pthread_cond_init(&pool->queued, NULL);
+    pool->head = 0;
+    pool->count = 0;
+    pool->inflight = 0;
+    pool->shutdown = false;
+    pool->bytes_read = 0;
+    pool->bytes_written = 0;
+    pthread_create(&pool->thread, NULL, prefetcher, pool);
+    return pool;
+}
+
+void ooc_pool_destroy(struct ooc_pool *pool) {
+    assert(pool);
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->queued);
+    pthread_mutex_unlock(&pool->lock);
+    pthread_join(pool->thread, NULL);
+    pthread_cond_destroy(&pool->queued);
+    pthread_cond_destroy(&pool->changed);
+    pthread_mutex_destroy(&pool->lock);
+    mem_free(pool->slots, pool->num_slots * sizeof(struct slot));
+    mem_free(pool->buffer, pool->num_slots * tile_bytes(pool->tile));
+    mem_free(pool, sizeof(struct ooc_pool));
+}
+
+void ooc_pool_io(struct ooc_pool *pool, long long *read, long long *written) {
+    assert(pool);
+    assert(read);
+    assert(written);
+    pthread_mutex_lock(&pool->lock);
+    *read = pool->bytes_read;
+    *written = pool->bytes_written;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// pool_drain(pool) waits until no prefetch is queued or loading
+// requires: pool->lock is held
+static void pool_drain(struct ooc_pool *pool) {
+    while (pool->count > 0 || pool->inflight > 0) {
+        pthread_cond_wait(&pool->changed, &pool->lock);
+    }
+}
+
+// pool_prepare(pool, tile) sets the pool up for tiles of the given size
+//   and returns the number of slots, which is 0 if not even one tile
+//   fits in the budget, or -1 (with an error message) if out of memory
+static int pool_prepare(struct ooc_pool *pool, int tile) {
+    pthread_mutex_lock(&pool->lock);
+    pool_drain(pool);
+    if (pool->tile != tile) {
+        // operations flush their dirty tiles, so the slots are clean
+        mem_free(pool->slots, pool->num_slots * sizeof(struct slot));
+        mem_free(pool->buffer, pool->num_slots * tile_bytes(pool->tile));
+        pool->slots = NULL;
+        pool->buffer = NULL;
+        pool->tile = tile;
+        pool->num_slots = pool->budget / tile_bytes(tile);
+        if (pool->num_slots > 0) {
+            pool->slots = mem_alloc(pool->num_slots * sizeof(struct slot));
+            pool->buffer = pool->slots ? mem_alloc(pool->num_slots * tile_bytes(tile)) : NULL;
+        }
+        if (pool->num_slots > 0 && !pool->buffer) {
+            mem_free(pool->slots, pool->num_slots * sizeof(struct slot));
+            pool->slots = NULL;
+            pool->tile = 0;
+            pool->num_slots = 0;
+            pthread_mutex_unlock(&pool->lock);
+            return -1;
+        }
+        for (int i = 0; i < pool->num_slots; ++i) {
+            pool->slots[i] = (struct slot){0};
+            pool->slots[i].data = pool->buffer + (size_t)i * tile * tile;
+        }
+    }
+    int slots = pool->num_slots;
+    pthread_mutex_unlock(&pool->lock);
+    return slots;
+}
+
+// pool_get(pool, mat, ti, tj, read) pins tile (ti, tj) of mat in the
+//   pool and returns its data; the tile is read from the file if read is
+//   true and zeroed otherwise (for tiles that will be overwritten).
+//   Returns NULL on a file error.
+// requires: there is an unpinned slot or one will be unpinned
+static float *pool_get(struct ooc_pool *pool, struct ooc_matrix *mat, long long ti, long long tj,
+                       bool read) {
+    long long index = ti * mat->tile_columns + tj;
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        struct slot *slot = find_slot(pool, mat->id, index);
+        if (slot && slot->state == SLOT_READY) {
+            ++slot->pins;
+            slot->used = ++pool->clock;
+            if (!read) {
+                memset(slot->data, 0, tile_bytes(pool->tile));
+            }
+            pthread_mutex_unlock(&pool->lock);
+            return slot->data;
+        }
+        if (!slot && !writing_back(pool, mat->id, index)) {
+            slot = claim_slot(pool, mat, index);
+            if (slot) {
+                pthread_mutex_unlock(&pool->lock);
+                if (fill_slot(pool, slot, read)) {
+                    return slot->data;
+                }
+                pthread_mutex_lock(&pool->lock);
+                --slot->pins;
+                pthread_mutex_unlock(&pool->lock);
+                return NULL;
+            }
+        }
+        pthread_cond_wait(&pool->changed, &pool->lock);
+    }
+}
+
+// pool_release(pool, data, dirty) unpins the tile returned by pool_get;
+//   dirty tiles are written back before their slot is reused
+static void pool_release(struct ooc_pool *pool, float *data, bool dirty) {
+    struct slot *slot = &pool->slots[(data - pool->buffer) / ((size_t)pool->tile * pool->tile)];
+    pthread_mutex_lock(&pool->lock);
+    --slot->pins;
+    slot->dirty = slot->dirty || dirty;
+    pthread_cond_broadcast(&pool->changed);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// pool_prefetch(pool, mat, ti, tj) asks the prefetch thread to load tile
+//   (ti, tj) of mat; the request is dropped if the queue is full
+static void pool_prefetch(struct ooc_pool *pool, struct ooc_matrix *mat, long long ti, long long tj) {
+    pthread_mutex_lock(&pool->lock);
+    if (pool->count < QUEUE_LENGTH) {
+        struct request req = {mat, ti * mat->tile_columns + tj};
+        pool->queue[(pool->head + pool->count) % QUEUE_LENGTH] = req;
+        ++pool->count;
+        pthread_cond_signal(&pool->queued);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// pool_flush(pool, mat) writes back the dirty tiles of mat. Each tile
+//   is pinned and marked clean under the lock and written after it is
+//   released, so other threads can use the pool during the I/O.
+static bool pool_flush(struct ooc_pool *pool, struct ooc_matrix *mat) {
+    bool ok = true;
+    pthread_mutex_lock(&pool->lock);
+    pool_drain(pool);
+    for (int i = 0; i < pool->num_slots; ++i) {
+        struct slot *slot = &pool->slots[i];
+        if (slot->state != SLOT_READY || slot->owner != mat->id || !slot->dirty) {
+            continue;
+        }
+        ++slot->pins;
+        slot->dirty = false;
+        pthread_mutex_unlock(&pool->lock);
+        bool written = tile_io(mat, slot->index, slot->data, true);
+        pthread_mutex_lock(&pool->lock);
+        ok = written && ok;
+        pool->bytes_written += written ? tile_bytes(pool->tile) : 0;
+        slot->dirty = slot->dirty || !written;
+        --slot->pins;
+        pthread_cond_broadcast(&pool->changed);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return ok;
+}
+
+// pool_forget(pool, mat) drops the tiles of mat without writing them
+//   back, before mat is closed after a failed operation
+static void pool_forget(struct ooc_pool *pool, struct ooc_matrix *mat) {
+    pthread_mutex_lock(&pool->lock);
+    pool_drain(pool);
+    for (int i = 0; i < pool->num_slots; ++i) {
+        struct slot *slot = &pool->slots[i];
+        if (slot->state == SLOT_READY && slot->owner == mat->id) {
+            slot->state = SLOT_FREE;
+            slot->dirty = false;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// ooc_alloc(fd, rows, columns, tile) returns a matrix for the open file
+//   fd, or closes fd and returns NULL if out of memory
+static struct ooc_matrix *ooc_alloc(int fd, long long rows, long long columns, int tile) {
+    struct ooc_matrix *mat = mem_alloc(sizeof(struct ooc_matrix));
+    if (!mat) {
+        close(fd);
+        return NULL;
+    }
+    mat->fd = fd;
+    mat->id = __atomic_fetch_add(&next_id, 1, __ATOMIC_RELAXED);
+    mat->rows = rows;
+    mat->columns = columns;
+    mat->tile = tile;
+    mat->tile_rows = (rows + tile - 1) / tile;
+    mat->tile_columns = (columns + tile - 1) / tile;
+    return mat;
+}
+
+struct ooc_matrix *ooc_create(const char *path, long long rows, long long columns, int tile) {
+    assert(path);
+    assert(rows > 0 && columns > 0 && tile > 0);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Error: cannot create %s\n", path);
+        return NULL;
+    }
+    struct ooc_matrix *mat = ooc_alloc(fd, rows, columns, tile);
+    if (!mat) {
+        return NULL;
+    }
+    long long header[HEADER_SIZE / sizeof(long long)] = {MAGIC, rows, columns, tile};
+    // the file is sparse, so unwritten tiles read as zeros
+    off_t size = tile_offset(mat, mat->tile_rows * mat->tile_columns);
+    if (!transfer(fd, header, HEADER_SIZE, 0, true) || ftruncate(fd, size)) {
+        fprintf(stderr, "Error: cannot create %s\n", path);
+        ooc_close(mat);
+        return NULL;
+    }
+    return mat;
+}
+
+struct ooc_matrix *ooc_open(const char *path) {
+    assert(path);
+    int fd = open(path, O_RDWR);
+    if (fd < 0) {
+        fprintf(stderr, "Error: cannot open %s\n", path);
+        return NULL;
+    }
+    long long header[HEADER_SIZE / sizeof(long long)];
+    if (!transfer(fd, header, HEADER_SIZE, 0, false) || header[0] != MAGIC ||
+        header[1] <= 0 || header[2] <= 0 || header[3] <= 0) {
+        fprintf(stderr, "Error: %s is not a matrix file\n", path);
+        close(fd);
+        return NULL;
+    }
+    return ooc_alloc(fd, header[1], header[2], header[3]);
+}
+
+void ooc_close(struct ooc_matrix *mat) {
+    assert(mat);
+    close(mat->fd);
+    mem_free(mat, sizeof(struct ooc_matrix));
+}
+
+long long ooc_rows(const struct ooc_matrix *mat) {
+    assert(mat);
+    return mat->rows;
+}
+
+long long ooc_columns(const struct ooc_matrix *mat) {
+    assert(mat);
+    return mat->columns;
+}
+
+struct ooc_matrix *ooc_from_matrix(const char *path, const struct matrix *mat, int tile) {
+    assert(mat);
+    struct ooc_matrix *out = ooc_create(path, matrix_rows(mat), matrix_columns(mat), tile);
+    if (!out) {
+        return NULL;
+    }
+    float *data = mem_alloc(tile_bytes(tile));
+    bool ok = data != NULL;
+    for (long long ti = 0; ok && ti < out->tile_rows; ++ti) {
+        for (long long tj = 0; ok && tj < out->tile_columns; ++tj) {
+            memset(data, 0, tile_bytes(tile));
+            for (long long i = ti * tile; i < out->rows && i < (ti + 1) * tile; ++i) {
+                for (long long j = tj * tile; j < out->columns && j < (tj + 1) * tile; ++j) {
+                    data[(i - ti * tile) * tile + j - tj * tile] = matrix_get(mat, i, j);
+                }
+            }
+            ok = tile_io(out, ti * out->tile_columns + tj, data, true);
+        }
+    }
+    mem_free(data, tile_bytes(tile));
+    if (!ok) {
+        ooc_close(out);
+        return NULL;
+    }
+    return out;
+}
+
+struct matrix *ooc_to_matrix(const struct ooc_matrix *mat) {
+    assert(mat);
+    int tile = mat->tile;
+    size_t bytes = mat->rows * mat->columns * sizeof(float);
+    float *entries = mem_alloc(bytes);
+    float *data = entries ? mem_alloc(tile_bytes(tile)) : NULL;
+    bool ok = data != NULL;
+    for (long long ti = 0; ok && ti < mat->tile_rows; ++ti) {
+        for (long long tj = 0; ok && tj < mat->tile_columns; ++tj) {
+            ok = tile_io((struct ooc_matrix *)mat, ti * mat->tile_columns + tj, data, false);
+            for (long long i = ti * tile; ok && i < mat->rows && i < (ti + 1) * tile; ++i) {
+                for (long long j = tj * tile; j < mat->columns && j < (tj + 1) * tile; ++j) {
+                    entries[i * mat->columns + j] = data[(i - ti * tile) * tile + j - tj * tile];
+                }
+            }
+        }
+    }
+    struct matrix *result = ok ? create_matrix(mat->rows, mat->columns, entries) : NULL;
+    mem_free(data, tile_bytes(tile));
+    mem_free(entries, bytes);
+    return result;
+}
+
+// A block of r x c result tiles and the tiles of the current k step
+struct gemm_block {
+    int tile;
+    int r;
+    int c;
+    float **a;        // r tiles of mat1
+    float **b;        // c tiles of mat2
+    float **out;      // r * c result tiles
+};
+
+// gemm_rows runs out += a * b for the tile rows [begin, end), where
+//   index i is row i % tile of result tile i / tile
+static void gemm_rows(int begin, int end, void *ctx) {
+    struct gemm_block *blk = ctx;
+    int t = blk->tile;
+    for (int idx = begin; idx < end; ++idx) {
+        int which = idx / t;
+        int row = idx % t;
+        const float *a = blk->a[which / blk->c] + row * t;
+        const float *b = blk->b[which % blk->c];
+        float *out = blk->out[which] + row * t;
+        for (int k = 0; k < t; ++k) {
+            float scale = a[k];
+            if (scale == 0) {
+                continue;
+            }
+            for (int j = 0; j < t; ++j) {
+                out[j] += scale * b[k * t + j];
+            }
+        }
+    }
+}
+
+struct ooc_matrix *ooc_multiply(struct ooc_pool *pool, struct ooc_matrix *mat1,
+                                struct ooc_matrix *mat2, const char *path) {
+    assert(pool);
+    assert(mat1);
+    assert(mat2);
+    assert(mat1->tile == mat2->tile);
+    if (mat1->columns != mat2->rows) {
+        fprintf(stderr, "Error: first matrix columns must equal second matrix rows \n");
+        return NULL;
+    }
+    int tile = mat1->tile;
+    int slots = pool_prepare(pool, tile);
+    if (slots < 0) {
+        return NULL;
+    }
+    if (slots < 3) {
+        fprintf(stderr, "Error: out-of-core budget must hold at least 3 tiles\n");
+        return NULL;
+    }
+    long long tr = mat1->tile_rows;
+    long long tk = mat1->tile_columns;
+    long long tc = mat2->tile_columns;
+    // choose the largest r x c block that fits together with one k step
+    //   (r + c tiles) and a prefetched k step (another r + c tiles)
+    int r = 1;
+    while ((r + 1) * (r + 1) + 4 * (r + 1) <= slots) {
+        ++r;
+    }
+    int c = r;
+    r = r > tr ? tr : r;
+    while (c < tc && r * (c + 1) + 4 * r + 2 * (c + 1) <= slots) {
+        ++c;
+    }
+    c = c > tc ? tc : c;
+    while (r < tr && (r + 1) * c + 2 * (r + 1) + 2 * c <= slots) {
+        ++r;
+    }
+    bool prefetch = r * c + 2 * (r + c) <= slots;
+
+    size_t bytes = (r + c + r * c) * sizeof(float *);
+    float **tiles = mem_alloc(bytes);
+    if (!tiles) {
+        return NULL;
+    }
+    struct ooc_matrix *out = ooc_create(path, mat1->rows, mat2->columns, tile);
+    if (!out) {
+        mem_free(tiles, bytes);
+        return NULL;
+    }
+    struct gemm_block blk = {tile, 0, 0, tiles, tiles + r, tiles + r + c};
+    bool ok = true;
+    for (long long bi = 0; ok && bi < tr; bi += r) {
+        for (long long bj = 0; ok && bj < tc; bj += c) {
+            blk.r = tr - bi < r ? tr - bi : r;
+            blk.c = tc - bj < c ? tc - bj : c;
+            for (int i = 0; i < blk.r * blk.c; ++i) {
+                blk.out[i] = pool_get(pool, out, bi + i / blk.c, bj + i % blk.c, false);
+                ok = ok && blk.out[i];
+            }
+            for (long long k = 0; ok && k < tk; ++k) {
+                if (prefetch && k + 1 < tk) {
+                    for (int i = 0; i < blk.r; ++i) {
+                        pool_prefetch(pool, mat1, bi + i, k + 1);
+                    }
+                    for (int j = 0; j < blk.c; ++j) {
+                        pool_prefetch(pool, mat2, k + 1, bj + j);
+                    }
+                }
+                for (int i = 0; i < blk.r; ++i) {
+                    blk.a[i] = pool_get(pool, mat1, bi + i, k, true);
+                    ok = ok && blk.a[i];
+                }
+                for (int j = 0; j < blk.c; ++j) {
+                    blk.b[j] = pool_get(pool, mat2, k, bj + j, true);
+                    ok = ok && blk.b[j];
+                }
+                if (ok) {
+                    parallel_for(blk.r * blk.c * tile, tile / 8 + 1, gemm_rows, &blk);
+                }
+                for (int i = 0; i < blk.r; ++i) {
+                    if (blk.a[i]) {
+                        pool_release(pool, blk.a[i], false);
+                    }
+                }
+                for (int j = 0; j < blk.c; ++j) {
+                    if (blk.b[j]) {
+                        pool_release(pool, blk.b[j], false);
+                    }
+                }
+            }
+            for (int i = 0; i < blk.r * blk.c; ++i) {
+                if (blk.out[i]) {
+                    pool_release(pool, blk.out[i], true);
+                }
+            }
+        }
+    }
+    mem_free(tiles, bytes);
+    ok = pool_flush(pool, out) && ok;
+    if (!ok) {
+        pool_forget(pool, out);
+        ooc_close(out);
+        return NULL;
+    }
+    return out;
+}
+
+// A tile column (tile rows first..tile_rows-1) pinned in the pool
+struct column {
+    int tile;
+    long long first;     // global row of the first pinned entry
+    long long rows;      // rows of the matrix (entries beyond are padding)
+    float **tiles;
+};
+
+// at(col, g, j) returns the entry of col in global row g, local column j
+static float *at(const struct column *col, long long g, int j) {
+    long long rel = g - col->first;
+    return col->tiles[rel / col->tile] + (rel % col->tile) * col->tile + j;
+}
+
+static void swap_rows(const struct column *col, long long g1, long long g2) {
+    float *row1 = at(col, g1, 0);
+    float *row2 = at(col, g2, 0);
+    for (int j = 0; j < col->tile; ++j) {
+        float t = row1[j];
+        row1[j] = row2[j];
+        row2[j] = t;
+    }
+}
+
+// Elimination of the rows below pivot row p, within one panel
+struct panel_step {
+    const struct column *panel;
+    long long p;
+    int j;               // local pivot column
+};
+
+static void eliminate_rows(int begin, int end, void *ctx) {
+    struct panel_step *step = ctx;
+    const float *pivot_row = at(step->panel, step->p, 0);
+    for (long long g = step->p + 1 + begin; g < step->p + 1 + end; ++g) {
+        float *row = at(step->panel, g, 0);
+        row[step->j] /= pivot_row[step->j];
+        for (int j = step->j + 1; j < step->panel->tile; ++j) {
+            row[j] -= row[step->j] * pivot_row[j];
+        }
+    }
+}
+
+// The update of one trailing tile column with a factored panel
+struct trailing {
+    const struct column *panel;
+    const struct column *col;
+};
+
+// update_tiles runs col(t) -= panel(t) * col(0) for tile rows t in
+//   [begin + 1, end + 1), below the diagonal tile
+static void update_tiles(int begin, int end, void *ctx) {
+    struct trailing *tr = ctx;
+    int t = tr->col->tile;
+    const float *u = tr->col->tiles[0];
+    for (int k = begin + 1; k < end + 1; ++k) {
+        const float *l = tr->panel->tiles[k];
+        float *a = tr->col->tiles[k];
+        for (int i = 0; i < t; ++i) {
+            for (int p = 0; p < t; ++p) {
+                float scale = l[i * t + p];
+                if (scale == 0) {
+                    continue;
+                }
+                for (int j = 0; j < t; ++j) {
+                    a[i * t + j] -= scale * u[p * t + j];
+                }
+            }
+        }
+    }
+}
+
+// pin_column(pool, mat, tj, first, col) pins tile rows first.. of tile
+//   column tj in col->tiles; returns false on a file error
+static bool pin_column(struct ooc_pool *pool, struct ooc_matrix *mat, long long tj,
+                       long long first, struct column *col) {
+    bool ok = true;
+    col->tile = mat->tile;
+    col->first = first * mat->tile;
+    col->rows = mat->rows;
+    for (long long ti = first; ti < mat->tile_rows; ++ti) {
+        col->tiles[ti - first] = pool_get(pool, mat, ti, tj, true);
+        ok = ok && col->tiles[ti - first];
+    }
+    return ok;
+}
+
+static void unpin_column(struct ooc_pool *pool, struct ooc_matrix *mat, long long first,
+                         struct column *col) {
+    for (long long ti = first; ti < mat->tile_rows; ++ti) {
+        if (col->tiles[ti - first]) {
+            pool_release(pool, col->tiles[ti - first], true);
+        }
+    }
+}
+
+// lu(pool, mat, pivots, keep_l) is ooc_lu; the row swaps are only
+//   applied to the L part (left of each panel) if keep_l is true
+static bool lu(struct ooc_pool *pool, struct ooc_matrix *mat, long long *pivots, bool keep_l) {
+    int tile = mat->tile;
+    long long tr = mat->tile_rows;
+    long long steps = mat->rows < mat->columns ? mat->rows : mat->columns;
+    int slots = pool_prepare(pool, tile);
+    if (slots < 0) {
+        return false;
+    }
+    if (slots < 2 * tr) {
+        fprintf(stderr, "Error: out-of-core budget must hold 2 tile columns (%lld tiles)\n", 2 * tr);
+        return false;
+    }
+    bool prefetch = slots >= 3 * tr;
+    float **tiles = mem_alloc(2 * tr * sizeof(float *));
+    if (!tiles) {
+        return false;
+    }
+    struct column panel = {tile, 0, 0, tiles};
+    struct column col = {tile, 0, 0, tiles + tr};
+    bool ok = true;
+    for (long long kt = 0; ok && kt * tile < steps; ++kt) {
+        ok = pin_column(pool, mat, kt, kt, &panel);
+        long long end = (kt + 1) * tile < steps ? (kt + 1) * tile : steps;
+        for (long long p = kt * tile; ok && p < end; ++p) {
+            int j = p - kt * tile;
+            long long best = p;
+            for (long long g = p + 1; g < mat->rows; ++g) {
+                if (fabsf(*at(&panel, g, j)) > fabsf(*at(&panel, best, j))) {
+                    best = g;
+                }
+            }
+            pivots[p] = best;
+            if (*at(&panel, best, j) == 0) {
+                continue;
+            }
+            if (best != p) {
+                swap_rows(&panel, p, best);
+            }
+            struct panel_step step = {&panel, p, j};
+            parallel_for(mat->rows - p - 1, 256, eliminate_rows, &step);
+        }
+        for (long long tj = kt + 1; ok && tj < mat->tile_columns; ++tj) {
+            if (prefetch && tj + 1 < mat->tile_columns) {
+                for (long long ti = kt; ti < tr; ++ti) {
+                    pool_prefetch(pool, mat, ti, tj + 1);
+                }
+            }
+            ok = pin_column(pool, mat, tj, kt, &col);
+            for (long long p = kt * tile; ok && p < end; ++p) {
+                if (pivots[p] != p) {
+                    swap_rows(&col, p, pivots[p]);
+                }
+            }
+            // U(kt, tj) = L(kt, kt)^-1 A(kt, tj), then the trailing tiles
+            for (int i = 0; ok && i < tile; ++i) {
+                const float *l = panel.tiles[0] + i * tile;
+                float *u = col.tiles[0] + i * tile;
+                for (int p = 0; p < i; ++p) {
+                    for (int j = 0; l[p] != 0 && j < tile; ++j) {
+                        u[j] -= l[p] * col.tiles[0][p * tile + j];
+                    }
+                }
+            }
+            if (ok) {
+                struct trailing update = {&panel, &col};
+                parallel_for(tr - kt - 1, 1, update_tiles, &update);
+            }
+            unpin_column(pool, mat, kt, &col);
+        }
+        unpin_column(pool, mat, kt, &panel);
+    }
+    // the row swaps of later panels, applied to the L part of each panel
+    for (long long jt = 0; ok && keep_l && jt * tile < steps && jt + 1 < tr; ++jt) {
+        ok = pin_column(pool, mat, jt, jt + 1, &col);
+        for (long long p = (jt + 1) * tile; ok && p < steps; ++p) {
+            if (pivots[p] != p) {
+                swap_rows(&col, p, pivots[p]);
+            }
+        }
+        unpin_column(pool, mat, jt + 1, &col);
+    }
+    mem_free(tiles, 2 * tr * sizeof(float *));
+    return pool_flush(pool, mat) && ok;
+}
+
+bool ooc_lu(struct ooc_pool *pool, struct ooc_matrix *mat, long long *pivots) {
+    assert(pool);
+    assert(mat);
+    assert(pivots);
+    return lu(pool, mat, pivots, true);
+}
+
+struct ooc_matrix *ooc_ref(struct ooc_pool *pool, struct ooc_matrix *mat, const char *path) {
+    assert(pool);
+    assert(mat);
+    int tile = mat->tile;
+    int slots = pool_prepare(pool, tile);
+    if (slots < 0) {
+        return NULL;
+    }
+    if (slots < 2) {
+        fprintf(stderr, "Error: out-of-core budget must hold at least 2 tiles\n");
+        return NULL;
+    }
+    struct ooc_matrix *out = ooc_create(path, mat->rows, mat->columns, tile);
+    if (!out) {
+        return NULL;
+    }
+    bool ok = true;
+    long long count = mat->tile_rows * mat->tile_columns;
+    for (long long index = 0; ok && index < count; ++index) {
+        if (index + 1 < count) {
+            pool_prefetch(pool, mat, (index + 1) / mat->tile_columns, (index + 1) % mat->tile_columns);
+        }
+        float *src = pool_get(pool, mat, index / mat->tile_columns, index % mat->tile_columns, true);
+        float *dst = src ? pool_get(pool, out, index / out->tile_columns, index % out->tile_columns, false) : NULL;
+        ok = dst != NULL;
+        if (ok) {
+            memcpy(dst, src, tile_bytes(tile));
+            pool_release(pool, dst, true);
+        }
+        if (src) {
+            pool_release(pool, src, false);
+        }
+    }
+    ok = ok && pool_flush(pool, out);
+    long long steps = mat->rows < mat->columns ? mat->rows : mat->columns;
+    long long *pivots = ok ? mem_alloc(steps * sizeof(long long)) : NULL;
+    ok = pivots && lu(pool, out, pivots, false);
+    mem_free(pivots, steps * sizeof(long long));
+    // clear the multipliers below the diagonal
+    for (long long ti = 0; ok && ti < out->tile_rows; ++ti) {
+        for (long long tj = 0; ok && tj <= ti && tj < out->tile_columns; ++tj) {
+            float *data = pool_get(pool, out, ti, tj, tj == ti);
+            ok = data != NULL;
+            for (int i = 0; ok && tj == ti && i < tile; ++i) {
+                memset(data + i * tile, 0, (i < tile ? i : tile) * sizeof(float));
+            }
+            if (data) {
+                pool_release(pool, data, true);
+            }
+        }
+    }
+    ok = ok && pool_flush(pool, out);
+    if (!ok) {
+        pool_forget(pool, out);
+        ooc_close(out);
+        return NULL;
+    }
+    return out;
+}
\ No newline at end of file
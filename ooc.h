@@ -0,0 +1,129 @@
+// Out-of-core matrices: matrices that live in a file instead of memory.
+// time: n is # of rows, m is # of columns (as in linalg.h)
+//       t is the tile size, S the number of tiles that fit in the budget
+// Every function below that allocates memory (tile buffers included)
+//   outputs an error message and fails, returning NULL or false, if out
+//   of memory (see memtrack.h).
+// see linalg.h
+
+// A matrix stored in a file as square t x t tiles (row by row, tiles
+//   are zero padded at the right and bottom edges). Sizes are 64-bit so
+//   matrices far larger than memory can be described.
+struct ooc_matrix;
+
+// A buffer pool holds the tiles that out-of-core operations work on.
+//   Its memory never exceeds the budget it was created with. A
+//   background thread prefetches the tiles an operation will need next
+//   while the current ones are being computed on.
+struct ooc_pool;
+
+// ooc_pool_create(budget) returns a pool that uses at most budget bytes
+//   for tile buffers.
+// effects: may allocate memory (client must call ooc_pool_destroy)
+//          may start a thread
+//          may produce output
+// time: O(1)
+struct ooc_pool *ooc_pool_create(size_t budget);
+
+// ooc_pool_destroy(pool) stops the prefetch thread and frees pool
+// requires: pool is a valid pointer and no operation is using it
+// effects: pool is no longer valid
+// time: O(S)
+void ooc_pool_destroy(struct ooc_pool *pool);
+
+// ooc_pool_io(pool, read, written) stores the number of bytes pool has
+//   read from and written to matrix files so far.
+// requires: pool, read and written are valid pointers
+// time: O(1)
+void ooc_pool_io(struct ooc_pool *pool, long long *read, long long *written);
+
+// ooc_create(path, rows, columns, tile) creates the file path for a
+//   zero rows x columns matrix with tile x tile tiles.
+// requires: path is a valid pointer, rows, columns and tile are > 0
+// notes: outputs an error message and returns NULL if the file cannot
+//   be created
+// effects: may allocate memory (client must call ooc_close)
+//          may create a file
+//          may produce output
+// time: O(1)
+struct ooc_matrix *ooc_create(const char *path, long long rows, long long columns, int tile);
+
+// ooc_open(path) opens a matrix file created by ooc_create
+// requires: path is a valid pointer
+// notes: outputs an error message and returns NULL if path cannot be
+//   opened or is not a matrix file
+// effects: may allocate memory (client must call ooc_close)
+//          may produce output
+// time: O(1)
+struct ooc_matrix *ooc_open(const char *path);
+
+// ooc_close(mat) closes the file of mat and frees mat
+// requires: mat is a valid pointer and no operation is using it
+// effects: mat is no longer valid
+// time: O(1)
+void ooc_close(struct ooc_matrix *mat);
+
+// ooc_rows(mat) and ooc_columns(mat) return the size of mat
+// requires: mat is a valid pointer
+// time: O(1)
+long long ooc_rows(const struct ooc_matrix *mat);
+long long ooc_columns(const struct ooc_matrix *mat);
+
+// ooc_from_matrix(path, mat, tile) writes mat to a new matrix file
+// requires: path and mat are valid pointers, tile > 0
+// notes: returns NULL as ooc_create does
+// effects: as ooc_create
+// time: O(nm)
+struct ooc_matrix *ooc_from_matrix(const char *path, const struct matrix *mat, int tile);
+
+// ooc_to_matrix(mat) reads all of mat into memory
+// requires: mat is a valid pointer, mat fits in memory
+// notes: outputs an error message and returns NULL if reading fails
+// effects: may allocate memory (client must call destroy_matrix)
+//          may produce output
+// time: O(nm)
+struct matrix *ooc_to_matrix(const struct ooc_matrix *mat);
+
+// ooc_multiply(pool, mat1, mat2, path) returns mat1 * mat2, stored in the
+//   new file path. Blocks of r x c result tiles are kept in the pool
+//   while the matching tile rows of mat1 and tile columns of mat2 are
+//   streamed past them, with r and c as large as the budget allows, so
+//   the file traffic is O(n m k / (t sqrt(S))) tiles for an n x k by
+//   k x m product.
+// requires: pool, mat1, mat2 and path are valid pointers
+//           mat1 and mat2 have the same tile size
+// notes: outputs an error message and returns NULL if the sizes do not
+//   match, the budget holds fewer than 3 tiles or a file error occurs
+// effects: may allocate memory (client must call ooc_close)
+//          may create a file
+//          may produce output
+// time: O(nmk)
+struct ooc_matrix *ooc_multiply(struct ooc_pool *pool, struct ooc_matrix *mat1,
+                                struct ooc_matrix *mat2, const char *path);
+
+// ooc_lu(pool, mat, pivots) factors mat in place into P mat = L U with
+//   partial pivoting (L unit lower triangular below the diagonal, U on
+//   and above it), one tile column (panel) at a time. At step i rows i
+//   and pivots[i] were swapped. A column without a nonzero pivot is
+//   skipped, so U then has a zero on its diagonal.
+// requires: pool, mat and pivots are valid pointers
+//           pivots has room for min(n, m) entries
+// notes: outputs an error message and returns false if the budget
+//   holds fewer than 2 tile columns or a file error occurs
+// effects: modifies the file of mat
+//          may produce output
+// time: O(nm min(n, m))
+bool ooc_lu(struct ooc_pool *pool, struct ooc_matrix *mat, long long *pivots);
+
+// ooc_ref(pool, mat, path) returns the U factor of the LU factorization
+//   of mat, stored in the new file path. It is a row echelon form of mat
+//   when no pivot column was skipped, e.g. when the first min(n, m)
+//   columns of mat are independent. Otherwise it is not: a skipped
+//   column leaves a zero on the diagonal, and the rows below it are not
+//   moved up, so a row can start with more zeros than the next one
+//   (use ref on the in-memory matrix for such input).
+// requires: pool, mat and path are valid pointers
+// notes: returns NULL as ooc_create and ooc_lu do
+// effects: as ooc_create
+// time: O(nm min(n, m))
+struct ooc_matrix *ooc_ref(struct ooc_pool *pool, struct ooc_matrix *mat, const char *path);
\ No newline at end of file
@@ -0,0 +1,517 @@
+#include <stdio.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "linalg.h"
+#include "packed.h"
+#include "memtrack.h"
+
+// Lower triangles are stored row by row, upper triangles column by
+//   column, so both keep entry (i, j) of the stored triangle at
+//   TRIANGLE(max(i, j)) + min(i, j).
+#define TRIANGLE(i) ((i) * ((i) + 1) / 2)
+
+struct packed_matrix {
+    size_t n;
+    enum packed_kind kind;
+    float *entries;
+};
+
+// Row i keeps columns i - kl .. i + ku at i * width + (j - i + kl);
+//   the slots outside the matrix are 0.
+struct band_matrix {
+    size_t n;
+    size_t kl;
+    size_t ku;
+    float *entries;
+};
+
+// The rows keep columns i - kl .. i + kl + ku (the multipliers of L
+//   and the widened U) at i * width + (j - i + kl).
+struct band_lu {
+    size_t n;
+    size_t kl;
+    size_t ku;
+    size_t *pivots;
+    bool singular;
+    float *entries;
+};
+
+// alloc_packed(n, kind) returns an uninitialized packed matrix, or NULL
+//   if out of memory (see memtrack.h)
+static struct packed_matrix *alloc_packed(size_t n, enum packed_kind kind) {
+    struct packed_matrix *p = mem_alloc(sizeof(struct packed_matrix));
+    float *entries = p ? mem_alloc(TRIANGLE(n) * sizeof(float)) : NULL;
+    if (!entries) {
+        mem_free(p, sizeof(struct packed_matrix));
+        return NULL;
+    }
+    p->n = n;
+    p->kind = kind;
+    p->entries = entries;
+    return p;
+}
+
+struct packed_matrix *packed_from_matrix(const struct matrix *mat, enum packed_kind kind) {
+    assert(mat);
+    size_t n = matrix_rows(mat);
+    if (matrix_columns(mat) != n) {
+        fprintf(stderr, "Error: Matrix must be square\n");
+        return NULL;
+    }
+    struct packed_matrix *p = alloc_packed(n, kind);
+    if (!p) {
+        return NULL;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = 0; j <= i; ++j) {
+            p->entries[TRIANGLE(i) + j] = kind == PACKED_UPPER ? matrix_get(mat, j, i) : matrix_get(mat, i, j);
+        }
+    }
+    return p;
+}
+
+struct matrix *packed_to_matrix(const struct packed_matrix *p) {
+    assert(p);
+    float *entries = mem_alloc(p->n * p->n * sizeof(float));
+    if (!entries) {
+        return NULL;
+    }
+    for (size_t i = 0; i < p->n; ++i) {
+        for (size_t j = 0; j < p->n; ++j) {
+            entries[i * p->n + j] = packed_get(p, i, j);
+        }
+    }
+    struct matrix *mat = create_matrix(p->n, p->n, entries);
+    mem_free(entries, p->n * p->n * sizeof(float));
+    return mat;
+}
+
+void destroy_packed(struct packed_matrix *p) {
+    assert(p);
+    mem_free(p->entries, TRIANGLE(p->n) * sizeof(float));
+    mem_free(p, sizeof(struct packed_matrix));
+}
+
+size_t packed_size(const struct packed_matrix *p) {
+    assert(p);
+    return p->n;
+}
+
+enum packed_kind packed_kind(const struct packed_matrix *p) {
+    assert(p);
+    return p->kind;
+}
+
+float packed_get(const struct packed_matrix *p, size_t row, size_t col) {
+    assert(p);
+    assert(row < p->n && col < p->n);
+    if ((p->kind == PACKED_LOWER && row < col) || (p->kind == PACKED_UPPER && row > col)) {
+        return 0;
+    }
+    size_t hi = row > col ? row : col;
+    size_t lo = row > col ? col : row;
+    return p->entries[TRIANGLE(hi) + lo];
+}
+
+// packed_rows(p, x, columns, y) stores p * x in y, where x and y are
+//   row-major arrays with n rows of columns floats (columns = 1 for a
+//   vector); each stored line t (a row of a lower, a column of an upper
+//   triangle) is read once
+static void packed_rows(const struct packed_matrix *p, const float *x, size_t columns, float *y) {
+    memset(y, 0, p->n * columns * sizeof(float));
+    for (size_t t = 0; t < p->n; ++t) {
+        const float *line = p->entries + TRIANGLE(t);
+        for (size_t s = 0; s <= t; ++s) {
+            float a = line[s];
+            if (a == 0) {
+                continue;
+            }
+            // (t, s) is below the diagonal for lower and symmetric
+            //   storage, and (s, t) above it for upper storage
+            size_t row = p->kind == PACKED_UPPER ? s : t;
+            size_t col = p->kind == PACKED_UPPER ? t : s;
+            for (size_t c = 0; c < columns; ++c) {
+                y[row * columns + c] += a * x[col * columns + c];
+            }
+            if (p->kind == PACKED_SYMMETRIC && s != t) {
+                for (size_t c = 0; c < columns; ++c) {
+                    y[s * columns + c] += a * x[t * columns + c];
+                }
+            }
+        }
+    }
+}
+
+void packed_vector_product(const struct packed_matrix *p, const float *x, float *y) {
+    assert(p);
+    assert(x);
+    assert(y);
+    packed_rows(p, x, 1, y);
+}
+
+struct matrix *packed_multiply(const struct packed_matrix *p, const struct matrix *mat) {
+    assert(p);
+    assert(mat);
+    if (matrix_rows(mat) != p->n) {
+        fprintf(stderr, "Error: first matrix columns must equal second matrix rows \n");
+        return NULL;
+    }
+    size_t columns = matrix_columns(mat);
+    size_t bytes = p->n * columns * sizeof(float);
+    float *x = mem_alloc(bytes);
+    float *y = x ? mem_alloc(bytes) : NULL;
+    if (!y) {
+        mem_free(x, bytes);
+        return NULL;
+    }
+    matrix_entries(mat, LAYOUT_ROW_MAJOR, x);
+    packed_rows(p, x, columns, y);
+    struct matrix *product = create_matrix(p->n, columns, y);
+    mem_free(x, bytes);
+    mem_free(y, bytes);
+    return product;
+}
+
+struct packed_matrix *packed_cholesky(const struct packed_matrix *p) {
+    assert(p);
+    assert(p->kind == PACKED_SYMMETRIC);
+    struct packed_matrix *l = alloc_packed(p->n, PACKED_LOWER);
+    if (!l) {
+        return NULL;
+    }
+    for (size_t i = 0; i < p->n; ++i) {
+        float *row_i = l->entries + TRIANGLE(i);
+        for (size_t j = 0; j <= i; ++j) {
+            // rows i and j of L are both contiguous
+            const float *row_j = l->entries + TRIANGLE(j);
+            double sum = p->entries[TRIANGLE(i) + j];
+            for (size_t k = 0; k < j; ++k) {
+                sum -= (double)row_i[k] * row_j[k];
+            }
+            if (i != j) {
+                row_i[j] = sum / row_j[j];
+            } else if (sum > 0) {
+                row_i[i] = sqrt(sum);
+            } else {
+                fprintf(stderr, "Error: Matrix is not positive definite\n");
+                destroy_packed(l);
+                return NULL;
+            }
+        }
+    }
+    return l;
+}
+
+// triangular_solve(p, x, transpose) solves p x = b (or p^T x = b) in
+//   place for a lower or upper triangular p, with b given in x
+static bool triangular_solve(const struct packed_matrix *p, float *x, bool transpose) {
+    for (size_t t = 0; t < p->n; ++t) {
+        if (p->entries[TRIANGLE(t) + t] == 0) {
+            fprintf(stderr, "Error: Matrix is singular\n");
+            return false;
+        }
+    }
+    // row-wise forward substitution (lower) or column-wise backward
+    //   substitution (upper, or a lower matrix transposed)
+    if (p->kind == PACKED_LOWER && !transpose) {
+        for (size_t i = 0; i < p->n; ++i) {
+            const float *row = p->entries + TRIANGLE(i);
+            double sum = x[i];
+            for (size_t j = 0; j < i; ++j) {
+                sum -= (double)row[j] * x[j];
+            }
+            x[i] = sum / row[i];
+        }
+    } else {
+        for (size_t j = p->n; j-- > 0;) {
+            const float *line = p->entries + TRIANGLE(j);
+            x[j] /= line[j];
+            for (size_t i = 0; i < j; ++i) {
+                x[i] -= line[i] * x[j];
+            }
+        }
+    }
+    return true;
+}
+
+bool packed_solve(const struct packed_matrix *p, const float *b, float *x) {
+    assert(p);
+    assert(b);
+    assert(x);
+    memmove(x, b, p->n * sizeof(float));
+    if (p->kind != PACKED_SYMMETRIC) {
+        return triangular_solve(p, x, false);
+    }
+    struct packed_matrix *l = packed_cholesky(p);
+    if (!l) {
+        return false;
+    }
+    triangular_solve(l, x, false);
+    triangular_solve(l, x, true);
+    destroy_packed(l);
+    return true;
+}
+
+// alloc_band(n, kl, ku) returns a zero band matrix, or NULL if out of
+//   memory (see memtrack.h)
+static struct band_matrix *alloc_band(size_t n, size_t kl, size_t ku) {
+    size_t bytes = n * (kl + ku + 1) * sizeof(float);
+    struct band_matrix *b = mem_alloc(sizeof(struct band_matrix));
+    float *entries = b ? mem_alloc(bytes) : NULL;
+    if (!entries) {
+        mem_free(b, sizeof(struct band_matrix));
+        return NULL;
+    }
+    memset(entries, 0, bytes);
+    b->n = n;
+    b->kl = kl;
+    b->ku = ku;
+    b->entries = entries;
+    return b;
+}
+
+struct band_matrix *band_from_matrix(const struct matrix *mat, size_t kl, size_t ku) {
+    assert(mat);
+    size_t n = matrix_rows(mat);
+    if (matrix_columns(mat) != n) {
+        fprintf(stderr, "Error: Matrix must be square\n");
+        return NULL;
+    }
+    kl = kl < n ? kl : n - 1;
+    ku = ku < n ? ku : n - 1;
+    struct band_matrix *b = alloc_band(n, kl, ku);
+    if (!b) {
+        return NULL;
+    }
+    size_t width = kl + ku + 1;
+    for (size_t i = 0; i < n; ++i) {
+        size_t first = i > kl ? i - kl : 0;
+        for (size_t j = first; j < n && j <= i + ku; ++j) {
+            b->entries[i * width + j + kl - i] = matrix_get(mat, i, j);
+        }
+    }
+    return b;
+}
+
+struct matrix *band_to_matrix(const struct band_matrix *b) {
+    assert(b);
+    size_t bytes = b->n * b->n * sizeof(float);
+    float *entries = mem_alloc(bytes);
+    if (!entries) {
+        return NULL;
+    }
+    memset(entries, 0, bytes);
+    size_t width = b->kl + b->ku + 1;
+    for (size_t i = 0; i < b->n; ++i) {
+        size_t first = i > b->kl ? i - b->kl : 0;
+        for (size_t j = first; j < b->n && j <= i + b->ku; ++j) {
+            entries[i * b->n + j] = b->entries[i * width + j + b->kl - i];
+        }
+    }
+    struct matrix *mat = create_matrix(b->n, b->n, entries);
+    mem_free(entries, bytes);
+    return mat;
+}
+
+void destroy_band(struct band_matrix *b) {
+    assert(b);
+    mem_free(b->entries, b->n * (b->kl + b->ku + 1) * sizeof(float));
+    mem_free(b, sizeof(struct band_matrix));
+}
+
+size_t band_size(const struct band_matrix *b) {
+    assert(b);
+    return b->n;
+}
+
+size_t band_lower(const struct band_matrix *b) {
+    assert(b);
+    return b->kl;
+}
+
+size_t band_upper(const struct band_matrix *b) {
+    assert(b);
+    return b->ku;
+}
+
+float band_get(const struct band_matrix *b, size_t row, size_t col) {
+    assert(b);
+    assert(row < b->n && col < b->n);
+    if (col + b->kl < row || col > row + b->ku) {
+        return 0;
+    }
+    return b->entries[row * (b->kl + b->ku + 1) + col + b->kl - row];
+}
+
+// band_rows(b, x, columns, y) stores b * x in y, where x and y are
+//   row-major arrays with n rows of columns floats
+static void band_rows(const struct band_matrix *b, const float *x, size_t columns, float *y) {
+    size_t width = b->kl + b->ku + 1;
+    memset(y, 0, b->n * columns * sizeof(float));
+    for (size_t i = 0; i < b->n; ++i) {
+        size_t first = i > b->kl ? i - b->kl : 0;
+        const float *row = b->entries + i * width + b->kl - i;
+        for (size_t j = first; j < b->n && j <= i + b->ku; ++j) {
+            for (size_t c = 0; c < columns; ++c) {
+                y[i * columns + c] += row[j] * x[j * columns + c];
+            }
+        }
+    }
+}
+
+void band_vector_product(const struct band_matrix *b, const float *x, float *y) {
+    assert(b);
+    assert(x);
+    assert(y);
+    band_rows(b, x, 1, y);
+}
+
+struct matrix *band_multiply(const struct band_matrix *b, const struct matrix *mat) {
+    assert(b);
+    assert(mat);
+    if (matrix_rows(mat) != b->n) {
+        fprintf(stderr, "Error: first matrix columns must equal second matrix rows \n");
+        return NULL;
+    }
+    size_t columns = matrix_columns(mat);
+    size_t bytes = b->n * columns * sizeof(float);
+    float *x = mem_alloc(bytes);
+    float *y = x ? mem_alloc(bytes) : NULL;
+    if (!y) {
+        mem_free(x, bytes);
+        return NULL;
+    }
+    matrix_entries(mat, LAYOUT_ROW_MAJOR, x);
+    band_rows(b, x, columns, y);
+    struct matrix *product = create_matrix(b->n, columns, y);
+    mem_free(x, bytes);
+    mem_free(y, bytes);
+    return product;
+}
+
+// lu_row(lu, i) returns row i of lu, shifted so that entry (i, j) is at
+//   lu_row(lu, i)[j] for j in i - kl .. i + kl + ku
+static float *lu_row(const struct band_lu *lu, size_t i) {
+    return lu->entries + i * (2 * lu->kl + lu->ku + 1) + lu->kl - i;
+}
+
+struct band_lu *band_factor(const struct band_matrix *b) {
+    assert(b);
+    size_t n = b->n;
+    size_t kl = b->kl;
+    size_t ku = b->ku;
+    size_t width = 2 * kl + ku + 1;
+    struct band_lu *lu = mem_alloc(sizeof(struct band_lu));
+    size_t *pivots = lu ? mem_alloc(n * sizeof(size_t)) : NULL;
+    float *entries = pivots ? mem_alloc(n * width * sizeof(float)) : NULL;
+    if (!entries) {
+        mem_free(pivots, n * sizeof(size_t));
+        mem_free(lu, sizeof(struct band_lu));
+        return NULL;
+    }
+    memset(entries, 0, n * width * sizeof(float));
+    lu->n = n;
+    lu->kl = kl;
+    lu->ku = ku;
+    lu->pivots = pivots;
+    lu->singular = false;
+    lu->entries = entries;
+    for (size_t i = 0; i < n; ++i) {
+        memcpy(lu->entries + i * width, b->entries + i * (kl + ku + 1), (kl + ku + 1) * sizeof(float));
+    }
+    for (size_t k = 0; k < n; ++k) {
+        size_t last = k + kl < n ? k + kl : n - 1;
+        size_t end = k + kl + ku + 1 < n ? k + kl + ku + 1 : n;
+        size_t pivot = k;
+        for (size_t r = k + 1; r <= last; ++r) {
+            if (fabsf(lu_row(lu, r)[k]) > fabsf(lu_row(lu, pivot)[k])) {
+                pivot = r;
+            }
+        }
+        lu->pivots[k] = pivot;
+        if (lu_row(lu, pivot)[k] == 0) {
+            lu->singular = true;
+            continue;
+        }
+        if (pivot != k) {
+            float *row1 = lu_row(lu, k);
+            float *row2 = lu_row(lu, pivot);
+            for (size_t j = k; j < end; ++j) {
+                float swap = row1[j];
+                row1[j] = row2[j];
+                row2[j] = swap;
+            }
+        }
+        const float *top = lu_row(lu, k);
+        for (size_t r = k + 1; r <= last; ++r) {
+            float *row = lu_row(lu, r);
+            float ratio = row[k] / top[k];
+            row[k] = ratio;
+            for (size_t j = k + 1; j < end; ++j) {
+                row[j] -= ratio * top[j];
+            }
+        }
+    }
+    return lu;
+}
+
+void destroy_band_lu(struct band_lu *lu) {
+    assert(lu);
+    mem_free(lu->pivots, lu->n * sizeof(size_t));
+    mem_free(lu->entries, lu->n * (2 * lu->kl + lu->ku + 1) * sizeof(float));
+    mem_free(lu, sizeof(struct band_lu));
+}
+
+bool band_solve(const struct band_lu *lu, const float *b, float *x) {
+    assert(lu);
+    assert(b);
+    assert(x);
+    if (lu->singular) {
+        fprintf(stderr, "Error: Matrix is singular\n");
+        return false;
+    }
+    size_t n = lu->n;
+    memmove(x, b, n * sizeof(float));
+    // replay the row interchanges and elimination steps on x
+    for (size_t k = 0; k < n; ++k) {
+        size_t pivot = lu->pivots[k];
+        float swap = x[k];
+        x[k] = x[pivot];
+        x[pivot] = swap;
+        for (size_t r = k + 1; r < n && r <= k + lu->kl; ++r) {
+            x[r] -= lu_row(lu, r)[k] * x[k];
+        }
+    }
+    for (size_t i = n; i-- > 0;) {
+        const float *row = lu_row(lu, i);
+        double sum = x[i];
+        for (size_t j = i + 1; j < n && j <= i + lu->kl + lu->ku; ++j) {
+            sum -= (double)row[j] * x[j];
+        }
+        x[i] = sum / row[i];
+    }
+    return true;
+}
+
+struct band_matrix *band_ref(const struct band_matrix *b) {
+    assert(b);
+    struct band_lu *lu = band_factor(b);
+    if (!lu) {
+        return NULL;
+    }
+    size_t ku = b->kl + b->ku < b->n ? b->kl + b->ku : b->n - 1;
+    struct band_matrix *u = alloc_band(b->n, 0, ku);
+    if (!u) {
+        destroy_band_lu(lu);
+        return NULL;
+    }
+    for (size_t i = 0; i < b->n; ++i) {
+        // the entries from the diagonal on are U
+        memcpy(u->entries + i * (ku + 1), lu_row(lu, i) + i, (ku + 1) * sizeof(float));
+    }
+    destroy_band_lu(lu);
+    return u;
+}
@@ -0,0 +1,178 @@
+// Structured matrices stored without their known zeros (or, for
+//   symmetric matrices, without their mirrored half).
+// time: n is the size of the (square) matrix
+//       m is # of columns of a dense operand
+//       kl and ku are the lower and upper bandwidths of a band matrix
+// Functions that return a new object output an error message and return
+//   NULL if out of memory (see memtrack.h).
+// see linalg.h
+
+// Packed storage keeps one triangle, row by row: n(n + 1) / 2 entries
+enum packed_kind {
+    PACKED_SYMMETRIC,    // the lower triangle of a symmetric matrix
+    PACKED_LOWER,        // a lower triangular matrix
+    PACKED_UPPER         // an upper triangular matrix
+};
+
+struct packed_matrix;
+
+// Band storage keeps the diagonals -kl..ku of an n x n matrix:
+//   n(kl + ku + 1) entries, all other entries are 0
+struct band_matrix;
+
+// The LU factorization of a band matrix with partial pivoting
+struct band_lu;
+
+// packed_from_matrix(mat, kind) returns the triangle of the square
+//   matrix mat that kind describes in packed storage (for
+//   PACKED_SYMMETRIC the lower triangle is used). The rest of mat is
+//   not read.
+// requires: mat is a valid pointer
+// notes: outputs an error message and returns NULL if mat is not square
+// effects: may allocate memory (client must call destroy_packed)
+//          may produce output
+// time: O(n^2)
+struct packed_matrix *packed_from_matrix(const struct matrix *mat, enum packed_kind kind);
+
+// packed_to_matrix(p) returns p as a full matrix
+// requires: p is a valid pointer
+// effects: may allocate memory (client must call destroy_matrix)
+//          may produce output
+// time: O(n^2)
+struct matrix *packed_to_matrix(const struct packed_matrix *p);
+
+// destroy_packed(p) frees all memory for p
+// requires: p is a valid pointer
+// effects: p is no longer valid
+// time: O(1)
+void destroy_packed(struct packed_matrix *p);
+
+// packed_size(p) returns n, packed_kind(p) the kind of p
+// requires: p is a valid pointer
+// time: O(1)
+size_t packed_size(const struct packed_matrix *p);
+enum packed_kind packed_kind(const struct packed_matrix *p);
+
+// packed_get(p, row, col) returns the entry of p at row, col
+// requires: p is a valid pointer, row and col are < n
+// time: O(1)
+float packed_get(const struct packed_matrix *p, size_t row, size_t col);
+
+// packed_vector_product(p, x, y) stores p * x in y (arrays of n floats),
+//   reading each stored entry once
+// requires: p, x and y are valid pointers
+//           x and y do not overlap
+// time: O(n^2)
+void packed_vector_product(const struct packed_matrix *p, const float *x, float *y);
+
+// packed_multiply(p, mat) returns p * mat
+// requires: p and mat are valid pointers
+// notes: outputs an error message and returns NULL if mat does not
+//   have n rows
+// effects: may allocate memory (client must call destroy_matrix)
+//          may produce output
+// time: O(n^2 m)
+struct matrix *packed_multiply(const struct packed_matrix *p, const struct matrix *mat);
+
+// packed_cholesky(p) returns the lower triangular L with L L^T = p for a
+//   symmetric positive definite p
+// requires: p is a valid pointer of kind PACKED_SYMMETRIC
+// notes: outputs an error message and returns NULL if p is not
+//   positive definite
+// effects: may allocate memory (client must call destroy_packed)
+//          may produce output
+// time: O(n^3)
+struct packed_matrix *packed_cholesky(const struct packed_matrix *p);
+
+// packed_solve(p, b, x) solves p x = b by substitution for triangular p
+//   and with packed_cholesky for symmetric p (which must then be
+//   positive definite). b and x are arrays of n floats.
+// requires: p, b and x are valid pointers
+// notes: outputs an error message and returns false if p is singular
+//   (or a symmetric p is not positive definite)
+// effects: may produce output
+// time: O(n^2) if p is triangular, O(n^3) if symmetric
+bool packed_solve(const struct packed_matrix *p, const float *b, float *x);
+
+// band_from_matrix(mat, kl, ku) returns the diagonals -kl..ku of the
+//   square matrix mat in band storage (entries outside them are not
+//   read)
+// requires: mat is a valid pointer
+// notes: outputs an error message and returns NULL if mat is not square
+// effects: may allocate memory (client must call destroy_band)
+//          may produce output
+// time: O(n (kl + ku))
+struct band_matrix *band_from_matrix(const struct matrix *mat, size_t kl, size_t ku);
+
+// band_to_matrix(b) returns b as a full matrix
+// requires: b is a valid pointer
+// effects: may allocate memory (client must call destroy_matrix)
+//          may produce output
+// time: O(n^2)
+struct matrix *band_to_matrix(const struct band_matrix *b);
+
+// destroy_band(b) frees all memory for b
+// requires: b is a valid pointer
+// effects: b is no longer valid
+// time: O(1)
+void destroy_band(struct band_matrix *b);
+
+// band_size(b), band_lower(b) and band_upper(b) return n, kl and ku
+// requires: b is a valid pointer
+// time: O(1)
+size_t band_size(const struct band_matrix *b);
+size_t band_lower(const struct band_matrix *b);
+size_t band_upper(const struct band_matrix *b);
+
+// band_get(b, row, col) returns the entry of b at row, col
+// requires: b is a valid pointer, row and col are < n
+// time: O(1)
+float band_get(const struct band_matrix *b, size_t row, size_t col);
+
+// band_vector_product(b, x, y) stores b * x in y (arrays of n floats)
+// requires: b, x and y are valid pointers
+//           x and y do not overlap
+// time: O(n (kl + ku))
+void band_vector_product(const struct band_matrix *b, const float *x, float *y);
+
+// band_multiply(b, mat) returns b * mat
+// requires: b and mat are valid pointers
+// notes: outputs an error message and returns NULL if mat does not
+//   have n rows
+// effects: may allocate memory (client must call destroy_matrix)
+//          may produce output
+// time: O(n (kl + ku) m)
+struct matrix *band_multiply(const struct band_matrix *b, const struct matrix *mat);
+
+// band_factor(b) returns the LU factorization of b with partial
+//   pivoting. Row interchanges widen U to kl + ku upper diagonals, and
+//   elimination only runs inside the band. A column without a nonzero
+//   pivot is skipped (the factorization is then singular).
+// requires: b is a valid pointer
+// effects: may allocate memory (client must call destroy_band_lu)
+//          may produce output
+// time: O(n kl (kl + ku))
+struct band_lu *band_factor(const struct band_matrix *b);
+
+// destroy_band_lu(lu) frees all memory for lu
+// requires: lu is a valid pointer
+// effects: lu is no longer valid
+// time: O(1)
+void destroy_band_lu(struct band_lu *lu);
+
+// band_solve(lu, b, x) solves A x = b, where lu = band_factor(A). b and
+//   x are arrays of n floats.
+// requires: lu, b and x are valid pointers
+// notes: outputs an error message and returns false if A is singular
+// effects: may produce output
+// time: O(n (kl + ku))
+bool band_solve(const struct band_lu *lu, const float *b, float *x);
+
+// band_ref(b) returns the U factor of band_factor(b), a band matrix with
+//   0 lower and kl + ku upper diagonals. It is a row echelon form of b
+//   when no pivot column was skipped (e.g. b is nonsingular); see ref.
+// requires: b is a valid pointer
+// effects: may allocate memory (client must call destroy_band)
+//          may produce output
+// time: O(n kl (kl + ku))
+struct band_matrix *band_ref(const struct band_matrix *b);
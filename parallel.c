@@ -0,0 +1,117 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "parallel.h"
+#include "trace.h"
+
+static int num_threads = 0;
+static pthread_once_t threads_once = PTHREAD_ONCE_INIT;
+
+// Helper threads started by the loops that are running now (updated
+//   atomically); all loops together start at most num_threads - 1, so
+//   loops run from several threads at once (jobs, server connections)
+//   share the processors instead of each taking all of them
+static int helpers = 0;
+
+// Whether the calling thread is running the body of a loop; a loop
+//   started from inside one runs on the calling thread
+static __thread bool in_loop = false;
+
+static void threads_from_environment(void) {
+    const char *env = getenv("LINALG_THREADS");
+    long threads = env ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN);
+    __atomic_store_n(&num_threads, threads > 0 ? (int)threads : 1, __ATOMIC_RELAXED);
+}
+
+int parallel_threads(void) {
+    pthread_once(&threads_once, threads_from_environment);
+    return __atomic_load_n(&num_threads, __ATOMIC_RELAXED);
+}
+
+void parallel_set_threads(int threads) {
+    assert(threads > 0);
+    // a later first call must not replace this with LINALG_THREADS
+    pthread_once(&threads_once, threads_from_environment);
+    __atomic_store_n(&num_threads, threads, __ATOMIC_RELAXED);
+}
+
+// reserve_helpers(wanted) returns how many of wanted helper threads may
+//   be started (and counts them as started)
+static int reserve_helpers(int wanted) {
+    int limit = parallel_threads() - 1;
+    int busy = __atomic_load_n(&helpers, __ATOMIC_RELAXED);
+    int granted = 0;
+    do {
+        granted = limit - busy < wanted ? limit - busy : wanted;
+        if (granted <= 0) {
+            return 0;
+        }
+    } while (!__atomic_compare_exchange_n(&helpers, &busy, busy + granted, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return granted;
+}
+
+struct loop {
+    int count;
+    int grain;
+    int next;    // first index not yet claimed (updated atomically)
+    void (*body)(int begin, int end, void *ctx);
+    void *ctx;
+};
+
+static void *run_loop(void *data) {
+    struct loop *loop = data;
+    // a loop over count indexes is traced as count x 1
+    TRACE_BEGIN("parallel_for", loop->count, 1);
+    in_loop = true;
+    while (1) {
+        int begin = __atomic_fetch_add(&loop->next, loop->grain, __ATOMIC_RELAXED);
+        if (begin >= loop->count) {
+            break;
+        }
+        int end = loop->count - begin < loop->grain ? loop->count : begin + loop->grain;
+        loop->body(begin, end, loop->ctx);
+    }
+    in_loop = false;
+    TRACE_END();
+    return NULL;
+}
+
+void parallel_for(int count, int grain, void (*body)(int begin, int end, void *ctx),
+                  void *ctx) {
+    assert(count >= 0);
+    assert(grain > 0);
+    assert(body);
+    int chunks = count / grain + (count % grain != 0);
+    int threads = parallel_threads() < chunks ? parallel_threads() : chunks;
+    int reserved = threads > 1 && !in_loop ? reserve_helpers(threads - 1) : 0;
+    pthread_t *workers = reserved ? malloc(reserved * sizeof(pthread_t)) : NULL;
+    if (!workers) {
+        __atomic_sub_fetch(&helpers, reserved, __ATOMIC_RELAXED);
+        if (count > 0) {
+            bool nested = in_loop;
+            in_loop = true;
+            body(0, count, ctx);
+            in_loop = nested;
+        }
+        return;
+    }
+    struct loop loop = {count, grain, 0, body, ctx};
+    int started = 0;
+    for (; started < reserved; ++started) {
+        if (pthread_create(&workers[started], NULL, run_loop, &loop)) {
+            break;
+        }
+    }
+    __atomic_sub_fetch(&helpers, reserved - started, __ATOMIC_RELAXED);
+    run_loop(&loop);
+    for (int i = 0; i < started; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+    __atomic_sub_fetch(&helpers, started, __ATOMIC_RELAXED);
+    free(workers);
+}
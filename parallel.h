@@ -0,0 +1,29 @@
+// Helpers for running loops across threads.
+//   The number of threads defaults to the number of online processors
+//   and can be overridden with the LINALG_THREADS environment variable.
+//   It caps the threads of all loops together: loops started at the
+//   same time from several threads share it, and a loop started from
+//   the body of another one runs on the calling thread.
+
+// parallel_threads() returns the number of threads parallel_for uses
+// time: O(1)
+int parallel_threads(void);
+
+// parallel_set_threads(threads) sets the number of threads parallel_for
+//   uses; threads = 1 makes every loop run on the calling thread.
+// requires: threads > 0
+// time: O(1)
+void parallel_set_threads(int threads);
+
+// parallel_for(count, grain, body, ctx) calls body(begin, end, ctx) for
+//   consecutive ranges [begin, end) that together cover [0, count).
+//   Threads claim ranges of (at most) grain indexes on demand, so a
+//   thread that gets cheap ranges simply claims more of them (dynamic
+//   load balancing). The calling thread takes part and the function
+//   returns once every range is done. The loop gets fewer threads (down
+//   to just the calling one) while other loops use them.
+// requires: count >= 0, grain > 0
+//           body is a valid pointer and safe to call concurrently
+// time: O(count / grain) plus the time of the body calls
+void parallel_for(int count, int grain, void (*body)(int begin, int end, void *ctx),
+                  void *ctx);
\ No newline at end of file
@@ -0,0 +1,392 @@
+#include <stdio.h>
+#include <assert.h>
+#include <float.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "linalg.h"
+#include "memtrack.h"
+#include "parallel.h"
+#include "qr.h"
+#include "trace.h"
+
+// Columns reduced together before the rest of the matrix is updated
+#define PANEL_COLUMNS 32
+
+// Products smaller than this many multiply-adds run on one thread
+#define PARALLEL_ENTRIES (1 << 16)
+
+// A product over rows first..last-1 of column-major arrays whose
+//   columns are lda apart: products computes W = V^T A (b x c) and
+//   update A -= V W
+struct rows_op {
+    size_t lda;
+    size_t first;
+    size_t last;
+    const float *v;         // b columns
+    size_t b;
+    float *a;               // c columns
+    size_t c;
+    double *w;              // b x c, row by row
+    double *partial;        // room for parallel_threads() blocks of b x c
+    int parts;
+};
+
+// part_rows(op, part, lo, hi) sets lo..hi-1 to the rows of part
+static void part_rows(const struct rows_op *op, int part, size_t *lo, size_t *hi) {
+    size_t rows = op->last - op->first;
+    *lo = op->first + rows * part / op->parts;
+    *hi = op->first + rows * (part + 1) / op->parts;
+}
+
+static void products_parts(int begin, int end, void *ctx) {
+    const struct rows_op *op = ctx;
+    for (int part = begin; part < end; ++part) {
+        size_t lo, hi;
+        part_rows(op, part, &lo, &hi);
+        double *block = op->partial + (size_t)part * op->b * op->c;
+        for (size_t j = 0; j < op->c; ++j) {
+            const float *a = op->a + j * op->lda;
+            for (size_t i = 0; i < op->b; ++i) {
+                const float *v = op->v + i * op->lda;
+                double sum = 0;
+                for (size_t r = lo; r < hi; ++r) {
+                    sum += (double)v[r] * a[r];
+                }
+                block[i * op->c + j] = sum;
+            }
+        }
+    }
+}
+
+static void update_parts(int begin, int end, void *ctx) {
+    const struct rows_op *op = ctx;
+    for (int part = begin; part < end; ++part) {
+        size_t lo, hi;
+        part_rows(op, part, &lo, &hi);
+        for (size_t j = 0; j < op->c; ++j) {
+            float *a = op->a + j * op->lda;
+            for (size_t i = 0; i < op->b; ++i) {
+                const float *v = op->v + i * op->lda;
+                float w = op->w[i * op->c + j];
+                for (size_t r = lo; r < hi; ++r) {
+                    a[r] -= w * v[r];
+                }
+            }
+        }
+    }
+}
+
+// split(op) picks how many row ranges op is split into
+static void split(struct rows_op *op) {
+    size_t work = (op->last - op->first) * op->b * op->c;
+    size_t parts = work / PARALLEL_ENTRIES + 1;
+    size_t rows = op->last - op->first;
+    parts = parts < rows ? parts : rows;
+    op->parts = parts < (size_t)parallel_threads() ? parts : (size_t)parallel_threads();
+    op->parts = op->parts ? op->parts : 1;
+}
+
+// products(op) stores V^T A in op->w; each part sums its rows in double
+//   and the parts are added in order, so the result does not depend on
+//   the timing of the threads
+static void products(struct rows_op *op) {
+    split(op);
+    parallel_for(op->parts, 1, products_parts, op);
+    size_t size = op->b * op->c;
+    for (size_t e = 0; e < size; ++e) {
+        double sum = 0;
+        for (int part = 0; part < op->parts; ++part) {
+            sum += op->partial[part * size + e];
+        }
+        op->w[e] = sum;
+    }
+}
+
+// update(op) subtracts V op->w from A
+static void update(struct rows_op *op) {
+    split(op);
+    parallel_for(op->parts, 1, update_parts, op);
+}
+
+// norm(x, first, last, partial) returns the length of x[first..last-1]
+static double norm(float *x, size_t first, size_t last, double *partial) {
+    double squares = 0;
+    struct rows_op op = {0, first, last, x, 1, x, 1, &squares, partial, 1};
+    products(&op);
+    return sqrt(squares);
+}
+
+// The state of a factorization, in one allocation
+struct householder {
+    size_t n;
+    size_t m;
+    size_t k;
+    float *a;               // n x m, column-major: R above the diagonal,
+                            //   the reflection vectors below it
+    float *v;               // n x PANEL_COLUMNS: the vectors of a panel
+                            //   (unit diagonal, zeros above it)
+    double *tau;            // k: H_j = I - tau[j] v_j v_j^T
+    double *t;              // PANEL_COLUMNS x PANEL_COLUMNS for each panel
+    double *w;              // PANEL_COLUMNS x max(m, PANEL_COLUMNS)
+    double *partial;        // parallel_threads() blocks the size of w
+};
+
+// reflect(h, j) replaces column j of a (rows j..n-1) by beta e_j, where
+//   H_j x = beta e_j, and stores v_j below the diagonal (as LAPACK's
+//   dlarfg does)
+static void reflect(struct householder *h, size_t j) {
+    float *x = h->a + j * h->n;
+    double alpha = x[j];
+    double rest = norm(x, j + 1, h->n, h->partial);
+    if (rest == 0) {
+        h->tau[j] = 0;
+        return;
+    }
+    double beta = -copysign(hypot(alpha, rest), alpha);
+    h->tau[j] = (beta - alpha) / beta;
+    float scale = 1 / (alpha - beta);
+    for (size_t r = j + 1; r < h->n; ++r) {
+        x[r] *= scale;
+    }
+    x[j] = beta;
+}
+
+// load_vector(h, j, j0) copies v_j into column j - j0 of h->v
+static void load_vector(struct householder *h, size_t j, size_t j0) {
+    float *v = h->v + (j - j0) * h->n;
+    memset(v + j0, 0, (j - j0) * sizeof(float));
+    v[j] = 1;
+    memcpy(v + j + 1, h->a + j * h->n + j + 1, (h->n - j - 1) * sizeof(float));
+}
+
+// panel_t(h, j0, b) computes T of the panel j0..j0+b-1, so that
+//   H_j0 ... H_j0+b-1 = I - V T V^T (as LAPACK's dlarft does)
+static double *panel_t(struct householder *h, size_t j0, size_t b) {
+    double *t = h->t + j0 / PANEL_COLUMNS * PANEL_COLUMNS * PANEL_COLUMNS;
+    struct rows_op op = {h->n, j0, h->n, h->v, b, h->v, b, h->w, h->partial, 1};
+    products(&op);
+    const double *vv = h->w;
+    const double *tau = h->tau + j0;
+    for (size_t i = 0; i < b; ++i) {
+        // T[0..i-1, i] = -tau_i T[0..i-1, 0..i-1] V[:, 0..i-1]^T v_i
+        for (size_t r = 0; r < i; ++r) {
+            double sum = 0;
+            for (size_t s = r; s < i; ++s) {
+                sum += t[r * b + s] * vv[s * b + i];
+            }
+            t[r * b + i] = -tau[i] * sum;
+        }
+        t[i * b + i] = tau[i];
+        for (size_t r = i + 1; r < b; ++r) {
+            t[r * b + i] = 0;
+        }
+    }
+    return t;
+}
+
+// apply_block(h, t, j0, b, first, c, transposed) multiplies columns
+//   first..first+c-1 of a (rows j0..n-1) by I - V T V^T, or by its
+//   transpose
+static void apply_block(struct householder *h, const double *t, size_t j0, size_t b,
+                        size_t first, size_t c, bool transposed) {
+    struct rows_op op = {h->n, j0, h->n, h->v, b, h->a + first * h->n, c, h->w, h->partial, 1};
+    products(&op);
+    // W = T W or T^T W, in place: T is upper triangular, so each row of
+    //   the result only reads rows of W that are not overwritten yet
+    for (size_t col = 0; col < c; ++col) {
+        if (transposed) {
+            for (size_t i = b; i-- > 0;) {
+                double sum = 0;
+                for (size_t s = 0; s <= i; ++s) {
+                    sum += t[s * b + i] * h->w[s * c + col];
+                }
+                h->w[i * c + col] = sum;
+            }
+        } else {
+            for (size_t i = 0; i < b; ++i) {
+                double sum = 0;
+                for (size_t s = i; s < b; ++s) {
+                    sum += t[i * b + s] * h->w[s * c + col];
+                }
+                h->w[i * c + col] = sum;
+            }
+        }
+    }
+    update(&op);
+}
+
+struct qr *qr_householder(const struct matrix *mat) {
+    assert(mat);
+    size_t n = matrix_rows(mat);
+    size_t m = matrix_columns(mat);
+    size_t k = n < m ? n : m;
+    size_t panels = (k + PANEL_COLUMNS - 1) / PANEL_COLUMNS;
+    size_t wide = m > PANEL_COLUMNS ? m : PANEL_COLUMNS;
+    size_t doubles = k + panels * PANEL_COLUMNS * PANEL_COLUMNS
+                   + (1 + parallel_threads()) * PANEL_COLUMNS * wide;
+    size_t floats = n * m + n * PANEL_COLUMNS + k * m;
+    size_t bytes = doubles * sizeof(double) + floats * sizeof(float);
+    struct qr *qr = mem_alloc(sizeof(struct qr));
+    void *block = qr ? mem_alloc(bytes) : NULL;
+    if (!block) {
+        mem_free(qr, sizeof(struct qr));
+        return NULL;
+    }
+    TRACE_BEGIN("qr_householder", n, m);
+    struct householder h = {n, m, k};
+    h.tau = block;
+    h.t = h.tau + k;
+    h.w = h.t + panels * PANEL_COLUMNS * PANEL_COLUMNS;
+    h.partial = h.w + PANEL_COLUMNS * wide;
+    h.a = (float *)(h.partial + parallel_threads() * PANEL_COLUMNS * wide);
+    h.v = h.a + n * m;
+    float *r = h.v + n * PANEL_COLUMNS;
+    matrix_entries(mat, LAYOUT_COLUMN_MAJOR, h.a);
+
+    for (size_t j0 = 0; j0 < k; j0 += PANEL_COLUMNS) {
+        size_t b = k - j0 < PANEL_COLUMNS ? k - j0 : PANEL_COLUMNS;
+        // reduce the panel a column at a time
+        for (size_t j = j0; j < j0 + b; ++j) {
+            reflect(&h, j);
+            load_vector(&h, j, j0);
+            if (j + 1 < j0 + b && h.tau[j]) {
+                float *v = h.v + (j - j0) * n;
+                struct rows_op op = {n, j, n, v, 1, h.a + (j + 1) * n, j0 + b - j - 1,
+                                     h.w, h.partial, 1};
+                products(&op);
+                for (size_t c = 0; c < op.c; ++c) {
+                    h.w[c] *= h.tau[j];
+                }
+                update(&op);
+            }
+        }
+        // then the rest of the matrix with Q_panel^T = I - V T^T V^T
+        double *t = panel_t(&h, j0, b);
+        if (j0 + b < m) {
+            apply_block(&h, t, j0, b, j0 + b, m - j0 - b, true);
+        }
+    }
+
+    for (size_t i = 0; i < k; ++i) {
+        for (size_t j = 0; j < m; ++j) {
+            r[i * m + j] = j < i ? 0 : h.a[j * n + i];
+        }
+    }
+    // Q = H_0 ... H_k-1 [I; 0], formed in place of the first k columns of
+    //   a from the last panel back (as LAPACK's dorgqr does): the columns
+    //   of a panel only hold its vectors until they are loaded
+    for (size_t j0 = (panels - 1) * PANEL_COLUMNS; j0 < k; j0 -= PANEL_COLUMNS) {
+        size_t b = k - j0 < PANEL_COLUMNS ? k - j0 : PANEL_COLUMNS;
+        for (size_t j = j0; j < j0 + b; ++j) {
+            load_vector(&h, j, j0);
+        }
+        for (size_t j = j0; j < j0 + b; ++j) {
+            memset(h.a + j * n, 0, n * sizeof(float));
+            h.a[j * n + j] = 1;
+        }
+        double *t = h.t + j0 / PANEL_COLUMNS * PANEL_COLUMNS * PANEL_COLUMNS;
+        apply_block(&h, t, j0, b, j0, k - j0, false);
+        if (!j0) {
+            break;
+        }
+    }
+    qr->q = create_matrix_layout(n, k, h.a, LAYOUT_COLUMN_MAJOR);
+    qr->r = create_matrix(k, m, r);
+    TRACE_END();
+    mem_free(block, bytes);
+    if (!qr->q || !qr->r) {
+        if (qr->q) {
+            destroy_matrix(qr->q);
+        }
+        if (qr->r) {
+            destroy_matrix(qr->r);
+        }
+        mem_free(qr, sizeof(struct qr));
+        return NULL;
+    }
+    return qr;
+}
+
+void destroy_qr(struct qr *qr) {
+    assert(qr);
+    destroy_matrix(qr->q);
+    destroy_matrix(qr->r);
+    mem_free(qr, sizeof(struct qr));
+}
+
+int gram_schmidt(struct matrix *const *vectors, size_t count, enum gram_schmidt method,
+                 struct matrix **basis) {
+    assert(vectors);
+    assert(basis);
+    assert(count > 0);
+    size_t n = matrix_rows(vectors[0]);
+    for (size_t i = 0; i < count; ++i) {
+        assert(vectors[i]);
+        if (matrix_columns(vectors[i]) != 1 || matrix_rows(vectors[i]) != n) {
+            fprintf(stderr, "Error: All matrices must be vectors (1 column) of the same size\n");
+            return -1;
+        }
+    }
+    // the basis so far (n x rank, column-major), the coefficients of a
+    //   pass and the partial sums of the parts
+    size_t doubles = (1 + parallel_threads()) * count;
+    size_t bytes = doubles * sizeof(double) + n * count * sizeof(float);
+    void *block = mem_alloc(bytes);
+    if (!block) {
+        return -1;
+    }
+    TRACE_BEGIN("gram_schmidt", n, count);
+    double *h = block;
+    double *partial = h + count;
+    float *q = (float *)(partial + parallel_threads() * count);
+    size_t rank = 0;
+    for (size_t i = 0; i < count; ++i) {
+        float *x = q + rank * n;
+        matrix_entries(vectors[i], LAYOUT_ROW_MAJOR, x);
+        double original = norm(x, 0, n, partial);
+        double before = original;
+        double after = original;
+        for (int pass = 0; pass < 2 && rank; ++pass) {
+            if (method == GS_CLASSICAL) {
+                struct rows_op op = {n, 0, n, q, rank, x, 1, h, partial, 1};
+                products(&op);
+                update(&op);
+            } else {
+                for (size_t j = 0; j < rank; ++j) {
+                    struct rows_op op = {n, 0, n, q + j * n, 1, x, 1, h, partial, 1};
+                    products(&op);
+                    update(&op);
+                }
+            }
+            after = norm(x, 0, n, partial);
+            if (after >= before / sqrt(2)) {
+                break;
+            }
+            before = after;
+        }
+        if (after > 16 * FLT_EPSILON * original) {
+            float scale = 1 / after;
+            for (size_t r = 0; r < n; ++r) {
+                x[r] *= scale;
+            }
+            ++rank;
+        }
+    }
+    int stored = rank;
+    for (size_t j = 0; j < rank; ++j) {
+        basis[j] = create_matrix(n, 1, q + j * n);
+        if (!basis[j]) {
+            while (j-- > 0) {
+                destroy_matrix(basis[j]);
+            }
+            stored = -1;
+            break;
+        }
+    }
+    TRACE_END();
+    mem_free(block, bytes);
+    return stored;
+}
@@ -0,0 +1,57 @@
+// QR factorization and Gram-Schmidt orthonormalization.
+//   Both work on a copy of the input in a single allocation and split
+//   every product along the rows, so tall, skinny matrices (many rows,
+//   few columns) are spread across threads (see parallel.h) too.
+// time: n is # of rows, m is # of columns (as in linalg.h)
+//       k = min(n, m)
+// see linalg.h
+
+// A QR factorization mat = Q R
+struct qr {
+    struct matrix *q;       // n x k, orthonormal columns (column-major)
+    struct matrix *r;       // k x m, upper triangular (row-major)
+};
+
+// qr_householder(mat) returns the QR factorization of mat.
+//   Columns are reduced with Householder reflections in panels of 32;
+//   the reflections of a panel are combined into one block reflection
+//   I - V T V^T (compact WY form), so the rest of the matrix is updated
+//   with two matrix products instead of one rank-1 update per column.
+//   Q is formed from the reflections the same way.
+// requires: mat is a valid pointer
+// notes: outputs an error message and returns NULL if out of memory
+// effects: may allocate memory (client must call destroy_qr)
+//          may produce output
+// time: O(nmk)
+struct qr *qr_householder(const struct matrix *mat);
+
+// destroy_qr(qr) frees all memory for qr
+// requires: qr is a valid pointer
+// effects: qr is no longer valid
+// time: O(1)
+void destroy_qr(struct qr *qr);
+
+enum gram_schmidt {
+    GS_CLASSICAL,   // project out all previous vectors at once (two
+                    //   matrix-vector products per pass)
+    GS_MODIFIED     // project out the previous vectors one at a time
+};
+
+// gram_schmidt(vectors, count, method, basis) stores an orthonormal
+//   basis of the span of the vectors in the array vectors in basis (as
+//   new vectors, in order) and returns how many it stored. A vector
+//   whose length drops below 1 / sqrt(2) of what it was in a pass is
+//   orthogonalized a second time ("twice is enough"); one that is
+//   numerically in the span of the previous ones (its length drops
+//   below 16 * FLT_EPSILON of what it was) adds nothing to the basis.
+// requires: vectors is a valid pointer to count valid pointers
+//           basis has room for count pointers
+//           count > 0
+// notes: outputs an error message and returns -1 if the matrices are
+//   not vectors (1 column) of the same size, or if out of memory
+// effects: may allocate memory (client must call destroy_matrix on each
+//          of the returned vectors)
+//          may produce output
+// time: O(n count^2)
+int gram_schmidt(struct matrix *const *vectors, size_t count, enum gram_schmidt method,
+                 struct matrix **basis);
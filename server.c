@@ -0,0 +1,529 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "linalg.h"
+#include "linkedlist.h"
+#include "memtrack.h"
+#include "server.h"
+
+// Connections with a request waiting for a thread
+#define QUEUE_LENGTH 64
+
+// Connections the accept loop watches before the array grows
+#define WATCHED 16
+
+// The accept loop polls the listener, the idle connections and a pipe.
+//   A connection with a request on it goes to the queue, a thread
+//   answers that one request and writes the connection to the pipe, and
+//   the loop watches it again. So an idle connection holds no thread.
+struct server {
+    struct llist *list;
+    // held for reading by every request that uses matrices of list and
+    //   for writing by the ones that remove matrices, so a matrix cannot
+    //   go away while a request reads it
+    pthread_rwlock_t store;
+    int wake[2];                // connections handed back (and -1 when
+                                //   the server stops) are written to
+                                //   wake[1]
+    pthread_mutex_t lock;       // guards the fields below
+    pthread_cond_t ready;       // signalled when a connection is queued
+                                //   or the server stops
+    pthread_cond_t space;       // signalled when a connection is taken
+    bool stopping;
+    int queue[QUEUE_LENGTH];
+    int head;
+    int count;
+};
+
+// The result of a request
+struct reply {
+    enum server_status status;
+    double value;
+    uint64_t id;                // of the matrix the request added, or 0
+    float *entries;             // row-major payload, or NULL
+    size_t rows;
+    size_t columns;
+};
+
+static bool read_full(int fd, void *buf, size_t bytes) {
+    char *p = buf;
+    while (bytes) {
+        ssize_t got = read(fd, p, bytes);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        p += got;
+        bytes -= got;
+    }
+    return true;
+}
+
+static bool write_full(int fd, const void *buf, size_t bytes) {
+    const char *p = buf;
+    while (bytes) {
+        // MSG_NOSIGNAL: a client that hung up must not kill the server
+        ssize_t sent = send(fd, p, bytes, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        p += sent;
+        bytes -= sent;
+    }
+    return true;
+}
+
+// lookup(s, id) returns the matrix with the given id in the workspace,
+//   or NULL
+// requires: the store lock is held
+static struct matrix *lookup(struct server *s, uint64_t id) {
+    return matrix_with_id(id, s->list);
+}
+
+// set_matrix(r, mat) makes a copy of the entries of mat the payload of r
+static void set_matrix(struct reply *r, const struct matrix *mat) {
+    r->rows = matrix_rows(mat);
+    r->columns = matrix_columns(mat);
+    r->entries = mem_alloc(r->rows * r->columns * sizeof(float));
+    if (!r->entries) {
+        r->status = SERVER_FAILED;
+        return;
+    }
+    matrix_entries(mat, LAYOUT_ROW_MAJOR, r->entries);
+}
+
+// finish(s, req, r, result) makes result (which may be NULL if the
+//   operation failed) the payload of r, and saves or destroys it
+// requires: the store lock is held
+static void finish(struct server *s, const struct server_message *req, struct reply *r,
+                   struct matrix *result) {
+    if (!result) {
+        r->status = SERVER_FAILED;
+        return;
+    }
+    set_matrix(r, result);
+    if (req->flags & SERVER_SAVE) {
+        r->id = list_add(result, s->list, false);
+    }
+    if (!r->id) {
+        destroy_matrix(result);
+    }
+}
+
+// upload(s, fd, req, r) reads the payload of an upload request and adds
+//   it to the workspace; it returns false if the connection must be
+//   closed because the payload could not be read
+static bool upload(struct server *s, int fd, const struct server_message *req, struct reply *r) {
+    if (req->rows == 0 || req->columns == 0 ||
+        req->columns > SIZE_MAX / sizeof(float) / req->rows) {
+        r->status = SERVER_BAD_REQUEST;
+        return false;
+    }
+    size_t bytes = req->rows * req->columns * sizeof(float);
+    float *entries = mem_alloc(bytes);
+    if (!entries) {
+        r->status = SERVER_FAILED;
+        return false;
+    }
+    if (!read_full(fd, entries, bytes)) {
+        mem_free(entries, bytes);
+        return false;
+    }
+    struct matrix *mat = create_matrix(req->rows, req->columns, entries);
+    mem_free(entries, bytes);
+    r->id = mat ? list_add(mat, s->list, false) : 0;
+    if (!r->id) {
+        if (mat) {
+            destroy_matrix(mat);
+        }
+        r->status = SERVER_FAILED;
+    }
+    return true;
+}
+
+// remove_matrices(s, req, r) runs SERVER_REMOVE and SERVER_REMOVEALL
+static void remove_matrices(struct server *s, const struct server_message *req,
+                            struct reply *r) {
+    pthread_rwlock_wrlock(&s->store);
+    if (req->op == SERVER_REMOVEALL) {
+        list_destroy(s->list, 0);
+    } else if (!remove_id(req->id[0], s->list)) {
+        r->status = SERVER_NO_MATRIX;
+    }
+    pthread_rwlock_unlock(&s->store);
+}
+
+// run_op(s, req, r) runs a request that reads the workspace
+static void run_op(struct server *s, const struct server_message *req, struct reply *r) {
+    pthread_rwlock_rdlock(&s->store);
+    struct matrix *mat1 = lookup(s, req->id[0]);
+    struct matrix *mat2 = NULL;
+    bool binary = req->op == SERVER_ADD || req->op == SERVER_SUBTRACT ||
+                  req->op == SERVER_DOTPRODUCT || req->op == SERVER_ANGLEBETWEEN ||
+                  req->op == SERVER_PROJ || req->op == SERVER_PERP ||
+                  req->op == SERVER_CROSSPRODUCT || req->op == SERVER_MATPROD;
+    if (binary) {
+        mat2 = lookup(s, req->id[1]);
+    }
+    if (!mat1 || (binary && !mat2)) {
+        pthread_rwlock_unlock(&s->store);
+        r->status = SERVER_NO_MATRIX;
+        return;
+    }
+    size_t count = 0;
+    switch (req->op) {
+    case SERVER_DOWNLOAD:
+        set_matrix(r, mat1);
+        break;
+    case SERVER_ADD:
+    case SERVER_SUBTRACT:
+        finish(s, req, r, addsub_matrix(mat1, mat2, req->op == SERVER_SUBTRACT));
+        break;
+    case SERVER_SCALARMULTIPLY:
+        finish(s, req, r, scalar_multiply(req->scalar, mat1));
+        break;
+    case SERVER_DOTPRODUCT:
+        r->value = dot_product(mat1, mat2);
+        break;
+    case SERVER_LENGTH:
+        r->value = length(mat1);
+        break;
+    case SERVER_UNITVECTOR:
+        finish(s, req, r, unit_vector(mat1));
+        break;
+    case SERVER_ANGLEBETWEEN:
+        r->value = angle_between(mat1, mat2);
+        break;
+    case SERVER_PROJ:
+        finish(s, req, r, projection(mat1, mat2));
+        break;
+    case SERVER_PERP:
+        finish(s, req, r, perpendicular(mat1, mat2));
+        break;
+    case SERVER_CROSSPRODUCT:
+        finish(s, req, r, cross_product(mat1, mat2));
+        break;
+    case SERVER_ROWSWAP:
+        finish(s, req, r, row_swap(req->row[0], req->row[1], mat1));
+        break;
+    case SERVER_ROWSCALE:
+        finish(s, req, r, row_scale(req->row[0], req->scalar, mat1));
+        break;
+    case SERVER_ROWADD:
+        finish(s, req, r, row_add(req->row[0], req->scalar, req->row[1], mat1));
+        break;
+    case SERVER_REF:
+        finish(s, req, r, ref(mat1));
+        break;
+    case SERVER_RREF:
+        finish(s, req, r, rref(mat1));
+        break;
+    case SERVER_RANK:
+    case SERVER_NULLITY:
+        count = req->op == SERVER_RANK ? rank(mat1) : nullity(mat1);
+        r->value = count == SIZE_MAX ? NAN : count;
+        break;
+    case SERVER_MATPROD:
+        finish(s, req, r, matrix_multiplication(mat1, mat2));
+        break;
+    default:
+        finish(s, req, r, transpose(mat1));
+        break;
+    }
+    pthread_rwlock_unlock(&s->store);
+    if (isnan(r->value)) {
+        r->status = SERVER_FAILED;
+    }
+}
+
+// hand_back(s, fd) passes fd (or -1) to the accept loop
+static void hand_back(struct server *s, int fd) {
+    // a write of at most PIPE_BUF bytes to a pipe is never split
+    ssize_t sent;
+    do {
+        sent = write(s->wake[1], &fd, sizeof(fd));
+    } while (sent < 0 && errno == EINTR);
+    if (sent < 0 && fd >= 0) {
+        close(fd);
+    }
+}
+
+// stop(s) makes the accept loop and every thread finish; connections
+//   get no more requests but the current ones are still answered
+static void stop(struct server *s) {
+    pthread_mutex_lock(&s->lock);
+    s->stopping = true;
+    pthread_cond_broadcast(&s->ready);
+    pthread_cond_broadcast(&s->space);
+    pthread_mutex_unlock(&s->lock);
+    hand_back(s, -1);
+}
+
+// serve(s, fd) answers one request on connection fd and returns whether
+//   the connection can carry more
+static bool serve(struct server *s, int fd) {
+    struct server_message req;
+    if (!read_full(fd, &req, sizeof(req))) {
+        return false;
+    }
+    struct reply r = {SERVER_OK, 0, 0, NULL, 0, 0};
+    bool keep = true;
+    if (req.op == SERVER_UPLOAD) {
+        keep = upload(s, fd, &req, &r);
+    } else if (req.op == SERVER_REMOVE || req.op == SERVER_REMOVEALL) {
+        remove_matrices(s, &req, &r);
+    } else if (req.op == SERVER_COUNT) {
+        r.value = list_length(s->list);
+    } else if (req.op == SERVER_ID) {
+        r.id = req.row[0] > INT_MAX ? 0 : id_at(req.row[0], s->list);
+        r.status = r.id ? SERVER_OK : SERVER_NO_MATRIX;
+    } else if (req.op == SERVER_SHUTDOWN) {
+        stop(s);
+    } else if (req.op >= SERVER_DOWNLOAD && req.op <= SERVER_TRANSPOSE) {
+        run_op(s, &req, &r);
+    } else {
+        r.status = SERVER_BAD_REQUEST;
+    }
+    struct server_message res = {r.status, r.entries != NULL, {r.id, 0}, {0, 0}, 0,
+                                 r.value, r.rows, r.columns};
+    bool sent = write_full(fd, &res, sizeof(res));
+    if (sent && r.entries) {
+        sent = write_full(fd, r.entries, r.rows * r.columns * sizeof(float));
+    }
+    mem_free(r.entries, r.rows * r.columns * sizeof(float));
+    return sent && keep;
+}
+
+static void *run_worker(void *arg) {
+    struct server *s = arg;
+    while (1) {
+        pthread_mutex_lock(&s->lock);
+        while (!s->count && !s->stopping) {
+            pthread_cond_wait(&s->ready, &s->lock);
+        }
+        if (s->stopping) {
+            pthread_mutex_unlock(&s->lock);
+            break;
+        }
+        int fd = s->queue[s->head];
+        s->head = (s->head + 1) % QUEUE_LENGTH;
+        --s->count;
+        pthread_cond_signal(&s->space);
+        pthread_mutex_unlock(&s->lock);
+        if (serve(s, fd)) {
+            hand_back(s, fd);
+        } else {
+            close(fd);
+        }
+    }
+    return NULL;
+}
+
+// enqueue(s, fd) queues connection fd for a thread and returns true, or
+//   returns false if the server is stopping
+static bool enqueue(struct server *s, int fd) {
+    pthread_mutex_lock(&s->lock);
+    while (s->count == QUEUE_LENGTH && !s->stopping) {
+        pthread_cond_wait(&s->space, &s->lock);
+    }
+    bool queued = !s->stopping;
+    if (queued) {
+        s->queue[(s->head + s->count) % QUEUE_LENGTH] = fd;
+        ++s->count;
+        pthread_cond_signal(&s->ready);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return queued;
+}
+
+// The descriptors the accept loop polls: the listener, the read end of
+//   the pipe, then the idle connections
+struct watched {
+    struct pollfd *fds;
+    size_t count;
+    size_t capacity;
+};
+
+// watch(w, fd) adds fd to w, or closes it if out of memory
+static void watch(struct watched *w, int fd) {
+    if (w->count == w->capacity) {
+        struct pollfd *fds = realloc(w->fds, 2 * w->capacity * sizeof(struct pollfd));
+        if (!fds) {
+            fprintf(stderr, "Error: out of memory\n");
+            close(fd);
+            return;
+        }
+        w->fds = fds;
+        w->capacity *= 2;
+    }
+    w->fds[w->count++] = (struct pollfd){fd, POLLIN, 0};
+}
+
+// take_back(s, w) watches the connections handed back through the pipe
+//   again and returns false once the server is stopping
+static bool take_back(struct server *s, struct watched *w) {
+    bool running = true;
+    int handed[64];
+    ssize_t got;
+    while ((got = read(s->wake[0], handed, sizeof(handed))) > 0 || (got < 0 && errno == EINTR)) {
+        for (ssize_t i = 0; i < got / (ssize_t)sizeof(int); ++i) {
+            if (handed[i] < 0) {
+                running = false;
+            } else if (w) {
+                watch(w, handed[i]);
+            } else {
+                close(handed[i]);
+            }
+        }
+    }
+    return running;
+}
+
+// remove_socket(path) removes the socket file at path, if there is one,
+//   and returns false if path is something else
+static bool remove_socket(const char *path) {
+    struct stat st;
+    if (lstat(path, &st)) {
+        return errno == ENOENT;
+    }
+    if (!S_ISSOCK(st.st_mode)) {
+        fprintf(stderr, "Error: %s exists and is not a socket\n", path);
+        return false;
+    }
+    unlink(path);
+    return true;
+}
+
+bool server_run(const char *path, struct llist *list, int threads) {
+    assert(path);
+    assert(list);
+    assert(threads > 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: socket path is too long\n");
+        return false;
+    }
+    strcpy(addr.sun_path, path);
+    if (!remove_socket(path)) {
+        return false;
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        fprintf(stderr, "Error: could not create a socket\n");
+        return false;
+    }
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) || listen(listener, QUEUE_LENGTH)) {
+        fprintf(stderr, "Error: could not listen on %s\n", path);
+        close(listener);
+        return false;
+    }
+    // a client that hangs up between poll and accept must not block it
+    fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+
+    struct server s;
+    s.list = list;
+    struct watched w = {malloc(WATCHED * sizeof(struct pollfd)), 0, WATCHED};
+    pthread_t *ids = malloc(threads * sizeof(pthread_t));
+    if (!w.fds || !ids || pipe(s.wake)) {
+        fprintf(stderr, "Error: could not set up the server\n");
+        free(w.fds);
+        free(ids);
+        close(listener);
+        remove_socket(path);
+        return false;
+    }
+    fcntl(s.wake[0], F_SETFL, fcntl(s.wake[0], F_GETFL) | O_NONBLOCK);
+    pthread_rwlock_init(&s.store, NULL);
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.ready, NULL);
+    pthread_cond_init(&s.space, NULL);
+    s.stopping = false;
+    s.head = 0;
+    s.count = 0;
+    int started = 0;
+    while (started < threads && !pthread_create(&ids[started], NULL, run_worker, &s)) {
+        ++started;
+    }
+    if (started) {
+        printf("Serving the workspace on %s\n", path);
+        fflush(stdout);
+        watch(&w, listener);
+        watch(&w, s.wake[0]);
+    } else {
+        fprintf(stderr, "Error: could not start a server thread\n");
+    }
+
+    bool running = started > 0;
+    while (running) {
+        if (poll(w.fds, w.count, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        // connections with a request (or a hangup) go to the threads
+        for (size_t i = 2; running && i < w.count;) {
+            if (!w.fds[i].revents) {
+                ++i;
+                continue;
+            }
+            int fd = w.fds[i].fd;
+            w.fds[i] = w.fds[--w.count];
+            if (!enqueue(&s, fd)) {
+                close(fd);
+                running = false;
+            }
+        }
+        if (running && w.fds[1].revents) {
+            running = take_back(&s, &w);
+        }
+        if (running && w.fds[0].revents) {
+            int fd = accept(listener, NULL, NULL);
+            if (fd >= 0) {
+                watch(&w, fd);
+            }
+        }
+    }
+    stop(&s);
+    for (int i = 0; i < started; ++i) {
+        pthread_join(ids[i], NULL);
+    }
+    take_back(&s, NULL);
+    for (; s.count; --s.count, s.head = (s.head + 1) % QUEUE_LENGTH) {
+        close(s.queue[s.head]);
+    }
+    for (size_t i = 2; i < w.count; ++i) {
+        close(w.fds[i].fd);
+    }
+    close(listener);
+    close(s.wake[0]);
+    close(s.wake[1]);
+    remove_socket(path);
+    pthread_rwlock_destroy(&s.store);
+    pthread_mutex_destroy(&s.lock);
+    pthread_cond_destroy(&s.ready);
+    pthread_cond_destroy(&s.space);
+    free(w.fds);
+    free(ids);
+    return started > 0;
+}
@@ -0,0 +1,102 @@
+// A server that shares one workspace (a list of matrices) between local
+//   clients over a Unix domain socket.
+//   Clients send requests and receive responses on a stream connection;
+//   a connection may carry any number of requests, answered in order.
+//   Requests are served concurrently by a fixed set of threads; a
+//   connection only holds a thread while one of its requests is being
+//   answered, so idle connections do not keep others waiting. Any
+//   number of requests may read the workspace at the same time (e.g.
+//   rank, dotproduct and download run in parallel); remove and
+//   removeall wait for them and run alone.
+//
+// Protocol: every message is a struct server_message, in host byte
+//   order (clients are on the same machine), followed by a payload of
+//   rows * columns floats (row by row) if the message carries a matrix:
+//   an upload request, and the response to every request that returns
+//   a matrix. A request names matrices by their id in id[0] and id[1].
+//   Unlike a workspace index, an id keeps naming the same matrix while
+//   other clients add and remove matrices. Uploads and saved results
+//   return the id of the new matrix, and SERVER_ID looks up the id of
+//   the matrix at a workspace index (as in the REPL, 0 is the front).
+// see linalg.h, linkedlist.h
+#include <stdbool.h>
+#include <stdint.h>
+
+// Requests (in op) and the fields they read
+enum server_op {
+    SERVER_UPLOAD = 1,      // rows, columns + payload: adds a matrix to
+                            //   the front and returns its id in id[0]
+    SERVER_DOWNLOAD,        // id[0]: returns the matrix
+    SERVER_REMOVE,          // id[0]: removes the matrix
+    SERVER_REMOVEALL,       // removes every matrix
+    SERVER_COUNT,           // returns the number of matrices in value
+    SERVER_ADD,             // id[0], id[1]
+    SERVER_SUBTRACT,        // id[0], id[1]
+    SERVER_SCALARMULTIPLY,  // id[0], scalar
+    SERVER_DOTPRODUCT,      // id[0], id[1]: returns value
+    SERVER_LENGTH,          // id[0]: returns value
+    SERVER_UNITVECTOR,      // id[0]
+    SERVER_ANGLEBETWEEN,    // id[0], id[1]: returns value (radians)
+    SERVER_PROJ,            // id[0] projected onto id[1]
+    SERVER_PERP,            // id[0], id[1]
+    SERVER_CROSSPRODUCT,    // id[0], id[1]
+    SERVER_ROWSWAP,         // id[0], row[0], row[1]
+    SERVER_ROWSCALE,        // id[0], row[0], scalar
+    SERVER_ROWADD,          // id[0], row[1] += scalar * row[0]
+    SERVER_REF,             // id[0]
+    SERVER_RREF,            // id[0]
+    SERVER_RANK,            // id[0]: returns value
+    SERVER_NULLITY,         // id[0]: returns value
+    SERVER_MATPROD,         // id[0] * id[1]
+    SERVER_TRANSPOSE,       // id[0]
+    SERVER_SHUTDOWN,        // stops the server once current requests finish
+    SERVER_ID               // row[0]: returns the id of the matrix at that
+                            //   workspace index in id[0]
+};
+
+// Response statuses (in op)
+enum server_status {
+    SERVER_OK = 0,
+    SERVER_BAD_REQUEST,     // unknown op or malformed message (an
+                            //   upload with bad dimensions also closes
+                            //   the connection, as its payload cannot
+                            //   be skipped)
+    SERVER_NO_MATRIX,       // an id (or the index of SERVER_ID) does not
+                            //   name a matrix
+    SERVER_FAILED           // the operation failed (e.g. sizes do not
+                            //   match, or out of memory)
+};
+
+// Flags of a request
+#define SERVER_SAVE 1       // also add a matrix result to the front of
+                            //   the workspace and return its id in id[0]
+
+struct server_message {
+    uint32_t op;            // enum server_op or enum server_status
+    uint32_t flags;         // request: SERVER_SAVE; response: 1 if a
+                            //   matrix payload follows
+    uint64_t id[2];         // request: the matrices; response: the id
+                            //   of an added matrix, or 0
+    uint64_t row[2];
+    double scalar;
+    double value;           // response: scalar result
+    uint64_t rows;          // dimensions of the payload
+    uint64_t columns;
+};
+
+struct llist;
+
+// server_run(path, list, threads) serves list on a Unix domain socket
+//   bound at path (an existing socket file there is replaced) with
+//   threads requests served at a time, until a client sends
+//   SERVER_SHUTDOWN. The socket file is removed on return.
+// requires: path is a valid string, list is a valid pointer
+//           threads > 0
+// notes: outputs an error message and returns false if path exists and
+//   is not a socket, the socket cannot be set up, or no thread can be
+//   started
+// effects: creates, binds and removes the socket file at path
+//          starts threads; modifies list on behalf of clients
+//          may produce output
+// time: until shutdown
+bool server_run(const char *path, struct llist *list, int threads);
@@ -0,0 +1,234 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "linalg.h"
+#include "memtrack.h"
+#include "shm.h"
+
+#define MAGIC "LINALGSM"
+
+// Longest name shm_export accepts
+#define NAME_LENGTH 200
+
+// Segments are readable by the owner's group, writable by the owner
+#define MODE 0640
+
+// Times shm_export retries creating its object when a concurrent export
+//   under the same name creates it first
+#define CREATE_ATTEMPTS 16
+
+struct header {
+    char magic[8];
+    uint32_t format;
+    uint32_t layout;
+    uint64_t rows;
+    uint64_t columns;
+    uint64_t version;
+    char padding[24];
+};
+
+// A segment mapped into this process
+struct mapping {
+    void *base;
+    size_t bytes;
+};
+
+// object_name(name, object) stores "/name" in object and returns true
+//   if name is a valid name, or outputs an error message and returns
+//   false
+static bool object_name(const char *name, char object[NAME_LENGTH + 2]) {
+    size_t length = strlen(name);
+    bool valid = length > 0 && length <= NAME_LENGTH;
+    for (size_t i = 0; valid && i < length; ++i) {
+        char c = name[i];
+        valid = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                c == '.' || c == '_' || c == '-';
+    }
+    if (!valid) {
+        fprintf(stderr, "Error: invalid shared memory name\n");
+        return false;
+    }
+    object[0] = '/';
+    memcpy(object + 1, name, length + 1);
+    return true;
+}
+
+// map_segment(object, mapping) maps the whole object read-only and
+//   returns its header, or returns NULL (with errno set) if it cannot
+//   be mapped or is too short for a header
+static const struct header *map_segment(const char *object, struct mapping *mapping) {
+    int fd = shm_open(object, O_RDONLY, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    void *base = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(struct header)) {
+        base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    } else {
+        errno = EINVAL;
+    }
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+    *mapping = (struct mapping){base, st.st_size};
+    return base;
+}
+
+// published(h) returns the version of h if it is a complete segment,
+//   or 0
+static uint64_t published(const struct header *h) {
+    if (memcmp(h->magic, MAGIC, sizeof(h->magic)) || h->format != SHM_FORMAT) {
+        return 0;
+    }
+    return __atomic_load_n(&h->version, __ATOMIC_ACQUIRE);
+}
+
+uint64_t shm_version(const char *name) {
+    assert(name);
+    char object[NAME_LENGTH + 2];
+    struct mapping mapping;
+    const struct header *h = object_name(name, object) ? map_segment(object, &mapping) : NULL;
+    if (!h) {
+        return 0;
+    }
+    uint64_t version = published(h);
+    munmap(mapping.base, mapping.bytes);
+    return version;
+}
+
+// next_version(previous) returns the version of an export replacing one
+//   of version previous (0 if there is none): the realtime clock in
+//   nanoseconds, so versions keep growing across shm_remove, or
+//   previous + 1 if the clock is not past previous
+static uint64_t next_version(uint64_t previous) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t version = (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+    return version > previous ? version : previous + 1;
+}
+
+uint64_t shm_export(const char *name, const struct matrix *mat) {
+    assert(name);
+    assert(mat);
+    char object[NAME_LENGTH + 2];
+    if (!object_name(name, object)) {
+        return 0;
+    }
+    uint64_t previous = shm_version(name);
+    size_t rows = matrix_rows(mat);
+    size_t columns = matrix_columns(mat);
+    size_t bytes = sizeof(struct header) + rows * columns * sizeof(float);
+
+    // the old segment stays mapped wherever it is attached; a concurrent
+    //   export may create the object between the unlink and the open, so
+    //   unlink its object too (the last export to create one stays)
+    int fd = -1;
+    for (int attempt = 0; fd < 0 && attempt < CREATE_ATTEMPTS; ++attempt) {
+        shm_unlink(object);
+        fd = shm_open(object, O_RDWR | O_CREAT | O_EXCL, MODE);
+        if (fd < 0 && errno != EEXIST) {
+            break;
+        }
+    }
+    void *base = MAP_FAILED;
+    if (fd >= 0 && ftruncate(fd, bytes) == 0) {
+        base = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    int saved = errno;
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Error: cannot create shared memory object %s: %s\n", object,
+                strerror(saved));
+        if (fd >= 0) {
+            shm_unlink(object);
+        }
+        return 0;
+    }
+    struct header *h = base;
+    memcpy(h->magic, MAGIC, sizeof(h->magic));
+    h->format = SHM_FORMAT;
+    h->layout = matrix_layout(mat) == LAYOUT_COLUMN_MAJOR;
+    h->rows = rows;
+    h->columns = columns;
+    matrix_entries(mat, matrix_layout(mat), (float *)(h + 1));
+    // readers only look at the entries once they see the version
+    uint64_t version = next_version(previous);
+    __atomic_store_n(&h->version, version, __ATOMIC_RELEASE);
+    munmap(base, bytes);
+    return version;
+}
+
+static void unmap(void *ctx) {
+    struct mapping *mapping = ctx;
+    munmap(mapping->base, mapping->bytes);
+    mem_free(mapping, sizeof(struct mapping));
+}
+
+struct matrix *shm_attach(const char *name, uint64_t *version) {
+    assert(name);
+    char object[NAME_LENGTH + 2];
+    if (!object_name(name, object)) {
+        return NULL;
+    }
+    struct mapping *mapping = mem_alloc(sizeof(struct mapping));
+    if (!mapping) {
+        return NULL;
+    }
+    const struct header *h = map_segment(object, mapping);
+    if (!h) {
+        fprintf(stderr, "Error: cannot attach shared memory object %s: %s\n", object,
+                strerror(errno));
+        mem_free(mapping, sizeof(struct mapping));
+        return NULL;
+    }
+    uint64_t published_version = published(h);
+    uint64_t rows = h->rows;
+    uint64_t columns = h->columns;
+    uint64_t capacity = (mapping->bytes - sizeof(struct header)) / sizeof(float);
+    if (!published_version || !rows || !columns || h->layout > 1 || columns > capacity / rows) {
+        fprintf(stderr, "Error: %s is not a complete matrix segment\n", object);
+        unmap(mapping);
+        return NULL;
+    }
+    enum matrix_layout layout = h->layout ? LAYOUT_COLUMN_MAJOR : LAYOUT_ROW_MAJOR;
+    struct matrix *mat = create_matrix_borrowed(rows, columns, (const float *)(h + 1), layout,
+                                                unmap, mapping);
+    if (!mat) {
+        unmap(mapping);
+        return NULL;
+    }
+    if (version) {
+        *version = published_version;
+    }
+    return mat;
+}
+
+bool shm_remove(const char *name) {
+    assert(name);
+    char object[NAME_LENGTH + 2];
+    if (!object_name(name, object)) {
+        return false;
+    }
+    if (shm_unlink(object)) {
+        fprintf(stderr, "Error: cannot remove shared memory object %s: %s\n", object,
+                strerror(errno));
+        return false;
+    }
+    return true;
+}
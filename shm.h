@@ -0,0 +1,71 @@
+// Matrices shared with other processes through POSIX shared memory.
+//   shm_export places a matrix in the shared memory object /name, where
+//   any process on the host can map it; shm_attach maps it back as a
+//   struct matrix without copying the entries.
+//   A segment is a 64-byte header followed by the rows x columns floats
+//   of the matrix, in its layout (all integers little-endian, as on the
+//   hosts this runs on):
+//     offset  0  char[8]   magic "LINALGSM"
+//     offset  8  uint32    format of the segment (SHM_FORMAT)
+//     offset 12  uint32    layout (0 row-major, 1 column-major)
+//     offset 16  uint64    rows
+//     offset 24  uint64    columns
+//     offset 32  uint64    version: 0 while the entries are written,
+//                          then the time of the export in nanoseconds
+//                          since the epoch, or one more than the version
+//                          it replaced if that is larger
+//     offset 40  zero padding up to 64
+//   In Python: struct.unpack_from("<8sIIQQQ", buf) and then
+//   numpy.frombuffer(buf, numpy.float32, rows * columns, 64).
+//   A segment is never written after its version is set. Exporting
+//   again under a name removes the old segment and creates a new one,
+//   so matrices attached to the old one stay valid (and unchanged), and
+//   a reader finds out about the new one by comparing versions. Versions
+//   under a name only grow, even across shm_remove, so a reader never
+//   mistakes a new export for one it has seen (unless the clock is set
+//   back between a shm_remove and the next export). Of concurrent
+//   exports under a name, the one that creates its object last stays.
+// see linalg.h
+#include <stdint.h>
+
+#define SHM_FORMAT 1
+
+// shm_export(name, mat) stores mat in the shared memory object /name
+//   (replacing any earlier export under name) and returns its version
+// requires: name and mat are valid pointers
+// notes: outputs an error message and returns 0 if name is not a valid
+//   name (1 to 200 letters, digits, '.', '_' or '-') or the object
+//   cannot be created (concurrent exports under name are retried)
+// effects: creates or replaces a shared memory object (readable by the
+//          owner's group), which stays until shm_remove(name) or a
+//          reboot
+//          may produce output
+// time: O(nm)
+uint64_t shm_export(const char *name, const struct matrix *mat);
+
+// shm_attach(name, version) returns the matrix exported under name,
+//   mapped read-only in place, and stores its version in *version
+//   unless version is NULL. The mapping lasts until the matrix and all
+//   matrices that share its storage are destroyed.
+// requires: name is a valid pointer
+// notes: outputs an error message and returns NULL if there is no
+//   complete export under name or it is not a matrix segment
+// effects: may allocate memory (client must call destroy_matrix)
+//          may produce output
+// time: O(1) (O(n) for a row-major matrix with n > 16384 / m)
+struct matrix *shm_attach(const char *name, uint64_t *version);
+
+// shm_version(name) returns the version of the export under name, or 0
+//   if there is none (or it is still being written)
+// requires: name is a valid pointer
+// time: O(1)
+uint64_t shm_version(const char *name);
+
+// shm_remove(name) removes the shared memory object /name; processes
+//   that have it attached keep their mapping
+// requires: name is a valid pointer
+// notes: outputs an error message and returns false if there is no
+//   such object
+// effects: may produce output
+// time: O(1)
+bool shm_remove(const char *name);
@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "linalg.h"
+#include "half.h"
+#include "memtrack.h"
+#include "parallel.h"
+#include "similarity.h"
+#include "trace.h"
+
+// Vectors scored by one parallel_for range
+#define SHARD_VECTORS 1024
+
+// Vectors scored together, so each entry of the query is loaded once
+//   for all of them
+#define BLOCK_VECTORS 4
+
+// Entries of each vector converted from bfloat16 at a time
+#define PIECE_ENTRIES 256
+
+// A reduced query re-ranks RERANK_FACTOR * k + RERANK_EXTRA candidates
+#define RERANK_FACTOR 4
+#define RERANK_EXTRA 16
+
+struct similarity_index {
+    size_t count;
+    size_t dimension;
+    float *vectors;         // count x dimension, row by row
+    float *lengths;
+    uint16_t *reduced;      // the unit vectors in bfloat16, or NULL
+};
+
+// index_bytes(count, d, reduced) returns the size of the block that
+//   holds an index and its arrays
+static size_t index_bytes(size_t count, size_t d, bool reduced) {
+    return sizeof(struct similarity_index) + (count * d + count) * sizeof(float) +
+           (reduced ? count * d * sizeof(uint16_t) : 0);
+}
+
+// dot(a, b, d) sums in the same order as dot_product, so the exact
+//   cosines match angle_between
+static float dot(const float *a, const float *b, size_t d) {
+    float sum = 0;
+    for (size_t j = 0; j < d; ++j) {
+        sum += a[j] * b[j];
+    }
+    return sum;
+}
+
+// worse(a, b) is true if a ranks after b
+static bool worse(const struct similarity_hit *a, const struct similarity_hit *b) {
+    return a->cosine < b->cosine || (a->cosine == b->cosine && a->index > b->index);
+}
+
+// A min-heap (by rank) of the best capacity hits seen so far
+struct heap {
+    struct similarity_hit *hits;
+    size_t size;
+    size_t capacity;
+};
+
+static void sift_down(struct heap *h, size_t i) {
+    while (1) {
+        size_t worst = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        if (left < h->size && worse(&h->hits[left], &h->hits[worst])) {
+            worst = left;
+        }
+        if (right < h->size && worse(&h->hits[right], &h->hits[worst])) {
+            worst = right;
+        }
+        if (worst == i) {
+            return;
+        }
+        struct similarity_hit temp = h->hits[i];
+        h->hits[i] = h->hits[worst];
+        h->hits[worst] = temp;
+        i = worst;
+    }
+}
+
+// offer(h, index, cosine) adds a hit to h if it ranks among the best
+static void offer(struct heap *h, size_t index, float cosine) {
+    struct similarity_hit hit = {index, cosine, 0};
+    if (h->size < h->capacity) {
+        size_t i = h->size++;
+        while (i && worse(&hit, &h->hits[(i - 1) / 2])) {
+            h->hits[i] = h->hits[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        h->hits[i] = hit;
+    } else if (worse(&h->hits[0], &hit)) {
+        h->hits[0] = hit;
+        sift_down(h, 0);
+    }
+}
+
+static int compare_hits(const void *a, const void *b) {
+    const struct similarity_hit *hit1 = a;
+    const struct similarity_hit *hit2 = b;
+    return worse(hit1, hit2) ? 1 : worse(hit2, hit1) ? -1 : 0;
+}
+
+struct query {
+    const struct similarity_index *idx;
+    const float *query;         // the query, or its unit vector if reduced
+    float length;               // length of the query
+    bool reduced;
+    struct heap *shards;        // the heap of each shard
+};
+
+// score_exact(q, begin, end, h) offers the exact cosines of the vectors
+//   begin..end-1 to h
+static void score_exact(const struct query *q, size_t begin, size_t end, struct heap *h) {
+    size_t d = q->idx->dimension;
+    size_t i = begin;
+    for (; i + BLOCK_VECTORS <= end; i += BLOCK_VECTORS) {
+        const float *v = q->idx->vectors + i * d;
+        float sums[BLOCK_VECTORS] = {0};
+        for (size_t j = 0; j < d; ++j) {
+            for (int b = 0; b < BLOCK_VECTORS; ++b) {
+                sums[b] += v[b * d + j] * q->query[j];
+            }
+        }
+        for (int b = 0; b < BLOCK_VECTORS; ++b) {
+            if (q->idx->lengths[i + b]) {
+                offer(h, i + b, sums[b] / (q->length * q->idx->lengths[i + b]));
+            }
+        }
+    }
+    for (; i < end; ++i) {
+        if (q->idx->lengths[i]) {
+            offer(h, i, dot(q->query, q->idx->vectors + i * d, d) / (q->length * q->idx->lengths[i]));
+        }
+    }
+}
+
+// score_reduced(q, begin, end, h) offers the bfloat16 cosines of the
+//   vectors begin..end-1 to h
+static void score_reduced(const struct query *q, size_t begin, size_t end, struct heap *h) {
+    size_t d = q->idx->dimension;
+    float pieces[BLOCK_VECTORS][PIECE_ENTRIES];
+    for (size_t i = begin; i < end; i += BLOCK_VECTORS) {
+        int block = end - i < BLOCK_VECTORS ? end - i : BLOCK_VECTORS;
+        float sums[BLOCK_VECTORS] = {0};
+        for (size_t start = 0; start < d; start += PIECE_ENTRIES) {
+            size_t count = d - start < PIECE_ENTRIES ? d - start : PIECE_ENTRIES;
+            for (int b = 0; b < block; ++b) {
+                half_decode(HALF_BF16, q->idx->reduced + (i + b) * d + start, pieces[b], count);
+            }
+            for (int b = 0; b < block; ++b) {
+                float sum = sums[b];
+                for (size_t j = 0; j < count; ++j) {
+                    sum += pieces[b][j] * q->query[start + j];
+                }
+                sums[b] = sum;
+            }
+        }
+        for (int b = 0; b < block; ++b) {
+            if (q->idx->lengths[i + b]) {
+                offer(h, i + b, sums[b]);
+            }
+        }
+    }
+}
+
+static void score_shards(int begin, int end, void *ctx) {
+    struct query *q = ctx;
+    for (int shard = begin; shard < end; ++shard) {
+        size_t first = (size_t)shard * SHARD_VECTORS;
+        size_t last = first + SHARD_VECTORS < q->idx->count ? first + SHARD_VECTORS : q->idx->count;
+        if (q->reduced) {
+            score_reduced(q, first, last, &q->shards[shard]);
+        } else {
+            score_exact(q, first, last, &q->shards[shard]);
+        }
+    }
+}
+
+struct similarity_index *similarity_index_create(struct matrix *const *vectors, size_t count,
+                                                 bool reduced) {
+    assert(vectors);
+    assert(count > 0);
+    size_t d = matrix_rows(vectors[0]);
+    for (size_t i = 0; i < count; ++i) {
+        assert(vectors[i]);
+        if (matrix_columns(vectors[i]) != 1 || matrix_rows(vectors[i]) != d) {
+            fprintf(stderr, "Error: All matrices must be vectors (1 column) of the same size\n");
+            return NULL;
+        }
+    }
+    TRACE_BEGIN("similarity_index_create", count, d);
+    struct similarity_index *idx = mem_alloc(index_bytes(count, d, reduced));
+    if (!idx) {
+        TRACE_END();
+        return NULL;
+    }
+    float *data = (float *)(idx + 1);
+    float *lengths = data + count * d;
+    uint16_t *bf16 = reduced ? (uint16_t *)(lengths + count) : NULL;
+    for (size_t i = 0; i < count; ++i) {
+        float *v = data + i * d;
+        matrix_entries(vectors[i], LAYOUT_ROW_MAJOR, v);
+        float squares = dot(v, v, d);
+        // as length computes it
+        lengths[i] = squares < 0 ? 0 : sqrt(squares);
+        if (bf16) {
+            // v is scaled to a unit vector in place and restored below
+            for (size_t j = 0; j < d; ++j) {
+                v[j] = lengths[i] ? v[j] / lengths[i] : 0;
+            }
+            half_encode(HALF_BF16, v, bf16 + i * d, d);
+            matrix_entries(vectors[i], LAYOUT_ROW_MAJOR, v);
+        }
+    }
+    *idx = (struct similarity_index){count, d, data, lengths, bf16};
+    TRACE_END();
+    return idx;
+}
+
+void similarity_index_destroy(struct similarity_index *idx) {
+    assert(idx);
+    mem_free(idx, index_bytes(idx->count, idx->dimension, idx->reduced));
+}
+
+size_t similarity_index_size(const struct similarity_index *idx) {
+    assert(idx);
+    return idx->count;
+}
+
+size_t similarity_index_dimension(const struct similarity_index *idx) {
+    assert(idx);
+    return idx->dimension;
+}
+
+size_t similarity_top_k(const struct similarity_index *idx, const float *query, size_t k,
+                        bool reduced, struct similarity_hit *hits) {
+    assert(idx);
+    assert(query);
+    assert(hits);
+    assert(k > 0);
+    assert(!reduced || idx->reduced);
+    size_t d = idx->dimension;
+    float squares = dot(query, query, d);
+    float length = squares < 0 ? 0 : sqrt(squares);
+    if (!length) {
+        fprintf(stderr, "Error: length 0 (cannot use zero vector)\n");
+        return 0;
+    }
+    size_t wanted = reduced ? RERANK_FACTOR * k + RERANK_EXTRA : k;
+    if (wanted > idx->count) {
+        wanted = idx->count;
+    }
+    int shard_count = (idx->count + SHARD_VECTORS - 1) / SHARD_VECTORS;
+    // one block: the shard heaps, their hits, the candidates, the unit
+    //   query
+    size_t hit_count = shard_count * wanted + (reduced ? wanted : 0);
+    size_t bytes = shard_count * sizeof(struct heap) + hit_count * sizeof(struct similarity_hit) +
+                   (reduced ? d * sizeof(float) : 0);
+    struct heap *shards = mem_alloc(bytes);
+    if (!shards) {
+        return 0;
+    }
+    struct similarity_hit *pool = (struct similarity_hit *)(shards + shard_count);
+    struct heap candidates = {reduced ? pool + shard_count * wanted : NULL, 0, wanted};
+    float *unit = reduced ? (float *)(pool + hit_count) : NULL;
+    TRACE_BEGIN("similarity_top_k", idx->count, d);
+    for (int s = 0; s < shard_count; ++s) {
+        shards[s] = (struct heap){pool + s * wanted, 0, wanted};
+    }
+    for (size_t j = 0; unit && j < d; ++j) {
+        unit[j] = query[j] / length;
+    }
+    struct query q = {idx, reduced ? unit : query, length, reduced, shards};
+    parallel_for(shard_count, 1, score_shards, &q);
+
+    // the best of all shards; a reduced query then re-ranks them
+    struct heap best = {hits, 0, k};
+    for (int s = 0; s < shard_count; ++s) {
+        for (size_t i = 0; i < shards[s].size; ++i) {
+            struct similarity_hit *hit = &shards[s].hits[i];
+            offer(reduced ? &candidates : &best, hit->index, hit->cosine);
+        }
+    }
+    for (size_t i = 0; reduced && i < candidates.size; ++i) {
+        size_t index = candidates.hits[i].index;
+        offer(&best, index, dot(query, idx->vectors + index * d, d) / (length * idx->lengths[index]));
+    }
+    qsort(hits, best.size, sizeof(struct similarity_hit), compare_hits);
+    for (size_t i = 0; i < best.size; ++i) {
+        // as angle_between computes it
+        hits[i].angle = acos(fmin(fmax(hits[i].cosine, -1), 1));
+    }
+    TRACE_END();
+    mem_free(shards, bytes);
+    return best.size;
+}
@@ -0,0 +1,67 @@
+// Nearest-neighbour search by cosine similarity over a fixed set of
+//   vectors of the same dimension.
+//   The index packs the vectors row by row into one array and computes
+//   their lengths once, so a query is a blocked matrix-vector product
+//   over contiguous memory instead of dot_product and two length calls
+//   per candidate. The vectors are split into shards scored in parallel
+//   (see parallel.h), each keeping its best k in a heap.
+//   An index may also keep the unit vectors in bfloat16 (the high half
+//   of a float: 8 bits of precision), which halves the memory a scan
+//   reads. A reduced query scores those first and then re-ranks the
+//   best candidates exactly.
+// time: N is # of vectors, d is their dimension, k is # of results
+// see linalg.h
+
+struct similarity_index;
+
+// A result of a query
+struct similarity_hit {
+    size_t index;       // the position of the vector in the index
+    float cosine;       // cosine of the angle to the query
+    float angle;        // the angle in radians, as angle_between returns it
+};
+
+// similarity_index_create(vectors, count, reduced) returns an index of
+//   the vectors in the array vectors (which are copied); with reduced,
+//   it also keeps them in bfloat16 for reduced queries
+// requires: vectors is a valid pointer to count valid pointers
+//           count > 0
+// notes: outputs an error message and returns NULL if the matrices are
+//   not vectors (1 column) of the same dimension, or if out of memory
+// effects: may allocate memory (client must call similarity_index_destroy)
+//          may produce output
+// time: O(Nd)
+struct similarity_index *similarity_index_create(struct matrix *const *vectors, size_t count,
+                                                 bool reduced);
+
+// similarity_index_destroy(idx) frees all memory for idx
+// requires: idx is a valid pointer
+// effects: idx is no longer valid
+// time: O(1)
+void similarity_index_destroy(struct similarity_index *idx);
+
+// similarity_index_size(idx) returns N, similarity_index_dimension(idx) d
+// requires: idx is a valid pointer
+// time: O(1)
+size_t similarity_index_size(const struct similarity_index *idx);
+size_t similarity_index_dimension(const struct similarity_index *idx);
+
+// similarity_top_k(idx, query, k, reduced, hits) stores the (at most k)
+//   vectors of idx most similar to query (an array of d floats) in hits,
+//   most similar (smallest angle) first, and returns how many it stored.
+//   Zero vectors, which have no angle, are never returned; equal
+//   cosines are ordered by index. The exact cosines equal the ratio
+//   angle_between computes. With reduced, the bfloat16 copy picks
+//   4k + 16 candidates whose exact cosines decide the result, so a
+//   vector can only be missed if bfloat16 rounding moves it out of the
+//   candidates.
+// requires: idx, query and hits are valid pointers
+//           hits has room for k results
+//           k > 0
+//           idx was created with reduced if reduced is true
+// notes: outputs an error message and returns 0 if query is the zero
+//   vector or if out of memory
+// effects: may produce output
+// time: O(Nd + N log k) (reduced: half the memory traffic, plus O(kd))
+size_t similarity_top_k(const struct similarity_index *idx, const float *query, size_t k,
+                        bool reduced, struct similarity_hit *hits);
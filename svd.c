@@ -0,0 +1,369 @@
+#include <stdio.h>
+#include <assert.h>
+#include <float.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "linalg.h"
+#include "svd.h"
+#include "trace.h"
+#include "memtrack.h"
+
+// Number of random probes for the error estimate
+#define PROBES 10
+
+#define PI 3.14159265358979323846
+
+// Limit on one-sided Jacobi sweeps (it needs far fewer in practice)
+#define MAX_SWEEPS 60
+
+// gaussian_matrix(rows, columns, seed) returns a matrix of independent
+//   standard normal entries (Box-Muller on a 64-bit LCG)
+static struct matrix *gaussian_matrix(size_t rows, size_t columns, unsigned long long *seed) {
+    size_t count = rows * columns;
+    float *entries = mem_alloc(count * sizeof(float));
+    if (!entries) {
+        return NULL;
+    }
+    for (size_t i = 0; i < count; i += 2) {
+        double u[2];
+        for (int j = 0; j < 2; ++j) {
+            *seed = *seed * 6364136223846793005ull + 1442695040888963407ull;
+            u[j] = ((*seed >> 11) + 0.5) / 9007199254740992.0;
+        }
+        double radius = sqrt(-2 * log(u[0]));
+        entries[i] = radius * cos(2 * PI * u[1]);
+        if (i + 1 < count) {
+            entries[i + 1] = radius * sin(2 * PI * u[1]);
+        }
+    }
+    struct matrix *mat = create_matrix(rows, columns, entries);
+    mem_free(entries, count * sizeof(float));
+    return mat;
+}
+
+static double dot(size_t n, const float *x, const float *y) {
+    double sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        sum += (double)x[i] * y[i];
+    }
+    return sum;
+}
+
+// orth(mat) returns a row-major matrix whose columns are an orthonormal
+//   basis of the columns of mat (Gram-Schmidt, twice). A column that is
+//   numerically in the span of the previous ones is replaced by 0.
+//   Returns NULL if mat is NULL or out of memory.
+// time: O(n l^2) for an n x l matrix
+static struct matrix *orth(const struct matrix *mat) {
+    if (!mat) {
+        return NULL;
+    }
+    size_t n = matrix_rows(mat);
+    int l = matrix_columns(mat);
+    float *q = mem_alloc(n * l * sizeof(float));
+    if (!q) {
+        return NULL;
+    }
+    matrix_entries(mat, LAYOUT_COLUMN_MAJOR, q);
+    for (int j = 0; j < l; ++j) {
+        float *qj = q + j * n;
+        double before = sqrt(dot(n, qj, qj));
+        for (int pass = 0; pass < 2; ++pass) {
+            for (int i = 0; i < j; ++i) {
+                float c = dot(n, q + i * n, qj);
+                for (size_t r = 0; r < n; ++r) {
+                    qj[r] -= c * q[i * n + r];
+                }
+            }
+        }
+        double after = sqrt(dot(n, qj, qj));
+        float scale = after > 16 * FLT_EPSILON * before ? 1 / after : 0;
+        for (size_t r = 0; r < n; ++r) {
+            qj[r] *= scale;
+        }
+    }
+    struct matrix *columns = create_matrix_layout(n, l, q, LAYOUT_COLUMN_MAJOR);
+    mem_free(q, n * l * sizeof(float));
+    struct matrix *rows = columns ? matrix_to_layout(columns, LAYOUT_ROW_MAJOR) : NULL;
+    if (columns) {
+        destroy_matrix(columns);
+    }
+    return rows;
+}
+
+// project(q, mat) returns q^T mat, reading mat once, or NULL if q is
+//   NULL or out of memory
+static struct matrix *project(const struct matrix *q, struct matrix *mat) {
+    // q is row-major, so its transpose is column-major and the product
+    //   is a sum of outer products with the rows of mat
+    struct matrix *qt = q ? transpose(q) : NULL;
+    if (!qt) {
+        return NULL;
+    }
+    struct matrix *product = matrix_multiplication(qt, mat);
+    destroy_matrix(qt);
+    return product;
+}
+
+// multiply(mat1, mat2) returns mat1 * mat2, or NULL if mat2 is NULL or
+//   out of memory; it destroys mat2
+static struct matrix *multiply(struct matrix *mat1, struct matrix *mat2) {
+    if (!mat2) {
+        return NULL;
+    }
+    struct matrix *product = matrix_multiplication(mat1, mat2);
+    destroy_matrix(mat2);
+    return product;
+}
+
+// destroy_all(mats, count) destroys the matrices in mats that are not NULL
+static void destroy_all(struct matrix **mats, int count) {
+    for (int i = 0; i < count; ++i) {
+        if (mats[i]) {
+            destroy_matrix(mats[i]);
+        }
+    }
+}
+
+// jacobi_svd(m, l, b, v) rotates the columns of the column-major m x l
+//   array b until they are orthogonal (one-sided Jacobi), accumulating
+//   the rotations in the column-major l x l array v, so that
+//   b_before v = b_after
+// time: O(m l^2) per sweep
+static void jacobi_svd(size_t m, int l, double *b, double *v) {
+    for (int i = 0; i < l * l; ++i) {
+        v[i] = i % (l + 1) == 0;
+    }
+    for (int sweep = 0; sweep < MAX_SWEEPS; ++sweep) {
+        bool rotated = false;
+        for (int p = 0; p < l; ++p) {
+            for (int q = p + 1; q < l; ++q) {
+                double *bp = b + p * m;
+                double *bq = b + q * m;
+                double alpha = 0;
+                double beta = 0;
+                double gamma = 0;
+                for (size_t r = 0; r < m; ++r) {
+                    alpha += bp[r] * bp[r];
+                    beta += bq[r] * bq[r];
+                    gamma += bp[r] * bq[r];
+                }
+                if (fabs(gamma) <= DBL_EPSILON * sqrt(alpha * beta)) {
+                    continue;
+                }
+                rotated = true;
+                double zeta = (beta - alpha) / (2 * gamma);
+                double t = (zeta >= 0 ? 1 : -1) / (fabs(zeta) + sqrt(1 + zeta * zeta));
+                double c = 1 / sqrt(1 + t * t);
+                double s = c * t;
+                for (size_t r = 0; r < m; ++r) {
+                    double x = bp[r];
+                    bp[r] = c * x - s * bq[r];
+                    bq[r] = s * x + c * bq[r];
+                }
+                for (int r = 0; r < l; ++r) {
+                    double x = v[p * l + r];
+                    v[p * l + r] = c * x - s * v[q * l + r];
+                    v[q * l + r] = s * x + c * v[q * l + r];
+                }
+            }
+        }
+        if (!rotated) {
+            break;
+        }
+    }
+}
+
+// estimate_error(mat, lr, seed) returns 10 sqrt(2 / pi) times the largest
+//   ||(A - U S V^T) w|| over PROBES Gaussian vectors w, which bounds
+//   ||A - U S V^T||_2 with probability at least 1 - 10^-PROBES, or
+//   returns NAN if out of memory
+static float estimate_error(struct matrix *mat, const struct low_rank *lr,
+                            unsigned long long *seed) {
+    size_t n = matrix_rows(mat);
+    int k = lr->rank;
+    // omega, exact, vt, small, scaled, approx, residual
+    struct matrix *m[7] = {NULL};
+    m[0] = gaussian_matrix(matrix_columns(mat), PROBES, seed);
+    m[1] = m[0] ? matrix_multiplication(mat, m[0]) : NULL;
+    m[2] = m[1] ? transpose(lr->v) : NULL;
+    m[3] = m[2] ? matrix_multiplication(m[2], m[0]) : NULL;
+    float *entries = m[3] ? mem_alloc(k * PROBES * sizeof(float)) : NULL;
+    if (entries) {
+        matrix_entries(m[3], LAYOUT_ROW_MAJOR, entries);
+        for (int i = 0; i < k * PROBES; ++i) {
+            entries[i] *= lr->values[i / PROBES];
+        }
+        m[4] = create_matrix(k, PROBES, entries);
+        mem_free(entries, k * PROBES * sizeof(float));
+    }
+    m[5] = m[4] ? matrix_multiplication(lr->u, m[4]) : NULL;
+    m[6] = m[5] ? addsub_matrix(m[1], m[5], 1) : NULL;
+    float *r = m[6] ? mem_alloc(n * PROBES * sizeof(float)) : NULL;
+    double largest = NAN;
+    if (r) {
+        matrix_entries(m[6], LAYOUT_COLUMN_MAJOR, r);
+        largest = 0;
+        for (int j = 0; j < PROBES; ++j) {
+            largest = fmax(largest, sqrt(dot(n, r + j * n, r + j * n)));
+        }
+        mem_free(r, n * PROBES * sizeof(float));
+    }
+    destroy_all(m, 7);
+    return 10 * sqrt(2 / PI) * largest;
+}
+
+// sketch(mat, l, power, seed) returns a row-major n x l matrix whose
+//   columns are an orthonormal basis of the sketched range of mat, or
+//   NULL if out of memory
+static struct matrix *sketch(struct matrix *mat, size_t l, int power, unsigned long long *seed) {
+    struct matrix *y = multiply(mat, gaussian_matrix(matrix_columns(mat), l, seed));
+    struct matrix *q = orth(y);
+    if (y) {
+        destroy_matrix(y);
+    }
+    for (int i = 0; q && i < power; ++i) {
+        struct matrix *w = project(q, mat);
+        struct matrix *wt = w ? transpose(w) : NULL;
+        y = multiply(mat, orth(wt));
+        destroy_matrix(q);
+        q = orth(y);
+        struct matrix *done[3] = {w, wt, y};
+        destroy_all(done, 3);
+    }
+    return q;
+}
+
+// The buffers randomized_svd works in, all in one allocation
+struct svd_work {
+    size_t bytes;
+    float *bt;          // m x l: B^T, then the columns of V
+    double *work;       // m x l: W S
+    double *rotation;   // l x l: R
+    double *norms;      // l
+    float *rk;          // l x k: the first k columns of R
+    int *order;         // l
+};
+
+static bool svd_work_alloc(struct svd_work *w, size_t m, size_t l, int k) {
+    w->bytes = 2 * m * l * sizeof(double) + l * l * sizeof(double) + l * sizeof(double) +
+               m * l * sizeof(float) + l * k * sizeof(float) + l * sizeof(int);
+    char *base = mem_alloc(w->bytes);
+    if (!base) {
+        return false;
+    }
+    w->work = (double *)base;
+    w->rotation = w->work + m * l;
+    w->norms = w->rotation + l * l;
+    w->bt = (float *)(w->norms + l);
+    w->rk = w->bt + m * l;
+    w->order = (int *)(w->rk + l * k);
+    return true;
+}
+
+struct low_rank *randomized_svd(struct matrix *mat, int k, const struct svd_options *opts) {
+    assert(mat);
+    size_t n = matrix_rows(mat);
+    size_t m = matrix_columns(mat);
+    assert(k > 0 && (size_t)k <= n && (size_t)k <= m);
+    int oversample = opts && opts->oversample > 0 ? opts->oversample : 10;
+    int power = opts && opts->power ? opts->power : 2;
+    unsigned long long seed = opts && opts->seed ? opts->seed : 1;
+    size_t l = k + oversample;
+    l = l < n ? l : n;
+    l = l < m ? l : m;
+    TRACE_BEGIN("randomized_svd", n, m);
+
+    // sketch the range of mat and sharpen it with power iterations
+    struct matrix *q = sketch(mat, l, power, &seed);
+
+    // decompose B = q^T mat through its (column-major) transpose
+    struct matrix *b = project(q, mat);
+    struct svd_work w;
+    struct low_rank *lr = NULL;
+    if (b && svd_work_alloc(&w, m, l, k)) {
+        lr = mem_alloc(sizeof(struct low_rank));
+        if (lr) {
+            lr->values = mem_alloc(k * sizeof(float));
+            lr->u = NULL;
+            lr->v = NULL;
+        }
+        if (lr && !lr->values) {
+            mem_free(lr, sizeof(struct low_rank));
+            lr = NULL;
+        }
+        if (!lr) {
+            mem_free(w.work, w.bytes);
+        }
+    }
+    if (b) {
+        if (lr) {
+            matrix_entries(b, LAYOUT_ROW_MAJOR, w.bt);
+        }
+        destroy_matrix(b);
+    }
+    if (!lr) {
+        if (q) {
+            destroy_matrix(q);
+        }
+        TRACE_END();
+        return NULL;
+    }
+    for (size_t i = 0; i < m * l; ++i) {
+        w.work[i] = w.bt[i];
+    }
+    jacobi_svd(m, l, w.work, w.rotation);
+
+    // B^T = W S R^T with the columns of work = W S, so B = R S W^T
+    for (size_t j = 0; j < l; ++j) {
+        double *col = w.work + j * m;
+        w.norms[j] = 0;
+        for (size_t r = 0; r < m; ++r) {
+            w.norms[j] += col[r] * col[r];
+        }
+        w.norms[j] = sqrt(w.norms[j]);
+        w.order[j] = j;
+        for (size_t i = j; i > 0 && w.norms[w.order[i - 1]] < w.norms[w.order[i]]; --i) {
+            int swap = w.order[i];
+            w.order[i] = w.order[i - 1];
+            w.order[i - 1] = swap;
+        }
+    }
+    lr->rank = k;
+    for (int c = 0; c < k; ++c) {
+        double sigma = w.norms[w.order[c]];
+        lr->values[c] = sigma;
+        double *col = w.work + w.order[c] * m;
+        for (size_t r = 0; r < m; ++r) {
+            w.bt[c * m + r] = sigma > 0 ? col[r] / sigma : 0;
+        }
+        for (size_t r = 0; r < l; ++r) {
+            w.rk[r * k + c] = w.rotation[w.order[c] * l + r];
+        }
+    }
+    lr->u = multiply(q, create_matrix(l, k, w.rk));
+    lr->v = lr->u ? create_matrix_layout(m, k, w.bt, LAYOUT_COLUMN_MAJOR) : NULL;
+    destroy_matrix(q);
+    mem_free(w.work, w.bytes);
+    lr->error = lr->v ? estimate_error(mat, lr, &seed) : NAN;
+    if (isnan(lr->error)) {
+        destroy_low_rank(lr);
+        lr = NULL;
+    }
+    TRACE_END();
+    return lr;
+}
+
+void destroy_low_rank(struct low_rank *lr) {
+    assert(lr);
+    if (lr->u) {
+        destroy_matrix(lr->u);
+    }
+    if (lr->v) {
+        destroy_matrix(lr->v);
+    }
+    mem_free(lr->values, lr->rank * sizeof(float));
+    mem_free(lr, sizeof(struct low_rank));
+}
@@ -0,0 +1,45 @@
+// Low-rank approximation of matrices with randomized SVD.
+// time: n is # of rows, m is # of columns (as in linalg.h)
+//       k is the rank asked for, l = k + oversampling
+//       q is the number of power iterations
+// see linalg.h
+
+struct svd_options {
+    int oversample;   // extra sketch columns; 0 picks 10
+    int power;        // power iterations (sharpen slowly decaying
+                      //   spectra); 0 picks 2, < 0 means none
+    unsigned seed;    // seed of the random sketch; 0 picks 1
+};
+
+// A rank k approximation U diag(values) V^T of a matrix
+struct low_rank {
+    int rank;               // k
+    struct matrix *u;       // n x k, orthonormal columns
+    float *values;          // k singular values, in descending order
+    struct matrix *v;       // m x k, orthonormal columns (column-major)
+    float error;            // an estimate of ||A - U diag(values) V^T||_2
+                            //   that bounds it with probability at
+                            //   least 1 - 10^-10
+};
+
+// randomized_svd(mat, k, opts) returns a rank k approximation of mat.
+//   The range of mat is sketched by multiplying it with a random
+//   Gaussian m x l matrix, refined by power iterations, and the small
+//   l x m projection of mat onto it is decomposed exactly (one-sided
+//   Jacobi). Nearly all of the work is in matrix_multiplication calls
+//   with mat, each reading mat once; the error estimate costs one more.
+// requires: mat is a valid pointer
+//           0 < k <= min(n, m)
+//           opts is a valid pointer or NULL (all defaults)
+// notes: returns NULL if out of memory or over the memory budget (see
+//   memtrack.h); everything built so far is freed
+// effects: may allocate memory (client must call destroy_low_rank)
+//          may produce output
+// time: O((2q + 3) nml + (n + m) l^2)
+struct low_rank *randomized_svd(struct matrix *mat, int k, const struct svd_options *opts);
+
+// destroy_low_rank(lr) frees all memory for lr
+// requires: lr is a valid pointer
+// effects: lr is no longer valid
+// time: O(1)
+void destroy_low_rank(struct low_rank *lr);
@@ -0,0 +1,66 @@
+// Checks of the row echelon forms of dense.h: dense_ref_float agrees
+//   with rank (linalg.h), and dense_ref_double resolves a rank that
+//   float rounds away.
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "linalg.h"
+#include "dense.h"
+
+#define ROUNDS 200
+#define MAX_SIZE 8
+
+static int failures = 0;
+
+static void check(bool ok, const char *what, int round) {
+    if (!ok) {
+        fprintf(stderr, "dense_test: %s (round %d)\n", what, round);
+        ++failures;
+    }
+}
+
+int main(void) {
+    srand(1);
+    float a[MAX_SIZE * MAX_SIZE];
+    double d[MAX_SIZE * MAX_SIZE];
+    for (int round = 0; round < ROUNDS; ++round) {
+        size_t rows = 1 + rand() % MAX_SIZE;
+        size_t columns = 1 + rand() % MAX_SIZE;
+        for (size_t j = 0; j < columns; ++j) {
+            // some columns are twice an earlier one
+            size_t earlier = j ? rand() % j : 0;
+            bool copy = j && rand() % 3 == 0;
+            for (size_t i = 0; i < rows; ++i) {
+                float value = copy ? 2 * a[i * columns + earlier] : rand() % 7 - 3;
+                a[i * columns + j] = value;
+                d[i * columns + j] = value;
+            }
+        }
+        struct matrix *mat = create_matrix(rows, columns, a);
+        size_t expected = rank(mat);
+        destroy_matrix(mat);
+        check(dense_ref_float(rows, columns, a) == expected, "float rank", round);
+        check(dense_ref_double(rows, columns, d) == expected, "double rank", round);
+        for (size_t i = 1; i < rows; ++i) {
+            // below the pivot of each row, the next row has zeros
+            size_t pivot = 0;
+            while (pivot < columns && !d[(i - 1) * columns + pivot]) {
+                ++pivot;
+            }
+            for (size_t j = 0; j <= pivot && j < columns; ++j) {
+                check(!d[i * columns + j], "echelon form", round);
+            }
+        }
+    }
+    // 1 + 1e-9 is 1 in float
+    double close[4] = {1, 1, 1, 1 + 1e-9};
+    float rounded[4] = {1, 1, 1, 1 + 1e-9f};
+    check(dense_ref_double(2, 2, close) == 2, "double resolves the rank", -1);
+    check(dense_ref_float(2, 2, rounded) == 1, "float does not", -1);
+    if (failures) {
+        fprintf(stderr, "dense_test: %d failures\n", failures);
+        return 1;
+    }
+    printf("dense_test: passed\n");
+    return 0;
+}
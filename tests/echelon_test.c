@@ -0,0 +1,166 @@
+// Randomized comparison of an echelon (echelon.h) against ref, rank and
+//   nullity (linalg.h) of the same matrix. The matrices have small
+//   integer entries and columns that are combinations of others, so
+//   every pivot decision is far from the tolerance and both must agree.
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "linalg.h"
+#include "echelon.h"
+
+#define ROUNDS 300
+#define OPERATIONS 40
+#define MAX_ROWS 9
+#define MAX_COLUMNS 12
+
+static int failures = 0;
+
+static void check(bool ok, const char *what, int round, int op) {
+    if (!ok) {
+        fprintf(stderr, "echelon_test: %s (round %d, operation %d)\n", what, round, op);
+        ++failures;
+    }
+}
+
+// entry(limit) returns a random integer in [-limit, limit]
+static float entry(int limit) {
+    return (float)(rand() % (2 * limit + 1) - limit);
+}
+
+// random_column(a, rows, columns, column) stores in column a random
+//   column, a zero one or a combination of two columns of a
+static void random_column(const float *a, size_t rows, size_t columns, float *column) {
+    int kind = rand() % 4;
+    size_t j1 = columns ? (size_t)rand() % columns : 0;
+    size_t j2 = columns ? (size_t)rand() % columns : 0;
+    float c1 = entry(2);
+    float c2 = entry(2);
+    for (size_t i = 0; i < rows; ++i) {
+        if (kind == 0) {
+            column[i] = 0;
+        } else if (kind == 1 && columns) {
+            column[i] = c1 * a[j1 * rows + i] + c2 * a[j2 * rows + i];
+        } else {
+            column[i] = entry(3);
+        }
+    }
+}
+
+// leading(mat, row) returns the column of the first nonzero entry of row
+//   of mat, or its number of columns if there is none
+static size_t leading(const struct matrix *mat, size_t row) {
+    size_t j = 0;
+    while (j < matrix_columns(mat) && !matrix_get(mat, row, j)) {
+        ++j;
+    }
+    return j;
+}
+
+// compare(ech, a, rows, columns, round, op) checks ech against ref of
+//   the column-major rows x columns matrix a
+static void compare(const struct echelon *ech, const float *a, size_t rows, size_t columns,
+                    int round, int op) {
+    check(echelon_columns(ech) == columns, "column count", round, op);
+    if (!columns) {
+        check(echelon_rank(ech) == 0, "rank of no columns", round, op);
+        return;
+    }
+    struct matrix *mat = create_matrix_layout(rows, columns, a, LAYOUT_COLUMN_MAJOR);
+    struct matrix *expected = ref(mat);
+    struct matrix *actual = echelon_ref(ech);
+    struct matrix *stored = echelon_to_matrix(ech);
+    check(echelon_rank(ech) == rank(mat), "rank", round, op);
+    check(echelon_nullity(ech) == nullity(mat), "nullity", round, op);
+    size_t previous = 0;
+    for (size_t i = 0; i < rows; ++i) {
+        size_t pivot = leading(actual, i);
+        check(i == 0 || pivot > previous || pivot == columns, "echelon form", round, op);
+        check(pivot == leading(expected, i), "pivot columns", round, op);
+        previous = pivot;
+    }
+    for (size_t j = 0; j < columns; ++j) {
+        // R = Q^T A and Q has orthonormal columns
+        double norm_a = 0;
+        double norm_r = 0;
+        for (size_t i = 0; i < rows; ++i) {
+            check(matrix_get(stored, i, j) == a[j * rows + i], "stored matrix", round, op);
+            norm_a += (double)a[j * rows + i] * a[j * rows + i];
+            norm_r += (double)matrix_get(actual, i, j) * matrix_get(actual, i, j);
+        }
+        check(fabs(sqrt(norm_a) - sqrt(norm_r)) <= 1e-4 * (1 + sqrt(norm_a)), "column norms",
+              round, op);
+    }
+    destroy_matrix(mat);
+    destroy_matrix(expected);
+    destroy_matrix(actual);
+    destroy_matrix(stored);
+}
+
+int main(void) {
+    srand(1);
+    float a[MAX_ROWS * MAX_COLUMNS];
+    float column[MAX_ROWS];
+    float u[MAX_ROWS];
+    float v[MAX_COLUMNS];
+    for (int round = 0; round < ROUNDS; ++round) {
+        size_t rows = 1 + (size_t)rand() % MAX_ROWS;
+        size_t columns = (size_t)rand() % (MAX_COLUMNS / 2);
+        for (size_t j = 0; j < columns; ++j) {
+            random_column(a, rows, j, a + j * rows);
+        }
+        struct echelon *ech;
+        if (columns) {
+            struct matrix *mat = create_matrix_layout(rows, columns, a, LAYOUT_COLUMN_MAJOR);
+            ech = echelon_from_matrix(mat);
+            destroy_matrix(mat);
+        } else {
+            ech = echelon_create(rows);
+        }
+        compare(ech, a, rows, columns, round, -1);
+        for (int op = 0; op < OPERATIONS; ++op) {
+            int kind = rand() % 4;
+            if (kind == 0 && columns < MAX_COLUMNS) {
+                random_column(a, rows, columns, column);
+                echelon_append_column(ech, column);
+                memcpy(a + columns * rows, column, rows * sizeof(float));
+                ++columns;
+            } else if (kind == 1 && columns) {
+                size_t col = (size_t)rand() % columns;
+                echelon_remove_column(ech, col);
+                memmove(a + col * rows, a + (col + 1) * rows, (columns - col - 1) * rows * sizeof(float));
+                --columns;
+            } else if (kind == 2 && columns) {
+                size_t col = (size_t)rand() % columns;
+                random_column(a, rows, columns, column);
+                echelon_set_column(ech, col, column);
+                memcpy(a + col * rows, column, rows * sizeof(float));
+            } else if (columns) {
+                // u is sometimes a column of A, so the rank can drop
+                size_t col = (size_t)rand() % columns;
+                bool negate = rand() % 2;
+                for (size_t i = 0; i < rows; ++i) {
+                    u[i] = negate ? -a[col * rows + i] : entry(2);
+                }
+                for (size_t j = 0; j < columns; ++j) {
+                    v[j] = negate ? (j == col) : (rand() % 3 ? 0 : entry(1));
+                }
+                echelon_rank_update(ech, u, v);
+                for (size_t j = 0; j < columns; ++j) {
+                    for (size_t i = 0; i < rows; ++i) {
+                        a[j * rows + i] += u[i] * v[j];
+                    }
+                }
+            }
+            compare(ech, a, rows, columns, round, op);
+        }
+        destroy_echelon(ech);
+    }
+    if (failures) {
+        fprintf(stderr, "echelon_test: %d failures\n", failures);
+        return 1;
+    }
+    printf("echelon_test: passed\n");
+    return 0;
+}
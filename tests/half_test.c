@@ -0,0 +1,191 @@
+// Checks of the 16-bit formats of half.h: every 16-bit value survives
+//   a round trip through float, floats round to the nearest 16-bit value
+//   (ties to even) whichever conversion code runs, and matrices and
+//   products in 16 bits match the float ones.
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "linalg.h"
+#include "half.h"
+
+// Entries in an array conversion, enough for every vector loop to run
+#define ARRAY_ENTRIES 1000
+
+static int failures = 0;
+
+static void check(bool ok, const char *what, unsigned value) {
+    if (!ok) {
+        fprintf(stderr, "half_test: %s (0x%x)\n", what, value);
+        ++failures;
+    }
+}
+
+static const char *format_name(enum half_format format) {
+    return format == HALF_FP16 ? "fp16" : "bf16";
+}
+
+static float decode(enum half_format format, uint16_t value) {
+    float result;
+    half_decode(format, &value, &result, 1);
+    return result;
+}
+
+static uint16_t encode(enum half_format format, float value) {
+    uint16_t result;
+    half_encode(format, &value, &result, 1);
+    return result;
+}
+
+// round_trip(format) decodes and encodes every 16-bit value
+static void round_trip(enum half_format format) {
+    for (uint32_t bits = 0; bits <= 0xffff; ++bits) {
+        float value = decode(format, bits);
+        if (isnan(value)) {
+            check(isnan(decode(format, encode(format, value))), "NaN round trip", bits);
+        } else {
+            check(encode(format, value) == bits, "round trip", bits);
+        }
+    }
+}
+
+// nearest(format, value, bits) checks that bits is the nearest 16-bit
+//   value to the finite float value, and the even one of a tie
+static void nearest(enum half_format format, float value, uint16_t bits) {
+    float result = decode(format, bits);
+    if (isinf(result)) {
+        // fp16 rounds to infinity from half a step above its largest value
+        float largest = decode(format, 0x7bff);
+        check(format == HALF_FP16 && fabsf(value) >= largest + 16, "overflow", bits);
+        return;
+    }
+    double error = fabs((double)value - result);
+    uint16_t magnitude = bits & 0x7fff;
+    uint16_t sign = bits & 0x8000;
+    for (int step = -1; step <= 1; step += 2) {
+        if ((step < 0 && !magnitude) || (step > 0 && magnitude >= 0x7bff && format == HALF_FP16)) {
+            continue;
+        }
+        float neighbour = decode(format, sign | (uint16_t)(magnitude + step));
+        if (isinf(neighbour) || isnan(neighbour)) {
+            continue;
+        }
+        double other = fabs((double)value - neighbour);
+        check(error < other || (error == other && !(bits & 1)), "rounding", bits);
+    }
+}
+
+// rounding(format) checks the rounding of random floats, of the values
+//   halfway between 16-bit values, and that array conversions (with the
+//   vector code) give what single ones (the portable code) do
+static void rounding(enum half_format format) {
+    static float in[ARRAY_ENTRIES];
+    static uint16_t out[ARRAY_ENTRIES];
+    static float back[ARRAY_ENTRIES];
+    for (int i = 0; i < ARRAY_ENTRIES; ++i) {
+        if (i % 3 == 0) {
+            // halfway between two 16-bit values
+            uint16_t low = rand() % 0x7bff;
+            in[i] = (decode(format, low) + decode(format, low + 1)) / 2;
+        } else if (format == HALF_FP16) {
+            // over the range of fp16, subnormals included
+            in[i] = ldexpf((float)rand() / RAND_MAX, rand() % 44 - 27);
+        } else {
+            uint32_t bits = (uint32_t)rand() << 16 ^ (uint32_t)rand();
+            memcpy(&in[i], &bits, sizeof(float));
+        }
+        if (isnan(in[i]) || isinf(in[i])) {
+            in[i] = 1;
+        }
+        in[i] = i % 2 ? -fabsf(in[i]) : fabsf(in[i]);
+    }
+    half_encode(format, in, out, ARRAY_ENTRIES);
+    half_decode(format, out, back, ARRAY_ENTRIES);
+    for (int i = 0; i < ARRAY_ENTRIES; ++i) {
+        check(out[i] == encode(format, in[i]), "array encoding", out[i]);
+        check(back[i] == decode(format, out[i]), "array decoding", out[i]);
+        nearest(format, in[i], out[i]);
+    }
+}
+
+// special(format, value, bits) checks that value encodes to bits
+static void special(enum half_format format, float value, uint16_t bits) {
+    check(encode(format, value) == bits, format_name(format), bits);
+}
+
+// products() checks half_from_matrix, half_to_matrix and half_multiply
+//   against float matrices of entries that fp16 holds exactly
+static void products(void) {
+    size_t n = 37;
+    size_t k = 29;
+    size_t p = 5;
+    float *a = malloc(n * k * sizeof(float));
+    float *b = malloc(k * p * sizeof(float));
+    for (size_t i = 0; i < n * k; ++i) {
+        a[i] = (float)(rand() % 64 - 32) / 8;
+    }
+    for (size_t i = 0; i < k * p; ++i) {
+        b[i] = (float)(rand() % 16 - 8);
+    }
+    for (int layout = 0; layout < 2; ++layout) {
+        enum matrix_layout order = layout ? LAYOUT_COLUMN_MAJOR : LAYOUT_ROW_MAJOR;
+        struct matrix *row_major_a = create_matrix(n, k, a);
+        struct matrix *mat_a = matrix_to_layout(row_major_a, order);
+        struct matrix *row_major_b = create_matrix(k, p, b);
+        struct matrix *mat_b = matrix_to_layout(row_major_b, order);
+        struct half_matrix *h = half_from_matrix(mat_a, HALF_FP16);
+        struct matrix *back = half_to_matrix(h);
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = 0; j < k; ++j) {
+                check(matrix_get(back, i, j) == a[i * k + j], "matrix round trip", layout);
+            }
+        }
+        struct matrix *expected = matrix_multiplication(mat_a, mat_b);
+        struct matrix *product = half_multiply(h, mat_b);
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = 0; j < p; ++j) {
+                // small integers times eighths: every sum is exact
+                check(matrix_get(product, i, j) == matrix_get(expected, i, j), "product", layout);
+            }
+        }
+        destroy_matrix(product);
+        destroy_matrix(expected);
+        destroy_matrix(back);
+        destroy_half(h);
+        destroy_matrix(mat_b);
+        destroy_matrix(row_major_b);
+        destroy_matrix(mat_a);
+        destroy_matrix(row_major_a);
+    }
+    free(a);
+    free(b);
+}
+
+int main(void) {
+    srand(1);
+    enum half_format formats[2] = {HALF_FP16, HALF_BF16};
+    for (int f = 0; f < 2; ++f) {
+        round_trip(formats[f]);
+        rounding(formats[f]);
+    }
+    special(HALF_FP16, 1, 0x3c00);
+    special(HALF_FP16, 65504, 0x7bff);
+    special(HALF_FP16, 65519, 0x7bff);
+    special(HALF_FP16, 65520, 0x7c00);
+    special(HALF_FP16, -INFINITY, 0xfc00);
+    special(HALF_FP16, ldexpf(1, -24), 0x0001);
+    special(HALF_FP16, ldexpf(1, -25), 0x0000);
+    special(HALF_FP16, ldexpf(3, -26), 0x0001);
+    special(HALF_FP16, ldexpf(3, -25), 0x0002);
+    special(HALF_BF16, 1 + ldexpf(1, -8), 0x3f80);
+    special(HALF_BF16, 1 + ldexpf(3, -8), 0x3f82);
+    products();
+    if (failures) {
+        fprintf(stderr, "half_test: %d failures\n", failures);
+        return 1;
+    }
+    printf("half_test: passed\n");
+    return 0;
+}
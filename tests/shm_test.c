@@ -0,0 +1,93 @@
+// Checks of the shared matrices of shm.h: versions keep growing across
+//   shm_remove, and concurrent exports under one name all succeed and
+//   leave one complete segment.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "linalg.h"
+#include "shm.h"
+
+#define THREADS 4
+#define EXPORTS 50
+#define SIZE 64
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    if (!ok) {
+        fprintf(stderr, "shm_test: %s\n", what);
+        ++failures;
+    }
+}
+
+static char name[64];
+
+// Each thread exports a matrix of its own value, so the one that stays
+//   must hold a single value throughout
+struct exporter {
+    float value;
+    int failed;
+};
+
+static void *export_all(void *ctx) {
+    struct exporter *e = ctx;
+    float entries[SIZE * SIZE];
+    for (int i = 0; i < SIZE * SIZE; ++i) {
+        entries[i] = e->value;
+    }
+    struct matrix *mat = create_matrix(SIZE, SIZE, entries);
+    for (int i = 0; i < EXPORTS; ++i) {
+        e->failed += !shm_export(name, mat);
+    }
+    destroy_matrix(mat);
+    return NULL;
+}
+
+int main(void) {
+    snprintf(name, sizeof(name), "shm_test.%ld", (long)getpid());
+    float entries[4] = {1, 2, 3, 4};
+    struct matrix *mat = create_matrix(2, 2, entries);
+    uint64_t first = shm_export(name, mat);
+    uint64_t second = shm_export(name, mat);
+    check(first && second > first, "versions grow");
+    check(shm_version(name) == second, "version of the export");
+    check(shm_remove(name), "remove");
+    check(shm_version(name) == 0, "no version after remove");
+    uint64_t third = shm_export(name, mat);
+    check(third > second, "versions grow across remove");
+    destroy_matrix(mat);
+
+    pthread_t threads[THREADS];
+    struct exporter exporters[THREADS];
+    for (int t = 0; t < THREADS; ++t) {
+        exporters[t] = (struct exporter){t + 1, 0};
+        pthread_create(&threads[t], NULL, export_all, &exporters[t]);
+    }
+    for (int t = 0; t < THREADS; ++t) {
+        pthread_join(threads[t], NULL);
+        check(!exporters[t].failed, "concurrent export");
+    }
+    uint64_t version = 0;
+    struct matrix *shared = shm_attach(name, &version);
+    check(shared && version > third, "attach after concurrent exports");
+    if (shared) {
+        float value = matrix_get(shared, 0, 0);
+        for (size_t i = 0; i < SIZE; ++i) {
+            for (size_t j = 0; j < SIZE; ++j) {
+                check(matrix_get(shared, i, j) == value, "one complete segment");
+            }
+        }
+        destroy_matrix(shared);
+    }
+    shm_remove(name);
+    if (failures) {
+        fprintf(stderr, "shm_test: %d failures\n", failures);
+        return 1;
+    }
+    printf("shm_test: passed\n");
+    return 0;
+}
@@ -0,0 +1,174 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "trace.h"
+
+bool trace_enabled = false;
+// Spans open on the calling thread
+static __thread int trace_depth = 0;
+
+struct event {
+    const char *name;    // NULL for an end event
+    size_t rows;
+    size_t columns;
+    long long time;      // nanoseconds (CLOCK_MONOTONIC)
+};
+
+// The events of one thread. A buffer whose thread has exited is reused
+//   by the next new thread (and keeps its id, the tid of the trace), so
+//   the short-lived workers of parallel_for share a few timeline rows.
+struct ring {
+    struct ring *next;
+    int id;
+    bool free;                  // updated atomically
+    unsigned long long head;    // # of events ever recorded (updated atomically)
+    struct event events[TRACE_EVENTS];
+};
+
+static struct ring *rings = NULL;
+static int ring_count = 0;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static __thread struct ring *ring = NULL;
+static char *exit_path = NULL;
+
+static void release_ring(void *data) {
+    struct ring *r = data;
+    __atomic_store_n(&r->free, true, __ATOMIC_RELEASE);
+}
+
+static void make_ring_key(void) {
+    pthread_key_create(&ring_key, release_ring);
+}
+
+// thread_ring() returns the buffer of the calling thread, claiming a
+//   free one or allocating a new one on its first event
+static struct ring *thread_ring(void) {
+    if (ring) {
+        return ring;
+    }
+    pthread_once(&ring_key_once, make_ring_key);
+    pthread_mutex_lock(&rings_lock);
+    for (struct ring *r = rings; r; r = r->next) {
+        if (__atomic_load_n(&r->free, __ATOMIC_ACQUIRE)) {
+            __atomic_store_n(&r->free, false, __ATOMIC_RELAXED);
+            ring = r;
+            break;
+        }
+    }
+    if (!ring) {
+        ring = malloc(sizeof(struct ring));
+        if (ring) {
+            ring->id = ring_count++;
+            ring->free = false;
+            ring->head = 0;
+            ring->next = rings;
+            rings = ring;
+        }
+    }
+    pthread_mutex_unlock(&rings_lock);
+    if (ring) {
+        pthread_setspecific(ring_key, ring);
+    }
+    return ring;
+}
+
+static void record(const char *name, size_t rows, size_t columns) {
+    struct ring *r = thread_ring();
+    if (!r) {
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    unsigned long long head = r->head;
+    struct event *event = &r->events[head % TRACE_EVENTS];
+    event->name = name;
+    event->rows = rows;
+    event->columns = columns;
+    event->time = now.tv_sec * 1000000000LL + now.tv_nsec;
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void trace_begin(const char *name, size_t rows, size_t columns) {
+    assert(name);
+    ++trace_depth;
+    record(name, rows, columns);
+}
+
+void trace_end(void) {
+    assert(trace_depth > 0);
+    --trace_depth;
+    record(NULL, 0, 0);
+}
+
+void trace_start(void) {
+    __atomic_store_n(&trace_enabled, true, __ATOMIC_RELAXED);
+}
+
+void trace_stop(void) {
+    __atomic_store_n(&trace_enabled, false, __ATOMIC_RELAXED);
+}
+
+void trace_clear(void) {
+    pthread_mutex_lock(&rings_lock);
+    for (struct ring *r = rings; r; r = r->next) {
+        __atomic_store_n(&r->head, 0, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&rings_lock);
+}
+
+bool trace_write(const char *path) {
+    assert(path);
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Error: could not open %s for writing\n", path);
+        return false;
+    }
+    fprintf(file, "{\"traceEvents\":[");
+    bool first = true;
+    pthread_mutex_lock(&rings_lock);
+    for (struct ring *r = rings; r; r = r->next) {
+        unsigned long long head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        unsigned long long begin = head > TRACE_EVENTS ? head - TRACE_EVENTS : 0;
+        for (unsigned long long i = begin; i < head; ++i) {
+            const struct event *event = &r->events[i % TRACE_EVENTS];
+            fprintf(file, "%s\n{\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"ts\":%.3f", first ? "" : ",",
+                    event->name ? 'B' : 'E', r->id, event->time / 1000.0);
+            if (event->name) {
+                fprintf(file, ",\"name\":\"%s\",\"args\":{\"rows\":%zu,\"columns\":%zu}",
+                        event->name, event->rows, event->columns);
+            }
+            fprintf(file, "}");
+            first = false;
+        }
+    }
+    pthread_mutex_unlock(&rings_lock);
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    if (fclose(file)) {
+        fprintf(stderr, "Error: could not write %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+static void write_at_exit(void) {
+    trace_stop();
+    trace_write(exit_path);
+}
+
+void trace_from_environment(void) {
+    const char *env = getenv("LINALG_TRACE");
+    if (!env || !*env || exit_path) {
+        return;
+    }
+    exit_path = malloc(strlen(env) + 1);
+    strcpy(exit_path, env);
+    atexit(write_at_exit);
+    trace_start();
+}
@@ -0,0 +1,74 @@
+// Tracing of library calls in the Chrome trace event format.
+//   Instrumented functions record a begin and an end event with their
+//   name, the dimensions they work on and the thread they run on, so a
+//   trace shows nested calls (e.g. the ref phase of rref, the copies
+//   each row_add makes, every allocation) on a timeline in
+//   chrome://tracing or ui.perfetto.dev.
+//   Each thread records into its own ring buffer of TRACE_EVENTS events
+//   without locking; once it is full the oldest events are overwritten.
+//   Tracing is off until trace_start is called, or from the start if
+//   the LINALG_TRACE environment variable names a file the trace is
+//   written to at exit (see trace_from_environment). While it is off an
+//   instrumented call costs one well-predicted branch on each side.
+#include <stdbool.h>
+#include <stddef.h>
+
+// Capacity of the ring buffer of each thread
+#define TRACE_EVENTS (1 << 14)
+
+extern bool trace_enabled;
+
+// TRACE_BEGIN(name, rows, columns) opens a span called name (a string
+//   literal) on the calling thread; every TRACE_BEGIN must be matched by
+//   one TRACE_END in the same function, on the same thread, before it
+//   returns. TRACE_BEGIN declares the local variable trace_span, which
+//   records whether it opened a span, and TRACE_END only closes a span
+//   if its own TRACE_BEGIN opened one. So a span opened while tracing is
+//   on is closed even if tracing is turned off in between, and a
+//   TRACE_BEGIN that ran while tracing was off never closes an enclosing
+//   span. At most one TRACE_BEGIN may be used in a block.
+#define TRACE_BEGIN(name, rows, columns) \
+    bool trace_span = __builtin_expect(__atomic_load_n(&trace_enabled, __ATOMIC_RELAXED), 0) && \
+                      (trace_begin(name, rows, columns), true)
+
+#define TRACE_END() \
+    do { \
+        if (__builtin_expect(trace_span, 0)) { \
+            trace_end(); \
+        } \
+    } while (0)
+
+// trace_begin(name, rows, columns) and trace_end() record the events
+//   behind TRACE_BEGIN and TRACE_END (use the macros instead)
+// time: O(1)
+void trace_begin(const char *name, size_t rows, size_t columns);
+void trace_end(void);
+
+// trace_start() turns tracing on, trace_stop() turns it off
+// time: O(1)
+void trace_start(void);
+void trace_stop(void);
+
+// trace_clear() drops all recorded events
+// requires: no instrumented call is running on another thread
+// time: O(threads)
+void trace_clear(void);
+
+// trace_write(path) writes the recorded events as a JSON trace to the
+//   file at path. Events keep being recorded meanwhile, but events a
+//   thread records while the write walks its buffer may be missing or,
+//   if the buffer wraps around, garbled; stop tracing first for an
+//   exact trace.
+// requires: path is a valid string
+// notes: outputs an error message and returns false if the file cannot
+//   be written
+// effects: writes to the file at path
+//          may produce output
+// time: O(events)
+bool trace_write(const char *path);
+
+// trace_from_environment() turns tracing on and writes the trace at
+//   exit if the LINALG_TRACE environment variable is set to a path
+// effects: may register an exit handler
+// time: O(1)
+void trace_from_environment(void);